@@ -211,6 +211,142 @@ pub fn build(b: *std.Build) void {
     const test_python_step = b.step("test-python", "Run Python integration tests");
     test_python_step.dependOn(&run_python_tests.step);
 
+    // WebSocket load and conformance client. src/websocket/ has no imports
+    // outside its directory, so it builds as a module of its own and the
+    // client does not need Python.
+    const websocket_mod = b.createModule(.{
+        .root_source_file = b.path("src/websocket/server.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    const ws_bench_mod = b.createModule(.{
+        .root_source_file = b.path("src/bench/ws_bench.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    ws_bench_mod.addImport("websocket", websocket_mod);
+
+    const ws_bench = b.addExecutable(.{
+        .name = "ws-bench",
+        .root_module = ws_bench_mod,
+    });
+
+    // Runs from the project root so the server can import tests.app
+    const run_ws_bench = b.addRunArtifact(ws_bench);
+    run_ws_bench.setCwd(b.path("."));
+    run_ws_bench.addArg("--server");
+    run_ws_bench.addArtifactArg(exe);
+    if (b.args) |args| {
+        run_ws_bench.addArgs(args);
+    }
+    const bench_ws_step = b.step("bench-ws", "Benchmark WebSocket echo and check conformance against tests/app.py");
+    bench_ws_step.dependOn(&run_ws_bench.step);
+
+    // WebSocket masking and UTF-8 validation throughput. Always ReleaseFast: numbers from a
+    // Debug build say nothing about the vector code.
+    const websocket_fast_mod = b.createModule(.{
+        .root_source_file = b.path("src/websocket/server.zig"),
+        .target = target,
+        .optimize = .ReleaseFast,
+    });
+    const codec_bench_mod = b.createModule(.{
+        .root_source_file = b.path("src/bench/codec_bench.zig"),
+        .target = target,
+        .optimize = .ReleaseFast,
+    });
+    codec_bench_mod.addImport("websocket", websocket_fast_mod);
+
+    const codec_bench = b.addExecutable(.{
+        .name = "codec-bench",
+        .root_module = codec_bench_mod,
+    });
+
+    const run_codec_bench = b.addRunArtifact(codec_bench);
+    if (b.args) |args| {
+        run_codec_bench.addArgs(args);
+    }
+    const bench_codec_step = b.step("bench-codec", "Measure WebSocket masking and UTF-8 validation throughput in a ReleaseFast build");
+    bench_codec_step.dependOn(&run_codec_bench.step);
+
+    // Accept distribution across forked workers for each accept mode
+    const http_server_mod = b.createModule(.{
+        .root_source_file = b.path("src/http/server.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    const accept_bench_mod = b.createModule(.{
+        .root_source_file = b.path("src/bench/accept_bench.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    accept_bench_mod.addImport("http_server", http_server_mod);
+
+    const accept_bench = b.addExecutable(.{
+        .name = "accept-bench",
+        .root_module = accept_bench_mod,
+    });
+
+    const run_accept_bench = b.addRunArtifact(accept_bench);
+    if (b.args) |args| {
+        run_accept_bench.addArgs(args);
+    }
+    const bench_accept_step = b.step("bench-accept", "Compare per-worker accept counts and latency across accept modes");
+    bench_accept_step.dependOn(&run_accept_bench.step);
+
+    // Reload under load: every request must succeed across SIGHUPs
+    const reload_bench = b.addExecutable(.{
+        .name = "reload-bench",
+        .root_module = b.createModule(.{
+            .root_source_file = b.path("src/bench/reload_bench.zig"),
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+
+    const run_reload_bench = b.addRunArtifact(reload_bench);
+    run_reload_bench.setCwd(b.path("."));
+    run_reload_bench.addArg("--server");
+    run_reload_bench.addArtifactArg(exe);
+    if (b.args) |args| {
+        run_reload_bench.addArgs(args);
+    }
+    const bench_reload_step = b.step("bench-reload", "Reload ladybug with SIGHUP under load and fail on any failed request");
+    bench_reload_step.dependOn(&run_reload_bench.step);
+
+    // HTTP/2 rapid reset and control frame floods against one worker
+    const h2_frames_mod = b.createModule(.{
+        .root_source_file = b.path("src/http/h2_frames.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    const autoscale_mod = b.createModule(.{
+        .root_source_file = b.path("src/utils/autoscale.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    const h2_flood_bench_mod = b.createModule(.{
+        .root_source_file = b.path("src/bench/h2_flood_bench.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    h2_flood_bench_mod.addImport("h2_frames", h2_frames_mod);
+    h2_flood_bench_mod.addImport("autoscale", autoscale_mod);
+
+    const h2_flood_bench = b.addExecutable(.{
+        .name = "h2-flood-bench",
+        .root_module = h2_flood_bench_mod,
+    });
+
+    const run_h2_flood_bench = b.addRunArtifact(h2_flood_bench);
+    run_h2_flood_bench.setCwd(b.path("."));
+    run_h2_flood_bench.addArg("--server");
+    run_h2_flood_bench.addArtifactArg(exe);
+    if (b.args) |args| {
+        run_h2_flood_bench.addArgs(args);
+    }
+    const bench_h2_step = b.step("bench-h2", "Flood an HTTP/2 worker with rapid resets and control frames and check it cuts them off cheaply");
+    bench_h2_step.dependOn(&run_h2_flood_bench.step);
+
     // This declares intent for the executable to be installed into the
     // standard location when the user invokes the "install" step (the default
     // step when running `zig build`).
@@ -94,6 +94,17 @@ int zig_py_unicode_check(PyObject* obj) {
     return PyUnicode_Check(obj);
 }
 
+// Build a str from bytes known to be ASCII. The data is copied straight into
+// the new object's storage without being decoded.
+PyObject* zig_py_unicode_from_ascii(const char* data, Py_ssize_t size) {
+    PyObject* str = PyUnicode_New(size, 127);
+    if (str == NULL) {
+        return NULL;
+    }
+    memcpy(PyUnicode_1BYTE_DATA(str), data, size);
+    return str;
+}
+
 // Wrapper for PyObject_New to work around Zig C ABI issues
 PyObject* zig_py_object_new(PyTypeObject* type) {
     return PyObject_New(void*, type);
@@ -2,11 +2,120 @@ const std = @import("std");
 const Allocator = std.mem.Allocator;
 const json = std.json;
 
+const h2_flood = @import("../http/h2_flood.zig");
 const h2_frames = @import("../http/h2_frames.zig");
 const h2_streams = @import("../http/h2_streams.zig");
 const hpack = @import("../http/hpack.zig");
+const h2_websocket = @import("h2_websocket.zig");
 const protocol = @import("protocol.zig");
 
+/// Header list bound used when none is configured. Advertised to the peer
+/// as SETTINGS_MAX_HEADER_LIST_SIZE and applied both to the encoded block
+/// (HEADERS + CONTINUATION) and to the decoded header list.
+pub const default_max_header_list_size: u32 = 64 * 1024;
+
+/// Map an error raised while processing frames to the GOAWAY error code
+/// that ends the connection (RFC 9113 section 5.4.1). Returns null for
+/// errors that are not protocol violations (allocation, I/O).
+pub fn connectionErrorCode(err: anyerror) ?h2_frames.ErrorCode {
+    return switch (err) {
+        error.ProtocolError,
+        error.InvalidPadding,
+        error.InvalidTransition,
+        error.StreamAlreadyExists,
+        error.InvalidWindowUpdateFrame,
+        => .PROTOCOL_ERROR,
+        error.FrameSizeError,
+        error.InvalidSettingsFrame,
+        error.InvalidPingFrame,
+        error.InvalidRstStreamFrame,
+        error.InvalidGoAwayFrame,
+        error.InvalidWindowUpdate,
+        => .FRAME_SIZE_ERROR,
+        error.FlowControlError => .FLOW_CONTROL_ERROR,
+        // Decoding stopped part-way through a block, so the HPACK context
+        // is no longer in sync with the peer's encoder
+        error.CompressionError,
+        error.HeaderListTooLarge,
+        error.InvalidInteger,
+        error.IntegerOverflow,
+        error.InvalidString,
+        error.InvalidIndex,
+        => .COMPRESSION_ERROR,
+        error.HeaderBlockTooLarge,
+        error.EnhanceYourCalm,
+        => .ENHANCE_YOUR_CALM,
+        else => null,
+    };
+}
+
+/// How long a connection lives. Recycling long-lived connections lets load
+/// rebalance across workers and nodes; the drain timeout bounds how long a
+/// connection that sent GOAWAY keeps serving its in-flight streams.
+pub const ConnectionLifetime = struct {
+    /// Start draining after accepting this many streams
+    max_streams: ?u32 = null,
+    /// Start draining once the connection is this old
+    max_age_ns: ?u64 = null,
+    /// Close a draining connection after this long even if streams remain
+    drain_timeout_ns: u64 = 30 * std.time.ns_per_s,
+};
+
+/// One end of the connection, as ASGI scopes report it
+pub const Endpoint = struct {
+    host: []const u8 = "127.0.0.1",
+    port: u16 = 0,
+};
+
+/// A stream ready for its application: the ASGI scope, built in an arena
+/// that also holds the strings it borrows. Whoever takes it from
+/// `takeReady` runs the application and destroys it.
+pub const StreamScope = struct {
+    stream_id: u31,
+    /// An extended CONNECT stream carrying a WebSocket
+    websocket: bool = false,
+    arena: std.heap.ArenaAllocator,
+    scope: json.Value = .null,
+
+    pub fn destroy(self: *StreamScope, allocator: Allocator) void {
+        self.arena.deinit();
+        allocator.destroy(self);
+    }
+};
+
+/// Header block being assembled from HEADERS and CONTINUATION frames
+const PendingHeaders = struct {
+    stream_id: u31,
+    end_stream: bool,
+    priority: ?struct {
+        depends_on: u31,
+        weight: u8,
+        exclusive: bool,
+    },
+};
+
+/// What is left of a stream's output once its send window, or the
+/// connection's, ran out (RFC 9113 section 6.9). Callers only lend their
+/// bytes until the next flush, so the unsent DATA payload is copied.
+const ParkedOutput = struct {
+    stream_id: u31,
+    data: std.ArrayListUnmanaged(u8) = .{},
+    /// END_STREAM goes on the last DATA frame
+    end_stream: bool = false,
+    /// Sent as the final HEADERS, ending the stream, once the data is out
+    trailers: ?[]const hpack.HeaderField = null,
+    /// Holds the trailer fields
+    arena: std.heap.ArenaAllocator,
+    /// The WebSocket application returned; reset the stream once this is out
+    reset_when_sent: bool = false,
+
+    fn destroy(self: *ParkedOutput, allocator: Allocator) void {
+        self.data.deinit(allocator);
+        self.arena.deinit();
+        allocator.destroy(self);
+    }
+};
+
 /// HTTP/2 to ASGI integration handler
 pub const Http2AsgiHandler = struct {
     const Self = @This();
@@ -16,14 +125,69 @@ pub const Http2AsgiHandler = struct {
     message_queue: protocol.Http2StreamMessageQueue,
     decoder: hpack.HpackDecoder,
     encoder: hpack.HpackEncoder,
+    /// Settings we advertise to the peer
+    local_settings: h2_streams.ConnectionSettings,
+    /// Settings the peer advertised to us
+    peer_settings: h2_streams.ConnectionSettings,
+    reader: h2_frames.FrameReader,
+    writer: h2_frames.FrameWriter,
+    /// Fragments of the header block currently being received. While
+    /// `pending_headers` is set the peer may only send CONTINUATION frames
+    /// for that stream.
+    header_block: std.ArrayList(u8),
+    pending_headers: ?PendingHeaders = null,
+    /// Budgets for control frames that cost work without producing a
+    /// response (rapid reset, PING/SETTINGS floods, empty DATA)
+    flood_guard: h2_flood.FloodGuard,
+    lifetime: ConnectionLifetime = .{},
+    opened_at: std.time.Instant,
+    streams_accepted: u32 = 0,
+    /// Highest client stream id we have started processing
+    last_stream_id: u31 = 0,
+    goaway_sent: bool = false,
+    goaway_code: h2_frames.ErrorCode = .NO_ERROR,
+    /// Set once we announced a graceful GOAWAY; in-flight streams finish
+    /// until the drain timeout, newer streams are refused
+    drain_started: ?std.time.Instant = null,
+    /// The peer sent GOAWAY and will open no further streams
+    peer_goaway: ?h2_frames.ErrorCode = null,
+    /// WebSockets on extended CONNECT streams, by stream id
+    tunnels: std.AutoHashMap(u31, *h2_websocket.Tunnel),
+    websocket_max_message_size: usize = h2_websocket.default_max_message_size,
+    /// Addresses reported in scopes; the strings are borrowed from whoever
+    /// set them and must outlive the handler
+    server: Endpoint = .{},
+    client: Endpoint = .{},
+    /// Streams whose request headers are complete, oldest first
+    ready: std.ArrayList(*StreamScope),
+    /// Output waiting for the peer to open its windows, oldest first
+    parked: std.ArrayList(*ParkedOutput),
 
     pub fn init(allocator: Allocator, initial_window_size: i32) !Self {
+        const local_settings = h2_streams.ConnectionSettings{
+            .max_header_list_size = default_max_header_list_size,
+            .enable_connect_protocol = true,
+        };
+
+        var decoder = hpack.HpackDecoder.init(allocator, local_settings.header_table_size);
+        decoder.max_header_list_size = local_settings.max_header_list_size.?;
+
         return Self{
             .allocator = allocator,
             .stream_manager = h2_streams.StreamManager.init(allocator, initial_window_size),
             .message_queue = protocol.Http2StreamMessageQueue.init(allocator),
-            .decoder = hpack.HpackDecoder.init(allocator, 4096),
+            .decoder = decoder,
             .encoder = hpack.HpackEncoder.init(allocator, 4096),
+            .local_settings = local_settings,
+            .peer_settings = h2_streams.ConnectionSettings{},
+            .reader = try h2_frames.FrameReader.init(allocator, local_settings.max_frame_size),
+            .writer = h2_frames.FrameWriter.init(allocator),
+            .header_block = std.ArrayList(u8).init(allocator),
+            .flood_guard = try h2_flood.FloodGuard.init(.{}),
+            .opened_at = try std.time.Instant.now(),
+            .tunnels = std.AutoHashMap(u31, *h2_websocket.Tunnel).init(allocator),
+            .ready = std.ArrayList(*StreamScope).init(allocator),
+            .parked = std.ArrayList(*ParkedOutput).init(allocator),
         };
     }
 
@@ -32,37 +196,259 @@ pub const Http2AsgiHandler = struct {
         self.message_queue.deinit();
         self.decoder.deinit();
         self.encoder.deinit();
+        self.reader.deinit();
+        self.writer.deinit();
+        self.header_block.deinit();
+
+        var tunnels = self.tunnels.valueIterator();
+        while (tunnels.next()) |tunnel| {
+            tunnel.*.deinit();
+            self.allocator.destroy(tunnel.*);
+        }
+        self.tunnels.deinit();
+
+        for (self.ready.items) |stream_scope| stream_scope.destroy(self.allocator);
+        self.ready.deinit();
+
+        for (self.parked.items) |parked| parked.destroy(self.allocator);
+        self.parked.deinit();
+    }
+
+    /// Take the oldest stream waiting for its application. Its queue
+    /// carries the request's events; a stream reset in the meantime has a
+    /// cancelled queue.
+    pub fn takeReady(self: *Self) ?*StreamScope {
+        if (self.ready.items.len == 0) return null;
+        return self.ready.orderedRemove(0);
     }
 
-    /// Process an HTTP/2 frame and convert to ASGI messages
+    /// Queue the server connection preface (our SETTINGS frame)
+    pub fn sendServerPreface(self: *Self) !void {
+        var settings = h2_frames.SettingsFrame.init(self.allocator);
+        defer settings.deinit();
+
+        try settings.addSetting(.MAX_CONCURRENT_STREAMS, self.local_settings.max_concurrent_streams);
+        try settings.addSetting(.MAX_FRAME_SIZE, self.local_settings.max_frame_size);
+        if (self.local_settings.max_header_list_size) |limit| {
+            try settings.addSetting(.MAX_HEADER_LIST_SIZE, limit);
+        }
+        if (self.local_settings.enable_connect_protocol) {
+            try settings.addSetting(.ENABLE_CONNECT_PROTOCOL, 1);
+        }
+        try settings.write(&self.writer, 0);
+    }
+
+    /// One reactor turn for a readable connection: read once, process every
+    /// complete frame in the read buffer, then flush all queued output with
+    /// a single writev. Returns false when the connection should be closed:
+    /// the peer closed it, or it committed a protocol violation and a GOAWAY
+    /// has been written.
+    pub fn onReadable(self: *Self, fd: std.posix.fd_t) !bool {
+        const bytes_read = try self.reader.fill(fd);
+        if (bytes_read == 0) return false;
+
+        const keep_open = try self.processReadBuffer();
+        try self.checkLifetime();
+        try self.flush(fd);
+        return keep_open and !self.shouldClose();
+    }
+
+    /// Process every complete frame in the read buffer. Returns false when
+    /// the peer committed a connection error; the GOAWAY is then queued.
+    pub fn processReadBuffer(self: *Self) !bool {
+        self.processBuffered() catch |err| {
+            const code = connectionErrorCode(err) orelse return err;
+            try self.goAway(code);
+            return false;
+        };
+        return true;
+    }
+
+    fn processBuffered(self: *Self) !void {
+        while (try self.reader.next()) |frame| {
+            try self.processFrame(frame);
+        }
+    }
+
+    /// Queue a GOAWAY carrying the last stream we processed. A connection
+    /// gets one GOAWAY, except that an error may follow a graceful one sent
+    /// while draining.
+    pub fn goAway(self: *Self, code: h2_frames.ErrorCode) !void {
+        if (self.goaway_sent and (code == .NO_ERROR or self.goaway_code != .NO_ERROR)) return;
+        self.goaway_sent = true;
+        self.goaway_code = code;
+
+        const goaway = h2_frames.GoAwayFrame{
+            .last_stream_id = self.last_stream_id,
+            .error_code = code,
+            .debug_data = "",
+        };
+        try goaway.write(&self.writer);
+    }
+
+    /// Start a graceful shutdown (deploys, recycling): announce GOAWAY with
+    /// NO_ERROR and the last stream we accepted, keep serving those streams,
+    /// and refuse newer ones. `shouldClose` turns true once they finish or
+    /// the drain timeout passes.
+    pub fn beginDrain(self: *Self) !void {
+        if (self.drain_started != null) return;
+        self.drain_started = try std.time.Instant.now();
+        try self.goAway(.NO_ERROR);
+    }
+
+    pub fn isDraining(self: *const Self) bool {
+        return self.drain_started != null or self.peer_goaway != null;
+    }
+
+    /// Start draining once the connection has outlived `lifetime.max_age_ns`.
+    /// The stream limit is checked as streams are accepted.
+    pub fn checkLifetime(self: *Self) !void {
+        if (self.drain_started != null) return;
+
+        if (self.lifetime.max_age_ns) |max_age| {
+            const now = std.time.Instant.now() catch return;
+            if (now.since(self.opened_at) >= max_age) try self.beginDrain();
+        }
+    }
+
+    /// Timer turn, for when there may be nothing to read: start draining a
+    /// connection that has grown too old and report whether it should stay
+    /// open. Call it at least every poll timeout so that idle connections
+    /// are recycled and draining ones close on time even if the peer is
+    /// silent.
+    pub fn tick(self: *Self) !bool {
+        try self.checkLifetime();
+        return !self.shouldClose();
+    }
+
+    /// Whether the connection is finished and should be closed after the
+    /// queued frames are flushed
+    pub fn shouldClose(self: *const Self) bool {
+        if (self.goaway_code != .NO_ERROR) return true;
+        if (self.peer_goaway) |code| {
+            if (code != .NO_ERROR) return true;
+        }
+        if (!self.isDraining()) return false;
+
+        if (self.stream_manager.streams.count() == 0) return true;
+
+        const started = self.drain_started orelse return false;
+        const now = std.time.Instant.now() catch return true;
+        return now.since(started) >= self.lifetime.drain_timeout_ns;
+    }
+
+    /// Write all queued frames to the connection
+    pub fn flush(self: *Self, fd: std.posix.fd_t) !void {
+        if (self.writer.hasPending()) {
+            try self.writer.flush(fd);
+        }
+    }
+
+    /// Process an HTTP/2 frame and convert to ASGI messages. The frame
+    /// payload borrows from the read buffer; anything kept past this call
+    /// must be copied.
     pub fn processFrame(self: *Self, frame: h2_frames.Frame) !void {
+        // A header block must be contiguous: nothing may be interleaved
+        // with its CONTINUATION frames (RFC 9113 section 6.10)
+        if (self.pending_headers) |pending| {
+            if (frame.header.frame_type != .CONTINUATION or frame.header.stream_id != pending.stream_id) {
+                return error.ProtocolError;
+            }
+        }
+
         switch (frame.header.frame_type) {
             .HEADERS => try self.processHeadersFrame(frame),
+            .CONTINUATION => try self.processContinuationFrame(frame),
             .DATA => try self.processDataFrame(frame),
             .RST_STREAM => try self.processRstStreamFrame(frame),
             .SETTINGS => try self.processSettingsFrame(frame),
             .WINDOW_UPDATE => try self.processWindowUpdateFrame(frame),
             .PING => try self.processPingFrame(frame),
             .GOAWAY => try self.processGoAwayFrame(frame),
-            else => {
-                std.debug.print("Unhandled frame type: {}\n", .{frame.header.frame_type});
-            },
+            // PRIORITY is deprecated (RFC 9113 section 5.3.2) and unknown
+            // types are ignored, but reading them is not free
+            else => try self.flood_guard.charge(.ignored),
         }
     }
 
-    /// Process HEADERS frame and create ASGI scope
+    /// Process HEADERS frame: strip padding and priority, then start
+    /// assembling the header block
     fn processHeadersFrame(self: *Self, frame: h2_frames.Frame) !void {
         const stream_id = frame.header.stream_id;
+        const flags = frame.header.flags;
+
+        // Client-initiated streams are odd-numbered
+        if (stream_id == 0 or stream_id % 2 == 0) return error.ProtocolError;
+
+        var fragment = frame.payload;
+
+        var pad_length: usize = 0;
+        if ((flags & h2_frames.FrameFlags.PADDED) != 0) {
+            if (fragment.len < 1) return error.FrameSizeError;
+            pad_length = fragment[0];
+            fragment = fragment[1..];
+        }
+
+        var pending = PendingHeaders{
+            .stream_id = stream_id,
+            .end_stream = (flags & h2_frames.FrameFlags.END_STREAM) != 0,
+            .priority = null,
+        };
+
+        if ((flags & h2_frames.FrameFlags.PRIORITY) != 0) {
+            if (fragment.len < 5) return error.FrameSizeError;
+            const dependency = std.mem.readInt(u32, fragment[0..4], .big);
+            pending.priority = .{
+                .depends_on = @intCast(dependency & 0x7FFFFFFF),
+                .weight = fragment[4],
+                .exclusive = (dependency & 0x80000000) != 0,
+            };
+            fragment = fragment[5..];
+        }
+
+        if (pad_length > fragment.len) return error.ProtocolError;
+        fragment = fragment[0 .. fragment.len - pad_length];
+
+        self.header_block.clearRetainingCapacity();
+        try self.appendHeaderFragment(fragment);
 
-        // Create or get stream
-        var stream = self.stream_manager.getStream(stream_id);
-        if (stream == null) {
-            stream = try self.stream_manager.createStream(stream_id);
-            try self.message_queue.createStreamQueue(stream_id);
+        if ((flags & h2_frames.FrameFlags.END_HEADERS) != 0) {
+            try self.completeHeaderBlock(pending);
+        } else {
+            self.pending_headers = pending;
+        }
+    }
+
+    /// Process CONTINUATION frame carrying the next header block fragment
+    fn processContinuationFrame(self: *Self, frame: h2_frames.Frame) !void {
+        // processFrame has already matched the stream; a CONTINUATION with
+        // no block in progress is the remaining violation
+        const pending = self.pending_headers orelse return error.ProtocolError;
+
+        try self.appendHeaderFragment(frame.payload);
+
+        if ((frame.header.flags & h2_frames.FrameFlags.END_HEADERS) != 0) {
+            self.pending_headers = null;
+            try self.completeHeaderBlock(pending);
         }
+    }
+
+    /// Append to the header block, refusing to buffer more than the header
+    /// list limit. A compressed block is never larger than the list it
+    /// decodes to, so this also bounds endless CONTINUATION sequences.
+    fn appendHeaderFragment(self: *Self, fragment: []const u8) !void {
+        const limit: usize = self.local_settings.max_header_list_size orelse default_max_header_list_size;
+        if (self.header_block.items.len + fragment.len > limit) return error.HeaderBlockTooLarge;
+        try self.header_block.appendSlice(fragment);
+    }
 
-        // Decode headers using HPACK
-        const headers = try self.decoder.decode(frame.payload);
+    /// Decode a complete header block and hand the request to the ASGI side
+    fn completeHeaderBlock(self: *Self, pending: PendingHeaders) !void {
+        const stream_id = pending.stream_id;
+
+        // Decode before touching stream state so the HPACK context stays in
+        // sync even if the block is for a stream we end up ignoring
+        const headers = try self.decoder.decode(self.header_block.items);
         defer {
             for (headers.items) |header| {
                 self.allocator.free(header.name);
@@ -71,40 +457,98 @@ pub const Http2AsgiHandler = struct {
             headers.deinit();
         }
 
-        // Extract pseudo-headers
-        var pseudo_headers = protocol.Http2PseudoHeaders.init();
-        var regular_headers = std.ArrayList([2][]const u8).init(self.allocator);
-        defer {
-            for (regular_headers.items) |header| {
-                self.allocator.free(header[0]);
-                self.allocator.free(header[1]);
-            }
-            regular_headers.deinit();
+        // A second header block on an open stream is the request trailers:
+        // it ends the request body
+        if (self.stream_manager.getStream(stream_id)) |existing| {
+            if (!existing.headers_complete or !pending.end_stream) return error.ProtocolError;
+
+            const request_message = try protocol.createHttpRequestMessage(self.allocator, null, false);
+            try self.deliver(stream_id, request_message);
+            try existing.transitionState(.recv_end_stream);
+            if (existing.state == .closed) self.finishStream(stream_id);
+            return;
+        }
+
+        // New streams must use increasing ids (RFC 9113 section 5.1.1)
+        if (stream_id <= self.last_stream_id) return error.ProtocolError;
+
+        // After our GOAWAY only streams it covered are served; refusing the
+        // rest tells the client it can safely retry them elsewhere
+        if (self.goaway_sent) {
+            const refuse = h2_frames.RstStreamFrame{ .error_code = .REFUSED_STREAM };
+            try refuse.write(&self.writer, stream_id);
+            return;
+        }
+
+        self.last_stream_id = stream_id;
+        self.streams_accepted += 1;
+        if (self.lifetime.max_streams) |max_streams| {
+            if (self.streams_accepted >= max_streams) try self.beginDrain();
+        }
+
+        const stream = try self.stream_manager.createStream(stream_id);
+
+        if (pending.priority) |priority| {
+            stream.setPriority(priority.depends_on, priority.weight, priority.exclusive) catch {
+                // A stream depending on itself is a stream error; we have
+                // no stream-level reset path yet, so keep default priority
+            };
         }
 
+        try self.ready.ensureUnusedCapacity(1);
+        const ready = try self.allocator.create(StreamScope);
+        ready.* = StreamScope{
+            .stream_id = stream_id,
+            .arena = std.heap.ArenaAllocator.init(self.allocator),
+        };
+        var handed_over = false;
+        defer if (!handed_over) ready.destroy(self.allocator);
+        const arena = ready.arena.allocator();
+
+        // Extract pseudo-headers. The scope borrows these strings, so they
+        // are copied into its arena.
+        var pseudo_headers = protocol.Http2PseudoHeaders.init();
+        var regular_headers = std.ArrayList([2][]const u8).init(arena);
+
         for (headers.items) |header| {
             if (std.mem.startsWith(u8, header.name, ":")) {
                 if (std.mem.eql(u8, header.name, ":method")) {
-                    pseudo_headers.method = try self.allocator.dupe(u8, header.value);
+                    pseudo_headers.method = try arena.dupe(u8, header.value);
                 } else if (std.mem.eql(u8, header.name, ":scheme")) {
-                    pseudo_headers.scheme = try self.allocator.dupe(u8, header.value);
+                    pseudo_headers.scheme = try arena.dupe(u8, header.value);
                 } else if (std.mem.eql(u8, header.name, ":authority")) {
-                    pseudo_headers.authority = try self.allocator.dupe(u8, header.value);
+                    pseudo_headers.authority = try arena.dupe(u8, header.value);
                 } else if (std.mem.eql(u8, header.name, ":path")) {
-                    pseudo_headers.path = try self.allocator.dupe(u8, header.value);
+                    pseudo_headers.path = try arena.dupe(u8, header.value);
+                } else if (std.mem.eql(u8, header.name, ":protocol")) {
+                    pseudo_headers.protocol = try arena.dupe(u8, header.value);
                 }
             } else {
                 try regular_headers.append([2][]const u8{
-                    try self.allocator.dupe(u8, header.name),
-                    try self.allocator.dupe(u8, header.value),
+                    try arena.dupe(u8, header.name),
+                    try arena.dupe(u8, header.value),
                 });
             }
         }
 
-        // Validate pseudo-headers
+        // Extended CONNECT needs the setting we advertised, the CONNECT
+        // method, :scheme and :path, and a stream left open for the tunnel;
+        // anything else is malformed (RFC 8441 section 4)
+        if (pseudo_headers.protocol) |requested| {
+            const is_connect = if (pseudo_headers.method) |method| std.mem.eql(u8, method, "CONNECT") else false;
+            if (!self.local_settings.enable_connect_protocol or !is_connect or !pseudo_headers.isValid() or pending.end_stream) {
+                return self.resetStream(stream_id, .PROTOCOL_ERROR);
+            }
+            if (!std.ascii.eqlIgnoreCase(requested, "websocket")) {
+                try self.sendResponse(stream_id, 501, &.{}, null, null);
+                return self.resetStream(stream_id, .NO_ERROR);
+            }
+        }
+
+        // A request without its pseudo-headers is malformed: a stream
+        // error (RFC 9113 section 8.1.1)
         if (!pseudo_headers.isValid()) {
-            std.debug.print("Invalid HTTP/2 pseudo-headers\n", .{});
-            return;
+            return self.resetStream(stream_id, .PROTOCOL_ERROR);
         }
 
         // Extract path and query string
@@ -117,240 +561,738 @@ pub const Http2AsgiHandler = struct {
             query = path_and_query[query_start + 1 ..];
         }
 
-        // Create HTTP/2 ASGI scope
-        const scope = try protocol.createHttp2Scope(
-            self.allocator,
-            "127.0.0.1", // TODO: Get actual server address
-            8080, // TODO: Get actual server port
-            "127.0.0.1", // TODO: Get actual client address
-            12345, // TODO: Get actual client port
-            pseudo_headers.method.?,
-            path,
-            query,
-            regular_headers.items,
-            stream_id,
-            pseudo_headers.scheme.?,
-            pseudo_headers.authority,
-        );
+        try self.message_queue.createStreamQueue(stream_id);
+        errdefer self.message_queue.removeStreamQueue(stream_id);
 
-        // Store scope for this stream (for later use)
-        // TODO: Add scope storage to stream or handler
+        // The block is complete, so the stream is ready for body processing
+        stream.headers_complete = true;
 
-        std.debug.print("Created HTTP/2 ASGI scope for stream {}: {}\n", .{ stream_id, scope });
-
-        // If this is the end of headers, mark stream as ready for body processing
-        if ((frame.header.flags & h2_frames.FrameFlags.END_HEADERS) != 0) {
-            if (stream) |s| {
-                s.headers_complete = true;
-            }
-        }
-
-        // If this is also end of stream, create the HTTP request message
-        if ((frame.header.flags & h2_frames.FrameFlags.END_STREAM) != 0) {
-            const request_message = try protocol.createHttpRequestMessage(
-                self.allocator,
-                null, // No body
-                false, // No more body
+        if (pseudo_headers.protocol != null) {
+            try self.openTunnel(stream, ready, path, query, pseudo_headers.scheme.?, regular_headers.items);
+        } else {
+            ready.scope = try protocol.createHttp2Scope(
+                arena,
+                self.server.host,
+                self.server.port,
+                self.client.host,
+                self.client.port,
+                pseudo_headers.method.?,
+                path,
+                query,
+                regular_headers.items,
+                stream_id,
+                pseudo_headers.scheme.?,
+                pseudo_headers.authority,
             );
 
-            try self.message_queue.pushToStream(stream_id, request_message);
+            // If this is also end of stream, create the HTTP request message
+            if (pending.end_stream) {
+                const request_message = try protocol.createHttpRequestMessage(
+                    self.allocator,
+                    null, // No body
+                    false, // No more body
+                );
 
-            // Transition stream state
-            if (stream) |s| {
-                try s.transitionState(.recv_end_stream);
+                try self.deliver(stream_id, request_message);
+
+                // Transition stream state
+                try stream.transitionState(.recv_end_stream);
             }
         }
 
-        // Clean up pseudo-headers
-        if (pseudo_headers.method) |m| self.allocator.free(m);
-        if (pseudo_headers.scheme) |s| self.allocator.free(s);
-        if (pseudo_headers.authority) |a| self.allocator.free(a);
-        if (pseudo_headers.path) |p| self.allocator.free(p);
+        // The application starts without waiting for the request body,
+        // which reaches it through the stream's queue
+        self.ready.appendAssumeCapacity(ready);
+        handed_over = true;
     }
 
     /// Process DATA frame
     fn processDataFrame(self: *Self, frame: h2_frames.Frame) !void {
         const stream_id = frame.header.stream_id;
+        const more_body = (frame.header.flags & h2_frames.FrameFlags.END_STREAM) == 0;
+
+        const data_frame = try h2_frames.DataFrame.parse(frame);
+
+        // Empty DATA that does not end the stream carries nothing useful
+        if (data_frame.data.len == 0 and more_body) {
+            try self.flood_guard.charge(.empty_data);
+        }
 
         const stream = self.stream_manager.getStream(stream_id) orelse {
-            std.debug.print("Received DATA frame for unknown stream {}\n", .{stream_id});
-            return;
+            // Discarded, but it still counted against the connection window
+            return self.releaseWindow(stream_id, frame.payload.len, false);
         };
 
         if (!stream.canReceiveData()) {
-            std.debug.print("Stream {} cannot receive data in state {}\n", .{ stream_id, stream.state });
-            return;
+            return self.releaseWindow(stream_id, frame.payload.len, false);
         }
 
-        // Create HTTP request message with body
-        const more_body = (frame.header.flags & h2_frames.FrameFlags.END_STREAM) == 0;
-        const request_message = try protocol.createHttpRequestMessage(
-            self.allocator,
-            frame.payload,
-            more_body,
+        try self.releaseWindow(stream_id, frame.payload.len, more_body);
+
+        if (self.tunnels.get(stream_id)) |tunnel| {
+            return self.processTunnelData(stream, tunnel, data_frame.data, more_body);
+        }
+
+        // A body arriving after the application returned is not kept
+        if (!self.message_queue.isCancelled(stream_id)) {
+            // The payload is a view into the read buffer, so the body handed
+            // to the application is the one copy made on the receive path
+            const body = try self.allocator.dupe(u8, data_frame.data);
+            errdefer self.allocator.free(body);
+
+            // Create HTTP request message with body
+            const request_message = try protocol.createHttpRequestMessage(
+                self.allocator,
+                body,
+                more_body,
+            );
+
+            try self.deliver(stream_id, request_message);
+        }
+
+        // If this is the end of stream, transition state; a stream already
+        // answered is then complete
+        if (!more_body) {
+            try stream.transitionState(.recv_end_stream);
+            if (stream.state == .closed) self.finishStream(stream_id);
+        }
+    }
+
+    /// Queue an event for a stream's application. Once the application has
+    /// returned and its queue is gone, whatever the peer still sends is
+    /// dropped.
+    fn deliver(self: *Self, stream_id: u31, message: json.Value) !void {
+        self.message_queue.pushToStream(stream_id, message) catch |err| {
+            protocol.jsonValueDeinit(message, self.allocator);
+            if (err != error.StreamNotFound) return err;
+        };
+    }
+
+    /// Give back the flow control window a DATA frame used: to the
+    /// connection always, and to the stream while it can still send. The
+    /// payload is copied into the application's events right away, so
+    /// nothing is left holding the window.
+    fn releaseWindow(self: *Self, stream_id: u31, flow_len: usize, more_body: bool) !void {
+        if (flow_len == 0) return;
+
+        const increment: u31 = @intCast(flow_len);
+        try (h2_frames.WindowUpdateFrame{ .window_size_increment = increment }).write(&self.writer, 0);
+        if (more_body) {
+            try (h2_frames.WindowUpdateFrame{ .window_size_increment = increment }).write(&self.writer, stream_id);
+        }
+    }
+
+    /// Start a WebSocket on an extended CONNECT stream. The application gets
+    /// a websocket scope, built into `ready`, and websocket.connect; the
+    /// stream stays open both ways until one side closes.
+    fn openTunnel(self: *Self, stream: *h2_streams.Stream, ready: *StreamScope, path: []const u8, query: ?[]const u8, scheme: []const u8, headers: []const [2][]const u8) !void {
+        const tunnel = try self.allocator.create(h2_websocket.Tunnel);
+        tunnel.* = h2_websocket.Tunnel.init(self.allocator, self.websocket_max_message_size);
+        self.tunnels.put(stream.id, tunnel) catch |err| {
+            tunnel.deinit();
+            self.allocator.destroy(tunnel);
+            return err;
+        };
+
+        errdefer if (self.tunnels.fetchRemove(stream.id)) |entry| {
+            entry.value.deinit();
+            self.allocator.destroy(entry.value);
+        };
+
+        ready.websocket = true;
+        ready.scope = try protocol.createWebSocketScope(
+            ready.arena.allocator(),
+            self.server.host,
+            self.server.port,
+            self.client.host,
+            self.client.port,
+            path,
+            query,
+            headers,
         );
+        try ready.scope.object.put("http_version", json.Value{ .string = "2" });
+        try ready.scope.object.put("scheme", json.Value{ .string = if (std.mem.eql(u8, scheme, "https")) "wss" else "ws" });
+
+        try self.deliver(stream.id, try protocol.createWebSocketConnectMessage(self.allocator));
+    }
+
+    /// Hand the WebSocket frames in a tunnel's DATA to the application
+    fn processTunnelData(self: *Self, stream: *h2_streams.Stream, tunnel: *h2_websocket.Tunnel, data: []const u8, more_body: bool) !void {
+        const stream_id = stream.id;
 
-        try self.message_queue.pushToStream(stream_id, request_message);
+        if (!tunnel.disconnected) try self.pumpTunnel(stream_id, tunnel, data);
 
-        // If this is the end of stream, transition state
         if (!more_body) {
+            // The peer ended the stream without a closing handshake
+            if (!tunnel.disconnected) {
+                try self.deliver(stream_id, try protocol.createWebSocketDisconnectMessage(self.allocator, 1006));
+                tunnel.disconnected = true;
+            }
+
             try stream.transitionState(.recv_end_stream);
+            if (stream.state == .closed) self.dropStream(stream_id);
+        }
+    }
+
+    /// Parse what a tunnel has buffered and act on each event
+    fn pumpTunnel(self: *Self, stream_id: u31, tunnel: *h2_websocket.Tunnel, data: []const u8) !void {
+        tunnel.feed(data) catch |err| return self.failTunnel(stream_id, tunnel, err);
+
+        while (!tunnel.disconnected) {
+            const next_event = tunnel.next() catch |err| return self.failTunnel(stream_id, tunnel, err);
+            switch (next_event orelse return) {
+                .message => |message| {
+                    const copy = try self.allocator.dupe(u8, message.data);
+                    errdefer self.allocator.free(copy);
+
+                    const receive = if (message.type == .text)
+                        try protocol.createWebSocketReceiveMessage(self.allocator, copy, null)
+                    else
+                        try protocol.createWebSocketReceiveMessage(self.allocator, null, copy);
+                    try self.deliver(stream_id, receive);
+                },
+                .ping => |payload| {
+                    if (!tunnel.close_sent) try self.queueTunnelFrame(stream_id, .pong, payload, false);
+                },
+                .pong => {},
+                .close => |code| {
+                    // Answer the closing handshake unless we started it;
+                    // 1005 means "no code present" and must not go on the wire
+                    if (!tunnel.close_sent) try self.closeTunnel(stream_id, tunnel, if (code == 1005) 1000 else code, "");
+                    try self.deliver(stream_id, try protocol.createWebSocketDisconnectMessage(self.allocator, code));
+                    tunnel.disconnected = true;
+                },
+            }
         }
     }
 
+    /// Close a WebSocket whose framing failed and tell the application why.
+    /// Only this stream is affected.
+    fn failTunnel(self: *Self, stream_id: u31, tunnel: *h2_websocket.Tunnel, err: anyerror) !void {
+        if (err == error.OutOfMemory) return err;
+
+        const code = h2_websocket.errorCloseCode(err);
+        if (!tunnel.close_sent) try self.closeTunnel(stream_id, tunnel, code, "");
+        try self.deliver(stream_id, try protocol.createWebSocketDisconnectMessage(self.allocator, code));
+        tunnel.disconnected = true;
+    }
+
+    /// Send a close frame and end our side of a tunnel stream
+    fn closeTunnel(self: *Self, stream_id: u31, tunnel: *h2_websocket.Tunnel, code: u16, reason: []const u8) !void {
+        var payload_buf: [125]u8 = undefined;
+        tunnel.close_sent = true;
+        try self.queueTunnelFrame(stream_id, .close, h2_websocket.closePayload(&payload_buf, code, reason), true);
+    }
+
+    /// Queue one WebSocket frame as DATA on a tunnel stream. Ending the
+    /// stream may release the tunnel.
+    fn queueTunnelFrame(self: *Self, stream_id: u31, opcode: h2_websocket.Opcode, payload: []const u8, end_stream: bool) !void {
+        // The writer takes ownership of the encoded frame; DATA borrows it
+        const bytes = try h2_websocket.encodeFrame(self.allocator, opcode, payload);
+        self.writer.adopt(bytes) catch |err| {
+            self.allocator.free(bytes);
+            return err;
+        };
+        const sent = try self.queueData(stream_id, bytes, end_stream);
+        if (sent and end_stream) try self.endTunnelStream(stream_id);
+    }
+
+    /// Our side of a tunnel stream has ended; once the peer's has too the
+    /// stream and its tunnel are released
+    fn endTunnelStream(self: *Self, stream_id: u31) !void {
+        const stream = self.stream_manager.getStream(stream_id) orelse return;
+        try stream.transitionState(.send_end_stream);
+        if (stream.state == .closed) self.dropStream(stream_id);
+    }
+
     /// Process RST_STREAM frame
     fn processRstStreamFrame(self: *Self, frame: h2_frames.Frame) !void {
         const stream_id = frame.header.stream_id;
 
+        if (stream_id == 0 or stream_id > self.last_stream_id) return error.ProtocolError;
+        _ = try h2_frames.RstStreamFrame.parse(frame);
+
         if (self.stream_manager.getStream(stream_id)) |stream| {
             try stream.transitionState(.recv_rst_stream);
-            self.message_queue.removeStreamQueue(stream_id);
-            self.stream_manager.removeStream(stream_id);
+            if (self.tunnels.get(stream_id)) |tunnel| {
+                // A WebSocket application expects websocket.disconnect
+                if (!tunnel.disconnected) {
+                    try self.deliver(stream_id, try protocol.createWebSocketDisconnectMessage(self.allocator, 1006));
+                }
+                self.dropStream(stream_id);
+            } else {
+                // Wake the application with http.disconnect instead of
+                // letting it keep working on a response nobody will read
+                self.closeStream(stream_id);
+            }
         }
+
+        // Each reset stream may have cost us a request dispatch; this is
+        // the rapid-reset budget (CVE-2023-44487)
+        try self.flood_guard.charge(.rst_stream);
     }
 
     /// Process SETTINGS frame
     fn processSettingsFrame(self: *Self, frame: h2_frames.Frame) !void {
         if ((frame.header.flags & h2_frames.FrameFlags.ACK) != 0) {
-            // This is a SETTINGS ACK
-            std.debug.print("Received SETTINGS ACK\n", .{});
+            // Acknowledges our SETTINGS; nothing to apply
             return;
         }
 
-        const settings_frame = try h2_frames.SettingsFrame.parse(self.allocator, frame.payload);
-        defer settings_frame.settings.deinit();
+        try self.flood_guard.charge(.settings);
+
+        var settings_frame = try h2_frames.SettingsFrame.parse(self.allocator, frame.payload);
+        defer settings_frame.deinit();
 
         // Apply settings
+        var window_changed = false;
         for (settings_frame.settings.items) |setting| {
+            try self.peer_settings.updateSetting(@intFromEnum(setting.id), setting.value);
+
             switch (setting.id) {
                 .INITIAL_WINDOW_SIZE => {
-                    self.stream_manager.initial_window_size = @intCast(setting.value);
+                    // Open streams' send windows move by the difference, and
+                    // may go negative (RFC 9113 section 6.9.2)
+                    const new_size: i32 = @intCast(setting.value);
+                    try self.stream_manager.updateAllStreamWindows(new_size - self.stream_manager.initial_window_size);
+                    self.stream_manager.initial_window_size = new_size;
+                    window_changed = true;
                 },
                 .MAX_CONCURRENT_STREAMS => {
                     self.stream_manager.max_concurrent_streams = setting.value;
                 },
-                else => {
-                    std.debug.print("Unhandled setting: {} = {}\n", .{ setting.id, setting.value });
-                },
+                else => {},
             }
         }
 
-        // Send SETTINGS ACK
-        // TODO: Implement response sending mechanism
+        // Acknowledge; goes out with the rest of this turn's frames
+        _ = try self.writer.reserveFrame(h2_frames.FrameHeader{
+            .length = 0,
+            .frame_type = .SETTINGS,
+            .flags = h2_frames.FrameFlags.ACK,
+            .stream_id = 0,
+        }, 0);
+
+        if (window_changed) try self.resumeParked();
     }
 
-    /// Process WINDOW_UPDATE frame
+    /// Process WINDOW_UPDATE frame. A zero increment is a PROTOCOL_ERROR
+    /// and a window pushed past 2^31-1 a FLOW_CONTROL_ERROR: for the whole
+    /// connection on stream 0, otherwise for the stream alone (RFC 9113
+    /// section 6.9).
     fn processWindowUpdateFrame(self: *Self, frame: h2_frames.Frame) !void {
+        try self.flood_guard.charge(.window_update);
+
         if (frame.payload.len != 4) {
             return error.InvalidWindowUpdate;
         }
 
-        const increment = (@as(u32, frame.payload[0]) << 24) |
-            (@as(u32, frame.payload[1]) << 16) |
-            (@as(u32, frame.payload[2]) << 8) |
-            @as(u32, frame.payload[3]);
+        // The high bit is reserved and ignored on receipt
+        const increment: u31 = @truncate(std.mem.readInt(u32, frame.payload[0..4], .big));
+        const stream_id = frame.header.stream_id;
 
-        if (frame.header.stream_id == 0) {
-            // Connection-level window update
-            self.stream_manager.connection_window_size += @as(i32, @intCast(increment));
+        if (stream_id == 0) {
+            if (increment == 0) return error.ProtocolError;
+            try self.stream_manager.updateConnectionWindow(increment);
         } else {
-            // Stream-level window update
-            if (self.stream_manager.getStream(frame.header.stream_id)) |stream| {
-                try stream.updateWindow(@intCast(increment));
-            }
+            const stream = self.stream_manager.getStream(stream_id) orelse return;
+            if (increment == 0) return self.resetStream(stream_id, .PROTOCOL_ERROR);
+            stream.updateWindow(increment) catch return self.resetStream(stream_id, .FLOW_CONTROL_ERROR);
         }
+
+        try self.resumeParked();
     }
 
     /// Process PING frame
     fn processPingFrame(self: *Self, frame: h2_frames.Frame) !void {
-        _ = self;
-        if ((frame.header.flags & h2_frames.FrameFlags.ACK) != 0) {
-            std.debug.print("Received PING ACK\n", .{});
-        } else {
-            std.debug.print("Received PING, should send ACK\n", .{});
-            // TODO: Send PING ACK response
-        }
+        if ((frame.header.flags & h2_frames.FrameFlags.ACK) != 0) return;
+
+        try self.flood_guard.charge(.ping);
+
+        const ping = try h2_frames.PingFrame.parse(frame);
+        try ping.write(&self.writer, h2_frames.FrameFlags.ACK);
     }
 
     /// Process GOAWAY frame
     fn processGoAwayFrame(self: *Self, frame: h2_frames.Frame) !void {
-        _ = self;
-        _ = frame;
-        std.debug.print("Received GOAWAY frame, connection should be closed\n", .{});
-        // TODO: Implement connection shutdown
+        if (frame.header.stream_id != 0) return error.ProtocolError;
+
+        const goaway = try h2_frames.GoAwayFrame.parse(frame);
+
+        // The client opens no further streams. Streams it already opened
+        // are ours to finish; with an error code it is closing right away.
+        self.peer_goaway = goaway.error_code;
     }
 
-    /// Send HTTP response to a specific stream
-    pub fn sendResponse(self: *Self, stream_id: u31, status: u16, headers: []const [2][]const u8, body: ?[]const u8) !void {
-        // Create response headers
-        var response_headers = std.ArrayList(hpack.HeaderField).init(self.allocator);
-        defer response_headers.deinit();
+    /// Release a reset stream. Its application gets http.disconnect from
+    /// then on and its task is cancelled; the queue stays until
+    /// `removeStreamQueue`.
+    fn closeStream(self: *Self, stream_id: u31) void {
+        self.message_queue.cancelStream(stream_id);
+        self.dropStream(stream_id);
+    }
 
-        // Add status pseudo-header
-        const status_str = try std.fmt.allocPrint(self.allocator, "{d}", .{status});
-        defer self.allocator.free(status_str);
+    /// Release a stream whose response is complete. The application may
+    /// still be running, so its task is left alone.
+    fn finishStream(self: *Self, stream_id: u31) void {
+        self.message_queue.endStream(stream_id);
+        self.dropStream(stream_id);
+    }
 
-        try response_headers.append(hpack.HeaderField{
-            .name = try self.allocator.dupe(u8, ":status"),
-            .value = try self.allocator.dupe(u8, status_str),
-        });
+    /// Forget a stream and any WebSocket on it, leaving its queue for the
+    /// application to drain
+    fn dropStream(self: *Self, stream_id: u31) void {
+        self.discardParked(stream_id);
+        if (self.tunnels.fetchRemove(stream_id)) |entry| {
+            entry.value.deinit();
+            self.allocator.destroy(entry.value);
+        }
+        self.stream_manager.removeStream(stream_id);
+    }
+
+    /// Reset one stream, leaving the rest of the connection alone
+    fn resetStream(self: *Self, stream_id: u31, code: h2_frames.ErrorCode) !void {
+        const reset = h2_frames.RstStreamFrame{ .error_code = code };
+        try reset.write(&self.writer, stream_id);
+        self.closeStream(stream_id);
+    }
+
+    /// Queue an HTTP response on a specific stream. The body is not copied:
+    /// it is split into DATA frames that borrow from `body`, which must stay
+    /// alive until the next `flush`. Only what the send windows admit goes
+    /// out now; the rest, trailers included, is copied and follows as the
+    /// peer opens its windows. With `trailers` (the ASGI
+    /// http.response.trailers extension) the stream is ended by a final
+    /// HEADERS frame carrying them instead of by the last DATA frame.
+    pub fn sendResponse(self: *Self, stream_id: u31, status: u16, headers: []const [2][]const u8, body: ?[]const u8, trailers: ?[]const [2][]const u8) !void {
+        // Trailers cannot carry pseudo-headers (RFC 9113 section 8.1).
+        // Checked first so a bad trailer leaves nothing half sent.
+        if (trailers) |t| {
+            for (t) |trailer| {
+                if (std.mem.startsWith(u8, trailer[0], ":")) return error.InvalidTrailer;
+            }
+        }
+
+        var fields = std.ArrayList(hpack.HeaderField).init(self.allocator);
+        defer fields.deinit();
+
+        // Add status pseudo-header
+        var status_buf: [3]u8 = undefined;
+        const status_str = try std.fmt.bufPrint(&status_buf, "{d}", .{status});
+        try fields.append(.{ .name = ":status", .value = status_str });
 
         // Add regular headers
         for (headers) |header| {
-            try response_headers.append(hpack.HeaderField{
-                .name = try self.allocator.dupe(u8, header[0]),
-                .value = try self.allocator.dupe(u8, header[1]),
-            });
+            try fields.append(.{ .name = header[0], .value = header[1] });
         }
 
-        // Encode headers
-        const encoded_headers = try self.encoder.encode(response_headers.items);
-        defer self.allocator.free(encoded_headers);
+        try self.queueHeaderBlock(stream_id, fields.items, body == null and trailers == null);
 
-        // Create HEADERS frame
-        var flags: u8 = h2_frames.FrameFlags.END_HEADERS;
-        if (body == null) {
-            flags |= h2_frames.FrameFlags.END_STREAM;
+        const body_sent = if (body) |b| try self.queueData(stream_id, b, trailers == null) else true;
+
+        if (trailers) |t| {
+            fields.clearRetainingCapacity();
+            for (t) |trailer| {
+                try fields.append(.{ .name = trailer[0], .value = trailer[1] });
+            }
+            if (!body_sent) return self.parkTrailers(stream_id, fields.items);
+            try self.queueHeaderBlock(stream_id, fields.items, true);
         }
 
-        const headers_frame = h2_frames.Frame{
-            .header = h2_frames.FrameHeader{
-                .length = @intCast(encoded_headers.len),
-                .frame_type = .HEADERS,
-                .flags = flags,
-                .stream_id = stream_id,
-            },
-            .payload = encoded_headers,
+        // Otherwise the stream ends once its parked body is out
+        if (body_sent) try self.endResponseStream(stream_id);
+    }
+
+    /// Our side of a response stream has ended. A stream complete in both
+    /// directions is released so draining connections can tell when they
+    /// are done.
+    fn endResponseStream(self: *Self, stream_id: u31) !void {
+        const stream = self.stream_manager.getStream(stream_id) orelse return;
+        try stream.transitionState(.send_end_stream);
+        if (stream.state == .closed) self.finishStream(stream_id);
+    }
+
+    /// Queue what the application sent on a WebSocket stream.
+    /// websocket.accept answers the CONNECT with 200, websocket.send becomes
+    /// a WebSocket frame in DATA, and websocket.close sends a close frame
+    /// and ends our side of the stream, or answers 403 before an accept.
+    /// Events for a WebSocket that has already closed are dropped.
+    pub fn sendWebSocketEvent(self: *Self, stream_id: u31, event: json.Value) !void {
+        const tunnel = self.tunnels.get(stream_id) orelse return;
+
+        const type_value = event.object.get("type") orelse return;
+        if (type_value != .string) return;
+        const event_type = type_value.string;
+
+        if (std.mem.eql(u8, event_type, "websocket.accept")) {
+            if (tunnel.accepted or tunnel.close_sent) return error.UnexpectedMessage;
+
+            var fields = std.ArrayList(hpack.HeaderField).init(self.allocator);
+            defer fields.deinit();
+            try fields.append(.{ .name = ":status", .value = "200" });
+
+            if (event.object.get("subprotocol")) |value| {
+                if (value == .string) try fields.append(.{ .name = "sec-websocket-protocol", .value = value.string });
+            }
+            if (event.object.get("headers")) |headers_value| {
+                if (headers_value == .array) {
+                    for (headers_value.array.items) |header| {
+                        if (header != .array or header.array.items.len != 2) continue;
+                        const name = header.array.items[0];
+                        const value = header.array.items[1];
+                        if (name != .string or value != .string) continue;
+                        try fields.append(.{ .name = name.string, .value = value.string });
+                    }
+                }
+            }
+
+            try self.queueHeaderBlock(stream_id, fields.items, false);
+            tunnel.accepted = true;
+        } else if (std.mem.eql(u8, event_type, "websocket.send")) {
+            // Sends racing a close are dropped, as the peer will not read them
+            if (!tunnel.accepted or tunnel.close_sent) return;
+
+            if (event.object.get("bytes")) |bytes| {
+                if (bytes == .string) return self.queueTunnelFrame(stream_id, .binary, bytes.string, false);
+            }
+            if (event.object.get("text")) |text| {
+                if (text == .string) return self.queueTunnelFrame(stream_id, .text, text.string, false);
+            }
+        } else if (std.mem.eql(u8, event_type, "websocket.close")) {
+            if (tunnel.close_sent) return;
+
+            if (!tunnel.accepted) {
+                tunnel.close_sent = true;
+                return self.sendResponse(stream_id, 403, &.{}, null, null);
+            }
+
+            var code: u16 = 1000;
+            if (event.object.get("code")) |value| {
+                if (value == .integer) code = std.math.cast(u16, value.integer) orelse 1000;
+            }
+            // Reserved and local-only codes must not go on the wire
+            if (!h2_websocket.isValidCloseCode(code)) code = 1000;
+
+            var reason: []const u8 = "";
+            if (event.object.get("reason")) |value| {
+                if (value == .string) reason = value.string;
+            }
+
+            try self.closeTunnel(stream_id, tunnel, code, reason);
+        }
+    }
+
+    /// Call once the application on a WebSocket stream has returned. One
+    /// that never accepted gets a 403 and one left open a 1000 close; a
+    /// peer still sending is then told to stop with RST_STREAM(NO_ERROR),
+    /// after any output still waiting for its window, and the stream's
+    /// queue is released.
+    pub fn finishWebSocket(self: *Self, stream_id: u31) !void {
+        defer self.message_queue.removeStreamQueue(stream_id);
+
+        const tunnel = self.tunnels.get(stream_id) orelse return;
+        if (!tunnel.close_sent) {
+            if (tunnel.accepted) {
+                try self.closeTunnel(stream_id, tunnel, 1000, "");
+            } else {
+                tunnel.close_sent = true;
+                try self.sendResponse(stream_id, 403, &.{}, null, null);
+            }
+        }
+        if (self.stream_manager.getStream(stream_id) == null) return;
+
+        if (self.findParked(stream_id)) |parked| {
+            parked.reset_when_sent = true;
+        } else {
+            try self.resetStream(stream_id, .NO_ERROR);
+        }
+    }
+
+    /// Queue `data` as DATA on a stream as far as the send windows allow,
+    /// and park the rest until the peer opens them. The frames borrow from
+    /// `data`. Output behind parked output is parked as well, so a stream's
+    /// bytes stay in order. Returns whether everything, END_STREAM
+    /// included, went out; if not, `resumeParked` ends the stream later.
+    /// Output for a stream that is gone is dropped.
+    fn queueData(self: *Self, stream_id: u31, data: []const u8, end_stream: bool) !bool {
+        const stream = self.stream_manager.getStream(stream_id) orelse return true;
+
+        var rest = data;
+        const parked = self.findParked(stream_id) orelse blk: {
+            const sent = try self.writeData(stream, data, end_stream);
+            if (sent == data.len) return true;
+            rest = data[sent..];
+            break :blk try self.park(stream_id);
         };
-        _ = headers_frame; // TODO: Send headers frame to client
-
-        std.debug.print("Would send HEADERS frame for stream {}\n", .{stream_id});
-
-        // Send body if present
-        if (body) |b| {
-            const data_frame = h2_frames.Frame{
-                .header = h2_frames.FrameHeader{
-                    .length = @intCast(b.len),
-                    .frame_type = .DATA,
-                    .flags = h2_frames.FrameFlags.END_STREAM,
-                    .stream_id = stream_id,
-                },
-                .payload = b,
-            };
-            _ = data_frame; // TODO: Send data frame to client
 
-            std.debug.print("Would send DATA frame for stream {}\n", .{stream_id});
+        try parked.data.appendSlice(self.allocator, rest);
+        parked.end_stream = end_stream;
+        return false;
+    }
+
+    /// Bytes of DATA the peer admits on `stream` right now: the smaller of
+    /// its window and the connection's. A SETTINGS change can push the
+    /// stream's below zero.
+    fn sendWindow(self: *const Self, stream: *const h2_streams.Stream) usize {
+        const window = @min(stream.window_size, self.stream_manager.connection_window_size);
+        return @intCast(@max(window, 0));
+    }
+
+    /// Queue DATA frames, split to the peer's maximum frame size, for as
+    /// much of `data` as the windows admit, and take it from them.
+    /// END_STREAM goes on the last frame only if all of `data` fits; an
+    /// empty frame carrying it costs no window. The frames borrow from
+    /// `data`. Returns how many bytes went out.
+    fn writeData(self: *Self, stream: *h2_streams.Stream, data: []const u8, end_stream: bool) !usize {
+        const admitted = @min(data.len, self.sendWindow(stream));
+        if (admitted == 0 and (data.len > 0 or !end_stream)) return 0;
+
+        const max_frame: usize = self.peer_settings.max_frame_size;
+        const end_flag: u8 = if (end_stream and admitted == data.len) h2_frames.FrameFlags.END_STREAM else 0;
+        var offset: usize = 0;
+        var frames: u32 = 0;
+        defer self.flood_guard.creditDataSent(frames);
+        while (true) {
+            const chunk = data[offset..@min(admitted, offset + max_frame)];
+            offset += chunk.len;
+
+            const last = offset == admitted;
+            const data_frame = h2_frames.DataFrame{ .data = chunk };
+            try data_frame.write(&self.writer, stream.id, if (last) end_flag else 0);
+            frames += 1;
+
+            if (last) break;
         }
 
-        // Update stream state
-        if (self.stream_manager.getStream(stream_id)) |stream| {
-            try stream.transitionState(.send_end_stream);
+        try self.stream_manager.consumeWindow(stream.id, @intCast(admitted));
+        return admitted;
+    }
+
+    fn findParked(self: *Self, stream_id: u31) ?*ParkedOutput {
+        for (self.parked.items) |parked| {
+            if (parked.stream_id == stream_id) return parked;
+        }
+        return null;
+    }
+
+    fn park(self: *Self, stream_id: u31) !*ParkedOutput {
+        try self.parked.ensureUnusedCapacity(1);
+        const parked = try self.allocator.create(ParkedOutput);
+        parked.* = ParkedOutput{
+            .stream_id = stream_id,
+            .arena = std.heap.ArenaAllocator.init(self.allocator),
+        };
+        self.parked.appendAssumeCapacity(parked);
+        return parked;
+    }
+
+    /// Keep a copy of the trailers to end a stream whose body is parked
+    fn parkTrailers(self: *Self, stream_id: u31, fields: []const hpack.HeaderField) !void {
+        const parked = self.findParked(stream_id).?;
+        const arena = parked.arena.allocator();
+
+        const copies = try arena.alloc(hpack.HeaderField, fields.len);
+        for (fields, copies) |field, *copy| {
+            copy.* = .{ .name = try arena.dupe(u8, field.name), .value = try arena.dupe(u8, field.value) };
         }
+        parked.trailers = copies;
+    }
+
+    /// Forget the parked output of a stream that is being released
+    fn discardParked(self: *Self, stream_id: u31) void {
+        for (self.parked.items, 0..) |parked, i| {
+            if (parked.stream_id != stream_id) continue;
+            _ = self.parked.orderedRemove(i);
+            parked.destroy(self.allocator);
+            return;
+        }
+    }
+
+    /// Send parked output, oldest first, as far as the windows now allow.
+    /// Streams whose output is complete are ended.
+    fn resumeParked(self: *Self) !void {
+        var i: usize = 0;
+        while (i < self.parked.items.len) {
+            const parked = self.parked.items[i];
+            if (!try self.sendParked(parked)) {
+                i += 1;
+                continue;
+            }
+
+            _ = self.parked.orderedRemove(i);
+            defer parked.destroy(self.allocator);
+
+            const stream_id = parked.stream_id;
+            if (parked.trailers) |trailers| try self.queueHeaderBlock(stream_id, trailers, true);
+            if (parked.trailers != null or parked.end_stream) {
+                if (self.tunnels.contains(stream_id)) {
+                    try self.endTunnelStream(stream_id);
+                } else {
+                    try self.endResponseStream(stream_id);
+                }
+            }
+            if (parked.reset_when_sent and self.stream_manager.getStream(stream_id) != null) {
+                try self.resetStream(stream_id, .NO_ERROR);
+            }
+        }
+    }
+
+    /// Send as much of a stream's parked data as the windows admit.
+    /// Returns whether all of it, and END_STREAM if it carries that, is out.
+    fn sendParked(self: *Self, parked: *ParkedOutput) !bool {
+        const stream = self.stream_manager.getStream(parked.stream_id) orelse return true;
+        const pending = parked.data.items;
+
+        const admitted = @min(pending.len, self.sendWindow(stream));
+        if (admitted == 0 and pending.len > 0) return false;
+
+        // The frames outlive the parked bytes, which move up below, so the
+        // writer gets its own copy
+        const bytes = try self.allocator.dupe(u8, pending[0..admitted]);
+        self.writer.adopt(bytes) catch |err| {
+            self.allocator.free(bytes);
+            return err;
+        };
+
+        const end_stream = parked.end_stream and parked.trailers == null and admitted == pending.len;
+        _ = try self.writeData(stream, bytes, end_stream);
+
+        std.mem.copyForwards(u8, pending, pending[admitted..]);
+        parked.data.shrinkRetainingCapacity(pending.len - admitted);
+        return parked.data.items.len == 0;
+    }
+
+    /// Encode a header block and queue it as a HEADERS frame followed by as
+    /// many CONTINUATION frames as the peer's max_frame_size requires
+    fn queueHeaderBlock(self: *Self, stream_id: u31, fields: []const hpack.HeaderField, end_stream: bool) !void {
+        // The writer takes ownership of the block; the frames borrow from it
+        const block = try self.encoder.encode(fields);
+        self.writer.adopt(block) catch |err| {
+            self.allocator.free(block);
+            return err;
+        };
+
+        const max_frame: usize = self.peer_settings.max_frame_size;
+        var frame_type: h2_frames.FrameType = .HEADERS;
+        var offset: usize = 0;
+        while (true) {
+            const fragment = block[offset..@min(block.len, offset + max_frame)];
+            offset += fragment.len;
+
+            var flags: u8 = 0;
+            if (offset == block.len) flags |= h2_frames.FrameFlags.END_HEADERS;
+            // END_STREAM belongs on the HEADERS frame, not on CONTINUATION
+            if (end_stream and frame_type == .HEADERS) flags |= h2_frames.FrameFlags.END_STREAM;
+
+            try self.writer.queueFrame(h2_frames.FrameHeader{
+                .length = @intCast(fragment.len),
+                .frame_type = frame_type,
+                .flags = flags,
+                .stream_id = stream_id,
+            }, fragment);
 
-        // Clean up response headers
-        for (response_headers.items) |header| {
-            self.allocator.free(header.name);
-            self.allocator.free(header.value);
+            frame_type = .CONTINUATION;
+            if (offset == block.len) break;
         }
     }
 };
@@ -2,7 +2,9 @@ const std = @import("std");
 const testing = std.testing;
 const h2_integration = @import("h2_integration.zig");
 const h2_frames = @import("../http/h2_frames.zig");
+const hpack = @import("../http/hpack.zig");
 const protocol = @import("protocol.zig");
+const websocket_frame = @import("../websocket/frame.zig");
 
 var test_allocator = std.testing.allocator;
 
@@ -187,3 +189,889 @@ test "SETTINGS frame processing" {
     try testing.expectEqual(@as(i32, 32768), handler.stream_manager.initial_window_size);
     try testing.expectEqual(@as(u32, 50), handler.stream_manager.max_concurrent_streams);
 }
+
+fn encodeRequestHeaders(encoder: *hpack.HpackEncoder, extra: []const hpack.HeaderField) ![]u8 {
+    var headers = std.ArrayList(hpack.HeaderField).init(test_allocator);
+    defer headers.deinit();
+
+    try headers.appendSlice(&[_]hpack.HeaderField{
+        .{ .name = ":method", .value = "GET" },
+        .{ .name = ":scheme", .value = "https" },
+        .{ .name = ":path", .value = "/test" },
+        .{ .name = ":authority", .value = "example.com" },
+    });
+    try headers.appendSlice(extra);
+
+    return encoder.encode(headers.items);
+}
+
+test "Header block split across CONTINUATION frames" {
+
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    const block = try encodeRequestHeaders(&encoder, &.{.{ .name = "user-agent", .value = "test" }});
+    defer test_allocator.free(block);
+
+    const split = block.len / 2;
+
+    try handler.processFrame(.{
+        .header = .{ .length = @intCast(split), .frame_type = .HEADERS, .flags = 0, .stream_id = 1 },
+        .payload = block[0..split],
+    });
+
+    // Nothing is created until the block is complete
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+    try testing.expect(handler.pending_headers != null);
+
+    try handler.processFrame(.{
+        .header = .{
+            .length = @intCast(block.len - split),
+            .frame_type = .CONTINUATION,
+            .flags = h2_frames.FrameFlags.END_HEADERS,
+            .stream_id = 1,
+        },
+        .payload = block[split..],
+    });
+
+    try testing.expect(handler.pending_headers == null);
+    const stream = handler.stream_manager.getStream(1).?;
+    try testing.expect(stream.headers_complete);
+    try testing.expectEqual(@as(u31, 1), handler.last_stream_id);
+}
+
+test "HEADERS with padding and priority" {
+
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    const block = try encodeRequestHeaders(&encoder, &.{});
+    defer test_allocator.free(block);
+
+    // pad length, dependency (exclusive on stream 0), weight, block, padding
+    var payload = std.ArrayList(u8).init(test_allocator);
+    defer payload.deinit();
+    try payload.append(3);
+    try payload.appendSlice(&[_]u8{ 0x80, 0, 0, 0, 200 });
+    try payload.appendSlice(block);
+    try payload.appendNTimes(0, 3);
+
+    try handler.processFrame(.{
+        .header = .{
+            .length = @intCast(payload.items.len),
+            .frame_type = .HEADERS,
+            .flags = h2_frames.FrameFlags.END_HEADERS | h2_frames.FrameFlags.PADDED | h2_frames.FrameFlags.PRIORITY,
+            .stream_id = 3,
+        },
+        .payload = payload.items,
+    });
+
+    const stream = handler.stream_manager.getStream(3).?;
+    try testing.expect(stream.priority.exclusive);
+    try testing.expectEqual(@as(u8, 200), stream.priority.weight);
+}
+
+test "Frames interleaved with CONTINUATION are a protocol error" {
+
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    const block = try encodeRequestHeaders(&encoder, &.{});
+    defer test_allocator.free(block);
+
+    try handler.processFrame(.{
+        .header = .{ .length = @intCast(block.len), .frame_type = .HEADERS, .flags = 0, .stream_id = 1 },
+        .payload = block,
+    });
+
+    const ping_payload = [_]u8{0} ** 8;
+    const result = handler.processFrame(.{
+        .header = .{ .length = 8, .frame_type = .PING, .flags = 0, .stream_id = 0 },
+        .payload = &ping_payload,
+    });
+    try testing.expectError(error.ProtocolError, result);
+    try testing.expectEqual(h2_frames.ErrorCode.PROTOCOL_ERROR, h2_integration.connectionErrorCode(error.ProtocolError).?);
+
+    // CONTINUATION with no header block in progress
+    var fresh = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer fresh.deinit();
+    try testing.expectError(error.ProtocolError, fresh.processFrame(.{
+        .header = .{ .length = 0, .frame_type = .CONTINUATION, .flags = h2_frames.FrameFlags.END_HEADERS, .stream_id = 1 },
+        .payload = "",
+    }));
+}
+
+test "Endless CONTINUATION frames are cut off at the header list limit" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    const fragment = [_]u8{0} ** 1024;
+
+    try handler.processFrame(.{
+        .header = .{ .length = fragment.len, .frame_type = .HEADERS, .flags = 0, .stream_id = 1 },
+        .payload = &fragment,
+    });
+
+    var result: anyerror = error.Unexpected;
+    var frames: usize = 0;
+    while (frames < 1000) : (frames += 1) {
+        handler.processFrame(.{
+            .header = .{ .length = fragment.len, .frame_type = .CONTINUATION, .flags = 0, .stream_id = 1 },
+            .payload = &fragment,
+        }) catch |err| {
+            result = err;
+            break;
+        };
+    }
+
+    try testing.expectEqual(error.HeaderBlockTooLarge, result);
+    try testing.expect(handler.header_block.items.len <= h2_integration.default_max_header_list_size);
+    try testing.expectEqual(h2_frames.ErrorCode.ENHANCE_YOUR_CALM, h2_integration.connectionErrorCode(result).?);
+
+    // The GOAWAY reports that no stream was processed
+    try handler.goAway(h2_integration.connectionErrorCode(result).?);
+    try testing.expect(handler.goaway_sent);
+    try testing.expect(handler.writer.hasPending());
+}
+
+fn appendFrame(out: *std.ArrayList(u8), header: h2_frames.FrameHeader, payload: []const u8) !void {
+    var header_bytes: [h2_frames.FrameHeader.SIZE]u8 = undefined;
+    try header.serialize(&header_bytes);
+    try out.appendSlice(&header_bytes);
+    try out.appendSlice(payload);
+}
+
+test "Rapid reset flood is cut off with ENHANCE_YOUR_CALM" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    var input = std.ArrayList(u8).init(test_allocator);
+    defer input.deinit();
+
+    const rst_payload = [_]u8{ 0, 0, 0, @intFromEnum(h2_frames.ErrorCode.CANCEL) };
+    var timer = try std.time.Timer.start();
+
+    // Each read carries a batch of streams that are opened and reset
+    // immediately, as in CVE-2023-44487
+    var next_stream: u31 = 1;
+    var streams_sent: usize = 0;
+    var keep_open = true;
+    while (keep_open and streams_sent < 100_000) {
+        input.clearRetainingCapacity();
+        for (0..64) |_| {
+            const block = try encodeRequestHeaders(&encoder, &.{});
+            defer test_allocator.free(block);
+
+            try appendFrame(&input, .{
+                .length = @intCast(block.len),
+                .frame_type = .HEADERS,
+                .flags = h2_frames.FrameFlags.END_HEADERS,
+                .stream_id = next_stream,
+            }, block);
+            try appendFrame(&input, .{
+                .length = rst_payload.len,
+                .frame_type = .RST_STREAM,
+                .flags = 0,
+                .stream_id = next_stream,
+            }, &rst_payload);
+
+            next_stream += 2;
+            streams_sent += 1;
+        }
+
+        try handler.reader.feed(input.items);
+        keep_open = try handler.processReadBuffer();
+    }
+
+    const elapsed_s = timer.read() / std.time.ns_per_s;
+
+    // The connection is dropped after the reset budget (burst plus refill
+    // over the test's runtime) rather than after all 100k streams
+    try testing.expect(!keep_open);
+    const defaults = @import("../http/h2_flood.zig").Limits{};
+    const budget = defaults.rst_stream.burst + defaults.rst_stream.per_second * (elapsed_s + 1);
+    try testing.expect(handler.last_stream_id / 2 <= budget + 64);
+
+    // No reset stream is left holding state
+    try testing.expectEqual(@as(usize, 0), handler.stream_manager.streams.count());
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    try handler.flush(fds[1]);
+
+    var out: [64]u8 = undefined;
+    const n = try std.posix.read(fds[0], &out);
+    const frame = try h2_frames.Frame.parse(out[0..n]);
+    const goaway = try h2_frames.GoAwayFrame.parse(frame);
+    try testing.expectEqual(h2_frames.ErrorCode.ENHANCE_YOUR_CALM, goaway.error_code);
+    try testing.expectEqual(handler.last_stream_id, goaway.last_stream_id);
+}
+
+test "PRIORITY and unknown frame floods are cut off with ENHANCE_YOUR_CALM" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var input = std.ArrayList(u8).init(test_allocator);
+    defer input.deinit();
+
+    // Stream 1 depends on stream 0 with the default weight
+    const priority_payload = [_]u8{ 0, 0, 0, 0, 15 };
+
+    var frames_sent: usize = 0;
+    var keep_open = true;
+    while (keep_open and frames_sent < 100_000) {
+        input.clearRetainingCapacity();
+        for (0..32) |_| {
+            try appendFrame(&input, .{
+                .length = priority_payload.len,
+                .frame_type = .PRIORITY,
+                .flags = 0,
+                .stream_id = 1,
+            }, &priority_payload);
+            try appendFrame(&input, .{
+                .length = 0,
+                .frame_type = @enumFromInt(0xFA),
+                .flags = 0,
+                .stream_id = 0,
+            }, "");
+            frames_sent += 2;
+        }
+
+        try handler.reader.feed(input.items);
+        keep_open = try handler.processReadBuffer();
+    }
+    try testing.expect(!keep_open);
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    try handler.flush(fds[1]);
+
+    var out: [64]u8 = undefined;
+    const n = try std.posix.read(fds[0], &out);
+    const frame = try h2_frames.Frame.parse(out[0..n]);
+    const goaway = try h2_frames.GoAwayFrame.parse(frame);
+    try testing.expectEqual(h2_frames.ErrorCode.ENHANCE_YOUR_CALM, goaway.error_code);
+}
+
+test "Reset wakes a blocked receiver with http.disconnect" {
+    var queue = protocol.Http2StreamMessageQueue.init(test_allocator);
+    defer queue.deinit();
+
+    try queue.createStreamQueue(1);
+
+    const Receiver = struct {
+        fn run(q: *protocol.Http2StreamMessageQueue, result: *?std.json.Value) void {
+            result.* = q.receiveFromStream(1) catch null;
+        }
+    };
+
+    var received: ?std.json.Value = null;
+    const thread = try std.Thread.spawn(.{}, Receiver.run, .{ &queue, &received });
+
+    // Wait for the receiver to block, then reset the stream
+    while (true) {
+        queue.global_mutex.lock();
+        const waiting = queue.stream_queues.get(1).?.waiters > 0;
+        queue.global_mutex.unlock();
+        if (waiting) break;
+        std.time.sleep(std.time.ns_per_ms);
+    }
+    queue.cancelStream(1);
+    thread.join();
+
+    try testing.expect(received != null);
+    try testing.expectEqualStrings("http.disconnect", received.?.object.get("type").?.string);
+    protocol.jsonValueDeinit(received.?, test_allocator);
+
+    // The queue is released only once the application is done with it
+    queue.removeStreamQueue(1);
+    try testing.expectError(error.StreamNotFound, queue.receiveFromStream(1));
+}
+
+test "Reset with no receiver waiting still disconnects and cancels the task" {
+    var queue = protocol.Http2StreamMessageQueue.init(test_allocator);
+    defer queue.deinit();
+
+    try queue.createStreamQueue(1);
+    try queue.pushToStream(1, try protocol.createHttpRequestMessage(test_allocator, null, true));
+
+    const Task = struct {
+        var cancelled: ?u31 = null;
+        fn cancel(context: ?*anyopaque, stream_id: u31) void {
+            _ = context;
+            cancelled = stream_id;
+        }
+    };
+    try queue.setCanceller(1, .{ .context = null, .cancel = Task.cancel });
+
+    queue.cancelStream(1);
+    try testing.expectEqual(@as(?u31, 1), Task.cancelled);
+    try testing.expect(queue.isCancelled(1));
+
+    // The undelivered request is dropped; every receive until the queue is
+    // removed reports the disconnect
+    for (0..2) |_| {
+        const message = try queue.receiveFromStream(1);
+        defer protocol.jsonValueDeinit(message, test_allocator);
+        try testing.expectEqualStrings("http.disconnect", message.object.get("type").?.string);
+    }
+
+    // A finished stream disconnects too, but leaves its task alone
+    try queue.createStreamQueue(3);
+    try queue.setCanceller(3, .{ .context = null, .cancel = Task.cancel });
+    queue.endStream(3);
+    try testing.expectEqual(@as(?u31, 1), Task.cancelled);
+    try testing.expect(queue.isCancelled(3));
+}
+
+fn openRequest(handler: *h2_integration.Http2AsgiHandler, encoder: *hpack.HpackEncoder, stream_id: u31) !void {
+    const block = try encodeRequestHeaders(encoder, &.{});
+    defer test_allocator.free(block);
+
+    try handler.processFrame(.{
+        .header = .{
+            .length = @intCast(block.len),
+            .frame_type = .HEADERS,
+            .flags = h2_frames.FrameFlags.END_HEADERS | h2_frames.FrameFlags.END_STREAM,
+            .stream_id = stream_id,
+        },
+        .payload = block,
+    });
+}
+
+test "Response trailers end the stream with a final HEADERS frame" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+    try openRequest(&handler, &encoder, 1);
+
+    try handler.sendResponse(1, 200, &.{.{ "content-type", "application/grpc" }}, "body", &.{.{ "grpc-status", "0" }});
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    try handler.flush(fds[1]);
+
+    var out: [256]u8 = undefined;
+    const n = try std.posix.read(fds[0], &out);
+
+    var offset: usize = 0;
+    const expected = [_]struct { h2_frames.FrameType, u8 }{
+        .{ .HEADERS, h2_frames.FrameFlags.END_HEADERS },
+        .{ .DATA, 0 },
+        .{ .HEADERS, h2_frames.FrameFlags.END_HEADERS | h2_frames.FrameFlags.END_STREAM },
+    };
+    for (expected) |frame_spec| {
+        const frame = try h2_frames.Frame.parse(out[offset..n]);
+        try testing.expectEqual(frame_spec[0], frame.header.frame_type);
+        try testing.expectEqual(frame_spec[1], frame.header.flags);
+        offset += frame.wireSize();
+    }
+    try testing.expectEqual(n, offset);
+
+    // Pseudo-headers are not allowed in trailers, and nothing of the
+    // response goes out before that is found
+    try openRequest(&handler, &encoder, 3);
+    try testing.expectError(error.InvalidTrailer, handler.sendResponse(3, 200, &.{}, "body", &.{.{ ":status", "200" }}));
+    try testing.expect(!handler.writer.hasPending());
+}
+
+test "Graceful drain finishes in-flight streams and refuses new ones" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openRequest(&handler, &encoder, 1);
+    try handler.beginDrain();
+
+    // Stream 1 is still in flight
+    try testing.expect(!handler.shouldClose());
+
+    // A stream opened after the GOAWAY is refused, not served
+    try openRequest(&handler, &encoder, 3);
+    try testing.expect(handler.stream_manager.getStream(3) == null);
+    try testing.expectEqual(@as(u31, 1), handler.last_stream_id);
+
+    try handler.sendResponse(1, 200, &.{}, "done", null);
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+    try testing.expect(handler.shouldClose());
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    try handler.flush(fds[1]);
+
+    var out: [256]u8 = undefined;
+    const n = try std.posix.read(fds[0], &out);
+
+    const goaway_frame = try h2_frames.Frame.parse(out[0..n]);
+    const goaway = try h2_frames.GoAwayFrame.parse(goaway_frame);
+    try testing.expectEqual(h2_frames.ErrorCode.NO_ERROR, goaway.error_code);
+    try testing.expectEqual(@as(u31, 1), goaway.last_stream_id);
+
+    const refused_frame = try h2_frames.Frame.parse(out[goaway_frame.wireSize()..n]);
+    const refused = try h2_frames.RstStreamFrame.parse(refused_frame);
+    try testing.expectEqual(@as(u31, 3), refused_frame.header.stream_id);
+    try testing.expectEqual(h2_frames.ErrorCode.REFUSED_STREAM, refused.error_code);
+}
+
+test "Drain deadline closes a connection with streams still open" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+    handler.lifetime.drain_timeout_ns = 0;
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openRequest(&handler, &encoder, 1);
+    try handler.beginDrain();
+
+    try testing.expect(handler.stream_manager.getStream(1) != null);
+    try testing.expect(handler.shouldClose());
+}
+
+test "Connections are recycled after max_streams" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+    handler.lifetime.max_streams = 2;
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openRequest(&handler, &encoder, 1);
+    try testing.expect(!handler.isDraining());
+
+    try openRequest(&handler, &encoder, 3);
+    try testing.expect(handler.isDraining());
+    try testing.expect(handler.goaway_sent);
+    try testing.expectEqual(h2_frames.ErrorCode.NO_ERROR, handler.goaway_code);
+}
+
+test "Peer GOAWAY drains the connection" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openRequest(&handler, &encoder, 1);
+
+    const payload = [_]u8{ 0, 0, 0, 0, 0, 0, 0, 0 };
+    try handler.processFrame(.{
+        .header = .{ .length = payload.len, .frame_type = .GOAWAY, .flags = 0, .stream_id = 0 },
+        .payload = &payload,
+    });
+
+    try testing.expect(handler.isDraining());
+    try testing.expect(!handler.shouldClose());
+
+    try handler.sendResponse(1, 204, &.{}, null, null);
+    try testing.expect(handler.shouldClose());
+}
+
+fn windowUpdate(handler: *h2_integration.Http2AsgiHandler, stream_id: u31, increment: u32) !void {
+    var payload: [4]u8 = undefined;
+    std.mem.writeInt(u32, &payload, increment, .big);
+    try handler.processFrame(.{
+        .header = .{ .length = payload.len, .frame_type = .WINDOW_UPDATE, .flags = 0, .stream_id = stream_id },
+        .payload = &payload,
+    });
+}
+
+test "WINDOW_UPDATE rejects zero increments and window overflow" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    // The reserved bit is ignored rather than read as part of the increment
+    try windowUpdate(&handler, 0, 0x8000_0001);
+    try testing.expectEqual(@as(i32, 65537), handler.stream_manager.connection_window_size);
+
+    // On the connection both are connection errors
+    try testing.expectError(error.ProtocolError, windowUpdate(&handler, 0, 0));
+    try testing.expectError(error.FlowControlError, windowUpdate(&handler, 0, 0x7FFF_FFFF));
+    try testing.expectEqual(h2_frames.ErrorCode.FLOW_CONTROL_ERROR, h2_integration.connectionErrorCode(error.FlowControlError).?);
+
+    // On a stream they reset only that stream
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openRequest(&handler, &encoder, 1);
+    try windowUpdate(&handler, 1, 0);
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+
+    try openRequest(&handler, &encoder, 3);
+    try windowUpdate(&handler, 3, 0x7FFF_FFFF);
+    try testing.expect(handler.stream_manager.getStream(3) == null);
+
+    var out: [128]u8 = undefined;
+    var frames: [4]h2_frames.Frame = undefined;
+    const sent = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(@as(usize, 2), sent.len);
+    try testing.expectEqual(h2_frames.ErrorCode.PROTOCOL_ERROR, (try h2_frames.RstStreamFrame.parse(sent[0])).error_code);
+    try testing.expectEqual(h2_frames.ErrorCode.FLOW_CONTROL_ERROR, (try h2_frames.RstStreamFrame.parse(sent[1])).error_code);
+}
+
+fn applySetting(handler: *h2_integration.Http2AsgiHandler, id: h2_frames.SettingsId, value: u32) !void {
+    var settings_frame = h2_frames.SettingsFrame.init(test_allocator);
+    defer settings_frame.deinit();
+    try settings_frame.addSetting(id, value);
+
+    const payload = try settings_frame.serialize(test_allocator);
+    defer test_allocator.free(payload);
+    try handler.processFrame(.{
+        .header = .{ .length = @intCast(payload.len), .frame_type = .SETTINGS, .flags = 0, .stream_id = 0 },
+        .payload = payload,
+    });
+}
+
+test "A body larger than the send window waits for WINDOW_UPDATE" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65535);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    var out: [512]u8 = undefined;
+    var frames: [8]h2_frames.Frame = undefined;
+
+    // Streams start with a 10-byte window
+    try applySetting(&handler, .INITIAL_WINDOW_SIZE, 10);
+    _ = try flushFrames(&handler, &out, &frames);
+    try openRequest(&handler, &encoder, 1);
+
+    // The body is lent only until the flush; what waits is a copy
+    var body = [_]u8{'a'} ** 10 ++ [_]u8{'b'} ** 10 ++ [_]u8{'c'} ** 5;
+    try handler.sendResponse(1, 200, &.{}, &body, &.{.{ "grpc-status", "0" }});
+    var written = try flushFrames(&handler, &out, &frames);
+    @memset(&body, 'x');
+
+    try testing.expectEqual(@as(usize, 2), written.len);
+    try testing.expectEqual(h2_frames.FrameType.DATA, written[1].header.frame_type);
+    try testing.expectEqual(@as(u8, 0), written[1].header.flags);
+    try testing.expectEqualStrings("a" ** 10, written[1].payload);
+    try testing.expect(handler.stream_manager.getStream(1) != null);
+
+    // Each WINDOW_UPDATE lets that much more out
+    try windowUpdate(&handler, 1, 10);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(@as(usize, 1), written.len);
+    try testing.expectEqualStrings("b" ** 10, written[0].payload);
+
+    // The rest, then the trailers end the stream
+    try windowUpdate(&handler, 1, 100);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(@as(usize, 2), written.len);
+    try testing.expectEqualStrings("c" ** 5, written[0].payload);
+    try testing.expectEqual(@as(u8, 0), written[0].header.flags);
+    try testing.expectEqual(h2_frames.FrameType.HEADERS, written[1].header.frame_type);
+    try testing.expectEqual(h2_frames.FrameFlags.END_HEADERS | h2_frames.FrameFlags.END_STREAM, written[1].header.flags);
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+    try testing.expectEqual(@as(i32, 65535 - 25), handler.stream_manager.connection_window_size);
+
+    // Nothing is sent past the connection's window either
+    try openRequest(&handler, &encoder, 3);
+    handler.stream_manager.connection_window_size = 4;
+    try handler.sendResponse(3, 200, &.{}, "0123456789", null);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqualStrings("0123", written[1].payload);
+
+    try windowUpdate(&handler, 0, 6);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqualStrings("456789", written[0].payload);
+    try testing.expectEqual(h2_frames.FrameFlags.END_STREAM, written[0].header.flags);
+}
+
+test "A send window the client shrinks holds output until it reopens" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65535);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    var out: [512]u8 = undefined;
+    var frames: [8]h2_frames.Frame = undefined;
+
+    try applySetting(&handler, .INITIAL_WINDOW_SIZE, 16);
+    _ = try flushFrames(&handler, &out, &frames);
+    try openRequest(&handler, &encoder, 1);
+
+    try handler.sendResponse(1, 200, &.{}, "0123456789abcdefghij", null);
+    var written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqualStrings("0123456789abcdef", written[1].payload);
+
+    // Shrinking by 12 leaves the stream 12 bytes in debt (RFC 9113
+    // section 6.9.2); paying it off sends nothing
+    try applySetting(&handler, .INITIAL_WINDOW_SIZE, 4);
+    try testing.expectEqual(@as(i32, -12), handler.stream_manager.getStream(1).?.window_size);
+    try windowUpdate(&handler, 1, 12);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(@as(usize, 1), written.len);
+    try testing.expectEqual(h2_frames.FrameType.SETTINGS, written[0].header.frame_type);
+
+    // Growing the setting again opens the window for the rest
+    try applySetting(&handler, .INITIAL_WINDOW_SIZE, 8);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(@as(usize, 2), written.len);
+    try testing.expectEqualStrings("ghij", written[1].payload);
+    try testing.expectEqual(h2_frames.FrameFlags.END_STREAM, written[1].header.flags);
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+}
+
+/// Append a masked client WebSocket frame to `out`
+fn appendWebSocketFrame(out: *std.ArrayList(u8), opcode: websocket_frame.Opcode, payload: []const u8) !void {
+    const key = [_]u8{ 0x37, 0xFA, 0x21, 0x3D };
+    var header_buf: [websocket_frame.max_header_size]u8 = undefined;
+    try out.appendSlice(websocket_frame.writeHeader(&header_buf, true, opcode, payload.len, key));
+
+    const start = out.items.len;
+    try out.appendSlice(payload);
+    for (out.items[start..], 0..) |*byte, i| byte.* ^= key[i % 4];
+}
+
+fn openWebSocket(handler: *h2_integration.Http2AsgiHandler, encoder: *hpack.HpackEncoder, stream_id: u31, method: []const u8) !void {
+    const block = try encoder.encode(&[_]hpack.HeaderField{
+        .{ .name = ":method", .value = method },
+        .{ .name = ":protocol", .value = "websocket" },
+        .{ .name = ":scheme", .value = "https" },
+        .{ .name = ":path", .value = "/chat" },
+        .{ .name = ":authority", .value = "example.com" },
+    });
+    defer test_allocator.free(block);
+
+    try handler.processFrame(.{
+        .header = .{ .length = @intCast(block.len), .frame_type = .HEADERS, .flags = h2_frames.FrameFlags.END_HEADERS, .stream_id = stream_id },
+        .payload = block,
+    });
+}
+
+fn sendStreamData(handler: *h2_integration.Http2AsgiHandler, stream_id: u31, data: []const u8, end_stream: bool) !void {
+    try handler.processFrame(.{
+        .header = .{
+            .length = @intCast(data.len),
+            .frame_type = .DATA,
+            .flags = if (end_stream) h2_frames.FrameFlags.END_STREAM else 0,
+            .stream_id = stream_id,
+        },
+        .payload = data,
+    });
+}
+
+/// Flush the handler and return its output frames other than WINDOW_UPDATE
+fn flushFrames(handler: *h2_integration.Http2AsgiHandler, out: []u8, frames: []h2_frames.Frame) ![]h2_frames.Frame {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    try handler.flush(fds[1]);
+    const n = try std.posix.read(fds[0], out);
+
+    var count: usize = 0;
+    var offset: usize = 0;
+    while (offset < n) {
+        const frame = try h2_frames.Frame.parse(out[offset..n]);
+        offset += frame.wireSize();
+        if (frame.header.frame_type == .WINDOW_UPDATE) continue;
+        frames[count] = frame;
+        count += 1;
+    }
+    return frames[0..count];
+}
+
+test "Extended CONNECT carries a WebSocket on a stream" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    var out: [1024]u8 = undefined;
+    var frames: [8]h2_frames.Frame = undefined;
+
+    // The preface advertises SETTINGS_ENABLE_CONNECT_PROTOCOL
+    try handler.sendServerPreface();
+    const preface = try flushFrames(&handler, &out, &frames);
+    var settings = try h2_frames.SettingsFrame.parse(test_allocator, preface[0].payload);
+    defer settings.deinit();
+    var advertised = false;
+    for (settings.settings.items) |setting| {
+        if (setting.id == .ENABLE_CONNECT_PROTOCOL) advertised = setting.value == 1;
+    }
+    try testing.expect(advertised);
+
+    try openWebSocket(&handler, &encoder, 1, "CONNECT");
+    const connect = try handler.message_queue.receiveFromStream(1);
+    try testing.expectEqualStrings("websocket.connect", connect.object.get("type").?.string);
+    protocol.jsonValueDeinit(connect, test_allocator);
+
+    // Accepting answers 200 and leaves the stream open
+    const accept = try protocol.createWebSocketAcceptMessage(test_allocator, null, null);
+    defer protocol.jsonValueDeinit(accept, test_allocator);
+    try handler.sendWebSocketEvent(1, accept);
+    var written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(@as(usize, 1), written.len);
+    try testing.expectEqual(h2_frames.FrameType.HEADERS, written[0].header.frame_type);
+    try testing.expectEqual(h2_frames.FrameFlags.END_HEADERS, written[0].header.flags);
+
+    // A WebSocket frame split over two DATA frames is one message
+    var wire = std.ArrayList(u8).init(test_allocator);
+    defer wire.deinit();
+    try appendWebSocketFrame(&wire, .text, "hello");
+    try sendStreamData(&handler, 1, wire.items[0..3], false);
+    try sendStreamData(&handler, 1, wire.items[3..], false);
+
+    const receive = try handler.message_queue.receiveFromStream(1);
+    try testing.expectEqualStrings("websocket.receive", receive.object.get("type").?.string);
+    const text = receive.object.get("text").?.string;
+    try testing.expectEqualStrings("hello", text);
+    test_allocator.free(text);
+    protocol.jsonValueDeinit(receive, test_allocator);
+
+    // Sends become unmasked frames in DATA
+    const send = try protocol.createWebSocketSendBinaryMessage(test_allocator, "abc");
+    defer protocol.jsonValueDeinit(send, test_allocator);
+    try handler.sendWebSocketEvent(1, send);
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(h2_frames.FrameType.DATA, written[0].header.frame_type);
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x82, 0x03, 'a', 'b', 'c' }, written[0].payload);
+
+    // The peer's close is answered and ends our side of the stream
+    wire.clearRetainingCapacity();
+    try appendWebSocketFrame(&wire, .close, &[_]u8{ 0x03, 0xE8 });
+    try sendStreamData(&handler, 1, wire.items, false);
+
+    written = try flushFrames(&handler, &out, &frames);
+    try testing.expectEqual(h2_frames.FrameFlags.END_STREAM, written[0].header.flags);
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x88, 0x02, 0x03, 0xE8 }, written[0].payload);
+
+    const disconnect = try handler.message_queue.receiveFromStream(1);
+    try testing.expectEqualStrings("websocket.disconnect", disconnect.object.get("type").?.string);
+    try testing.expectEqual(@as(i64, 1000), disconnect.object.get("code").?.integer);
+    protocol.jsonValueDeinit(disconnect, test_allocator);
+
+    // Once the peer ends its side the stream is gone; the queue stays
+    // until the application returns
+    try sendStreamData(&handler, 1, "", true);
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+    try testing.expectEqual(@as(u32, 0), handler.tunnels.count());
+    try handler.finishWebSocket(1);
+    try testing.expectError(error.StreamNotFound, handler.message_queue.receiveFromStream(1));
+}
+
+test "Extended CONNECT must use the CONNECT method" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openWebSocket(&handler, &encoder, 1, "GET");
+    try testing.expect(handler.stream_manager.getStream(1) == null);
+
+    var out: [256]u8 = undefined;
+    var frames: [4]h2_frames.Frame = undefined;
+    const written = try flushFrames(&handler, &out, &frames);
+    const reset = try h2_frames.RstStreamFrame.parse(written[0]);
+    try testing.expectEqual(h2_frames.ErrorCode.PROTOCOL_ERROR, reset.error_code);
+
+    // A malformed request resets its stream, not the connection
+    try testing.expect(!handler.goaway_sent);
+}
+
+test "Requests are handed over with their scope and events" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+    handler.server = .{ .host = "10.0.0.1", .port = 8443 };
+    handler.client = .{ .host = "10.0.0.2", .port = 50000 };
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+
+    try openRequest(&handler, &encoder, 1);
+
+    const ready = handler.takeReady().?;
+    defer ready.destroy(test_allocator);
+    try testing.expect(handler.takeReady() == null);
+    try testing.expectEqual(@as(u31, 1), ready.stream_id);
+    try testing.expect(!ready.websocket);
+
+    const scope = ready.scope.object;
+    try testing.expectEqualStrings("/test", scope.get("path").?.string);
+    try testing.expectEqualStrings("10.0.0.1", scope.get("server").?.array.items[0].string);
+    try testing.expectEqualStrings("10.0.0.2", scope.get("client").?.array.items[0].string);
+
+    const request = try handler.message_queue.receiveFromStream(1);
+    try testing.expectEqualStrings("http.request", request.object.get("type").?.string);
+    protocol.jsonValueDeinit(request, test_allocator);
+    handler.message_queue.removeStreamQueue(1);
+
+    // A request missing :path is malformed: its stream is reset and never
+    // reaches the application
+    const block = try encoder.encode(&[_]hpack.HeaderField{
+        .{ .name = ":method", .value = "GET" },
+        .{ .name = ":scheme", .value = "https" },
+    });
+    defer test_allocator.free(block);
+    try handler.processFrame(.{
+        .header = .{
+            .length = @intCast(block.len),
+            .frame_type = .HEADERS,
+            .flags = h2_frames.FrameFlags.END_HEADERS | h2_frames.FrameFlags.END_STREAM,
+            .stream_id = 3,
+        },
+        .payload = block,
+    });
+    try testing.expect(handler.takeReady() == null);
+
+    var out: [256]u8 = undefined;
+    var frames: [4]h2_frames.Frame = undefined;
+    const written = try flushFrames(&handler, &out, &frames);
+    const reset = try h2_frames.RstStreamFrame.parse(written[0]);
+    try testing.expectEqual(@as(u31, 3), written[0].header.stream_id);
+    try testing.expectEqual(h2_frames.ErrorCode.PROTOCOL_ERROR, reset.error_code);
+}
+
+test "Timer turns recycle idle connections and end stalled drains" {
+    var handler = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer handler.deinit();
+    handler.lifetime.max_age_ns = 0;
+
+    // Nothing was read, yet the connection is past its age and has no
+    // streams: it drains and closes
+    try testing.expect(!try handler.tick());
+    try testing.expect(handler.goaway_sent);
+
+    var draining = try h2_integration.Http2AsgiHandler.init(test_allocator, 65536);
+    defer draining.deinit();
+    draining.lifetime.drain_timeout_ns = 0;
+
+    var encoder = hpack.HpackEncoder.init(test_allocator, 4096);
+    defer encoder.deinit();
+    try openRequest(&draining, &encoder, 1);
+    try testing.expect(try draining.tick());
+
+    // The peer goes quiet with a stream open; the drain deadline still
+    // closes the connection
+    try draining.beginDrain();
+    try testing.expect(!try draining.tick());
+}
@@ -0,0 +1,144 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const websocket = @import("../websocket/server.zig");
+const frame = websocket.frame;
+
+pub const Opcode = frame.Opcode;
+pub const isValidCloseCode = websocket.isValidCloseCode;
+
+/// Largest message accepted on a WebSocket stream unless configured
+/// otherwise
+pub const default_max_message_size = websocket.default_max_message_size;
+
+/// Something received on a WebSocket stream. Data is borrowed until the
+/// next `feed`.
+pub const Event = union(enum) {
+    /// Complete data message, reassembled if it arrived in fragments
+    message: struct {
+        type: websocket.MessageType,
+        data: []const u8,
+    },
+    ping: []const u8,
+    pong,
+    /// Close frame; 1005 when it carried no code
+    close: u16,
+};
+
+/// WebSocket carried on an HTTP/2 extended CONNECT stream (RFC 8441). The
+/// stream's DATA frames hold the RFC 6455 byte stream, client frames still
+/// masked, so only the handshake differs from an upgraded HTTP/1.1
+/// connection. Frame boundaries need not line up with DATA frames.
+///
+/// permessage-deflate is not negotiated on these streams, so every frame
+/// arrives uncompressed.
+pub const Tunnel = struct {
+    const Self = @This();
+
+    allocator: Allocator,
+    reader: frame.FrameReader,
+    /// Data message being reassembled
+    fragments: std.ArrayList(u8),
+    fragment_type: ?websocket.MessageType = null,
+    max_message_size: usize,
+    /// The application sent websocket.accept and got its 200
+    accepted: bool = false,
+    /// Our close frame is out and our side of the stream has ended
+    close_sent: bool = false,
+    /// websocket.disconnect is queued for the application; anything the
+    /// peer sends after that is dropped
+    disconnected: bool = false,
+
+    pub fn init(allocator: Allocator, max_message_size: usize) Self {
+        return Self{
+            .allocator = allocator,
+            .reader = frame.FrameReader.init(allocator, max_message_size, true),
+            .fragments = std.ArrayList(u8).init(allocator),
+            .max_message_size = max_message_size,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.reader.deinit();
+        self.fragments.deinit();
+    }
+
+    /// Append the payload of a DATA frame
+    pub fn feed(self: *Self, data: []const u8) !void {
+        try self.reader.feed(data);
+    }
+
+    /// Next event from the bytes fed so far, or null once they hold no
+    /// complete frame
+    pub fn next(self: *Self) !?Event {
+        while (try self.reader.next()) |next_frame| {
+            switch (next_frame.opcode) {
+                .text, .binary => {
+                    // A new data message may not start inside another one
+                    if (self.fragment_type != null) return error.ProtocolError;
+
+                    const message_type: websocket.MessageType = if (next_frame.opcode == .text) .text else .binary;
+                    if (next_frame.fin) {
+                        return Event{ .message = .{ .type = message_type, .data = next_frame.payload } };
+                    }
+
+                    self.fragment_type = message_type;
+                    self.fragments.clearRetainingCapacity();
+                    try self.appendFragment(next_frame.payload);
+                },
+                .continuation => {
+                    const message_type = self.fragment_type orelse return error.ProtocolError;
+                    try self.appendFragment(next_frame.payload);
+
+                    if (next_frame.fin) {
+                        self.fragment_type = null;
+                        return Event{ .message = .{ .type = message_type, .data = self.fragments.items } };
+                    }
+                },
+                .ping => return Event{ .ping = next_frame.payload },
+                .pong => return .pong,
+                .close => {
+                    try websocket.validateClosePayload(next_frame.payload);
+                    return Event{ .close = websocket.closeCode(next_frame.payload) };
+                },
+                _ => return error.InvalidOpcode,
+            }
+        }
+        return null;
+    }
+
+    fn appendFragment(self: *Self, payload: []const u8) !void {
+        if (self.fragments.items.len + payload.len > self.max_message_size) return error.MessageTooBig;
+        try self.fragments.appendSlice(payload);
+    }
+};
+
+/// Encode an unmasked server frame. The caller owns the returned bytes.
+pub fn encodeFrame(allocator: Allocator, opcode: frame.Opcode, payload: []const u8) ![]u8 {
+    var header_buf: [frame.max_header_size]u8 = undefined;
+    const header = frame.writeHeader(&header_buf, true, opcode, payload.len, null);
+
+    const bytes = try allocator.alloc(u8, header.len + payload.len);
+    @memcpy(bytes[0..header.len], header);
+    @memcpy(bytes[header.len..], payload);
+    return bytes;
+}
+
+/// Payload of a close frame; control frames are limited to 125 bytes, so
+/// the reason is cut to fit on a character boundary
+pub fn closePayload(buf: *[125]u8, code: u16, reason: []const u8) []const u8 {
+    std.mem.writeInt(u16, buf[0..2], code, .big);
+
+    const kept = websocket.closeReason(reason);
+    @memcpy(buf[2..][0..kept.len], kept);
+    return buf[0 .. 2 + kept.len];
+}
+
+/// Close code for a stream whose WebSocket framing failed
+pub fn errorCloseCode(err: anyerror) u16 {
+    return switch (err) {
+        error.MessageTooBig, error.FrameTooLarge, error.ReadBufferFull => 1009,
+        error.InvalidUtf8 => 1007,
+        else => 1002,
+    };
+}
@@ -0,0 +1,91 @@
+const std = @import("std");
+const testing = std.testing;
+const h2_websocket = @import("h2_websocket.zig");
+const frame = @import("../websocket/frame.zig");
+const mask = @import("../websocket/mask.zig");
+const websocket = @import("../websocket/server.zig");
+
+const test_key = [_]u8{ 0x37, 0xFA, 0x21, 0x3D };
+
+/// Append a client frame (masked with `test_key`) to `out`
+fn appendClientFrame(out: *std.ArrayList(u8), fin: bool, opcode: frame.Opcode, payload: []const u8) !void {
+    var header_buf: [frame.max_header_size]u8 = undefined;
+    try out.appendSlice(frame.writeHeader(&header_buf, fin, opcode, payload.len, test_key));
+
+    const start = out.items.len;
+    try out.appendSlice(payload);
+    mask.applyMask(test_key, out.items[start..], 0);
+}
+
+test "Tunnel reassembles frames split across DATA frames" {
+    var tunnel = h2_websocket.Tunnel.init(testing.allocator, 1024);
+    defer tunnel.deinit();
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, false, .text, "hel");
+    try appendClientFrame(&wire, true, .ping, "mid");
+    try appendClientFrame(&wire, true, .continuation, "lo");
+    try appendClientFrame(&wire, true, .close, &[_]u8{ 0x03, 0xE8 });
+
+    // DATA frame boundaries fall inside WebSocket frames
+    try tunnel.feed(wire.items[0..4]);
+    try testing.expect(try tunnel.next() == null);
+    try tunnel.feed(wire.items[4..]);
+
+    const ping = (try tunnel.next()).?;
+    try testing.expectEqualStrings("mid", ping.ping);
+
+    const message = (try tunnel.next()).?;
+    try testing.expectEqual(websocket.MessageType.text, message.message.type);
+    try testing.expectEqualStrings("hello", message.message.data);
+
+    try testing.expectEqual(@as(u16, 1000), (try tunnel.next()).?.close);
+    try testing.expect(try tunnel.next() == null);
+}
+
+test "Tunnel rejects unmasked frames and oversized messages" {
+    var unmasked = h2_websocket.Tunnel.init(testing.allocator, 1024);
+    defer unmasked.deinit();
+    try unmasked.feed(&[_]u8{ 0x82, 0x00 });
+    try testing.expectError(error.UnmaskedFrame, unmasked.next());
+
+    var limited = h2_websocket.Tunnel.init(testing.allocator, 4);
+    defer limited.deinit();
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, false, .binary, "abc");
+    try appendClientFrame(&wire, true, .continuation, "de");
+    try limited.feed(wire.items);
+    try testing.expectError(error.MessageTooBig, limited.next());
+    try testing.expectEqual(@as(u16, 1009), h2_websocket.errorCloseCode(error.MessageTooBig));
+}
+
+test "Tunnel rejects close frames with an invalid code" {
+    var tunnel = h2_websocket.Tunnel.init(testing.allocator, 1024);
+    defer tunnel.deinit();
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    // 1006 is only ever reported locally
+    try appendClientFrame(&wire, true, .close, &[_]u8{ 0x03, 0xEE });
+    try tunnel.feed(wire.items);
+    try testing.expectError(error.ProtocolError, tunnel.next());
+    try testing.expectEqual(@as(u16, 1002), h2_websocket.errorCloseCode(error.ProtocolError));
+}
+
+test "encodeFrame writes an unmasked server frame" {
+    const bytes = try h2_websocket.encodeFrame(testing.allocator, .binary, "abc");
+    defer testing.allocator.free(bytes);
+
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x82, 0x03, 'a', 'b', 'c' }, bytes);
+
+    var buf: [125]u8 = undefined;
+    const long_reason = "x" ** 200;
+    try testing.expectEqual(@as(usize, 125), h2_websocket.closePayload(&buf, 1001, long_reason).len);
+
+    // Two-byte characters: the one across the limit is left out
+    const accented = "\u{E9}" ** 100;
+    try testing.expectEqualStrings("\u{E9}" ** 61, h2_websocket.closePayload(&buf, 1001, accented)[2..]);
+}
@@ -29,6 +29,38 @@ pub fn jsonValueDeinit(value: json.Value, allocator: Allocator) void {
     }
 }
 
+/// Free an event along with its `bytes`, `text` or `body` string, for
+/// events whose producer copied the payload into memory of their own.
+/// Anything else is freed as by `jsonValueDeinit`.
+pub fn eventDeinit(message: json.Value, allocator: Allocator) void {
+    if (message == .object) {
+        for ([_][]const u8{ "bytes", "text", "body" }) |key| {
+            if (message.object.get(key)) |value| {
+                if (value == .string) allocator.free(value.string);
+            }
+        }
+    }
+    jsonValueDeinit(message, allocator);
+}
+
+/// Bytes of body data an event carries: its `bytes`, `text` or `body`
+/// strings, or the size recorded for its payload object. Used to account
+/// for queued events.
+pub fn messagePayloadSize(message: json.Value) usize {
+    if (message != .object) return 0;
+
+    var size: usize = 0;
+    for ([_][]const u8{ "bytes", "text", "body" }) |key| {
+        if (message.object.get(key)) |value| {
+            if (value == .string) size += value.string.len;
+        }
+    }
+    if (message.object.get(payload_size_key)) |value| {
+        if (value == .integer) size += @intCast(value.integer);
+    }
+    return size;
+}
+
 /// ASGI specification version
 pub const AsgiVersion = struct {
     version: []const u8 = "3.0",
@@ -38,7 +70,6 @@ pub const AsgiVersion = struct {
 // OPTIMIZATION 3: Concurrency - Replace mutex-based queue with lock-free alternatives
 // OPTIMIZATION 8: Protocol-Specific - Implement message batching for better throughput
 // UVICORN PARITY: Add message priority handling for different ASGI event types
-// UVICORN PARITY: Add queue size limits and backpressure handling
 /// ASGI Message Queue for communication with the application
 pub const MessageQueue = struct {
     const Self = @This();
@@ -46,6 +77,17 @@ pub const MessageQueue = struct {
     messages: std.ArrayList(json.Value),
     mutex: std.Thread.Mutex = .{},
     condition: std.Thread.Condition = .{},
+    /// Payload bytes (see `messagePayloadSize`) pushed and not yet
+    /// released by the consumer; only counted when `max_pending_bytes` is set
+    pending_bytes: usize = 0,
+    /// `pushBounded` waits while `pending_bytes` is at least this; 0 turns
+    /// the accounting off
+    max_pending_bytes: usize = 0,
+    /// Signalled when `release` makes room
+    room: std.Thread.Condition = .{},
+    /// Whether pushed events own their payload strings (see `eventDeinit`),
+    /// for `dispose` to free them
+    owns_events: bool = false,
 
     /// Initialize a new message queue
     pub fn init(allocator: Allocator) Self {
@@ -60,7 +102,56 @@ pub const MessageQueue = struct {
         self.mutex.lock();
         defer self.mutex.unlock();
 
+        try self.appendLocked(message);
+    }
+
+    /// Push a message, first waiting while the consumer has
+    /// `max_pending_bytes` or more still to release. A single message
+    /// larger than the limit is let through once the queue drains below it.
+    pub fn pushBounded(self: *Self, message: json.Value) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (self.max_pending_bytes != 0 and self.pending_bytes >= self.max_pending_bytes) {
+            self.room.wait(&self.mutex);
+        }
+        try self.appendLocked(message);
+    }
+
+    /// Report that `size` payload bytes taken from the queue have been
+    /// dealt with, waking producers waiting for room
+    pub fn release(self: *Self, size: usize) void {
+        if (size == 0) return;
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.max_pending_bytes == 0) return;
+        self.pending_bytes -|= size;
+        if (self.pending_bytes < self.max_pending_bytes) self.room.broadcast();
+    }
+
+    /// Hand back an event taken from the queue once the consumer has made
+    /// its own copy: its payload bytes are released and, if the queue owns
+    /// its events, it is freed
+    pub fn dispose(self: *Self, message: json.Value) void {
+        self.release(messagePayloadSize(message));
+        if (self.owns_events) eventDeinit(message, self.allocator);
+    }
+
+    /// Stop bounding the queue, letting producers waiting in `pushBounded`
+    /// go ahead. For when nothing will consume the queue any more.
+    pub fn unbound(self: *Self) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.max_pending_bytes = 0;
+        self.room.broadcast();
+    }
+
+    fn appendLocked(self: *Self, message: json.Value) !void {
         try self.messages.append(message);
+        if (self.max_pending_bytes != 0) self.pending_bytes += messagePayloadSize(message);
         self.condition.signal();
     }
 
@@ -83,6 +174,15 @@ pub const MessageQueue = struct {
         return message;
     }
 
+    /// Take the oldest message without waiting, or null if there is none
+    pub fn tryReceive(self: *Self) ?json.Value {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.messages.items.len == 0) return null;
+        return self.messages.orderedRemove(0);
+    }
+
     /// Free all resources associated with the queue
     pub fn deinit(self: *Self) void {
         self.mutex.lock();
@@ -98,20 +198,35 @@ pub const MessageQueue = struct {
 pub const Http2StreamMessageQueue = struct {
     const Self = @This();
 
+    /// Stops whatever serves a stream, normally its application task, when
+    /// the stream is cancelled
+    pub const Canceller = struct {
+        context: ?*anyopaque,
+        cancel: *const fn (context: ?*anyopaque, stream_id: u31) void,
+    };
+
+    /// Heap-allocated so receivers blocked on `condition` keep a stable
+    /// pointer while other streams are added to the map
     const StreamQueue = struct {
         messages: std.ArrayList(json.Value),
         condition: std.Thread.Condition = .{},
+        /// Receivers currently blocked on this stream
+        waiters: u32 = 0,
+        /// Set once the stream is reset or finished. Every later receive
+        /// gets `http.disconnect` until the queue is removed.
+        cancelled: bool = false,
+        canceller: ?Canceller = null,
     };
 
     allocator: Allocator,
-    stream_queues: std.HashMap(u31, StreamQueue, std.hash_map.AutoContext(u31), std.hash_map.default_max_load_percentage),
+    stream_queues: std.HashMap(u31, *StreamQueue, std.hash_map.AutoContext(u31), std.hash_map.default_max_load_percentage),
     global_mutex: std.Thread.Mutex = .{},
 
     /// Initialize a new HTTP/2 stream-aware message queue
     pub fn init(allocator: Allocator) Self {
         return Self{
             .allocator = allocator,
-            .stream_queues = std.HashMap(u31, StreamQueue, std.hash_map.AutoContext(u31), std.hash_map.default_max_load_percentage).init(allocator),
+            .stream_queues = std.HashMap(u31, *StreamQueue, std.hash_map.AutoContext(u31), std.hash_map.default_max_load_percentage).init(allocator),
         };
     }
 
@@ -124,7 +239,9 @@ pub const Http2StreamMessageQueue = struct {
             return; // Queue already exists
         }
 
-        const stream_queue = StreamQueue{
+        const stream_queue = try self.allocator.create(StreamQueue);
+        errdefer self.allocator.destroy(stream_queue);
+        stream_queue.* = StreamQueue{
             .messages = std.ArrayList(json.Value).init(self.allocator),
         };
 
@@ -136,40 +253,121 @@ pub const Http2StreamMessageQueue = struct {
         self.global_mutex.lock();
         defer self.global_mutex.unlock();
 
-        var stream_queue = self.stream_queues.getPtr(stream_id) orelse {
+        const stream_queue = self.stream_queues.get(stream_id) orelse {
             return error.StreamNotFound;
         };
 
+        // Nobody will read it
+        if (stream_queue.cancelled) {
+            jsonValueDeinit(message, self.allocator);
+            return;
+        }
+
         try stream_queue.messages.append(message);
         stream_queue.condition.signal();
     }
 
-    /// Receive a message from a specific stream queue
+    /// Register what to stop when the stream is cancelled
+    pub fn setCanceller(self: *Self, stream_id: u31, canceller: Canceller) !void {
+        self.global_mutex.lock();
+        defer self.global_mutex.unlock();
+
+        const stream_queue = self.stream_queues.get(stream_id) orelse {
+            return error.StreamNotFound;
+        };
+        stream_queue.canceller = canceller;
+    }
+
+    /// Receive a message from a specific stream queue. Once the stream has
+    /// been cancelled this returns `http.disconnect`.
     pub fn receiveFromStream(self: *Self, stream_id: u31) !json.Value {
         self.global_mutex.lock();
         defer self.global_mutex.unlock();
 
-        var stream_queue = self.stream_queues.getPtr(stream_id) orelse {
+        const stream_queue = self.stream_queues.get(stream_id) orelse {
             return error.StreamNotFound;
         };
 
-        while (stream_queue.messages.items.len == 0) {
+        while (stream_queue.messages.items.len == 0 and !stream_queue.cancelled) {
+            stream_queue.waiters += 1;
             stream_queue.condition.wait(&self.global_mutex);
+            stream_queue.waiters -= 1;
         }
 
+        if (stream_queue.cancelled) return createHttpDisconnectMessage(self.allocator);
+
+        return stream_queue.messages.orderedRemove(0);
+    }
+
+    /// Take the oldest message for a stream without waiting. Returns null
+    /// when there is none, and once the stream has been cancelled.
+    pub fn takeFromStream(self: *Self, stream_id: u31) ?json.Value {
+        self.global_mutex.lock();
+        defer self.global_mutex.unlock();
+
+        const stream_queue = self.stream_queues.get(stream_id) orelse return null;
+        if (stream_queue.cancelled or stream_queue.messages.items.len == 0) return null;
         return stream_queue.messages.orderedRemove(0);
     }
 
-    /// Remove a stream queue when the stream is closed
+    /// Cancel a stream the peer reset. Undelivered messages are dropped,
+    /// receivers get `http.disconnect` from now on, blocked ones right away,
+    /// and the stream's canceller stops its application task.
+    pub fn cancelStream(self: *Self, stream_id: u31) void {
+        const canceller = self.endStreamLocked(stream_id, true) orelse return;
+        canceller.cancel(canceller.context, stream_id);
+    }
+
+    /// Mark a stream finished: as `cancelStream`, except that the
+    /// application task, which may still be running after its response, is
+    /// left alone
+    pub fn endStream(self: *Self, stream_id: u31) void {
+        _ = self.endStreamLocked(stream_id, false);
+    }
+
+    /// Returns the canceller to call, once the lock is released, if
+    /// `take_canceller` is set and one is registered
+    fn endStreamLocked(self: *Self, stream_id: u31, take_canceller: bool) ?Canceller {
+        self.global_mutex.lock();
+        defer self.global_mutex.unlock();
+
+        const stream_queue = self.stream_queues.get(stream_id) orelse return null;
+
+        for (stream_queue.messages.items) |message| {
+            jsonValueDeinit(message, self.allocator);
+        }
+        stream_queue.messages.clearRetainingCapacity();
+        stream_queue.cancelled = true;
+        stream_queue.condition.broadcast();
+
+        if (!take_canceller) return null;
+        defer stream_queue.canceller = null;
+        return stream_queue.canceller;
+    }
+
+    pub fn isCancelled(self: *Self, stream_id: u31) bool {
+        self.global_mutex.lock();
+        defer self.global_mutex.unlock();
+
+        const stream_queue = self.stream_queues.get(stream_id) orelse return true;
+        return stream_queue.cancelled;
+    }
+
+    /// Remove a stream queue once its application has finished with it
     pub fn removeStreamQueue(self: *Self, stream_id: u31) void {
         self.global_mutex.lock();
         defer self.global_mutex.unlock();
 
         if (self.stream_queues.fetchRemove(stream_id)) |kv| {
-            kv.value.messages.deinit();
+            self.destroyStreamQueue(kv.value);
         }
     }
 
+    fn destroyStreamQueue(self: *Self, stream_queue: *StreamQueue) void {
+        stream_queue.messages.deinit();
+        self.allocator.destroy(stream_queue);
+    }
+
     /// Free all resources associated with the queue
     pub fn deinit(self: *Self) void {
         self.global_mutex.lock();
@@ -177,12 +375,21 @@ pub const Http2StreamMessageQueue = struct {
 
         var iterator = self.stream_queues.iterator();
         while (iterator.next()) |entry| {
-            entry.value_ptr.messages.deinit();
+            self.destroyStreamQueue(entry.value_ptr.*);
         }
         self.stream_queues.deinit();
     }
 };
 
+/// Advertise the ASGI extensions the HTTP servers implement
+fn putHttpExtensions(allocator: Allocator, scope: *json.Value) !void {
+    var extensions = json.Value{
+        .object = json.ObjectMap.init(allocator),
+    };
+    try extensions.object.put("http.response.trailers", json.Value{ .object = json.ObjectMap.init(allocator) });
+    try scope.object.put("extensions", extensions);
+}
+
 // OPTIMIZATION 1: Memory Management - Use object pools for scope creation
 // OPTIMIZATION 6: Data Structure - Use native Zig structs instead of JSON for internal messaging
 // UVICORN PARITY: Add HTTP/2 specific scope fields (stream_id, push_promise support)
@@ -228,6 +435,8 @@ pub fn createHttpScope(allocator: Allocator, server_addr: []const u8, server_por
 
     try scope.object.put("headers", header_list);
 
+    try putHttpExtensions(allocator, &scope);
+
     var client = json.Value{
         .array = json.Array.init(allocator),
     };
@@ -295,6 +504,8 @@ pub fn createHttp2Scope(allocator: Allocator, server_addr: []const u8, server_po
 
     try scope.object.put("headers", header_list);
 
+    try putHttpExtensions(allocator, &scope);
+
     var client = json.Value{
         .array = json.Array.init(allocator),
     };
@@ -318,6 +529,8 @@ pub const Http2PseudoHeaders = struct {
     scheme: ?[]const u8 = null,
     authority: ?[]const u8 = null,
     path: ?[]const u8 = null,
+    /// Protocol an extended CONNECT asks for (RFC 8441 section 4)
+    protocol: ?[]const u8 = null,
 
     pub fn init() Http2PseudoHeaders {
         return Http2PseudoHeaders{};
@@ -338,6 +551,8 @@ pub const Http2PseudoHeaders = struct {
                 pseudo.authority = value;
             } else if (std.mem.eql(u8, name, ":path")) {
                 pseudo.path = value;
+            } else if (std.mem.eql(u8, name, ":protocol")) {
+                pseudo.protocol = value;
             }
         }
 
@@ -359,6 +574,8 @@ pub fn createWebSocketScope(allocator: Allocator, server_addr: []const u8, serve
     };
 
     try scope.object.put("type", json.Value{ .string = "websocket" });
+    try scope.object.put("http_version", json.Value{ .string = "1.1" });
+    try scope.object.put("scheme", json.Value{ .string = "ws" });
 
     var asgi_version = json.Value{
         .object = json.ObjectMap.init(allocator),
@@ -390,6 +607,21 @@ pub fn createWebSocketScope(allocator: Allocator, server_addr: []const u8, serve
 
     try scope.object.put("headers", header_list);
 
+    // Subprotocols offered by the client, in the order it listed them
+    var subprotocols = json.Value{
+        .array = json.Array.init(allocator),
+    };
+    for (headers) |header| {
+        if (!std.ascii.eqlIgnoreCase(header[0], "sec-websocket-protocol")) continue;
+
+        var offered = std.mem.splitScalar(u8, header[1], ',');
+        while (offered.next()) |item| {
+            const name = std.mem.trim(u8, item, " \t");
+            if (name.len > 0) try subprotocols.array.append(json.Value{ .string = name });
+        }
+    }
+    try scope.object.put("subprotocols", subprotocols);
+
     var client = json.Value{
         .array = json.Array.init(allocator),
     };
@@ -445,6 +677,17 @@ pub fn createHttpRequestMessage(allocator: Allocator, body: ?[]const u8, more_bo
     return message;
 }
 
+/// Create an HTTP disconnect message
+pub fn createHttpDisconnectMessage(allocator: Allocator) !json.Value {
+    var message = json.Value{
+        .object = json.ObjectMap.init(allocator),
+    };
+
+    try message.object.put("type", json.Value{ .string = "http.disconnect" });
+
+    return message;
+}
+
 /// Create an HTTP response start message
 pub fn createHttpResponseStartMessage(allocator: Allocator, status: u16, headers: []const [2][]const u8) !json.Value {
     var message = json.Value{
@@ -485,8 +728,33 @@ pub fn createHttpResponseBodyMessage(allocator: Allocator, body: []const u8, mor
     return message;
 }
 
-// UVICORN PARITY: Add WebSocket ping/pong message handling
-// UVICORN PARITY: Add WebSocket close code and reason support
+/// Create an HTTP response trailers message (http.response.trailers extension)
+pub fn createHttpResponseTrailersMessage(allocator: Allocator, headers: []const [2][]const u8, more_trailers: bool) !json.Value {
+    var message = json.Value{
+        .object = json.ObjectMap.init(allocator),
+    };
+
+    try message.object.put("type", json.Value{ .string = "http.response.trailers" });
+
+    var header_list = json.Value{
+        .array = json.Array.init(allocator),
+    };
+
+    for (headers) |header| {
+        var header_pair = json.Value{
+            .array = json.Array.init(allocator),
+        };
+        try header_pair.array.append(json.Value{ .string = header[0] });
+        try header_pair.array.append(json.Value{ .string = header[1] });
+        try header_list.array.append(header_pair);
+    }
+
+    try message.object.put("headers", header_list);
+    try message.object.put("more_trailers", json.Value{ .bool = more_trailers });
+
+    return message;
+}
+
 /// Create a WebSocket connect message
 pub fn createWebSocketConnectMessage(allocator: Allocator) !json.Value {
     var message = json.Value{
@@ -554,6 +822,22 @@ pub fn createWebSocketSendBinaryMessage(allocator: Allocator, bytes: []const u8)
     return message;
 }
 
+/// Create a WebSocket close message
+pub fn createWebSocketCloseMessage(allocator: Allocator, code: u16, reason: ?[]const u8) !json.Value {
+    var message = json.Value{
+        .object = json.ObjectMap.init(allocator),
+    };
+
+    try message.object.put("type", json.Value{ .string = "websocket.close" });
+    try message.object.put("code", json.Value{ .integer = code });
+
+    if (reason) |r| {
+        try message.object.put("reason", json.Value{ .string = r });
+    }
+
+    return message;
+}
+
 /// Create a WebSocket receive message
 pub fn createWebSocketReceiveMessage(allocator: Allocator, text: ?[]const u8, bytes: ?[]const u8) !json.Value {
     var message = json.Value{
@@ -573,6 +857,51 @@ pub fn createWebSocketReceiveMessage(allocator: Allocator, text: ?[]const u8, by
     return message;
 }
 
+/// Keys under which a websocket.receive event carries a handle to a payload
+/// object the server made itself, in place of the `text` or `bytes` string
+pub const text_object_key = "ladybug.text_object";
+pub const bytes_object_key = "ladybug.bytes_object";
+/// Key holding the size of the data behind a payload object, so that
+/// `messagePayloadSize` can account for it
+pub const payload_size_key = "ladybug.payload_size";
+
+/// Payload object referenced by an event
+pub const PayloadObject = struct {
+    /// Key holding the handle in the event
+    handle_key: [:0]const u8,
+    /// ASGI key the object belongs under
+    key: [:0]const u8,
+    handle: usize,
+};
+
+/// Create a WebSocket receive message whose payload is already an object
+/// of the application's runtime, identified by `handle`, made from `size`
+/// bytes of data
+pub fn createWebSocketReceiveObjectMessage(allocator: Allocator, is_text: bool, handle: usize, size: usize) !json.Value {
+    var message = json.Value{
+        .object = json.ObjectMap.init(allocator),
+    };
+
+    try message.object.put("type", json.Value{ .string = "websocket.receive" });
+    try message.object.put(if (is_text) text_object_key else bytes_object_key, json.Value{ .integer = @intCast(handle) });
+    try message.object.put(payload_size_key, json.Value{ .integer = @intCast(size) });
+
+    return message;
+}
+
+/// Payload object an event refers to, if any
+pub fn payloadObject(message: json.Value) ?PayloadObject {
+    if (message != .object) return null;
+
+    if (message.object.get(text_object_key)) |value| {
+        return PayloadObject{ .handle_key = text_object_key, .key = "text", .handle = @intCast(value.integer) };
+    }
+    if (message.object.get(bytes_object_key)) |value| {
+        return PayloadObject{ .handle_key = bytes_object_key, .key = "bytes", .handle = @intCast(value.integer) };
+    }
+    return null;
+}
+
 /// Create a WebSocket disconnect message
 pub fn createWebSocketDisconnectMessage(allocator: Allocator, code: u16) !json.Value {
     var message = json.Value{
@@ -85,6 +85,10 @@ test "createHttpScope" {
     try testing.expectEqualStrings("3.0", asgi.object.get("version").?.string);
     try testing.expectEqualStrings("2.0", asgi.object.get("spec_version").?.string);
 
+    // Check advertised extensions
+    const extensions = scope.object.get("extensions").?;
+    try testing.expect(extensions.object.get("http.response.trailers") != null);
+
     // Check headers
     const header_list = scope.object.get("headers").?;
     try testing.expectEqual(@as(usize, 2), header_list.array.items.len);
@@ -140,6 +144,23 @@ test "createWebSocketScope" {
     try testing.expectEqualStrings("websocket", header_list.array.items[1].array.items[1].string);
 }
 
+test "createWebSocketScope lists offered subprotocols" {
+    const headers = [_][2][]const u8{
+        .{ "upgrade", "websocket" },
+        .{ "sec-websocket-protocol", "chat.v2, chat.v1" },
+    };
+
+    const scope = try protocol.createWebSocketScope(test_allocator, "127.0.0.1", 8000, "127.0.0.1", 50000, "/ws", null, &headers);
+    defer protocol.jsonValueDeinit(scope, test_allocator);
+
+    try testing.expectEqualStrings("ws", scope.object.get("scheme").?.string);
+
+    const subprotocols = scope.object.get("subprotocols").?.array.items;
+    try testing.expectEqual(@as(usize, 2), subprotocols.len);
+    try testing.expectEqualStrings("chat.v2", subprotocols[0].string);
+    try testing.expectEqualStrings("chat.v1", subprotocols[1].string);
+}
+
 test "createLifespanScope" {
     const scope = try protocol.createLifespanScope(test_allocator);
 
@@ -220,6 +241,22 @@ test "createHttpResponseMessages" {
         try testing.expectEqualStrings(body, message.object.get("body").?.string);
         try testing.expectEqual(false, message.object.get("more_body").?.bool);
     }
+    // Test response trailers
+    {
+        const trailers = [_][2][]const u8{
+            .{ "grpc-status", "0" },
+        };
+
+        const message = try protocol.createHttpResponseTrailersMessage(test_allocator, &trailers, false);
+        defer protocol.jsonValueDeinit(message, test_allocator);
+
+        try testing.expectEqualStrings("http.response.trailers", message.object.get("type").?.string);
+        try testing.expectEqual(false, message.object.get("more_trailers").?.bool);
+
+        const header_list = message.object.get("headers").?;
+        try testing.expectEqualStrings("grpc-status", header_list.array.items[0].array.items[0].string);
+        try testing.expectEqualStrings("0", header_list.array.items[0].array.items[1].string);
+    }
 }
 
 test "createWebSocketMessages" {
@@ -290,6 +327,22 @@ test "createWebSocketMessages" {
         try testing.expectEqualStrings(text, message.object.get("text").?.string);
     }
 
+    // Test receive message carrying a payload object
+    {
+        const message = try protocol.createWebSocketReceiveObjectMessage(test_allocator, false, 0x7f00_1234_5678, 42);
+
+        try testing.expectEqualStrings("websocket.receive", message.object.get("type").?.string);
+        try testing.expect(message.object.get("bytes") == null);
+
+        const payload = protocol.payloadObject(message).?;
+        try testing.expectEqualStrings("bytes", payload.key);
+        try testing.expectEqual(@as(usize, 0x7f00_1234_5678), payload.handle);
+        try testing.expectEqual(@as(usize, 42), protocol.messagePayloadSize(message));
+
+        const text = try protocol.createWebSocketReceiveMessage(test_allocator, "inline", null);
+        try testing.expect(protocol.payloadObject(text) == null);
+    }
+
     // Test disconnect message
     {
         const code: u16 = 1000;
@@ -302,6 +355,16 @@ test "createWebSocketMessages" {
         try testing.expectEqualStrings("websocket.disconnect", message.object.get("type").?.string);
         try testing.expectEqual(@as(i64, 1000), message.object.get("code").?.integer);
     }
+
+    // Test close message
+    {
+        const message = try protocol.createWebSocketCloseMessage(test_allocator, 4000, "going away");
+        defer protocol.jsonValueDeinit(message, test_allocator);
+
+        try testing.expectEqualStrings("websocket.close", message.object.get("type").?.string);
+        try testing.expectEqual(@as(i64, 4000), message.object.get("code").?.integer);
+        try testing.expectEqualStrings("going away", message.object.get("reason").?.string);
+    }
 }
 
 test "createLifespanMessages" {
@@ -360,6 +423,72 @@ test "createLifespanMessages" {
     }
 }
 
+fn releaseAfterDelay(queue: *protocol.MessageQueue, size: usize) void {
+    std.time.sleep(20 * std.time.ns_per_ms);
+    queue.release(size);
+}
+
+test "MessageQueue.pushBounded waits for room" {
+    var queue = protocol.MessageQueue.init(test_allocator);
+    defer queue.deinit();
+    queue.max_pending_bytes = 8;
+
+    var send = json.Value{ .object = json.ObjectMap.init(test_allocator) };
+    try send.object.put("type", json.Value{ .string = "websocket.send" });
+    try send.object.put("text", json.Value{ .string = "0123456789" });
+    try testing.expectEqual(@as(usize, 10), protocol.messagePayloadSize(send));
+
+    // The first message goes in even though it is over the limit
+    try queue.pushBounded(send);
+    try testing.expectEqual(@as(usize, 10), queue.pending_bytes);
+
+    // The second waits until the consumer releases the first
+    const consumer = try std.Thread.spawn(.{}, releaseAfterDelay, .{ &queue, 10 });
+    try queue.pushBounded(send);
+    consumer.join();
+
+    try testing.expectEqual(@as(usize, 10), queue.pending_bytes);
+    try testing.expectEqual(@as(usize, 2), queue.messages.items.len);
+}
+
+fn unboundAfterDelay(queue: *protocol.MessageQueue) void {
+    std.time.sleep(20 * std.time.ns_per_ms);
+    queue.unbound();
+}
+
+test "MessageQueue.dispose frees owned events and makes room" {
+    var queue = protocol.MessageQueue.init(testing.allocator);
+    defer queue.deinit();
+    queue.max_pending_bytes = 8;
+    queue.owns_events = true;
+
+    const text = try testing.allocator.dupe(u8, "0123456789");
+    try queue.pushBounded(try protocol.createWebSocketReceiveMessage(testing.allocator, text, null));
+    try testing.expectEqual(@as(usize, 10), queue.pending_bytes);
+
+    // testing.allocator reports the event or its text if they are not freed
+    queue.dispose(queue.tryReceive().?);
+    try testing.expectEqual(@as(usize, 0), queue.pending_bytes);
+}
+
+test "MessageQueue.unbound lets waiting producers through" {
+    var queue = protocol.MessageQueue.init(test_allocator);
+    defer queue.deinit();
+    queue.max_pending_bytes = 8;
+
+    var send = json.Value{ .object = json.ObjectMap.init(test_allocator) };
+    try send.object.put("type", json.Value{ .string = "websocket.send" });
+    try send.object.put("text", json.Value{ .string = "0123456789" });
+    try queue.pushBounded(send);
+
+    // Nobody releases anything; only unbound ends the wait
+    const closer = try std.Thread.spawn(.{}, unboundAfterDelay, .{&queue});
+    try queue.pushBounded(send);
+    closer.join();
+
+    try testing.expectEqual(@as(usize, 2), queue.messages.items.len);
+}
+
 test "cleanup" {
     // Note: This doesn't actually detect leaks since we disabled safety,
     // but it's good practice to deinit the GPA
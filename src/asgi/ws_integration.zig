@@ -0,0 +1,766 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const json = std.json;
+const net = std.net;
+
+const websocket = @import("../websocket/server.zig");
+const broadcast = websocket.broadcast;
+const timer_wheel = @import("../utils/timer_wheel.zig");
+const protocol = @import("protocol.zig");
+
+/// Close code reported to the application when the connection dropped
+/// without a close frame (RFC 6455 section 7.1.5)
+pub const abnormal_closure: u16 = 1006;
+
+/// Close code sent when the peer violates the framing protocol
+pub const protocol_error: u16 = 1002;
+
+/// Close code sent to a broadcast subscriber evicted for falling behind
+pub const policy_violation: u16 = 1008;
+
+/// Close code sent when a message cannot be decoded: text that is not
+/// UTF-8, or a compressed message that does not inflate
+pub const invalid_payload: u16 = 1007;
+
+/// Close code sent when a frame exceeds the size limit
+pub const message_too_big: u16 = 1009;
+
+/// Close code sent when a keepalive ping went unanswered
+pub const keepalive_timeout: u16 = 1011;
+
+/// Close code sent when the server cannot continue, e.g. out of memory
+pub const internal_error: u16 = 1011;
+
+/// Makes the application's payload objects on the reader thread, straight
+/// from the connection's buffer, so a received message is copied once: into
+/// the object the application gets. The event then carries a handle to the
+/// object instead of the payload (see `protocol.payloadObject`).
+pub const PayloadFactory = struct {
+    context: ?*anyopaque = null,
+    /// Object holding `data`, or null if it could not be made. `ascii` is
+    /// set for text known to be all ASCII.
+    create: *const fn (context: ?*anyopaque, message_type: websocket.MessageType, data: []const u8, ascii: bool) ?usize,
+    /// Drop an object whose event never reached the application
+    destroy: *const fn (context: ?*anyopaque, handle: usize) void,
+};
+
+/// Per-connection settings taken from the command line
+pub const Config = struct {
+    /// Largest message accepted, whole or reassembled from fragments
+    max_message_size: usize = websocket.default_max_message_size,
+    /// Bytes the application may have sent and not yet written to the
+    /// socket before its next send waits; 0 lets the queue grow unbounded
+    max_buffered_bytes: usize = 4 * 1024 * 1024,
+    /// Deliver each fragment as its own websocket.receive carrying
+    /// `more_body` instead of reassembling the message first
+    stream_fragments: bool = false,
+    /// Accept permessage-deflate when the client offers it
+    per_message_deflate: bool = true,
+    /// Memory a connection may keep between messages for compression;
+    /// below `deflate.retained_context_size` every message is compressed
+    /// from scratch
+    deflate_memory_budget: usize = 1024 * 1024,
+    /// Process-wide cap on connections keeping a compression context
+    deflate_max_contexts: u32 = 1024,
+    /// Groups the application can publish to; broadcast is unavailable
+    /// when null
+    hub: ?*broadcast.Hub = null,
+    /// Broadcast frames a connection may have queued before `broadcast_policy`
+    /// applies
+    broadcast_max_pending: usize = 256,
+    broadcast_policy: broadcast.Policy = .drop_oldest,
+    /// Read buffers are borrowed from here while a message arrives and
+    /// returned while the connection is idle; each connection keeps its
+    /// own when null
+    buffer_pool: ?*websocket.buffer_pool.BufferPool = null,
+    /// Turns received payloads into application objects; when null they
+    /// are copied into the event as strings
+    payloads: ?PayloadFactory = null,
+    /// Drives keepalive pings; no pings are sent when null
+    timers: ?*timer_wheel.TimerService = null,
+    /// Time between server pings; 0 disables them
+    ping_interval_ns: u64 = 20 * std.time.ns_per_s,
+    /// Time to wait for the pong before failing the connection; 0 waits
+    /// forever
+    ping_timeout_ns: u64 = 20 * std.time.ns_per_s,
+};
+
+/// Messages of up to `max_message_size` the application may leave
+/// unreceived before the reader stops reading the socket
+pub const unread_messages = 4;
+
+/// Response for an application that closes or returns before accepting
+const denied_response = "HTTP/1.1 403 Forbidden\r\n" ++
+    "Content-Length: 0\r\n" ++
+    "Connection: close\r\n" ++
+    "\r\n";
+
+/// Bridges one upgraded HTTP/1.1 connection to an ASGI websocket
+/// application.
+///
+/// The ASGI call blocks the calling thread until the application returns,
+/// so the socket is serviced by two pump threads while it runs: the reader
+/// turns frames into `websocket.receive`/`websocket.disconnect` events on
+/// `to_app`, and the writer turns `websocket.accept`/`send`/`close` events
+/// from `from_app` into the handshake response and frames. The writer
+/// takes whatever has queued up while it was busy and writes the frames
+/// together, and `from_app` is bounded by `max_buffered_bytes` so a peer
+/// that reads slowly holds up the application's sends instead of growing
+/// the queue without limit. `to_app` is bounded the same way at
+/// `unread_messages` whole messages, past which the reader leaves frames in
+/// the socket until the application catches up.
+///
+/// Call `start` before running the application and `finish` once it has
+/// returned. The session must not move between the two.
+pub const WebSocketSession = struct {
+    const Self = @This();
+
+    pub const State = enum {
+        /// Waiting for websocket.accept
+        connecting,
+        open,
+        /// Our close frame is out; waiting for the peer's
+        closing,
+        closed,
+    };
+
+    allocator: Allocator,
+    config: Config,
+    stream: net.Stream,
+    connection: websocket.Connection,
+    to_app: protocol.MessageQueue,
+    from_app: protocol.MessageQueue,
+    /// Sec-WebSocket-Accept value; base64 of a SHA-1 digest is always 28 bytes
+    accept_key: [28]u8 = undefined,
+    /// permessage-deflate offer we will accept, if the client made one
+    deflate_offer: ?websocket.deflate.Offer = null,
+    state: State = .connecting,
+    /// Guards `state`. Taken before `write_mutex` when both are needed.
+    state_mutex: std.Thread.Mutex = .{},
+    /// Serializes writes from the two pump threads so frames never interleave
+    write_mutex: std.Thread.Mutex = .{},
+    /// Set once the handshake is answered either way; the reader waits on it
+    handshake_done: std.Thread.ResetEvent = .{},
+    reader_thread: ?std.Thread = null,
+    writer_thread: ?std.Thread = null,
+    /// Broadcast frames for this connection. Shares `from_app`'s lock so
+    /// the writer wakes for either; set up by `start` once the session
+    /// has its final address.
+    subscriber: ?broadcast.Subscriber = null,
+    /// The writer has acted on the subscriber's eviction
+    eviction_handled: bool = false,
+    /// Keepalive timer on `config.timers`; armed once the connection opens
+    keepalive_timer: timer_wheel.Timer = timer_wheel.Timer.init(onKeepalive),
+    /// Only touched by the keepalive callback
+    keepalive_phase: enum { idle, awaiting_pong } = .idle,
+    /// Set by the reader on every pong
+    pong_received: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+    /// Keepalive work for the writer. Guarded by `from_app.mutex`.
+    ping_due: bool = false,
+    ping_expired: bool = false,
+
+    /// Validate the upgrade request. Fails with error.NotWebSocketRequest or
+    /// error.UnsupportedVersion before anything is written to the socket.
+    pub fn init(allocator: Allocator, config: Config, stream: net.Stream, request_headers: *const std.StringHashMap([]const u8)) !Self {
+        var self = Self{
+            .allocator = allocator,
+            .config = config,
+            .stream = stream,
+            .connection = websocket.Connection.init(stream, allocator, true),
+            .to_app = protocol.MessageQueue.init(allocator),
+            .from_app = protocol.MessageQueue.init(allocator),
+        };
+
+        _ = try websocket.acceptKeyForRequest(request_headers, &self.accept_key);
+        self.connection.setMaxMessageSize(config.max_message_size);
+        self.from_app.max_pending_bytes = config.max_buffered_bytes;
+        // Events on `to_app` are the session's until the bridge disposes them
+        self.to_app.owns_events = true;
+        self.to_app.max_pending_bytes = config.max_message_size *| unread_messages;
+        if (config.buffer_pool) |pool| self.connection.usePool(pool);
+
+        if (config.per_message_deflate) {
+            if (websocket.getHeader(request_headers, "Sec-WebSocket-Extensions")) |extensions| {
+                self.deflate_offer = websocket.deflate.Offer.negotiate(extensions);
+            }
+        }
+
+        return self;
+    }
+
+    pub fn deinit(self: *Self) void {
+        // Events the application never received
+        for (self.to_app.messages.items) |event| self.discardEvent(event);
+
+        self.connection.deinit();
+        self.to_app.deinit();
+        self.from_app.deinit();
+    }
+
+    /// Queue websocket.connect and start the pump threads
+    pub fn start(self: *Self) !void {
+        const connect = try protocol.createWebSocketConnectMessage(self.allocator);
+        self.to_app.push(connect) catch |err| {
+            protocol.eventDeinit(connect, self.allocator);
+            return err;
+        };
+
+        if (self.config.hub != null) {
+            self.subscriber = broadcast.Subscriber.init(
+                self.allocator,
+                &self.from_app.mutex,
+                &self.from_app.condition,
+                self.config.broadcast_max_pending,
+                self.config.broadcast_policy,
+            );
+        }
+
+        self.writer_thread = try std.Thread.spawn(.{}, writerLoop, .{self});
+        errdefer self.finish();
+
+        self.reader_thread = try std.Thread.spawn(.{}, readerLoop, .{self});
+    }
+
+    /// Stop the pumps once the application has returned. An application
+    /// that never accepted gets a 403; one that never closed gets a 1000
+    /// close frame.
+    pub fn finish(self: *Self) void {
+        // No new broadcasts once the application is done
+        if (self.subscriber) |*subscriber| self.config.hub.?.leaveAll(subscriber);
+
+        if (self.writer_thread) |thread| {
+            // Null is never produced by the bridge, so it marks the end
+            self.from_app.push(.null) catch {};
+            thread.join();
+            self.writer_thread = null;
+        }
+
+        // Only once the writer is gone: a websocket.accept it takes late
+        // still arms the timer, which must not outlive the session
+        if (self.config.timers) |timers| timers.cancel(&self.keepalive_timer);
+
+        self.state_mutex.lock();
+        switch (self.state) {
+            .connecting => self.deny(),
+            .open => {
+                self.sendClose(1000, "") catch {};
+                self.state = .closing;
+            },
+            .closing, .closed => {},
+        }
+        self.state_mutex.unlock();
+
+        // Wake a reader blocked on the socket, on the handshake or on an
+        // application that stopped receiving
+        std.posix.shutdown(self.stream.handle, .both) catch {};
+        self.handshake_done.set();
+        self.to_app.unbound();
+
+        if (self.reader_thread) |thread| {
+            thread.join();
+            self.reader_thread = null;
+        }
+
+        if (self.subscriber) |*subscriber| {
+            subscriber.deinit();
+            self.subscriber = null;
+        }
+    }
+
+    /// Add this connection to a broadcast group
+    pub fn join(self: *Self, group: []const u8) !void {
+        const subscriber = if (self.subscriber) |*s| s else return error.BroadcastUnavailable;
+        try self.config.hub.?.join(group, subscriber);
+    }
+
+    /// Remove this connection from a broadcast group
+    pub fn leave(self: *Self, group: []const u8) void {
+        const subscriber = if (self.subscriber) |*s| s else return;
+        self.config.hub.?.leave(group, subscriber);
+    }
+
+    pub fn getState(self: *Self) State {
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+        return self.state;
+    }
+
+    /// Work for the writer, in the order it is taken
+    const WriterWork = union(enum) {
+        /// Event sent by the application
+        event: json.Value,
+        /// Broadcast frame; the writer owns the reference
+        shared: *broadcast.SharedFrame,
+        /// The subscriber fell behind and must be disconnected
+        evicted,
+        /// Time for a keepalive ping
+        ping,
+        /// The last keepalive ping went unanswered
+        ping_expired,
+    };
+
+    /// Next application event or broadcast frame, waiting for one when
+    /// `wait` is set. Application events go first so an accept is never
+    /// overtaken by a broadcast.
+    fn nextWork(self: *Self, wait: bool) ?WriterWork {
+        const queue = &self.from_app;
+        queue.mutex.lock();
+        defer queue.mutex.unlock();
+
+        while (true) {
+            if (queue.messages.items.len > 0) return .{ .event = queue.messages.orderedRemove(0) };
+
+            if (self.ping_expired) {
+                self.ping_expired = false;
+                return .ping_expired;
+            }
+            if (self.ping_due) {
+                self.ping_due = false;
+                return .ping;
+            }
+
+            if (self.subscriber) |*subscriber| {
+                if (subscriber.evicted and !self.eviction_handled) {
+                    self.eviction_handled = true;
+                    return .evicted;
+                }
+                if (subscriber.takeLocked()) |shared| return .{ .shared = shared };
+            }
+
+            if (!wait) return null;
+            queue.condition.wait(&queue.mutex);
+        }
+    }
+
+    /// Application events whose frames are queued on the connection. Their
+    /// payloads may be borrowed by those frames, so they are freed only
+    /// once the frames are flushed.
+    const Batch = struct {
+        events: [websocket.send_queue.max_batch]json.Value = undefined,
+        len: usize = 0,
+
+        fn isFull(self: *const Batch) bool {
+            return self.len == self.events.len;
+        }
+    };
+
+    /// Take whatever work is waiting, up to a batch, queue its frames and
+    /// write them together
+    fn writerLoop(self: *Self) void {
+        while (true) {
+            var batch = Batch{};
+            var finished = false;
+
+            var work = self.nextWork(true);
+            while (work) |current| {
+                if (!self.handleWork(current, &batch)) {
+                    finished = true;
+                    break;
+                }
+                if (batch.isFull()) break;
+                work = self.nextWork(false);
+            }
+
+            self.flushBatch(&batch);
+            if (finished) return;
+        }
+    }
+
+    /// Queue the frames for one piece of work. Returns false for the
+    /// marker `finish` pushes to stop the writer.
+    fn handleWork(self: *Self, work: WriterWork, batch: *Batch) bool {
+        switch (work) {
+            .event => |event| {
+                if (event == .null) return false;
+
+                batch.events[batch.len] = event;
+                batch.len += 1;
+                if (event != .object) return true;
+
+                self.handleAppEvent(event) catch |err| {
+                    std.log.err("WebSocket send failed: {!}", .{err});
+                    self.markClosed();
+                };
+            },
+            .shared => |shared| {
+                defer shared.release();
+                self.sendShared(shared) catch |err| {
+                    std.log.err("WebSocket broadcast failed: {!}", .{err});
+                };
+            },
+            .evicted => self.evict(),
+            .ping => self.sendPing(),
+            .ping_expired => self.failKeepalive(),
+        }
+        return true;
+    }
+
+    /// Write everything queued, then free the batch's events and make
+    /// room for the application's next sends
+    fn flushBatch(self: *Self, batch: *Batch) void {
+        const flushed = blk: {
+            self.write_mutex.lock();
+            defer self.write_mutex.unlock();
+            break :blk self.connection.flush();
+        };
+        flushed catch |err| {
+            std.log.err("WebSocket send failed: {!}", .{err});
+            self.markClosed();
+        };
+
+        var size: usize = 0;
+        for (batch.events[0..batch.len]) |event| {
+            size += protocol.messagePayloadSize(event);
+            protocol.jsonValueDeinit(event, self.allocator);
+        }
+        self.from_app.release(size);
+    }
+
+    /// Give up on the connection after a failed write
+    fn markClosed(self: *Self) void {
+        self.state_mutex.lock();
+        self.state = .closed;
+        self.state_mutex.unlock();
+        self.handshake_done.set();
+    }
+
+    /// Apply one event sent by the application
+    fn handleAppEvent(self: *Self, event: json.Value) !void {
+        const type_value = event.object.get("type") orelse return;
+        if (type_value != .string) return;
+        const event_type = type_value.string;
+
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+
+        if (std.mem.eql(u8, event_type, "websocket.accept")) {
+            if (self.state != .connecting) return error.UnexpectedMessage;
+
+            var subprotocol: ?[]const u8 = null;
+            if (event.object.get("subprotocol")) |value| {
+                if (value == .string) subprotocol = value.string;
+            }
+
+            var extra_headers = std.ArrayList([2][]const u8).init(self.allocator);
+            defer extra_headers.deinit();
+            if (event.object.get("headers")) |headers_value| {
+                if (headers_value == .array) {
+                    for (headers_value.array.items) |header| {
+                        if (header != .array or header.array.items.len != 2) continue;
+                        const name = header.array.items[0];
+                        const value = header.array.items[1];
+                        if (name != .string or value != .string) continue;
+                        try extra_headers.append(.{ name.string, value.string });
+                    }
+                }
+            }
+
+            var codec: ?*websocket.deflate.Codec = null;
+            errdefer if (codec) |c| c.destroy();
+            var extension_buf: [128]u8 = undefined;
+            if (self.deflate_offer) |offer| {
+                const created = try websocket.deflate.Codec.create(
+                    self.allocator,
+                    offer,
+                    self.config.deflate_memory_budget,
+                    self.config.deflate_max_contexts,
+                );
+                codec = created;
+                const extension = try offer.response(created.context_takeover, &extension_buf);
+                try extra_headers.append(.{ "Sec-WebSocket-Extensions", extension });
+            }
+
+            {
+                self.write_mutex.lock();
+                defer self.write_mutex.unlock();
+                try websocket.writeHandshakeResponse(self.allocator, self.stream, &self.accept_key, subprotocol, extra_headers.items);
+            }
+
+            // The reader is still parked on `handshake_done`, so this cannot
+            // race an incoming compressed frame
+            if (codec) |c| self.connection.enableDeflate(c);
+            codec = null;
+
+            self.state = .open;
+            self.handshake_done.set();
+            self.armKeepalive(self.config.ping_interval_ns);
+        } else if (std.mem.eql(u8, event_type, "websocket.send")) {
+            // Sends racing a close are dropped, as the peer will not read them
+            if (self.state != .open) return;
+
+            if (event.object.get("bytes")) |bytes| {
+                if (bytes == .string) return self.queueMessage(.binary, bytes.string);
+            }
+            if (event.object.get("text")) |text| {
+                if (text == .string) return self.queueMessage(.text, text.string);
+            }
+        } else if (std.mem.eql(u8, event_type, "websocket.close")) {
+            switch (self.state) {
+                .connecting => self.deny(),
+                .open => {
+                    var code: u16 = 1000;
+                    if (event.object.get("code")) |value| {
+                        if (value == .integer) code = std.math.cast(u16, value.integer) orelse 1000;
+                    }
+                    // Reserved and local-only codes must not go on the wire
+                    if (!websocket.isValidCloseCode(code)) code = 1000;
+
+                    var reason: []const u8 = "";
+                    if (event.object.get("reason")) |value| {
+                        if (value == .string) reason = value.string;
+                    }
+
+                    try self.sendClose(code, reason);
+                    self.state = .closing;
+                },
+                .closing, .closed => {},
+            }
+        }
+    }
+
+    /// Reject the upgrade. Caller holds `state_mutex`.
+    fn deny(self: *Self) void {
+        {
+            self.write_mutex.lock();
+            defer self.write_mutex.unlock();
+            self.stream.writeAll(denied_response) catch {};
+        }
+
+        self.state = .closed;
+        self.handshake_done.set();
+    }
+
+    fn sendMessage(self: *Self, message_type: websocket.MessageType, data: []const u8) !void {
+        self.write_mutex.lock();
+        defer self.write_mutex.unlock();
+        try self.connection.send(message_type, data);
+    }
+
+    /// Queue a message for the writer's next flush
+    fn queueMessage(self: *Self, message_type: websocket.MessageType, data: []const u8) !void {
+        self.write_mutex.lock();
+        defer self.write_mutex.unlock();
+        try self.connection.queue(message_type, data);
+    }
+
+    /// Queue a broadcast frame as is. Frames published before the
+    /// application accepted, or after it closed, are skipped.
+    fn sendShared(self: *Self, shared: *broadcast.SharedFrame) !void {
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+        if (self.state != .open) return;
+
+        self.write_mutex.lock();
+        defer self.write_mutex.unlock();
+        try self.connection.queueShared(shared);
+    }
+
+    /// Schedule the next keepalive step, if keepalive is enabled
+    fn armKeepalive(self: *Self, delay_ns: u64) void {
+        const timers = self.config.timers orelse return;
+        if (self.config.ping_interval_ns == 0) return;
+        timers.schedule(&self.keepalive_timer, delay_ns);
+    }
+
+    /// Runs on the timer thread. Only flags work for the writer, so a peer
+    /// that stopped reading cannot stall the wheel.
+    fn onKeepalive(timer: *timer_wheel.Timer) void {
+        const self: *Self = @fieldParentPtr("keepalive_timer", timer);
+        const interval = self.config.ping_interval_ns;
+        const timeout = self.config.ping_timeout_ns;
+
+        switch (self.keepalive_phase) {
+            .idle => {
+                self.pong_received.store(false, .release);
+                self.wakeWriter(.ping);
+
+                if (timeout == 0) {
+                    self.armKeepalive(interval);
+                } else {
+                    self.keepalive_phase = .awaiting_pong;
+                    self.armKeepalive(timeout);
+                }
+            },
+            .awaiting_pong => {
+                if (!self.pong_received.load(.acquire)) {
+                    self.wakeWriter(.ping_expired);
+                    return;
+                }
+
+                // Keep pings `interval` apart however quickly the pong came
+                self.keepalive_phase = .idle;
+                self.armKeepalive(interval -| timeout);
+            },
+        }
+    }
+
+    fn wakeWriter(self: *Self, work: enum { ping, ping_expired }) void {
+        self.from_app.mutex.lock();
+        defer self.from_app.mutex.unlock();
+
+        switch (work) {
+            .ping => self.ping_due = true,
+            .ping_expired => self.ping_expired = true,
+        }
+        self.from_app.condition.signal();
+    }
+
+    fn sendPing(self: *Self) void {
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+        if (self.state != .open) return;
+
+        self.queueMessage(.ping, "") catch {};
+    }
+
+    /// Give up on a peer that did not answer a ping. The socket is shut
+    /// down as well, since a peer this unresponsive will not finish the
+    /// closing handshake; the reader then reports the disconnect.
+    fn failKeepalive(self: *Self) void {
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+
+        if (self.state == .open) self.sendClose(keepalive_timeout, "keepalive ping timeout") catch {};
+        if (self.state != .closed) {
+            self.state = .closed;
+            std.posix.shutdown(self.stream.handle, .both) catch {};
+        }
+    }
+
+    /// Close a subscriber that fell too far behind its broadcasts
+    fn evict(self: *Self) void {
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+
+        if (self.state == .open) {
+            self.sendClose(policy_violation, "Too slow") catch {};
+            self.state = .closing;
+        }
+    }
+
+    fn sendClose(self: *Self, code: u16, reason: []const u8) !void {
+        self.write_mutex.lock();
+        defer self.write_mutex.unlock();
+        try self.connection.sendClose(code, reason);
+    }
+
+    fn readerLoop(self: *Self) void {
+        self.handshake_done.wait();
+
+        if (self.getState() == .closed) {
+            self.pushDisconnect(abnormal_closure);
+            return;
+        }
+
+        while (true) {
+            // Borrowed from the connection; `deliver` copies what it keeps
+            const next_chunk = if (self.config.stream_fragments)
+                self.connection.receiveChunk()
+            else
+                self.connection.receiveBorrowed();
+            const chunk = next_chunk catch |err| return self.failFromReader(err);
+
+            switch (chunk.type) {
+                .text, .binary => self.deliver(chunk) catch |err| return self.failFromReader(err),
+                .ping => self.sendMessage(.pong, chunk.data) catch {},
+                .pong => self.pong_received.store(true, .release),
+                .close => {
+                    const code = websocket.closeCode(chunk.data);
+                    // 1005 means "no code present" and must not go on the wire
+                    self.closeFromReader(if (code == 1005) 1000 else code);
+                    self.pushDisconnect(code);
+                    return;
+                },
+            }
+        }
+    }
+
+    /// Push a data message, or one piece of it when streaming, to the app
+    fn deliver(self: *Self, chunk: websocket.Chunk) !void {
+        const is_text = chunk.type == .text;
+
+        var event: json.Value = undefined;
+        if (self.payloadFactory(chunk)) |factory| {
+            const object = factory.create(factory.context, chunk.type, chunk.data, chunk.ascii) orelse return error.OutOfMemory;
+            event = protocol.createWebSocketReceiveObjectMessage(self.allocator, is_text, object, chunk.data.len) catch |err| {
+                factory.destroy(factory.context, object);
+                return err;
+            };
+        } else {
+            const data = try self.allocator.dupe(u8, chunk.data);
+            const made = if (is_text)
+                protocol.createWebSocketReceiveMessage(self.allocator, data, null)
+            else
+                protocol.createWebSocketReceiveMessage(self.allocator, null, data);
+            event = made catch |err| {
+                self.allocator.free(data);
+                return err;
+            };
+        }
+        errdefer self.discardEvent(event);
+
+        if (self.config.stream_fragments) {
+            try event.object.put("more_body", json.Value{ .bool = !chunk.final });
+        }
+
+        // Waits while the application is behind, leaving later frames
+        // unread in the socket
+        try self.to_app.pushBounded(event);
+    }
+
+    /// Free an event the application will never receive, along with its
+    /// payload object
+    fn discardEvent(self: *Self, event: json.Value) void {
+        if (self.config.payloads) |factory| {
+            if (protocol.payloadObject(event)) |payload| factory.destroy(factory.context, payload.handle);
+        }
+        protocol.eventDeinit(event, self.allocator);
+    }
+
+    /// Factory for a chunk's payload object, if one applies. A streamed
+    /// text piece may end partway through a code point, so only whole
+    /// text messages are made into objects.
+    fn payloadFactory(self: *const Self, chunk: websocket.Chunk) ?PayloadFactory {
+        const factory = self.config.payloads orelse return null;
+        if (chunk.type == .text and self.config.stream_fragments) return null;
+        return factory;
+    }
+
+    /// End the connection after a read or framing error
+    fn failFromReader(self: *Self, err: anyerror) void {
+        const code: u16 = switch (err) {
+            error.InvalidOpcode,
+            error.ProtocolError,
+            error.UnmaskedFrame,
+            => protocol_error,
+            error.FrameTooLarge,
+            error.MessageTooBig,
+            error.ReadBufferFull,
+            => message_too_big,
+            error.InvalidCompressedData,
+            error.InvalidUtf8,
+            => invalid_payload,
+            error.OutOfMemory => internal_error,
+            else => abnormal_closure,
+        };
+        self.closeFromReader(code);
+        self.pushDisconnect(code);
+    }
+
+    /// Answer or start the closing handshake from the reader and mark the
+    /// connection closed
+    fn closeFromReader(self: *Self, code: u16) void {
+        self.state_mutex.lock();
+        defer self.state_mutex.unlock();
+
+        if (self.state == .open and code != abnormal_closure) {
+            self.sendClose(code, "") catch {};
+        }
+        self.state = .closed;
+    }
+
+    fn pushDisconnect(self: *Self, code: u16) void {
+        const event = protocol.createWebSocketDisconnectMessage(self.allocator, code) catch return;
+        self.to_app.push(event) catch protocol.eventDeinit(event, self.allocator);
+    }
+};
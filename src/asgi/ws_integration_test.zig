@@ -0,0 +1,766 @@
+const std = @import("std");
+const testing = std.testing;
+const json = std.json;
+const net = std.net;
+const ws_integration = @import("ws_integration.zig");
+const protocol = @import("protocol.zig");
+const websocket = @import("../websocket/server.zig");
+const timer_wheel = @import("../utils/timer_wheel.zig");
+
+const WebSocketSession = ws_integration.WebSocketSession;
+
+/// Both ends of a loopback TCP connection
+const SocketPair = struct {
+    listener: net.Server,
+    client: net.Stream,
+    server: net.Stream,
+
+    fn open() !SocketPair {
+        const address = try net.Address.parseIp("127.0.0.1", 0);
+        var listener = try address.listen(.{ .reuse_address = true });
+        errdefer listener.deinit();
+
+        const client = try net.tcpConnectToAddress(listener.listen_address);
+        errdefer client.close();
+
+        const accepted = try listener.accept();
+        return SocketPair{ .listener = listener, .client = client, .server = accepted.stream };
+    }
+
+    fn close(self: *SocketPair) void {
+        self.client.close();
+        self.server.close();
+        self.listener.deinit();
+    }
+};
+
+fn upgradeHeaders(allocator: std.mem.Allocator) !std.StringHashMap([]const u8) {
+    var headers = std.StringHashMap([]const u8).init(allocator);
+    try headers.put("Upgrade", "websocket");
+    try headers.put("Connection", "Upgrade");
+    try headers.put("Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ==");
+    try headers.put("Sec-WebSocket-Version", "13");
+    return headers;
+}
+
+/// Read an HTTP response head byte by byte so no frame bytes are consumed
+fn readResponseHead(stream: net.Stream, buf: []u8) ![]const u8 {
+    var len: usize = 0;
+    while (len < buf.len) {
+        const n = try stream.read(buf[len .. len + 1]);
+        if (n == 0) return error.ConnectionClosed;
+        len += 1;
+        if (std.mem.endsWith(u8, buf[0..len], "\r\n\r\n")) return buf[0..len];
+    }
+    return error.ResponseTooLarge;
+}
+
+/// Stands in for a Python application: accepts (or rejects) the
+/// connection, echoes every message and records the disconnect code
+const EchoApp = struct {
+    session: *WebSocketSession,
+    accept: bool = true,
+    received: usize = 0,
+    /// Events that said more of the message follows
+    partial: usize = 0,
+    disconnect_code: ?i64 = null,
+    /// Copies of the echoed payloads. Received events are handed back at
+    /// once, as the bridge does, while sends borrow their data until the
+    /// writer has flushed it.
+    echoed: std.heap.ArenaAllocator = std.heap.ArenaAllocator.init(testing.allocator),
+
+    /// Once the session has finished
+    fn deinit(self: *EchoApp) void {
+        self.echoed.deinit();
+    }
+
+    fn run(self: *EchoApp) void {
+        self.serve() catch |err| std.debug.print("echo app failed: {!}\n", .{err});
+    }
+
+    fn serve(self: *EchoApp) !void {
+        const allocator = testing.allocator;
+
+        const connect = try self.session.to_app.receive();
+        try testing.expectEqualStrings("websocket.connect", connect.object.get("type").?.string);
+        self.session.to_app.dispose(connect);
+
+        if (self.accept) {
+            try self.session.from_app.push(try protocol.createWebSocketAcceptMessage(allocator, null, null));
+        } else {
+            try self.session.from_app.push(try protocol.createWebSocketCloseMessage(allocator, 1000, null));
+        }
+
+        while (true) {
+            const event = try self.session.to_app.receive();
+            defer self.session.to_app.dispose(event);
+            const event_type = event.object.get("type").?.string;
+
+            if (std.mem.eql(u8, event_type, "websocket.disconnect")) {
+                self.disconnect_code = event.object.get("code").?.integer;
+                return;
+            }
+
+            self.received += 1;
+            if (event.object.get("more_body")) |more_body| {
+                if (more_body.bool) self.partial += 1;
+            }
+            if (event.object.get("bytes")) |bytes| {
+                const data = try self.echoed.allocator().dupe(u8, bytes.string);
+                try self.session.from_app.push(try protocol.createWebSocketSendBinaryMessage(allocator, data));
+            } else if (event.object.get("text")) |text| {
+                const data = try self.echoed.allocator().dupe(u8, text.string);
+                try self.session.from_app.push(try protocol.createWebSocketSendTextMessage(allocator, data));
+            }
+        }
+    }
+};
+
+test "WebSocketSession rejects requests that are not upgrades" {
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = std.StringHashMap([]const u8).init(testing.allocator);
+    defer headers.deinit();
+    try headers.put("Host", "example.com");
+
+    try testing.expectError(error.NotWebSocketRequest, WebSocketSession.init(testing.allocator, .{}, pair.server, &headers));
+}
+
+test "WebSocketSession echoes messages and completes the closing handshake" {
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    var session = try WebSocketSession.init(testing.allocator, .{}, pair.server, &headers);
+    defer session.deinit();
+
+    var app = EchoApp{ .session = &session };
+    defer app.deinit();
+    try session.start();
+    const app_thread = try std.Thread.spawn(.{}, EchoApp.run, .{&app});
+
+    var head_buf: [512]u8 = undefined;
+    const head = try readResponseHead(pair.client, &head_buf);
+    try testing.expect(std.mem.startsWith(u8, head, "HTTP/1.1 101 Switching Protocols\r\n"));
+    try testing.expect(std.mem.indexOf(u8, head, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != null);
+
+    var client = websocket.Connection.init(pair.client, testing.allocator, false);
+    defer client.deinit();
+
+    try client.send(.text, "hello");
+    var echoed = try client.receive();
+    try testing.expectEqual(websocket.MessageType.text, echoed.type);
+    try testing.expectEqualStrings("hello", echoed.data);
+    echoed.deinit();
+
+    try client.send(.binary, &[_]u8{ 0x00, 0xFF, 0x10 });
+    echoed = try client.receive();
+    try testing.expectEqual(websocket.MessageType.binary, echoed.type);
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x00, 0xFF, 0x10 }, echoed.data);
+    echoed.deinit();
+
+    // Pings are answered by the server without involving the application
+    try client.send(.ping, "tick");
+    echoed = try client.receive();
+    try testing.expectEqual(websocket.MessageType.pong, echoed.type);
+    try testing.expectEqualStrings("tick", echoed.data);
+    echoed.deinit();
+
+    try client.sendClose(1000, "");
+    var close_reply = try client.receive();
+    defer close_reply.deinit();
+    try testing.expectEqual(websocket.MessageType.close, close_reply.type);
+    try testing.expectEqual(@as(u16, 1000), websocket.closeCode(close_reply.data));
+
+    app_thread.join();
+    session.finish();
+
+    try testing.expectEqual(@as(usize, 2), app.received);
+    try testing.expectEqual(@as(?i64, 1000), app.disconnect_code);
+    try testing.expectEqual(WebSocketSession.State.closed, session.getState());
+}
+
+test "WebSocketSession answers 403 when the application closes before accepting" {
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    var session = try WebSocketSession.init(testing.allocator, .{}, pair.server, &headers);
+    defer session.deinit();
+
+    var app = EchoApp{ .session = &session, .accept = false };
+    defer app.deinit();
+    try session.start();
+    const app_thread = try std.Thread.spawn(.{}, EchoApp.run, .{&app});
+
+    var head_buf: [512]u8 = undefined;
+    const head = try readResponseHead(pair.client, &head_buf);
+    try testing.expect(std.mem.startsWith(u8, head, "HTTP/1.1 403 Forbidden\r\n"));
+
+    app_thread.join();
+    session.finish();
+
+    try testing.expectEqual(@as(?i64, ws_integration.abnormal_closure), app.disconnect_code);
+}
+
+/// Open a session with `config`, run an echo app and complete the handshake
+const EchoFixture = struct {
+    pair: SocketPair,
+    headers: std.StringHashMap([]const u8),
+    session: WebSocketSession,
+    app: EchoApp,
+    app_thread: std.Thread,
+    client: websocket.Connection,
+
+    fn start(self: *EchoFixture, config: ws_integration.Config) !void {
+        self.pair = try SocketPair.open();
+        self.headers = try upgradeHeaders(testing.allocator);
+        self.session = try WebSocketSession.init(testing.allocator, config, self.pair.server, &self.headers);
+        self.app = EchoApp{ .session = &self.session };
+        try self.session.start();
+        self.app_thread = try std.Thread.spawn(.{}, EchoApp.run, .{&self.app});
+
+        var head_buf: [512]u8 = undefined;
+        _ = try readResponseHead(self.pair.client, &head_buf);
+        self.client = websocket.Connection.init(self.pair.client, testing.allocator, false);
+    }
+
+    /// Wait for the app to see its disconnect and tear everything down
+    fn stop(self: *EchoFixture) void {
+        self.app_thread.join();
+        self.session.finish();
+        self.app.deinit();
+        self.session.deinit();
+        self.client.deinit();
+        self.headers.deinit();
+        self.pair.close();
+    }
+};
+
+test "WebSocketSession reassembles fragments around interleaved pings" {
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{});
+
+    try fixture.client.sendFragment(.text, "hel", true, false);
+    try fixture.client.send(.ping, "mid");
+    try fixture.client.sendFragment(.text, "lo", false, true);
+
+    // The pong overtakes the message it interrupted
+    var pong = try fixture.client.receive();
+    try testing.expectEqual(websocket.MessageType.pong, pong.type);
+    try testing.expectEqualStrings("mid", pong.data);
+    pong.deinit();
+
+    var echoed = try fixture.client.receive();
+    try testing.expectEqual(websocket.MessageType.text, echoed.type);
+    try testing.expectEqualStrings("hello", echoed.data);
+    echoed.deinit();
+
+    try fixture.client.sendClose(1000, "");
+    var close_reply = try fixture.client.receive();
+    close_reply.deinit();
+
+    fixture.stop();
+    try testing.expectEqual(@as(usize, 1), fixture.app.received);
+}
+
+test "WebSocketSession streams fragments when configured to" {
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{ .stream_fragments = true });
+
+    try fixture.client.sendFragment(.binary, "ab", true, false);
+    try fixture.client.sendFragment(.binary, "cd", false, false);
+    try fixture.client.sendFragment(.binary, "ef", false, true);
+
+    // Each piece reaches the app, and is echoed, on its own
+    for ([_][]const u8{ "ab", "cd", "ef" }) |expected| {
+        var echoed = try fixture.client.receive();
+        defer echoed.deinit();
+        try testing.expectEqualStrings(expected, echoed.data);
+    }
+
+    try fixture.client.sendClose(1000, "");
+    var close_reply = try fixture.client.receive();
+    close_reply.deinit();
+
+    fixture.stop();
+    try testing.expectEqual(@as(usize, 3), fixture.app.received);
+    try testing.expectEqual(@as(usize, 2), fixture.app.partial);
+}
+
+test "WebSocketSession closes with 1009 when a message exceeds the limit" {
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{ .max_message_size = 8 });
+
+    try fixture.client.sendFragment(.text, "12345", true, false);
+    try fixture.client.sendFragment(.text, "67890", false, true);
+
+    var close_reply = try fixture.client.receive();
+    defer close_reply.deinit();
+    try testing.expectEqual(websocket.MessageType.close, close_reply.type);
+    try testing.expectEqual(ws_integration.message_too_big, websocket.closeCode(close_reply.data));
+
+    fixture.stop();
+    try testing.expectEqual(@as(?i64, ws_integration.message_too_big), fixture.app.disconnect_code);
+}
+
+test "WebSocketSession closes with 1002 on an invalid close code" {
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{});
+
+    // 1006 is only ever reported locally and must not be echoed
+    try fixture.client.sendClose(1006, "");
+
+    var close_reply = try fixture.client.receive();
+    defer close_reply.deinit();
+    try testing.expectEqual(websocket.MessageType.close, close_reply.type);
+    try testing.expectEqual(ws_integration.protocol_error, websocket.closeCode(close_reply.data));
+
+    fixture.stop();
+    try testing.expectEqual(@as(?i64, ws_integration.protocol_error), fixture.app.disconnect_code);
+}
+
+test "WebSocketSession closes with 1007 on invalid UTF-8" {
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{});
+
+    try fixture.client.send(.text, "surrogate \xED\xA0\x80");
+
+    var close_reply = try fixture.client.receive();
+    defer close_reply.deinit();
+    try testing.expectEqual(websocket.MessageType.close, close_reply.type);
+    try testing.expectEqual(ws_integration.invalid_payload, websocket.closeCode(close_reply.data));
+
+    fixture.stop();
+    try testing.expectEqual(@as(?i64, ws_integration.invalid_payload), fixture.app.disconnect_code);
+}
+
+/// Stands in for the Python bridge's payload objects
+const FakePayloads = struct {
+    const Object = struct {
+        message_type: websocket.MessageType,
+        ascii: bool,
+        data: []const u8,
+    };
+
+    mutex: std.Thread.Mutex = .{},
+    live: usize = 0,
+    destroyed: usize = 0,
+
+    fn factory(self: *FakePayloads) ws_integration.PayloadFactory {
+        return .{ .context = self, .create = create, .destroy = destroy };
+    }
+
+    fn create(context: ?*anyopaque, message_type: websocket.MessageType, data: []const u8, ascii: bool) ?usize {
+        const self: *FakePayloads = @ptrCast(@alignCast(context.?));
+        const object = testing.allocator.create(Object) catch return null;
+        const copy = testing.allocator.dupe(u8, data) catch {
+            testing.allocator.destroy(object);
+            return null;
+        };
+        object.* = .{ .message_type = message_type, .ascii = ascii, .data = copy };
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.live += 1;
+        return @intFromPtr(object);
+    }
+
+    fn destroy(context: ?*anyopaque, handle: usize) void {
+        const self: *FakePayloads = @ptrCast(@alignCast(context.?));
+        const object: *Object = @ptrFromInt(handle);
+        testing.allocator.free(object.data);
+        testing.allocator.destroy(object);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.live -= 1;
+        self.destroyed += 1;
+    }
+};
+
+test "WebSocketSession hands payloads to the factory instead of copying them" {
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    var payloads = FakePayloads{};
+    var session = try WebSocketSession.init(testing.allocator, .{ .payloads = payloads.factory() }, pair.server, &headers);
+    var session_live = true;
+    defer if (session_live) session.deinit();
+
+    try session.start();
+    session.to_app.dispose(try session.to_app.receive()); // websocket.connect
+    try session.from_app.push(try protocol.createWebSocketAcceptMessage(testing.allocator, null, null));
+
+    var head_buf: [512]u8 = undefined;
+    _ = try readResponseHead(pair.client, &head_buf);
+    var client = websocket.Connection.init(pair.client, testing.allocator, false);
+    defer client.deinit();
+
+    try client.send(.text, "plain");
+    try client.send(.text, "caf\xC3\xA9");
+    try client.send(.binary, "\x00\xFF");
+
+    const expected = [_]FakePayloads.Object{
+        .{ .message_type = .text, .ascii = true, .data = "plain" },
+        .{ .message_type = .text, .ascii = false, .data = "caf\xC3\xA9" },
+        .{ .message_type = .binary, .ascii = false, .data = "\x00\xFF" },
+    };
+    for (expected) |want| {
+        const event = try session.to_app.receive();
+        defer session.to_app.dispose(event);
+        try testing.expectEqualStrings("websocket.receive", event.object.get("type").?.string);
+        try testing.expect(event.object.get("text") == null and event.object.get("bytes") == null);
+
+        const payload = protocol.payloadObject(event).?;
+        try testing.expectEqualStrings(if (want.message_type == .text) "text" else "bytes", payload.key);
+
+        // The application owns what it received
+        const object: *FakePayloads.Object = @ptrFromInt(payload.handle);
+        try testing.expectEqual(want.message_type, object.message_type);
+        try testing.expectEqual(want.ascii, object.ascii);
+        try testing.expectEqualSlices(u8, want.data, object.data);
+        FakePayloads.destroy(&payloads, payload.handle);
+    }
+
+    // Never received by the application, so the session drops it; the
+    // close reply shows the reader has queued it
+    try client.send(.binary, "unread");
+    try client.sendClose(1000, "");
+    var close_reply = try client.receive();
+    close_reply.deinit();
+
+    session.finish();
+    session.deinit();
+    session_live = false;
+
+    try testing.expectEqual(@as(usize, 0), payloads.live);
+    try testing.expectEqual(@as(usize, 4), payloads.destroyed);
+}
+
+test "WebSocketSession stops reading while the application is behind" {
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    const message_size = 1024;
+    var session = try WebSocketSession.init(testing.allocator, .{ .max_message_size = message_size }, pair.server, &headers);
+    defer session.deinit();
+    const bound = message_size * ws_integration.unread_messages;
+    try testing.expectEqual(@as(usize, bound), session.to_app.max_pending_bytes);
+
+    try session.start();
+    session.to_app.dispose(try session.to_app.receive()); // websocket.connect
+    try session.from_app.push(try protocol.createWebSocketAcceptMessage(testing.allocator, null, null));
+
+    var head_buf: [512]u8 = undefined;
+    _ = try readResponseHead(pair.client, &head_buf);
+    var client = websocket.Connection.init(pair.client, testing.allocator, false);
+    defer client.deinit();
+
+    // Far more than the bound; the socket buffers what the reader leaves
+    const message_count = 4 * ws_integration.unread_messages;
+    var payload: [message_size]u8 = undefined;
+    for (0..message_count) |i| {
+        @memset(&payload, @truncate(i));
+        try client.send(.binary, &payload);
+    }
+    std.time.sleep(50 * std.time.ns_per_ms);
+
+    session.to_app.mutex.lock();
+    const queued = session.to_app.messages.items.len;
+    const pending = session.to_app.pending_bytes;
+    session.to_app.mutex.unlock();
+    try testing.expect(queued <= ws_integration.unread_messages);
+    try testing.expect(pending <= bound);
+
+    // Everything arrives, in order, once the application catches up
+    for (0..message_count) |i| {
+        const event = try session.to_app.receive();
+        defer session.to_app.dispose(event);
+        const bytes = event.object.get("bytes").?.string;
+        try testing.expectEqual(@as(usize, message_size), bytes.len);
+        try testing.expectEqual(@as(u8, @truncate(i)), bytes[0]);
+    }
+
+    try client.sendClose(1000, "");
+    var close_reply = try client.receive();
+    close_reply.deinit();
+    session.finish();
+}
+
+/// Accepts, then sends `count` numbered messages as fast as the queue lets
+/// it, the way the Python bridge does
+const FloodApp = struct {
+    session: *WebSocketSession,
+    count: usize,
+    /// Payloads must outlive the writer's flush, which is after `serve`
+    /// may have returned
+    payloads: std.heap.ArenaAllocator,
+
+    fn run(self: *FloodApp) void {
+        self.serve() catch |err| std.debug.print("flood app failed: {!}\n", .{err});
+    }
+
+    fn serve(self: *FloodApp) !void {
+        const allocator = testing.allocator;
+        self.session.to_app.dispose(try self.session.to_app.receive());
+        try self.session.from_app.pushBounded(try protocol.createWebSocketAcceptMessage(allocator, null, null));
+
+        var payload: [1024]u8 = undefined;
+        for (0..self.count) |i| {
+            @memset(&payload, @truncate(i));
+            const data = try self.payloads.allocator().dupe(u8, &payload);
+            try self.session.from_app.pushBounded(try protocol.createWebSocketSendBinaryMessage(allocator, data));
+
+            // Never more than one message past the limit is waiting
+            self.session.from_app.mutex.lock();
+            const pending = self.session.from_app.pending_bytes;
+            self.session.from_app.mutex.unlock();
+            try testing.expect(pending <= self.session.config.max_buffered_bytes + payload.len);
+        }
+    }
+};
+
+test "WebSocketSession holds back sends beyond the buffer limit" {
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    var session = try WebSocketSession.init(testing.allocator, .{ .max_buffered_bytes = 4096, .per_message_deflate = false }, pair.server, &headers);
+    defer session.deinit();
+
+    var app = FloodApp{ .session = &session, .count = 200, .payloads = std.heap.ArenaAllocator.init(testing.allocator) };
+    defer app.payloads.deinit();
+    try session.start();
+    const app_thread = try std.Thread.spawn(.{}, FloodApp.run, .{&app});
+
+    var head_buf: [512]u8 = undefined;
+    _ = try readResponseHead(pair.client, &head_buf);
+    var client = websocket.Connection.init(pair.client, testing.allocator, false);
+    defer client.deinit();
+
+    // Read slowly at first so the app runs into the limit
+    std.time.sleep(50 * std.time.ns_per_ms);
+    for (0..app.count) |i| {
+        var message = try client.receive();
+        defer message.deinit();
+        try testing.expectEqual(@as(usize, 1024), message.data.len);
+        try testing.expectEqual(@as(u8, @truncate(i)), message.data[0]);
+    }
+
+    app_thread.join();
+    session.finish();
+    try testing.expectEqual(@as(usize, 0), session.from_app.pending_bytes);
+}
+
+fn sendMessages(client: *websocket.Connection, payload: []const u8, count: usize) void {
+    for (0..count) |_| {
+        client.send(.binary, payload) catch return;
+    }
+}
+
+test "WebSocketSession delivers broadcasts to every member" {
+    var hub = websocket.broadcast.Hub.init(testing.allocator);
+    defer hub.deinit();
+
+    var fixtures: [2]EchoFixture = undefined;
+    for (&fixtures) |*fixture| {
+        try fixture.start(.{ .hub = &hub });
+        try fixture.session.join("news");
+    }
+
+    const delivery = try hub.publish("news", .text, "extra");
+    try testing.expectEqual(@as(usize, 2), delivery.queued);
+
+    for (&fixtures) |*fixture| {
+        var message = try fixture.client.receive();
+        defer message.deinit();
+        try testing.expectEqual(websocket.MessageType.text, message.type);
+        try testing.expectEqualStrings("extra", message.data);
+    }
+
+    for (&fixtures) |*fixture| {
+        try fixture.client.sendClose(1000, "");
+        var close_reply = try fixture.client.receive();
+        close_reply.deinit();
+        fixture.stop();
+    }
+
+    // Finished sessions leave their groups
+    try testing.expectEqual(@as(usize, 0), hub.memberCount("news"));
+}
+
+test "WebSocketSession pings and keeps a connection that answers" {
+    var timers = try timer_wheel.TimerService.init(5 * std.time.ns_per_ms);
+    try timers.start();
+    defer timers.stop();
+
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{
+        .timers = &timers,
+        .ping_interval_ns = 40 * std.time.ns_per_ms,
+        .ping_timeout_ns = 20 * std.time.ns_per_ms,
+    });
+
+    // Outlive several timeouts by answering each ping
+    for (0..3) |_| {
+        var ping = try fixture.client.receive();
+        defer ping.deinit();
+        try testing.expectEqual(websocket.MessageType.ping, ping.type);
+        try fixture.client.send(.pong, ping.data);
+    }
+
+    try fixture.client.send(.text, "still here");
+    while (true) {
+        var message = try fixture.client.receive();
+        defer message.deinit();
+        if (message.type == .ping) {
+            try fixture.client.send(.pong, message.data);
+            continue;
+        }
+        try testing.expectEqualStrings("still here", message.data);
+        break;
+    }
+
+    try fixture.client.sendClose(1000, "");
+    while (true) {
+        var message = try fixture.client.receive();
+        defer message.deinit();
+        if (message.type == .close) break;
+    }
+
+    fixture.stop();
+    try testing.expectEqual(@as(?i64, 1000), fixture.app.disconnect_code);
+}
+
+test "WebSocketSession drops a connection that stops answering pings" {
+    var timers = try timer_wheel.TimerService.init(5 * std.time.ns_per_ms);
+    try timers.start();
+    defer timers.stop();
+
+    var fixture: EchoFixture = undefined;
+    try fixture.start(.{
+        .timers = &timers,
+        .ping_interval_ns = 20 * std.time.ns_per_ms,
+        .ping_timeout_ns = 20 * std.time.ns_per_ms,
+    });
+
+    var ping = try fixture.client.receive();
+    try testing.expectEqual(websocket.MessageType.ping, ping.type);
+    ping.deinit();
+
+    var close_frame = try fixture.client.receive();
+    defer close_frame.deinit();
+    try testing.expectEqual(websocket.MessageType.close, close_frame.type);
+    try testing.expectEqual(ws_integration.keepalive_timeout, websocket.closeCode(close_frame.data));
+    try testing.expectError(error.ConnectionClosed, fixture.client.receive());
+
+    fixture.stop();
+    try testing.expectEqual(@as(?i64, ws_integration.abnormal_closure), fixture.app.disconnect_code);
+}
+
+test "WebSocketSession leaves no keepalive scheduled when the app returns right after accepting" {
+    var timers = try timer_wheel.TimerService.init(5 * std.time.ns_per_ms);
+    try timers.start();
+    defer timers.stop();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    for (0..20) |_| {
+        var pair = try SocketPair.open();
+        defer pair.close();
+
+        var session = try WebSocketSession.init(testing.allocator, .{
+            .timers = &timers,
+            // Long enough that an armed timer is still pending below
+            .ping_interval_ns = 10 * std.time.ns_per_s,
+        }, pair.server, &headers);
+        defer session.deinit();
+
+        try session.start();
+        const connect = try session.to_app.receive();
+        try testing.expectEqualStrings("websocket.connect", connect.object.get("type").?.string);
+        session.to_app.dispose(connect);
+
+        // The writer may only get to the accept while finish is running
+        try session.from_app.push(try protocol.createWebSocketAcceptMessage(testing.allocator, null, null));
+        session.finish();
+
+        try testing.expect(!session.keepalive_timer.isScheduled());
+    }
+}
+
+test "WebSocket echo throughput" {
+    const message_count = 5000;
+    const message_size = 1024;
+
+    var pair = try SocketPair.open();
+    defer pair.close();
+
+    var headers = try upgradeHeaders(testing.allocator);
+    defer headers.deinit();
+
+    var session = try WebSocketSession.init(testing.allocator, .{}, pair.server, &headers);
+    defer session.deinit();
+
+    var app = EchoApp{ .session = &session };
+    defer app.deinit();
+    try session.start();
+    const app_thread = try std.Thread.spawn(.{}, EchoApp.run, .{&app});
+
+    var head_buf: [512]u8 = undefined;
+    _ = try readResponseHead(pair.client, &head_buf);
+
+    var client = websocket.Connection.init(pair.client, testing.allocator, false);
+    defer client.deinit();
+
+    var payload: [message_size]u8 = undefined;
+    std.crypto.random.bytes(&payload);
+
+    const started = try std.time.Instant.now();
+
+    // Send from a second thread so the echo path is kept full
+    const sender = try std.Thread.spawn(.{}, sendMessages, .{ &client, @as([]const u8, &payload), @as(usize, message_count) });
+
+    var echoed_bytes: usize = 0;
+    for (0..message_count) |_| {
+        var echoed = try client.receive();
+        defer echoed.deinit();
+        echoed_bytes += echoed.data.len;
+    }
+
+    const elapsed_ns = (try std.time.Instant.now()).since(started);
+    sender.join();
+
+    try client.sendClose(1000, "");
+    var close_reply = try client.receive();
+    close_reply.deinit();
+
+    app_thread.join();
+    session.finish();
+
+    try testing.expectEqual(@as(usize, message_count * message_size), echoed_bytes);
+
+    const seconds = @as(f64, @floatFromInt(elapsed_ns)) / std.time.ns_per_s;
+    std.debug.print("\nWebSocket echo: {d} x {d} B in {d:.3} s ({d:.0} msg/s, {d:.1} MiB/s)\n", .{
+        message_count,
+        message_size,
+        seconds,
+        @as(f64, @floatFromInt(message_count)) / seconds,
+        @as(f64, @floatFromInt(echoed_bytes)) / seconds / (1024 * 1024),
+    });
+}
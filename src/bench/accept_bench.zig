@@ -0,0 +1,269 @@
+//! Accept distribution benchmark behind `zig build bench-accept`.
+//!
+//! For each accept mode, forks worker processes that serve a fixed HTTP
+//! response on sockets bound the way the master binds them, then drives
+//! them with concurrent short-lived connections. Worker 0 spends extra time
+//! on every request, standing in for a Python worker busy with a slow
+//! handler. Prints the request rate, latency percentiles and how many
+//! connections each worker accepted.
+//!
+//!     zig build bench-accept -Doptimize=ReleaseFast -- --workers 8 --slow-ms 10
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const http_server = @import("http_server");
+
+const Mode = struct {
+    name: []const u8,
+    accept_mode: http_server.AcceptMode,
+    steering: http_server.Steering = .hash,
+};
+
+const all_modes = [_]Mode{
+    .{ .name = "shared", .accept_mode = .shared },
+    .{ .name = "exclusive", .accept_mode = .exclusive },
+    .{ .name = "reuseport-hash", .accept_mode = .reuseport, .steering = .hash },
+    .{ .name = "reuseport-cpu", .accept_mode = .reuseport, .steering = .cpu },
+};
+
+const Options = struct {
+    workers: usize = 4,
+    /// Client threads, each opening one connection per request
+    clients: usize = 32,
+    requests: usize = 500,
+    /// Extra time worker 0 spends on each request
+    slow_ms: u64 = 5,
+};
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        if (i + 1 >= args.len) return usage();
+        const value = std.fmt.parseInt(usize, args[i + 1], 10) catch return usage();
+        if (std.mem.eql(u8, args[i], "--workers")) {
+            options.workers = @max(value, 1);
+        } else if (std.mem.eql(u8, args[i], "--clients")) {
+            options.clients = @max(value, 1);
+        } else if (std.mem.eql(u8, args[i], "--requests")) {
+            options.requests = value;
+        } else if (std.mem.eql(u8, args[i], "--slow-ms")) {
+            options.slow_ms = value;
+        } else {
+            return usage();
+        }
+        i += 1;
+    }
+
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("{d} workers, {d} clients x {d} requests, worker 0 +{d} ms per request\n\n", .{
+        options.workers, options.clients, options.requests, options.slow_ms,
+    });
+    try stdout.print("{s:<15} {s:>9} {s:>9} {s:>9}  connections per worker\n", .{ "mode", "req/s", "p50 us", "p99 us" });
+
+    for (all_modes) |mode| {
+        runMode(allocator, mode, options, stdout) catch |err| {
+            try stdout.print("{s:<15} failed: {}\n", .{ mode.name, err });
+        };
+    }
+    return 0;
+}
+
+fn usage() u8 {
+    std.debug.print(
+        \\Usage: accept-bench [--workers N] [--clients N] [--requests N] [--slow-ms N]
+        \\
+    , .{});
+    return 2;
+}
+
+/// One forked worker as seen from the benchmark
+const Child = struct {
+    pid: std.posix.pid_t,
+    /// Closed to stop the worker
+    control: std.posix.fd_t,
+    /// The worker writes its accept count here before exiting
+    result: std.posix.fd_t,
+};
+
+fn runMode(allocator: Allocator, mode: Mode, options: Options, out: anytype) !void {
+    // Bound the way WorkerPool.listen binds them, on a free port
+    const listeners = if (mode.accept_mode == .reuseport)
+        try http_server.bindReusePortGroup(allocator, "127.0.0.1", 0, 1024, options.workers, mode.steering)
+    else blk: {
+        const shared = try allocator.alloc(std.net.Server, 1);
+        errdefer allocator.free(shared);
+        shared[0] = try http_server.bindListener("127.0.0.1", 0, 1024, false);
+        break :blk shared;
+    };
+    defer allocator.free(listeners);
+    var listening = true;
+    defer if (listening) for (listeners) |listener| std.posix.close(listener.stream.handle);
+    const address = listeners[0].listen_address;
+
+    const children = try allocator.alloc(Child, options.workers);
+    defer allocator.free(children);
+
+    var forked: usize = 0;
+    defer for (children[0..forked]) |child| {
+        if (child.control >= 0) std.posix.close(child.control);
+        std.posix.close(child.result);
+        _ = std.posix.waitpid(child.pid, 0);
+    };
+    for (children, 0..) |*child, index| {
+        const listener = listeners[if (mode.accept_mode == .reuseport) index else 0];
+        child.* = try forkWorker(listeners, listener, mode.accept_mode, children[0..forked], if (index == 0) options.slow_ms else 0);
+        forked += 1;
+    }
+
+    // Only the workers accept
+    for (listeners) |listener| std.posix.close(listener.stream.handle);
+    listening = false;
+
+    const samples = try allocator.alloc(u64, options.clients * options.requests);
+    defer allocator.free(samples);
+
+    const clients = try allocator.alloc(Client, options.clients);
+    defer allocator.free(clients);
+    const threads = try allocator.alloc(std.Thread, options.clients);
+    defer allocator.free(threads);
+
+    const start = try std.time.Instant.now();
+    for (clients, threads, 0..) |*client, *thread, index| {
+        client.* = .{ .address = address, .samples = samples[index * options.requests ..][0..options.requests] };
+        thread.* = try std.Thread.spawn(.{}, Client.run, .{client});
+    }
+    for (threads) |thread| thread.join();
+    const elapsed_ns = (try std.time.Instant.now()).since(start);
+
+    for (clients) |client| {
+        if (client.err) |err| return err;
+    }
+
+    // Stop the workers and collect their counts
+    for (children[0..forked]) |*child| {
+        std.posix.close(child.control);
+        child.control = -1;
+    }
+    var counts_buf: [256]u8 = undefined;
+    var counts = std.io.fixedBufferStream(&counts_buf);
+    for (children[0..forked]) |child| {
+        var count: u64 = 0;
+        _ = try std.posix.read(child.result, std.mem.asBytes(&count));
+        counts.writer().print(" {d}", .{count}) catch {};
+    }
+
+    std.mem.sort(u64, samples, {}, std.sort.asc(u64));
+    const rate = @as(f64, @floatFromInt(samples.len)) / (@as(f64, @floatFromInt(elapsed_ns)) / std.time.ns_per_s);
+    try out.print("{s:<15} {d:>9.0} {d:>9.1} {d:>9.1} {s}\n", .{
+        mode.name,
+        rate,
+        percentileMicros(samples, 500),
+        percentileMicros(samples, 990),
+        counts.getWritten(),
+    });
+}
+
+/// Fork a worker serving on `listener` until its control pipe closes
+fn forkWorker(listeners: []const std.net.Server, listener: std.net.Server, accept_mode: http_server.AcceptMode, siblings: []const Child, slow_ms: u64) !Child {
+    const control = try std.posix.pipe();
+    const result = try std.posix.pipe();
+
+    const pid = try std.posix.fork();
+    if (pid == 0) {
+        std.posix.close(control[1]);
+        std.posix.close(result[0]);
+        for (siblings) |sibling| {
+            std.posix.close(sibling.control);
+            std.posix.close(sibling.result);
+        }
+        for (listeners) |other| {
+            if (other.stream.handle != listener.stream.handle) std.posix.close(other.stream.handle);
+        }
+
+        const count = serve(listener, accept_mode, control[0], slow_ms);
+        _ = std.posix.write(result[1], std.mem.asBytes(&count)) catch {};
+        std.posix.exit(0);
+    }
+
+    std.posix.close(control[0]);
+    std.posix.close(result[1]);
+    return Child{ .pid = pid, .control = control[1], .result = result[0] };
+}
+
+/// Worker loop: accept, read the request head, answer, close. Returns the
+/// number of connections accepted.
+fn serve(listener: std.net.Server, accept_mode: http_server.AcceptMode, control: std.posix.fd_t, slow_ms: u64) u64 {
+    var server = http_server.Server.init(std.heap.page_allocator, .{ .accept_mode = accept_mode });
+    server.adopt(listener);
+
+    const response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+    var count: u64 = 0;
+    var buf: [1024]u8 = undefined;
+    while (true) {
+        const conn = server.accept() catch |err| switch (err) {
+            error.WouldBlock => {
+                const stop = server.waitForConnection(control, 100) catch true;
+                if (stop) return count;
+                continue;
+            },
+            else => continue,
+        };
+        defer conn.stream.close();
+        count += 1;
+
+        var len: usize = 0;
+        while (std.mem.indexOf(u8, buf[0..len], "\r\n\r\n") == null and len < buf.len) {
+            const n = conn.stream.read(buf[len..]) catch break;
+            if (n == 0) break;
+            len += n;
+        }
+        if (slow_ms > 0) std.time.sleep(slow_ms * std.time.ns_per_ms);
+        conn.stream.writeAll(response) catch {};
+    }
+}
+
+const Client = struct {
+    address: std.net.Address,
+    /// Round-trip time of each request in nanoseconds
+    samples: []u64,
+    err: ?anyerror = null,
+
+    fn run(self: *Client) void {
+        for (self.samples) |*sample| {
+            sample.* = self.request() catch |err| {
+                self.err = err;
+                return;
+            };
+        }
+    }
+
+    /// One request on a new connection
+    fn request(self: *Client) !u64 {
+        const start = try std.time.Instant.now();
+
+        const stream = try std.net.tcpConnectToAddress(self.address);
+        defer stream.close();
+        try stream.writeAll("GET / HTTP/1.1\r\nHost: bench\r\n\r\n");
+
+        var buf: [256]u8 = undefined;
+        while (try stream.read(&buf) > 0) {}
+
+        return (try std.time.Instant.now()).since(start);
+    }
+};
+
+/// Sample at `per_mille` of the sorted samples, in microseconds
+fn percentileMicros(sorted: []const u64, per_mille: usize) f64 {
+    if (sorted.len == 0) return 0;
+    const index = @min(sorted.len - 1, sorted.len * per_mille / 1000);
+    return @as(f64, @floatFromInt(sorted[index])) / std.time.ns_per_us;
+}
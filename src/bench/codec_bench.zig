@@ -0,0 +1,151 @@
+//! WebSocket payload codec throughput behind `zig build bench-codec`.
+//!
+//! Masks a large buffer with `applyMask` and with a byte-by-byte loop,
+//! then validates ASCII and mixed-width UTF-8 text alone and fused with
+//! unmasking, and reports each in GB/s. Always built ReleaseFast, whatever
+//! -Doptimize says, so the numbers reflect production code.
+//!
+//!     zig build bench-codec -- --size 4194304 --rounds 128
+
+const std = @import("std");
+const websocket = @import("websocket");
+const mask = websocket.mask;
+const utf8 = websocket.utf8;
+
+const Options = struct {
+    /// Bytes in the buffer each pass runs over
+    size: usize = 1024 * 1024,
+    /// Passes over the buffer per measurement
+    rounds: usize = 64,
+};
+
+const key = [_]u8{ 0x37, 0xFA, 0x21, 0x3D };
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    const options = parseArgs(args) catch |err| {
+        std.debug.print("Invalid arguments: {}\n", .{err});
+        printUsage();
+        return 2;
+    };
+
+    const buffer = try allocator.alloc(u8, options.size);
+    defer allocator.free(buffer);
+
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("{d} rounds over {d} bytes\n", .{ options.rounds, options.size });
+    try benchMask(stdout, buffer, options.rounds);
+    if (!try benchUtf8(stdout, buffer, options.rounds)) {
+        try stdout.print("valid text was rejected\n", .{});
+        return 1;
+    }
+    return 0;
+}
+
+fn printUsage() void {
+    std.debug.print(
+        \\Usage: codec-bench [OPTIONS]
+        \\
+        \\  --size N      Bytes per pass. [default: 1048576]
+        \\  --rounds N    Passes per measurement. [default: 64]
+        \\
+    , .{});
+}
+
+fn parseArgs(args: []const []const u8) !Options {
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 >= args.len) return error.MissingValue;
+        const value = args[i + 1];
+        i += 1;
+
+        if (std.mem.eql(u8, arg, "--size")) {
+            options.size = @max(try std.fmt.parseInt(usize, value, 10), 1);
+        } else if (std.mem.eql(u8, arg, "--rounds")) {
+            options.rounds = @max(try std.fmt.parseInt(usize, value, 10), 1);
+        } else {
+            return error.UnknownOption;
+        }
+    }
+    return options;
+}
+
+/// GB/s for `bytes` processed in `ns`
+fn gigabytesPerSecond(bytes: usize, ns: u64) f64 {
+    return @as(f64, @floatFromInt(bytes)) / @as(f64, @floatFromInt(@max(ns, 1)));
+}
+
+fn maskScalar(mask_key: [4]u8, data: []u8, offset: usize) void {
+    for (data, 0..) |*byte, i| {
+        byte.* ^= mask_key[(offset + i) % 4];
+    }
+}
+
+fn benchMask(out: anytype, buffer: []u8, rounds: usize) !void {
+    @memset(buffer, 0x5A);
+
+    var timer = try std.time.Timer.start();
+    for (0..rounds) |round| mask.applyMask(key, buffer, round);
+    const vector_ns = timer.lap();
+    std.mem.doNotOptimizeAway(buffer[buffer.len / 2]);
+
+    for (0..rounds) |round| maskScalar(key, buffer, round);
+    const scalar_ns = timer.read();
+    std.mem.doNotOptimizeAway(buffer[buffer.len / 2]);
+
+    const total = buffer.len * rounds;
+    try out.print("applyMask ({d}-byte vectors): {d:.2} GB/s, byte loop: {d:.2} GB/s\n", .{
+        mask.vector_len,
+        gigabytesPerSecond(total, vector_ns),
+        gigabytesPerSecond(total, scalar_ns),
+    });
+}
+
+/// Validate every payload, fused with unmasking or not. Returns whether
+/// all of the (well-formed) text passed.
+fn benchUtf8(out: anytype, buffer: []u8, rounds: usize) !bool {
+    var valid = true;
+
+    @memset(buffer, 'a');
+    valid = try benchValidate(out, "ascii validate", buffer, rounds, false) and valid;
+
+    // Two-, three- and four-byte sequences throughout
+    const mixed = "ascii κόσμε 日本語 \u{1F600} ";
+    for (buffer, 0..) |*byte, i| byte.* = mixed[i % mixed.len];
+    const whole = buffer[0 .. buffer.len - buffer.len % mixed.len];
+    valid = try benchValidate(out, "mixed validate", whole, rounds, false) and valid;
+
+    // Fused pass, reported as unmask plus validate bytes
+    mask.applyMask(key, whole, 0);
+    valid = try benchValidate(out, "mixed unmask+validate", whole, rounds, true) and valid;
+    return valid;
+}
+
+fn benchValidate(out: anytype, name: []const u8, payload: []u8, rounds: usize, fused: bool) !bool {
+    var valid = true;
+    var timer = try std.time.Timer.start();
+    for (0..rounds) |_| {
+        if (fused) {
+            var validator = utf8.Validator{};
+            utf8.unmaskAndValidate(key, payload, 0, &validator);
+            valid = valid and validator.isComplete();
+            // Mask again so every round unmasks the same bytes
+            mask.applyMask(key, payload, 0);
+        } else {
+            valid = valid and utf8.validate(payload);
+        }
+    }
+    const elapsed = timer.read();
+
+    const bytes = payload.len * rounds * @as(usize, if (fused) 2 else 1);
+    try out.print("utf8 {s}: {d:.2} GB/s\n", .{ name, gigabytesPerSecond(bytes, elapsed) });
+    return valid;
+}
@@ -0,0 +1,397 @@
+//! HTTP/2 flood check behind `zig build bench-h2`.
+//!
+//! Starts a single ladybug worker on tests/app.py and attacks it over h2c
+//! the way rapid reset (CVE-2023-44487) and control-frame floods do. Each
+//! scenario sends one kind of abusive frame as fast as the connection
+//! takes it until the server answers GOAWAY ENHANCE_YOUR_CALM, then
+//! reconnects, for a fixed time. It reports how many frames a connection
+//! got away with and the server's CPU time per frame, and checks that a
+//! normal request still succeeds afterwards. Exits non-zero when a
+//! connection is never cut off, the server stops answering, or its CPU
+//! time per frame exceeds --max-cpu-us.
+//!
+//!     zig build bench-h2 -Doptimize=ReleaseFast -- --duration 5
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const h2_frames = @import("h2_frames");
+const autoscale = @import("autoscale");
+
+const Options = struct {
+    host: []const u8 = "127.0.0.1",
+    port: u16 = 8767,
+    /// ladybug binary to start (set by zig build)
+    server: ?[]const u8 = null,
+    app: []const u8 = "tests.app:app",
+    /// Seconds each scenario attacks for
+    duration: u64 = 3,
+    /// Frames a connection may send without being cut off before the
+    /// scenario fails
+    frame_limit: usize = 10_000,
+    /// Server CPU microseconds allowed per attack frame
+    max_cpu_us: f64 = 100,
+    /// Extra arguments for the server
+    server_args: []const []const u8 = &.{},
+};
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const options = parseArgs(arena.allocator(), args) catch |err| {
+        std.debug.print("Invalid arguments: {}\n", .{err});
+        printUsage();
+        return 2;
+    };
+    const path = options.server orelse {
+        printUsage();
+        return 2;
+    };
+
+    const address = try std.net.Address.resolveIp(options.host, options.port);
+
+    var server = try startServer(arena.allocator(), path, options);
+    defer _ = server.kill() catch null;
+    try waitForServer(address);
+
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("{s:<14} {s:>6} {s:>9} {s:>10} {s:>8} {s:>9}\n", .{ "scenario", "conns", "frames", "max/conn", "cpu", "us/frame" });
+
+    var failures: usize = 0;
+    for (scenarios) |scenario| {
+        const result = try runScenario(allocator, address, server.id, scenario, options);
+        try stdout.print("{s:<14} {d:>6} {d:>9} {d:>10} {d:>7.0}% {d:>9.2}\n", .{
+            scenario.name,
+            result.connections,
+            result.frames,
+            result.max_frames_per_connection,
+            result.cpu_share * 100,
+            result.cpuUsPerFrame(),
+        });
+
+        if (result.uncut > 0) {
+            try stdout.print("FAIL {s}: {d} connections sent {d} frames without GOAWAY ENHANCE_YOUR_CALM\n", .{ scenario.name, result.uncut, options.frame_limit });
+            failures += 1;
+        }
+        if (result.cpuUsPerFrame() > options.max_cpu_us) {
+            try stdout.print("FAIL {s}: {d:.2} us of server CPU per frame, over {d:.2}\n", .{ scenario.name, result.cpuUsPerFrame(), options.max_cpu_us });
+            failures += 1;
+        }
+        healthCheck(address) catch |err| {
+            try stdout.print("FAIL {s}: server did not answer a normal request afterwards: {}\n", .{ scenario.name, err });
+            failures += 1;
+        };
+    }
+
+    try stdout.print("{d}/{d} scenarios passed\n", .{ scenarios.len - @min(failures, scenarios.len), scenarios.len });
+    return if (failures == 0) 0 else 1;
+}
+
+fn printUsage() void {
+    std.debug.print(
+        \\Usage: h2-flood-bench --server PATH [OPTIONS] [-- SERVER ARGS]
+        \\
+        \\  --server PATH      ladybug binary to start (set by zig build)
+        \\  --host TEXT        [default: 127.0.0.1]
+        \\  --port INTEGER     [default: 8767]
+        \\  --app TEXT         [default: tests.app:app]
+        \\  --duration N       Seconds per scenario. [default: 3]
+        \\  --frame-limit N    Frames a connection may send before it must be
+        \\                     cut off. [default: 10000]
+        \\  --max-cpu-us N     Server CPU microseconds allowed per attack frame.
+        \\                     [default: 100]
+        \\
+    , .{});
+}
+
+fn parseArgs(allocator: Allocator, args: []const []const u8) !Options {
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--")) {
+            options.server_args = try allocator.dupe([]const u8, args[i + 1 ..]);
+            break;
+        }
+        if (i + 1 >= args.len) return error.MissingValue;
+        const value = args[i + 1];
+        i += 1;
+
+        if (std.mem.eql(u8, arg, "--server")) {
+            options.server = value;
+        } else if (std.mem.eql(u8, arg, "--host")) {
+            options.host = value;
+        } else if (std.mem.eql(u8, arg, "--port")) {
+            options.port = try std.fmt.parseInt(u16, value, 10);
+        } else if (std.mem.eql(u8, arg, "--app")) {
+            options.app = value;
+        } else if (std.mem.eql(u8, arg, "--duration")) {
+            options.duration = @max(try std.fmt.parseInt(u64, value, 10), 1);
+        } else if (std.mem.eql(u8, arg, "--frame-limit")) {
+            options.frame_limit = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--max-cpu-us")) {
+            options.max_cpu_us = try std.fmt.parseFloat(f64, value);
+        } else {
+            return error.UnknownOption;
+        }
+    }
+    return options;
+}
+
+fn startServer(allocator: Allocator, path: []const u8, options: Options) !std.process.Child {
+    const port = try std.fmt.allocPrint(allocator, "{d}", .{options.port});
+
+    // One worker, so the server's pid is the process doing the work
+    var argv = std.ArrayList([]const u8).init(allocator);
+    try argv.appendSlice(&.{ path, "--host", options.host, "--port", port, "--workers", "1" });
+    try argv.appendSlice(options.server_args);
+    try argv.append(options.app);
+
+    var child = std.process.Child.init(argv.items, allocator);
+    // The app logs every request; keep that out of the results
+    child.stdin_behavior = .Ignore;
+    child.stdout_behavior = .Ignore;
+    child.stderr_behavior = .Ignore;
+    try child.spawn();
+    return child;
+}
+
+/// Poll until the server accepts connections
+fn waitForServer(address: std.net.Address) !void {
+    var attempts: usize = 0;
+    while (attempts < 100) : (attempts += 1) {
+        if (std.net.tcpConnectToAddress(address)) |stream| {
+            stream.close();
+            return;
+        } else |_| {
+            std.time.sleep(100 * std.time.ns_per_ms);
+        }
+    }
+    return error.ServerNotReady;
+}
+
+/// One GET over HTTP/1.1, which must be answered with 200
+fn healthCheck(address: std.net.Address) !void {
+    const stream = try std.net.tcpConnectToAddress(address);
+    defer stream.close();
+    try stream.writeAll("GET / HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n");
+
+    var buf: [64]u8 = undefined;
+    var len: usize = 0;
+    while (len < 12) {
+        const n = try stream.read(buf[len..]);
+        if (n == 0) return error.IncompleteResponse;
+        len += n;
+    }
+    if (!std.mem.startsWith(u8, buf[0..len], "HTTP/1.1 200")) return error.UnexpectedStatus;
+}
+
+/// One kind of abusive traffic
+const Scenario = struct {
+    name: []const u8,
+    /// Queue one round of the attack; returns the frames queued
+    attack: *const fn (attacker: *Attacker) anyerror!usize,
+    /// Frames sent once after the preface, such as a stream to attack
+    setup: ?*const fn (attacker: *Attacker) anyerror!void = null,
+};
+
+const scenarios = [_]Scenario{
+    .{ .name = "rapid-reset", .attack = rapidReset },
+    .{ .name = "ping", .attack = pingFlood },
+    .{ .name = "settings", .attack = settingsFlood },
+    .{ .name = "empty-data", .attack = emptyDataFlood, .setup = openStream },
+    .{ .name = "window-update", .attack = windowUpdateFlood },
+};
+
+/// GET / from the static table: :method GET, :scheme http, :path /, and
+/// :authority as a literal that is not indexed
+const request_block = "\x82\x86\x84\x01\x05bench";
+
+/// Open a stream and cancel it at once
+fn rapidReset(attacker: *Attacker) !usize {
+    const stream_id = attacker.next_stream;
+    attacker.next_stream += 2;
+    try attacker.frame(.HEADERS, h2_frames.FrameFlags.END_HEADERS | h2_frames.FrameFlags.END_STREAM, stream_id, request_block);
+
+    var code: [4]u8 = undefined;
+    std.mem.writeInt(u32, &code, @intFromEnum(h2_frames.ErrorCode.CANCEL), .big);
+    try attacker.frame(.RST_STREAM, 0, stream_id, &code);
+    return 2;
+}
+
+fn pingFlood(attacker: *Attacker) !usize {
+    try attacker.frame(.PING, 0, 0, &[_]u8{0} ** 8);
+    return 1;
+}
+
+fn settingsFlood(attacker: *Attacker) !usize {
+    try attacker.frame(.SETTINGS, 0, 0, "");
+    return 1;
+}
+
+/// A request whose body never arrives, for empty DATA frames to land on
+fn openStream(attacker: *Attacker) !void {
+    try attacker.frame(.HEADERS, h2_frames.FrameFlags.END_HEADERS, 1, request_block);
+    attacker.next_stream = 3;
+}
+
+fn emptyDataFlood(attacker: *Attacker) !usize {
+    try attacker.frame(.DATA, 0, 1, "");
+    return 1;
+}
+
+fn windowUpdateFlood(attacker: *Attacker) !usize {
+    var increment: [4]u8 = undefined;
+    std.mem.writeInt(u32, &increment, 1, .big);
+    try attacker.frame(.WINDOW_UPDATE, 0, 0, &increment);
+    return 1;
+}
+
+/// Attack rounds queued before each write
+const rounds_per_write = 64;
+
+/// Client side of one attacking connection
+const Attacker = struct {
+    stream: std.net.Stream,
+    reader: h2_frames.FrameReader,
+    out: std.ArrayList(u8),
+    next_stream: u31 = 1,
+    frames_sent: usize = 0,
+    goaway: ?h2_frames.ErrorCode = null,
+    closed: bool = false,
+
+    fn open(allocator: Allocator, address: std.net.Address) !Attacker {
+        const stream = try std.net.tcpConnectToAddress(address);
+        errdefer stream.close();
+
+        return Attacker{
+            .stream = stream,
+            .reader = try h2_frames.FrameReader.init(allocator, 16384),
+            .out = std.ArrayList(u8).init(allocator),
+        };
+    }
+
+    /// Queue the connection preface and our (empty) settings
+    fn greet(self: *Attacker) !void {
+        try self.out.appendSlice(h2_frames.CONNECTION_PREFACE);
+        try self.frame(.SETTINGS, 0, 0, "");
+    }
+
+    fn deinit(self: *Attacker) void {
+        self.stream.close();
+        self.reader.deinit();
+        self.out.deinit();
+    }
+
+    fn frame(self: *Attacker, frame_type: h2_frames.FrameType, flags: u8, stream_id: u31, payload: []const u8) !void {
+        var header: [h2_frames.FrameHeader.SIZE]u8 = undefined;
+        const frame_header = h2_frames.FrameHeader{
+            .length = @intCast(payload.len),
+            .frame_type = frame_type,
+            .flags = flags,
+            .stream_id = stream_id,
+        };
+        try frame_header.serialize(&header);
+        try self.out.appendSlice(&header);
+        try self.out.appendSlice(payload);
+    }
+
+    /// Write everything queued; a connection the server has dropped is
+    /// marked closed
+    fn send(self: *Attacker) !void {
+        defer self.out.clearRetainingCapacity();
+        self.stream.writeAll(self.out.items) catch |err| switch (err) {
+            error.BrokenPipe, error.ConnectionResetByPeer => self.closed = true,
+            else => return err,
+        };
+    }
+
+    /// Read whatever the server has sent so far without blocking, looking
+    /// for its GOAWAY
+    fn drain(self: *Attacker) !void {
+        while (!self.closed and self.goaway == null) {
+            var fds = [_]std.posix.pollfd{.{ .fd = self.stream.handle, .events = std.posix.POLL.IN, .revents = 0 }};
+            if (try std.posix.poll(&fds, 0) == 0) return;
+
+            const n = self.reader.fill(self.stream.handle) catch 0;
+            if (n == 0) {
+                self.closed = true;
+                return;
+            }
+            while (try self.reader.next()) |received| {
+                if (received.header.frame_type == .GOAWAY and received.payload.len >= 8) {
+                    self.goaway = @enumFromInt(std.mem.readInt(u32, received.payload[4..8], .big));
+                }
+            }
+        }
+    }
+
+    /// Wait briefly for the GOAWAY of a connection that was dropped
+    /// before it could be read
+    fn awaitGoAway(self: *Attacker) void {
+        var waited: usize = 0;
+        while (self.goaway == null and !self.closed and waited < 100) : (waited += 1) {
+            self.drain() catch return;
+            if (self.goaway == null) std.time.sleep(std.time.ns_per_ms);
+        }
+    }
+};
+
+const Result = struct {
+    connections: usize = 0,
+    frames: usize = 0,
+    max_frames_per_connection: usize = 0,
+    /// Connections that reached the frame limit without being cut off
+    uncut: usize = 0,
+    cpu_share: f64 = 0,
+    elapsed_ms: i64 = 0,
+
+    fn cpuUsPerFrame(self: Result) f64 {
+        if (self.frames == 0) return 0;
+        const cpu_us = self.cpu_share * @as(f64, @floatFromInt(self.elapsed_ms)) * std.time.us_per_ms;
+        return cpu_us / @as(f64, @floatFromInt(self.frames));
+    }
+};
+
+/// Attack on fresh connections until the duration is up, measuring the
+/// server's CPU time meanwhile
+fn runScenario(allocator: Allocator, address: std.net.Address, pid: std.posix.pid_t, scenario: Scenario, options: Options) !Result {
+    var result = Result{};
+    const start_ms = std.time.milliTimestamp();
+    const end_ms = start_ms + @as(i64, @intCast(options.duration * std.time.ms_per_s));
+    const start_ticks = try autoscale.processCpuTicks(pid);
+
+    while (std.time.milliTimestamp() < end_ms) {
+        var attacker = try Attacker.open(allocator, address);
+        defer attacker.deinit();
+        result.connections += 1;
+
+        try attacker.greet();
+        if (scenario.setup) |setup| try setup(&attacker);
+        try attacker.send();
+
+        var sent: usize = 0;
+        while (!attacker.closed and attacker.goaway == null and sent < options.frame_limit) {
+            for (0..rounds_per_write) |_| sent += try scenario.attack(&attacker);
+            try attacker.send();
+            try attacker.drain();
+        }
+        attacker.awaitGoAway();
+
+        result.frames += sent;
+        result.max_frames_per_connection = @max(result.max_frames_per_connection, sent);
+        const cut_off = if (attacker.goaway) |code| code == .ENHANCE_YOUR_CALM else false;
+        if (!cut_off) result.uncut += 1;
+    }
+
+    result.elapsed_ms = std.time.milliTimestamp() - start_ms;
+    const ticks = try autoscale.processCpuTicks(pid);
+    result.cpu_share = autoscale.cpuShare(ticks -| start_ticks, result.elapsed_ms);
+    return result;
+}
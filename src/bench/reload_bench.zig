@@ -0,0 +1,212 @@
+//! Zero-downtime reload check behind `zig build bench-reload`.
+//!
+//! Starts ladybug with several workers on tests/app.py, keeps it under
+//! HTTP load from client threads that open a connection per request, and
+//! sends the master SIGHUP at a fixed interval. Every request must succeed
+//! across the reloads; exits non-zero on any refused connection, reset or
+//! incomplete response.
+//!
+//!     zig build bench-reload -Doptimize=ReleaseFast -- --workers 4 --reloads 5
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const Options = struct {
+    host: []const u8 = "127.0.0.1",
+    port: u16 = 8766,
+    /// ladybug binary to start (set by zig build)
+    server: ?[]const u8 = null,
+    app: []const u8 = "tests.app:app",
+    workers: usize = 4,
+    clients: usize = 16,
+    reloads: usize = 3,
+    /// Seconds between reloads, and of load before the first and after
+    /// the last
+    interval: u64 = 3,
+    /// Extra arguments for the server, such as "--accept-mode=reuseport"
+    server_args: []const []const u8 = &.{},
+};
+
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const options = parseArgs(arena.allocator(), args) catch |err| {
+        std.debug.print("Invalid arguments: {}\n", .{err});
+        printUsage();
+        return 2;
+    };
+    const path = options.server orelse {
+        printUsage();
+        return 2;
+    };
+
+    const address = try std.net.Address.resolveIp(options.host, options.port);
+
+    var server = try startServer(arena.allocator(), path, options);
+    defer _ = server.kill() catch null;
+    try waitForServer(address);
+
+    var stats = Stats{};
+    var stop = std.atomic.Value(bool).init(false);
+
+    const threads = try allocator.alloc(std.Thread, options.clients);
+    defer allocator.free(threads);
+    var spawned: usize = 0;
+    defer {
+        stop.store(true, .release);
+        for (threads[0..spawned]) |thread| thread.join();
+    }
+    for (threads) |*thread| {
+        thread.* = try std.Thread.spawn(.{}, runClient, .{ address, &stats, &stop });
+        spawned += 1;
+    }
+
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("{d} workers, {d} clients, {d} reloads {d} s apart\n", .{ options.workers, options.clients, options.reloads, options.interval });
+
+    for (0..options.reloads) |reload| {
+        std.time.sleep(options.interval * std.time.ns_per_s);
+        try std.posix.kill(server.id, std.posix.SIG.HUP);
+        try stdout.print("reload {d}: {d} ok, {d} failed so far\n", .{ reload + 1, stats.ok.load(.acquire), stats.failed.load(.acquire) });
+    }
+    std.time.sleep(options.interval * std.time.ns_per_s);
+
+    stop.store(true, .release);
+    for (threads[0..spawned]) |thread| thread.join();
+    spawned = 0;
+
+    const ok = stats.ok.load(.acquire);
+    const failed = stats.failed.load(.acquire);
+    try stdout.print("{d} requests, {d} failed\n", .{ ok + failed, failed });
+    const first_error = stats.first_error.load(.acquire);
+    if (first_error != 0) try stdout.print("first failure: {s}\n", .{@errorName(@errorFromInt(first_error))});
+    return if (failed == 0 and ok > 0) 0 else 1;
+}
+
+fn printUsage() void {
+    std.debug.print(
+        \\Usage: reload-bench --server PATH [OPTIONS] [-- SERVER ARGS]
+        \\
+        \\  --server PATH      ladybug binary to start (set by zig build)
+        \\  --host TEXT        [default: 127.0.0.1]
+        \\  --port INTEGER     [default: 8766]
+        \\  --app TEXT         [default: tests.app:app]
+        \\  --workers N        [default: 4]
+        \\  --clients N        Concurrent client threads. [default: 16]
+        \\  --reloads N        SIGHUPs to send. [default: 3]
+        \\  --interval N       Seconds between reloads. [default: 3]
+        \\
+    , .{});
+}
+
+fn parseArgs(allocator: Allocator, args: []const []const u8) !Options {
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--")) {
+            options.server_args = try allocator.dupe([]const u8, args[i + 1 ..]);
+            break;
+        }
+        if (i + 1 >= args.len) return error.MissingValue;
+        const value = args[i + 1];
+        i += 1;
+
+        if (std.mem.eql(u8, arg, "--server")) {
+            options.server = value;
+        } else if (std.mem.eql(u8, arg, "--host")) {
+            options.host = value;
+        } else if (std.mem.eql(u8, arg, "--port")) {
+            options.port = try std.fmt.parseInt(u16, value, 10);
+        } else if (std.mem.eql(u8, arg, "--app")) {
+            options.app = value;
+        } else if (std.mem.eql(u8, arg, "--workers")) {
+            options.workers = @max(try std.fmt.parseInt(usize, value, 10), 2);
+        } else if (std.mem.eql(u8, arg, "--clients")) {
+            options.clients = @max(try std.fmt.parseInt(usize, value, 10), 1);
+        } else if (std.mem.eql(u8, arg, "--reloads")) {
+            options.reloads = try std.fmt.parseInt(usize, value, 10);
+        } else if (std.mem.eql(u8, arg, "--interval")) {
+            options.interval = try std.fmt.parseInt(u64, value, 10);
+        } else {
+            return error.UnknownOption;
+        }
+    }
+    return options;
+}
+
+fn startServer(allocator: Allocator, path: []const u8, options: Options) !std.process.Child {
+    const port = try std.fmt.allocPrint(allocator, "{d}", .{options.port});
+    const workers = try std.fmt.allocPrint(allocator, "{d}", .{options.workers});
+
+    var argv = std.ArrayList([]const u8).init(allocator);
+    try argv.appendSlice(&.{ path, "--host", options.host, "--port", port, "--workers", workers });
+    try argv.appendSlice(options.server_args);
+    try argv.append(options.app);
+
+    var child = std.process.Child.init(argv.items, allocator);
+    // The app logs every request; keep that out of the results
+    child.stdin_behavior = .Ignore;
+    child.stdout_behavior = .Ignore;
+    child.stderr_behavior = .Ignore;
+    try child.spawn();
+    return child;
+}
+
+/// Poll until the server accepts connections
+fn waitForServer(address: std.net.Address) !void {
+    var attempts: usize = 0;
+    while (attempts < 100) : (attempts += 1) {
+        if (std.net.tcpConnectToAddress(address)) |stream| {
+            stream.close();
+            return;
+        } else |_| {
+            std.time.sleep(100 * std.time.ns_per_ms);
+        }
+    }
+    return error.ServerNotReady;
+}
+
+const Stats = struct {
+    ok: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    failed: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    /// First error seen, for the report; 0 until one is
+    first_error: std.atomic.Value(u16) = std.atomic.Value(u16).init(0),
+};
+
+fn runClient(address: std.net.Address, stats: *Stats, stop: *const std.atomic.Value(bool)) void {
+    while (!stop.load(.acquire)) {
+        if (request(address)) {
+            _ = stats.ok.fetchAdd(1, .monotonic);
+        } else |err| {
+            _ = stats.failed.fetchAdd(1, .monotonic);
+            _ = stats.first_error.cmpxchgStrong(0, @intFromError(err), .acq_rel, .acquire);
+        }
+    }
+}
+
+/// One GET on a new connection; the server closes it after the response
+fn request(address: std.net.Address) !void {
+    const stream = try std.net.tcpConnectToAddress(address);
+    defer stream.close();
+    try stream.writeAll("GET / HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n");
+
+    var head: [16]u8 = undefined;
+    var len: usize = 0;
+    var buf: [4096]u8 = undefined;
+    while (true) {
+        const n = try stream.read(&buf);
+        if (n == 0) break;
+        const take = @min(n, head.len - len);
+        @memcpy(head[len..][0..take], buf[0..take]);
+        len += take;
+    }
+    if (!std.mem.startsWith(u8, head[0..len], "HTTP/1.1 200")) return error.BadResponse;
+}
@@ -0,0 +1,785 @@
+//! WebSocket load and conformance client behind `zig build bench-ws`.
+//!
+//! Starts ladybug on tests/app.py (or connects to a running server with
+//! `--external`), measures echo throughput and round-trip latency over a
+//! grid of payload sizes, fragment counts and connection counts, then runs
+//! a set of protocol edge cases modelled on the Autobahn test suite. Exits
+//! non-zero when any edge case fails, so it can gate optimization work.
+//!
+//! Build with `-Doptimize=ReleaseFast` for meaningful numbers:
+//!
+//!     zig build bench-ws -Doptimize=ReleaseFast -- --sizes 64,16384 --connections 1,32
+
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+const websocket = @import("websocket");
+const frame = websocket.frame;
+
+const Options = struct {
+    host: []const u8 = "127.0.0.1",
+    port: u16 = 8765,
+    /// ladybug binary to start; null with `--external`
+    server: ?[]const u8 = null,
+    app: []const u8 = "tests.app:app",
+    /// Round trips per connection in each scenario
+    messages: usize = 2000,
+    sizes: []const usize = &.{ 16, 1024, 16 * 1024, 256 * 1024 },
+    fragments: []const usize = &.{ 1, 8 },
+    connections: []const usize = &.{ 1, 16, 64 },
+    run_load: bool = true,
+    run_conformance: bool = true,
+};
+
+/// Exits 1 when a scenario or conformance case failed
+pub fn main() !u8 {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+    const options = parseArgs(arena.allocator(), args) catch |err| {
+        std.debug.print("Invalid arguments: {}\n", .{err});
+        printUsage();
+        std.process.exit(2);
+    };
+
+    const address = try std.net.Address.resolveIp(options.host, options.port);
+
+    var server: ?std.process.Child = null;
+    if (options.server) |path| {
+        server = try startServer(allocator, path, options);
+    }
+    defer if (server) |*child| {
+        _ = child.kill() catch null;
+    };
+    try waitForServer(address);
+
+    const stdout = std.io.getStdOut().writer();
+    var failures: usize = 0;
+
+    if (options.run_load) {
+        try stdout.print("{s:>8} {s:>5} {s:>5} {s:>10} {s:>9} {s:>8} {s:>8} {s:>8} {s:>8} {s:>8}\n", .{
+            "size", "frags", "conns", "msgs/s", "MiB/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us",
+        });
+        for (options.sizes) |size| {
+            for (options.fragments) |fragments| {
+                for (options.connections) |connections| {
+                    const scenario = Scenario{
+                        .size = size,
+                        .fragments = @min(fragments, @max(size, 1)),
+                        .connections = connections,
+                        .messages = options.messages,
+                    };
+                    runScenario(allocator, address, options.host, scenario, stdout) catch |err| {
+                        try stdout.print("{d:>8} {d:>5} {d:>5} failed: {}\n", .{ size, fragments, connections, err });
+                        failures += 1;
+                    };
+                }
+            }
+        }
+    }
+
+    if (options.run_conformance) {
+        try stdout.writeAll("\n");
+        failures += try runConformance(allocator, address, options.host, stdout);
+    }
+
+    if (failures > 0) {
+        try stdout.print("\n{d} failure(s)\n", .{failures});
+        return 1;
+    }
+    return 0;
+}
+
+fn parseArgs(allocator: Allocator, args: []const []const u8) !Options {
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--help") or std.mem.eql(u8, arg, "-h")) {
+            printUsage();
+            std.process.exit(0);
+        } else if (std.mem.eql(u8, arg, "--external")) {
+            options.server = null;
+        } else if (std.mem.eql(u8, arg, "--load-only")) {
+            options.run_conformance = false;
+        } else if (std.mem.eql(u8, arg, "--conformance-only")) {
+            options.run_load = false;
+        } else if (i + 1 < args.len) {
+            i += 1;
+            const value = args[i];
+            if (std.mem.eql(u8, arg, "--server")) {
+                options.server = value;
+            } else if (std.mem.eql(u8, arg, "--host")) {
+                options.host = value;
+            } else if (std.mem.eql(u8, arg, "--port")) {
+                options.port = try std.fmt.parseInt(u16, value, 10);
+            } else if (std.mem.eql(u8, arg, "--app")) {
+                options.app = value;
+            } else if (std.mem.eql(u8, arg, "--messages")) {
+                options.messages = try std.fmt.parseInt(usize, value, 10);
+            } else if (std.mem.eql(u8, arg, "--sizes")) {
+                options.sizes = try parseList(allocator, value);
+            } else if (std.mem.eql(u8, arg, "--fragments")) {
+                options.fragments = try parseList(allocator, value);
+            } else if (std.mem.eql(u8, arg, "--connections")) {
+                options.connections = try parseList(allocator, value);
+            } else {
+                return error.UnknownOption;
+            }
+        } else {
+            return error.UnknownOption;
+        }
+    }
+    return options;
+}
+
+/// Parse a comma separated list such as "1,16,64"
+fn parseList(allocator: Allocator, value: []const u8) ![]const usize {
+    var list = std.ArrayList(usize).init(allocator);
+    var items = std.mem.tokenizeScalar(u8, value, ',');
+    while (items.next()) |item| {
+        try list.append(try std.fmt.parseInt(usize, item, 10));
+    }
+    if (list.items.len == 0) return error.EmptyList;
+    return list.toOwnedSlice();
+}
+
+fn printUsage() void {
+    std.debug.print(
+        \\Usage: ws-bench [OPTIONS]
+        \\
+        \\Options:
+        \\  --server PATH          ladybug binary to start on the app (set by zig build)
+        \\  --external             Use a server that is already running
+        \\  --host TEXT            Server address. [default: 127.0.0.1]
+        \\  --port INTEGER         Server port. [default: 8765]
+        \\  --app TEXT             Application to start. [default: tests.app:app]
+        \\  --messages INTEGER     Round trips per connection. [default: 2000]
+        \\  --sizes LIST           Payload sizes in bytes. [default: 16,1024,16384,262144]
+        \\  --fragments LIST       Frames per message. [default: 1,8]
+        \\  --connections LIST     Concurrent connections. [default: 1,16,64]
+        \\  --load-only            Skip the conformance cases
+        \\  --conformance-only     Skip the load scenarios
+        \\
+    , .{});
+}
+
+fn startServer(allocator: Allocator, path: []const u8, options: Options) !std.process.Child {
+    var port_buf: [8]u8 = undefined;
+    const port = try std.fmt.bufPrint(&port_buf, "{d}", .{options.port});
+
+    const argv = [_][]const u8{ path, "--host", options.host, "--port", port, options.app };
+    var child = std.process.Child.init(&argv, allocator);
+    // The app logs every message; keep that out of the results
+    child.stdin_behavior = .Ignore;
+    child.stdout_behavior = .Ignore;
+    child.stderr_behavior = .Ignore;
+    try child.spawn();
+    return child;
+}
+
+/// Poll until the server accepts connections
+fn waitForServer(address: std.net.Address) !void {
+    var attempts: usize = 0;
+    while (attempts < 100) : (attempts += 1) {
+        if (std.net.tcpConnectToAddress(address)) |stream| {
+            stream.close();
+            return;
+        } else |_| {
+            std.time.sleep(100 * std.time.ns_per_ms);
+        }
+    }
+    return error.ServerNotReady;
+}
+
+/// Something read from the server
+const Event = union(enum) {
+    /// Complete data message; valid until the next read
+    message: struct {
+        opcode: frame.Opcode,
+        data: []const u8,
+    },
+    ping: []const u8,
+    pong: []const u8,
+    close: u16,
+};
+
+/// Blocking WebSocket client over one TCP connection
+const Client = struct {
+    const Self = @This();
+
+    allocator: Allocator,
+    stream: std.net.Stream,
+    reader: frame.FrameReader,
+    /// Data message being reassembled
+    message: std.ArrayList(u8),
+    message_opcode: ?frame.Opcode = null,
+    /// Encoded outgoing frame
+    out: std.ArrayList(u8),
+
+    fn connect(allocator: Allocator, address: std.net.Address, host: []const u8) !Self {
+        const stream = try std.net.tcpConnectToAddress(address);
+        errdefer stream.close();
+        try std.posix.setsockopt(stream.handle, std.posix.IPPROTO.TCP, std.posix.TCP.NODELAY, &std.mem.toBytes(@as(c_int, 1)));
+
+        var self = Self{
+            .allocator = allocator,
+            .stream = stream,
+            .reader = frame.FrameReader.init(allocator, frame.default_max_frame_size, false),
+            .message = std.ArrayList(u8).init(allocator),
+            .out = std.ArrayList(u8).init(allocator),
+        };
+        errdefer self.deinitBuffers();
+
+        try self.handshake(host, address.getPort());
+        return self;
+    }
+
+    fn deinit(self: *Self) void {
+        self.stream.close();
+        self.deinitBuffers();
+    }
+
+    fn deinitBuffers(self: *Self) void {
+        self.reader.deinit();
+        self.message.deinit();
+        self.out.deinit();
+    }
+
+    fn handshake(self: *Self, host: []const u8, port: u16) !void {
+        var key_bytes: [16]u8 = undefined;
+        std.crypto.random.bytes(&key_bytes);
+        var key_buf: [24]u8 = undefined;
+        const key = std.base64.standard.Encoder.encode(&key_buf, &key_bytes);
+
+        var request_buf: [512]u8 = undefined;
+        const request = try std.fmt.bufPrint(&request_buf, "GET /ws HTTP/1.1\r\n" ++
+            "Host: {s}:{d}\r\n" ++
+            "Upgrade: websocket\r\n" ++
+            "Connection: Upgrade\r\n" ++
+            "Sec-WebSocket-Key: {s}\r\n" ++
+            "Sec-WebSocket-Version: 13\r\n\r\n", .{ host, port, key });
+        try self.stream.writeAll(request);
+
+        // Read the response head; anything after it is already frames
+        var response_buf: [4096]u8 = undefined;
+        var len: usize = 0;
+        const head_end = while (true) {
+            if (std.mem.indexOf(u8, response_buf[0..len], "\r\n\r\n")) |end| break end + 4;
+            if (len == response_buf.len) return error.HandshakeTooLarge;
+            const n = try self.stream.read(response_buf[len..]);
+            if (n == 0) return error.ConnectionClosed;
+            len += n;
+        };
+        if (!std.mem.startsWith(u8, response_buf[0..head_end], "HTTP/1.1 101")) return error.HandshakeRejected;
+
+        var expected_buf: [28]u8 = undefined;
+        const expected = websocket.computeAcceptKey(key, &expected_buf);
+        if (std.mem.indexOf(u8, response_buf[0..head_end], expected) == null) return error.BadAcceptKey;
+
+        try self.reader.feed(response_buf[head_end..len]);
+    }
+
+    /// Write one masked frame, optionally in `chop`-byte writes to make
+    /// the server reassemble it from partial reads
+    fn writeFrame(self: *Self, fin: bool, rsv: u3, opcode: frame.Opcode, payload: []const u8, chop: ?usize) !void {
+        var mask_key: [4]u8 = undefined;
+        std.crypto.random.bytes(&mask_key);
+
+        var header_buf: [frame.max_header_size]u8 = undefined;
+        const header = frame.writeHeader(&header_buf, fin, opcode, payload.len, mask_key);
+
+        self.out.clearRetainingCapacity();
+        try self.out.appendSlice(header);
+        self.out.items[0] |= @as(u8, rsv) << 4;
+        const start = self.out.items.len;
+        try self.out.appendSlice(payload);
+        websocket.mask.applyMask(mask_key, self.out.items[start..], 0);
+
+        try self.writeRaw(self.out.items, chop);
+    }
+
+    fn writeRaw(self: *Self, bytes: []const u8, chop: ?usize) !void {
+        const step = chop orelse bytes.len;
+        var offset: usize = 0;
+        while (offset < bytes.len) {
+            const end = @min(bytes.len, offset + step);
+            try self.stream.writeAll(bytes[offset..end]);
+            offset = end;
+        }
+    }
+
+    /// Send a data message split into `fragments` frames of near equal size
+    fn sendMessage(self: *Self, opcode: frame.Opcode, payload: []const u8, fragments: usize) !void {
+        const count = @max(fragments, 1);
+        const piece = (payload.len + count - 1) / count;
+        var i: usize = 0;
+        while (i < count) : (i += 1) {
+            const start = @min(payload.len, i * piece);
+            const end = @min(payload.len, start + piece);
+            try self.writeFrame(i + 1 == count, 0, if (i == 0) opcode else .continuation, payload[start..end], null);
+        }
+    }
+
+    /// Read until the next complete message or control frame
+    fn readEvent(self: *Self) !Event {
+        while (true) {
+            const next_frame = (try self.reader.next()) orelse {
+                if (try self.reader.fill(self.stream.handle) == 0) return error.ConnectionClosed;
+                continue;
+            };
+
+            switch (next_frame.opcode) {
+                .ping => return Event{ .ping = next_frame.payload },
+                .pong => return Event{ .pong = next_frame.payload },
+                .close => return Event{ .close = websocket.closeCode(next_frame.payload) },
+                .text, .binary => {
+                    if (self.message_opcode != null) return error.ServerProtocolError;
+                    if (next_frame.fin) {
+                        return Event{ .message = .{ .opcode = next_frame.opcode, .data = next_frame.payload } };
+                    }
+                    self.message_opcode = next_frame.opcode;
+                    self.message.clearRetainingCapacity();
+                    try self.message.appendSlice(next_frame.payload);
+                },
+                .continuation => {
+                    const opcode = self.message_opcode orelse return error.ServerProtocolError;
+                    try self.message.appendSlice(next_frame.payload);
+                    if (next_frame.fin) {
+                        self.message_opcode = null;
+                        return Event{ .message = .{ .opcode = opcode, .data = self.message.items } };
+                    }
+                },
+                _ => return error.ServerProtocolError,
+            }
+        }
+    }
+
+    /// Next data message, answering keepalive pings on the way
+    fn readMessage(self: *Self) !Event {
+        while (true) {
+            const event = try self.readEvent();
+            switch (event) {
+                .message, .close => return event,
+                .ping => |payload| try self.writeFrame(true, 0, .pong, payload, null),
+                .pong => {},
+            }
+        }
+    }
+
+    /// Start or answer the closing handshake and wait for the server's half
+    fn close(self: *Self, code: u16) !void {
+        var payload: [2]u8 = undefined;
+        std.mem.writeInt(u16, &payload, code, .big);
+        try self.writeFrame(true, 0, .close, &payload, null);
+        while (true) {
+            switch (try self.readMessage()) {
+                .close => return,
+                else => {},
+            }
+        }
+    }
+};
+
+const Scenario = struct {
+    size: usize,
+    fragments: usize,
+    connections: usize,
+    messages: usize,
+};
+
+/// One connection's share of a scenario
+const Worker = struct {
+    client: Client,
+    payload: []const u8,
+    fragments: usize,
+    /// Round-trip time of each message in nanoseconds
+    samples: []u64,
+    err: ?anyerror = null,
+
+    fn run(self: *Worker) void {
+        self.echo() catch |err| {
+            self.err = err;
+        };
+    }
+
+    fn echo(self: *Worker) !void {
+        for (self.samples) |*sample| {
+            const start = try std.time.Instant.now();
+            try self.client.sendMessage(.binary, self.payload, self.fragments);
+
+            switch (try self.client.readMessage()) {
+                .message => |message| {
+                    if (message.opcode != .binary or !std.mem.eql(u8, message.data, self.payload)) return error.BadEcho;
+                },
+                else => return error.UnexpectedClose,
+            }
+
+            const end = try std.time.Instant.now();
+            sample.* = end.since(start);
+        }
+        try self.client.close(1000);
+    }
+};
+
+/// Echo binary messages on every connection at once and print a result
+/// row. Connections are opened before the clock starts.
+fn runScenario(allocator: Allocator, address: std.net.Address, host: []const u8, scenario: Scenario, out: anytype) !void {
+    const payload = try allocator.alloc(u8, scenario.size);
+    defer allocator.free(payload);
+    std.crypto.random.bytes(payload);
+
+    const samples = try allocator.alloc(u64, scenario.connections * scenario.messages);
+    defer allocator.free(samples);
+
+    const workers = try allocator.alloc(Worker, scenario.connections);
+    defer allocator.free(workers);
+
+    var opened: usize = 0;
+    defer for (workers[0..opened]) |*worker| worker.client.deinit();
+    for (workers, 0..) |*worker, i| {
+        worker.* = Worker{
+            .client = try Client.connect(allocator, address, host),
+            .payload = payload,
+            .fragments = scenario.fragments,
+            .samples = samples[i * scenario.messages ..][0..scenario.messages],
+        };
+        opened += 1;
+    }
+
+    const threads = try allocator.alloc(std.Thread, scenario.connections);
+    defer allocator.free(threads);
+
+    const start = try std.time.Instant.now();
+    var spawned: usize = 0;
+    defer for (threads[0..spawned]) |thread| thread.join();
+    for (threads, workers) |*thread, *worker| {
+        thread.* = try std.Thread.spawn(.{}, Worker.run, .{worker});
+        spawned += 1;
+    }
+    for (threads) |thread| thread.join();
+    spawned = 0;
+    const elapsed_ns = (try std.time.Instant.now()).since(start);
+
+    for (workers) |worker| {
+        if (worker.err) |err| return err;
+    }
+
+    std.mem.sort(u64, samples, {}, std.sort.asc(u64));
+    const seconds = @as(f64, @floatFromInt(elapsed_ns)) / std.time.ns_per_s;
+    const rate = @as(f64, @floatFromInt(samples.len)) / seconds;
+    const mib = rate * @as(f64, @floatFromInt(scenario.size)) / (1024 * 1024);
+
+    try out.print("{d:>8} {d:>5} {d:>5} {d:>10.0} {d:>9.1} {d:>8.1} {d:>8.1} {d:>8.1} {d:>8.1} {d:>8.1}\n", .{
+        scenario.size,
+        scenario.fragments,
+        scenario.connections,
+        rate,
+        mib,
+        percentileMicros(samples, 500),
+        percentileMicros(samples, 900),
+        percentileMicros(samples, 990),
+        percentileMicros(samples, 999),
+        percentileMicros(samples, 1000),
+    });
+}
+
+/// Sample at `per_mille` of the sorted samples, in microseconds
+fn percentileMicros(sorted: []const u64, per_mille: usize) f64 {
+    if (sorted.len == 0) return 0;
+    const index = @min(sorted.len - 1, sorted.len * per_mille / 1000);
+    return @as(f64, @floatFromInt(sorted[index])) / std.time.ns_per_us;
+}
+
+/// Protocol edge case, numbered after the Autobahn section it follows
+const Case = struct {
+    id: []const u8,
+    description: []const u8,
+    run: *const fn (client: *Client) anyerror!void,
+};
+
+const cases = [_]Case{
+    .{ .id = "1.1.1", .description = "text message echoed", .run = textEcho },
+    .{ .id = "1.2.2", .description = "binary message of 125 bytes", .run = binary125 },
+    .{ .id = "1.2.3", .description = "binary message of 126 bytes", .run = binary126 },
+    .{ .id = "1.2.4", .description = "binary message of 65535 bytes", .run = binary65535 },
+    .{ .id = "1.2.6", .description = "binary message of 65536 bytes", .run = binary65536 },
+    .{ .id = "1.2.8", .description = "binary message written in 997-byte pieces", .run = binaryChopped },
+    .{ .id = "2.2", .description = "ping with payload is answered with the same pong", .run = pingPayload },
+    .{ .id = "2.5", .description = "ping over 125 bytes is a protocol error", .run = pingTooLong },
+    .{ .id = "2.7", .description = "unsolicited pong is ignored", .run = unsolicitedPong },
+    .{ .id = "3.1", .description = "RSV1 without an extension is a protocol error", .run = reservedBits },
+    .{ .id = "4.1.1", .description = "reserved data opcode is a protocol error", .run = reservedDataOpcode },
+    .{ .id = "4.2.1", .description = "reserved control opcode is a protocol error", .run = reservedControlOpcode },
+    .{ .id = "5.1", .description = "fragmented ping is a protocol error", .run = fragmentedPing },
+    .{ .id = "5.6", .description = "ping between fragments is answered first", .run = pingBetweenFragments },
+    .{ .id = "5.9", .description = "continuation with nothing to continue is a protocol error", .run = orphanContinuation },
+    .{ .id = "5.18", .description = "new message inside a fragmented one is a protocol error", .run = nestedMessage },
+    .{ .id = "6.2.3", .description = "UTF-8 split inside a code point across fragments", .run = splitCodePoint },
+    .{ .id = "6.3.1", .description = "invalid UTF-8 text closes with 1007", .run = invalidUtf8 },
+    .{ .id = "6.4.1", .description = "invalid UTF-8 in a later fragment closes with 1007", .run = invalidUtf8Fragment },
+    .{ .id = "7.1.1", .description = "close is answered with the same code", .run = closeNormal },
+    .{ .id = "7.3.1", .description = "close without a code is answered with 1000", .run = closeEmpty },
+    .{ .id = "7.3.2", .description = "close with a one-byte payload is a protocol error", .run = closeOneByte },
+    .{ .id = "7.5.1", .description = "close reason that is not UTF-8 closes with 1007", .run = closeInvalidReason },
+    .{ .id = "7.7.1", .description = "close code 1000 is answered with the same code", .run = closeWithCode(1000, 1000) },
+    .{ .id = "7.7.2", .description = "close code 1001 is answered with the same code", .run = closeWithCode(1001, 1001) },
+    .{ .id = "7.7.3", .description = "close code 1002 is answered with the same code", .run = closeWithCode(1002, 1002) },
+    .{ .id = "7.7.4", .description = "close code 1003 is answered with the same code", .run = closeWithCode(1003, 1003) },
+    .{ .id = "7.7.5", .description = "close code 1007 is answered with the same code", .run = closeWithCode(1007, 1007) },
+    .{ .id = "7.7.6", .description = "close code 1008 is answered with the same code", .run = closeWithCode(1008, 1008) },
+    .{ .id = "7.7.7", .description = "close code 1009 is answered with the same code", .run = closeWithCode(1009, 1009) },
+    .{ .id = "7.7.8", .description = "close code 1010 is answered with the same code", .run = closeWithCode(1010, 1010) },
+    .{ .id = "7.7.9", .description = "close code 1011 is answered with the same code", .run = closeWithCode(1011, 1011) },
+    .{ .id = "7.7.10", .description = "close code 3000 is answered with the same code", .run = closeWithCode(3000, 3000) },
+    .{ .id = "7.7.11", .description = "close code 3999 is answered with the same code", .run = closeWithCode(3999, 3999) },
+    .{ .id = "7.7.12", .description = "close code 4000 is answered with the same code", .run = closeWithCode(4000, 4000) },
+    .{ .id = "7.7.13", .description = "close code 4999 is answered with the same code", .run = closeWithCode(4999, 4999) },
+    .{ .id = "7.9.1", .description = "close code 0 is a protocol error", .run = closeWithCode(0, 1002) },
+    .{ .id = "7.9.2", .description = "close code 999 is a protocol error", .run = closeWithCode(999, 1002) },
+    .{ .id = "7.9.3", .description = "close code 1004 is a protocol error", .run = closeWithCode(1004, 1002) },
+    .{ .id = "7.9.4", .description = "close code 1005 is a protocol error", .run = closeWithCode(1005, 1002) },
+    .{ .id = "7.9.5", .description = "close code 1006 is a protocol error", .run = closeWithCode(1006, 1002) },
+    .{ .id = "7.9.6", .description = "close code 1016 is a protocol error", .run = closeWithCode(1016, 1002) },
+    .{ .id = "7.9.7", .description = "close code 1100 is a protocol error", .run = closeWithCode(1100, 1002) },
+    .{ .id = "7.9.8", .description = "close code 2000 is a protocol error", .run = closeWithCode(2000, 1002) },
+    .{ .id = "7.9.9", .description = "close code 2999 is a protocol error", .run = closeWithCode(2999, 1002) },
+    .{ .id = "7.13.1", .description = "close code 5000 is a protocol error", .run = closeWithCode(5000, 1002) },
+    .{ .id = "7.13.2", .description = "close code 65535 is a protocol error", .run = closeWithCode(65535, 1002) },
+    .{ .id = "9.2.4", .description = "binary message of 4 MiB", .run = binaryLarge },
+    .{ .id = "masking", .description = "unmasked client frame is a protocol error", .run = unmaskedFrame },
+};
+
+/// Run every case on a fresh connection. Returns the number that failed.
+fn runConformance(allocator: Allocator, address: std.net.Address, host: []const u8, out: anytype) !usize {
+    var failures: usize = 0;
+    for (cases) |case| {
+        const result = runCase(allocator, address, host, case);
+        if (result) |_| {
+            try out.print("PASS {s:<8} {s}\n", .{ case.id, case.description });
+        } else |err| {
+            try out.print("FAIL {s:<8} {s}: {}\n", .{ case.id, case.description, err });
+            failures += 1;
+        }
+    }
+    try out.print("{d}/{d} conformance cases passed\n", .{ cases.len - failures, cases.len });
+    return failures;
+}
+
+fn runCase(allocator: Allocator, address: std.net.Address, host: []const u8, case: Case) !void {
+    var client = try Client.connect(allocator, address, host);
+    defer client.deinit();
+    try case.run(&client);
+}
+
+/// The app answers text with "You said: " and the text, and echoes bytes
+fn expectEcho(client: *Client, opcode: frame.Opcode, payload: []const u8) !void {
+    switch (try client.readMessage()) {
+        .message => |message| {
+            if (message.opcode != opcode) return error.WrongOpcode;
+            if (opcode == .text) {
+                const prefix = "You said: ";
+                if (!std.mem.startsWith(u8, message.data, prefix)) return error.BadEcho;
+                if (!std.mem.eql(u8, message.data[prefix.len..], payload)) return error.BadEcho;
+            } else if (!std.mem.eql(u8, message.data, payload)) {
+                return error.BadEcho;
+            }
+        },
+        .close => return error.UnexpectedClose,
+        else => unreachable,
+    }
+}
+
+/// The server must send a close frame with `code`, skipping any data
+fn expectClose(client: *Client, code: u16) !void {
+    while (true) {
+        switch (try client.readEvent()) {
+            .close => |received| {
+                if (received != code) return error.WrongCloseCode;
+                return;
+            },
+            else => {},
+        }
+    }
+}
+
+fn echoBinary(client: *Client, size: usize, chop: ?usize) !void {
+    const payload = try client.allocator.alloc(u8, size);
+    defer client.allocator.free(payload);
+    for (payload, 0..) |*byte, i| byte.* = @truncate(i);
+
+    try client.writeFrame(true, 0, .binary, payload, chop);
+    try expectEcho(client, .binary, payload);
+    try client.close(1000);
+}
+
+fn textEcho(client: *Client) !void {
+    try client.sendMessage(.text, "Hello, world!", 1);
+    try expectEcho(client, .text, "Hello, world!");
+    try client.close(1000);
+}
+
+fn binary125(client: *Client) !void {
+    try echoBinary(client, 125, null);
+}
+
+fn binary126(client: *Client) !void {
+    try echoBinary(client, 126, null);
+}
+
+fn binary65535(client: *Client) !void {
+    try echoBinary(client, 65535, null);
+}
+
+fn binary65536(client: *Client) !void {
+    try echoBinary(client, 65536, null);
+}
+
+fn binaryChopped(client: *Client) !void {
+    try echoBinary(client, 65536, 997);
+}
+
+fn binaryLarge(client: *Client) !void {
+    try echoBinary(client, 4 * 1024 * 1024, null);
+}
+
+fn pingPayload(client: *Client) !void {
+    const payload = "\x00\xffping payload";
+    try client.writeFrame(true, 0, .ping, payload, null);
+    switch (try client.readEvent()) {
+        .pong => |data| if (!std.mem.eql(u8, data, payload)) return error.BadPong,
+        else => return error.ExpectedPong,
+    }
+    try client.close(1000);
+}
+
+fn pingTooLong(client: *Client) !void {
+    try client.writeFrame(true, 0, .ping, &([_]u8{0xfe} ** 126), null);
+    try expectClose(client, 1002);
+}
+
+fn unsolicitedPong(client: *Client) !void {
+    try client.writeFrame(true, 0, .pong, "unsolicited", null);
+    try client.sendMessage(.text, "after pong", 1);
+    try expectEcho(client, .text, "after pong");
+    try client.close(1000);
+}
+
+fn reservedBits(client: *Client) !void {
+    try client.writeFrame(true, 0b100, .text, "rsv1", null);
+    try expectClose(client, 1002);
+}
+
+fn reservedDataOpcode(client: *Client) !void {
+    try client.writeFrame(true, 0, @enumFromInt(0x3), "", null);
+    try expectClose(client, 1002);
+}
+
+fn reservedControlOpcode(client: *Client) !void {
+    try client.writeFrame(true, 0, @enumFromInt(0xB), "", null);
+    try expectClose(client, 1002);
+}
+
+fn fragmentedPing(client: *Client) !void {
+    try client.writeFrame(false, 0, .ping, "frag", null);
+    try client.writeFrame(true, 0, .continuation, "ment", null);
+    try expectClose(client, 1002);
+}
+
+fn pingBetweenFragments(client: *Client) !void {
+    try client.writeFrame(false, 0, .text, "frag", null);
+    try client.writeFrame(true, 0, .ping, "between", null);
+    try client.writeFrame(true, 0, .continuation, "ment", null);
+
+    switch (try client.readEvent()) {
+        .pong => |data| if (!std.mem.eql(u8, data, "between")) return error.BadPong,
+        else => return error.ExpectedPong,
+    }
+    try expectEcho(client, .text, "fragment");
+    try client.close(1000);
+}
+
+fn orphanContinuation(client: *Client) !void {
+    try client.writeFrame(true, 0, .continuation, "orphan", null);
+    try expectClose(client, 1002);
+}
+
+fn nestedMessage(client: *Client) !void {
+    try client.writeFrame(false, 0, .text, "first", null);
+    try client.writeFrame(true, 0, .text, "second", null);
+    try expectClose(client, 1002);
+}
+
+fn splitCodePoint(client: *Client) !void {
+    // U+03BA GREEK SMALL LETTER KAPPA split between its two bytes
+    const text = "\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5";
+    try client.writeFrame(false, 0, .text, text[0..1], null);
+    try client.writeFrame(false, 0, .continuation, text[1..4], null);
+    try client.writeFrame(true, 0, .continuation, text[4..], null);
+    try expectEcho(client, .text, text);
+    try client.close(1000);
+}
+
+fn invalidUtf8(client: *Client) !void {
+    try client.writeFrame(true, 0, .text, "\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5\xed\xa0\x80edited", null);
+    try expectClose(client, 1007);
+}
+
+fn invalidUtf8Fragment(client: *Client) !void {
+    try client.writeFrame(false, 0, .text, "\xce\xba\xe1\xbd\xb9", null);
+    try client.writeFrame(true, 0, .continuation, "\xf4\x90\x80\x80", null);
+    try expectClose(client, 1007);
+}
+
+fn closeNormal(client: *Client) !void {
+    var payload: [2]u8 = undefined;
+    std.mem.writeInt(u16, &payload, 1000, .big);
+    try client.writeFrame(true, 0, .close, &payload, null);
+    try expectClose(client, 1000);
+}
+
+fn closeEmpty(client: *Client) !void {
+    try client.writeFrame(true, 0, .close, "", null);
+    switch (try client.readEvent()) {
+        // 1005 here means the server's close carried no code, which is
+        // also allowed
+        .close => |code| if (code != 1000 and code != 1005) return error.WrongCloseCode,
+        else => return error.ExpectedClose,
+    }
+}
+
+fn closeOneByte(client: *Client) !void {
+    try client.writeFrame(true, 0, .close, "\x03", null);
+    try expectClose(client, 1002);
+}
+
+/// Case that closes with `code` and expects the server to close with
+/// `expected`: the same code when it is valid, 1002 when it is not
+fn closeWithCode(comptime code: u16, comptime expected: u16) *const fn (client: *Client) anyerror!void {
+    return struct {
+        fn run(client: *Client) !void {
+            var payload: [2]u8 = undefined;
+            std.mem.writeInt(u16, &payload, code, .big);
+            try client.writeFrame(true, 0, .close, &payload, null);
+            try expectClose(client, expected);
+        }
+    }.run;
+}
+
+fn closeInvalidReason(client: *Client) !void {
+    try client.writeFrame(true, 0, .close, "\x03\xe8\xce\xba\xed\xa0\x80", null);
+    try expectClose(client, 1007);
+}
+
+fn unmaskedFrame(client: *Client) !void {
+    var header_buf: [frame.max_header_size]u8 = undefined;
+    try client.writeRaw(frame.writeHeader(&header_buf, true, .text, 8, null), null);
+    try client.writeRaw("unmasked", null);
+    try expectClose(client, 1002);
+}
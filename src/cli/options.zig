@@ -1,9 +1,11 @@
 const std = @import("std");
 const Allocator = std.mem.Allocator;
+const broadcast = @import("../websocket/broadcast.zig");
+const http_server = @import("../http/server.zig");
+const affinity = @import("../utils/affinity.zig");
 
 // UVICORN PARITY: Add missing CLI options (--env-file, --log-config, --date-header-field)
 // UVICORN PARITY: Add HTTP/2 specific options (--h2, --http2-max-concurrent-streams)
-// UVICORN PARITY: Add WebSocket options (--ws-ping-interval, --ws-ping-timeout, --ws-max-size)
 // UVICORN PARITY: Add development options (--reload-include, --reload-exclude patterns)
 /// CLI options for the server
 pub const Options = struct {
@@ -19,6 +21,11 @@ pub const Options = struct {
 
     // Process options
     workers: u16 = 1,
+    workers_min: ?u16 = null,
+    workers_max: ?u16 = null, // enables autoscaling
+    accept_mode: http_server.AcceptMode = .shared,
+    reuseport_steering: http_server.Steering = .hash,
+    cpu_affinity: affinity.Policy = .none,
     loop: []const u8 = "auto", // auto, asyncio, uvloop
     http: []const u8 = "auto", // auto, h11, httptools
     ws: []const u8 = "auto", // auto, websockets, wsproto
@@ -34,8 +41,29 @@ pub const Options = struct {
     // Server resource options
     limit_concurrency: ?u32 = null,
     limit_max_requests: ?u32 = null,
+    limit_max_requests_jitter: ?u32 = null, // default: a tenth of the limit
+    limit_max_rss: ?u32 = null, // MiB
     backlog: u32 = 2048,
     timeout_keep_alive: u32 = 5,
+    timeout_graceful_shutdown: ?u32 = null,
+    timeout_worker_hang: ?u32 = null,
+    timeout_worker_startup: ?u32 = null,
+
+    // HTTP/2 connection recycling
+    h2_max_connection_streams: ?u32 = null,
+    h2_max_connection_age: ?u32 = null,
+
+    // WebSocket options
+    ws_max_size: u32 = 16 * 1024 * 1024,
+    ws_stream_fragments: bool = false,
+    ws_max_buffered: u32 = 4 * 1024 * 1024,
+    ws_per_message_deflate: bool = true,
+    ws_deflate_memory: u32 = 1024 * 1024,
+    ws_deflate_max_contexts: u32 = 1024,
+    ws_broadcast_max_pending: u32 = 256,
+    ws_broadcast_policy: broadcast.Policy = .drop_oldest,
+    ws_ping_interval: f64 = 20.0,
+    ws_ping_timeout: f64 = 20.0,
 
     // SSL options
     ssl_keyfile: ?[]const u8 = null,
@@ -87,6 +115,33 @@ pub const Options = struct {
             } else if (std.mem.eql(u8, arg, "--workers") and i + 1 < args.len) {
                 i += 1;
                 self.workers = try std.fmt.parseInt(u16, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--workers-min=")) {
+                self.workers_min = try std.fmt.parseInt(u16, arg[14..], 10);
+            } else if (std.mem.eql(u8, arg, "--workers-min") and i + 1 < args.len) {
+                i += 1;
+                self.workers_min = try std.fmt.parseInt(u16, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--workers-max=")) {
+                self.workers_max = try std.fmt.parseInt(u16, arg[14..], 10);
+            } else if (std.mem.eql(u8, arg, "--workers-max") and i + 1 < args.len) {
+                i += 1;
+                self.workers_max = try std.fmt.parseInt(u16, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--accept-mode=")) {
+                self.accept_mode = http_server.AcceptMode.parse(arg[14..]) orelse return error.InvalidAcceptMode;
+            } else if (std.mem.eql(u8, arg, "--accept-mode") and i + 1 < args.len) {
+                i += 1;
+                self.accept_mode = http_server.AcceptMode.parse(args[i]) orelse return error.InvalidAcceptMode;
+            } else if (std.mem.startsWith(u8, arg, "--reuseport-steering=")) {
+                self.reuseport_steering = http_server.Steering.parse(arg[21..]) orelse return error.InvalidSteering;
+            } else if (std.mem.eql(u8, arg, "--reuseport-steering") and i + 1 < args.len) {
+                i += 1;
+                self.reuseport_steering = http_server.Steering.parse(args[i]) orelse return error.InvalidSteering;
+            } else if (std.mem.startsWith(u8, arg, "--cpu-affinity=")) {
+                self.cpu_affinity.deinit(allocator);
+                self.cpu_affinity = try affinity.Policy.parse(allocator, arg[15..]);
+            } else if (std.mem.eql(u8, arg, "--cpu-affinity") and i + 1 < args.len) {
+                i += 1;
+                self.cpu_affinity.deinit(allocator);
+                self.cpu_affinity = try affinity.Policy.parse(allocator, args[i]);
             } else if (std.mem.eql(u8, arg, "--reload")) {
                 self.reload = true;
             } else if (std.mem.startsWith(u8, arg, "--reload-dir=")) {
@@ -135,6 +190,93 @@ pub const Options = struct {
             } else if (std.mem.eql(u8, arg, "--interface") and i + 1 < args.len) {
                 i += 1;
                 self.interface = try allocator.dupe(u8, args[i]);
+            } else if (std.mem.startsWith(u8, arg, "--limit-max-requests=")) {
+                self.limit_max_requests = try std.fmt.parseInt(u32, arg[21..], 10);
+            } else if (std.mem.eql(u8, arg, "--limit-max-requests") and i + 1 < args.len) {
+                i += 1;
+                self.limit_max_requests = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--limit-max-requests-jitter=")) {
+                self.limit_max_requests_jitter = try std.fmt.parseInt(u32, arg[28..], 10);
+            } else if (std.mem.eql(u8, arg, "--limit-max-requests-jitter") and i + 1 < args.len) {
+                i += 1;
+                self.limit_max_requests_jitter = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--limit-max-rss=")) {
+                self.limit_max_rss = try std.fmt.parseInt(u32, arg[16..], 10);
+            } else if (std.mem.eql(u8, arg, "--limit-max-rss") and i + 1 < args.len) {
+                i += 1;
+                self.limit_max_rss = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--timeout-graceful-shutdown=")) {
+                self.timeout_graceful_shutdown = try std.fmt.parseInt(u32, arg[28..], 10);
+            } else if (std.mem.eql(u8, arg, "--timeout-graceful-shutdown") and i + 1 < args.len) {
+                i += 1;
+                self.timeout_graceful_shutdown = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--timeout-worker-hang=")) {
+                self.timeout_worker_hang = try std.fmt.parseInt(u32, arg[22..], 10);
+            } else if (std.mem.eql(u8, arg, "--timeout-worker-hang") and i + 1 < args.len) {
+                i += 1;
+                self.timeout_worker_hang = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--timeout-worker-startup=")) {
+                self.timeout_worker_startup = try std.fmt.parseInt(u32, arg[25..], 10);
+            } else if (std.mem.eql(u8, arg, "--timeout-worker-startup") and i + 1 < args.len) {
+                i += 1;
+                self.timeout_worker_startup = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--h2-max-connection-streams=")) {
+                self.h2_max_connection_streams = try std.fmt.parseInt(u32, arg[28..], 10);
+            } else if (std.mem.eql(u8, arg, "--h2-max-connection-streams") and i + 1 < args.len) {
+                i += 1;
+                self.h2_max_connection_streams = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--h2-max-connection-age=")) {
+                self.h2_max_connection_age = try std.fmt.parseInt(u32, arg[24..], 10);
+            } else if (std.mem.eql(u8, arg, "--h2-max-connection-age") and i + 1 < args.len) {
+                i += 1;
+                self.h2_max_connection_age = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--ws-max-size=")) {
+                self.ws_max_size = try std.fmt.parseInt(u32, arg[14..], 10);
+            } else if (std.mem.eql(u8, arg, "--ws-max-size") and i + 1 < args.len) {
+                i += 1;
+                self.ws_max_size = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--ws-max-buffered=")) {
+                self.ws_max_buffered = try std.fmt.parseInt(u32, arg[18..], 10);
+            } else if (std.mem.eql(u8, arg, "--ws-max-buffered") and i + 1 < args.len) {
+                i += 1;
+                self.ws_max_buffered = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.eql(u8, arg, "--ws-stream-fragments")) {
+                self.ws_stream_fragments = true;
+            } else if (std.mem.startsWith(u8, arg, "--ws-per-message-deflate=")) {
+                self.ws_per_message_deflate = try parseBool(arg[25..]);
+            } else if (std.mem.eql(u8, arg, "--ws-per-message-deflate") and i + 1 < args.len) {
+                i += 1;
+                self.ws_per_message_deflate = try parseBool(args[i]);
+            } else if (std.mem.startsWith(u8, arg, "--ws-deflate-memory=")) {
+                self.ws_deflate_memory = try std.fmt.parseInt(u32, arg[20..], 10);
+            } else if (std.mem.eql(u8, arg, "--ws-deflate-memory") and i + 1 < args.len) {
+                i += 1;
+                self.ws_deflate_memory = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--ws-deflate-max-contexts=")) {
+                self.ws_deflate_max_contexts = try std.fmt.parseInt(u32, arg[26..], 10);
+            } else if (std.mem.eql(u8, arg, "--ws-deflate-max-contexts") and i + 1 < args.len) {
+                i += 1;
+                self.ws_deflate_max_contexts = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--ws-broadcast-max-pending=")) {
+                self.ws_broadcast_max_pending = try std.fmt.parseInt(u32, arg[27..], 10);
+            } else if (std.mem.eql(u8, arg, "--ws-broadcast-max-pending") and i + 1 < args.len) {
+                i += 1;
+                self.ws_broadcast_max_pending = try std.fmt.parseInt(u32, args[i], 10);
+            } else if (std.mem.startsWith(u8, arg, "--ws-broadcast-policy=")) {
+                self.ws_broadcast_policy = broadcast.Policy.parse(arg[22..]) orelse return error.InvalidBroadcastPolicy;
+            } else if (std.mem.eql(u8, arg, "--ws-broadcast-policy") and i + 1 < args.len) {
+                i += 1;
+                self.ws_broadcast_policy = broadcast.Policy.parse(args[i]) orelse return error.InvalidBroadcastPolicy;
+            } else if (std.mem.startsWith(u8, arg, "--ws-ping-interval=")) {
+                self.ws_ping_interval = try std.fmt.parseFloat(f64, arg[19..]);
+            } else if (std.mem.eql(u8, arg, "--ws-ping-interval") and i + 1 < args.len) {
+                i += 1;
+                self.ws_ping_interval = try std.fmt.parseFloat(f64, args[i]);
+            } else if (std.mem.startsWith(u8, arg, "--ws-ping-timeout=")) {
+                self.ws_ping_timeout = try std.fmt.parseFloat(f64, arg[18..]);
+            } else if (std.mem.eql(u8, arg, "--ws-ping-timeout") and i + 1 < args.len) {
+                i += 1;
+                self.ws_ping_timeout = try std.fmt.parseFloat(f64, args[i]);
             } else if (!std.mem.startsWith(u8, arg, "-")) {
                 // Assume it's the application
                 self.app = try allocator.dupe(u8, arg);
@@ -142,6 +284,9 @@ pub const Options = struct {
         }
 
         // Validate options
+        if (self.workers_max) |max| {
+            if (max == 0 or (self.workers_min orelse 1) > max) return error.InvalidWorkerRange;
+        }
         if (self.app.len == 0) {
             std.debug.print("Error: No application specified.\n", .{});
             try self.printUsage(allocator);
@@ -167,6 +312,21 @@ pub const Options = struct {
             \\  --host TEXT                 Bind socket to this host. [default: 127.0.0.1]
             \\  --port INTEGER              Bind socket to this port. [default: 8000]
             \\  --workers INTEGER           Number of worker processes. [default: 1]
+            \\  --workers-min INTEGER       Fewest workers when autoscaling. [default: 1]
+            \\  --workers-max INTEGER       Scale the worker count with load, up to this many.
+            \\                              Starts at --workers, kept within the range. Needs the
+            \\                              shared or exclusive accept mode.
+            \\  --accept-mode [shared|exclusive|reuseport]
+            \\                              How workers share the port: one polled socket, one
+            \\                              socket waited on with EPOLLEXCLUSIVE, or a
+            \\                              SO_REUSEPORT socket per worker. [default: shared]
+            \\  --reuseport-steering [hash|cpu]
+            \\                              Assign reuseport connections by address hash or by
+            \\                              the CPU that received them. [default: hash]
+            \\  --cpu-affinity [none|compact|spread|LIST]
+            \\                              Pin each worker to one CPU: filling one NUMA node at a
+            \\                              time, alternating between nodes, or from a list such
+            \\                              as 0,2,4-7. [default: none]
             \\  --reload                    Enable auto-reload.
             \\  --reload-dir PATH           Specify directories to watch for file changes.
             \\  --log-level TEXT            Set log level. [default: info]
@@ -174,11 +334,70 @@ pub const Options = struct {
             \\  --no-use-colors             Don't use colors in logs.
             \\  --lifespan TEXT             Lifespan implementation. [default: auto]
             \\  --interface TEXT            Select ASGI3, ASGI2, or WSGI app. [default: asgi3]
+            \\  --limit-max-requests INTEGER
+            \\                              Replace a worker after it serves this many requests.
+            \\  --limit-max-requests-jitter INTEGER
+            \\                              Add up to this many requests to each worker's limit so
+            \\                              workers do not restart together. [default: a tenth of
+            \\                              --limit-max-requests]
+            \\  --limit-max-rss INTEGER     Replace a worker once its resident memory exceeds this
+            \\                              many MiB.
+            \\  --timeout-graceful-shutdown INTEGER
+            \\                              Seconds to let in-flight requests finish on shutdown
+            \\                              before workers are terminated. [default: 30]
+            \\  --timeout-worker-hang INTEGER
+            \\                              Replace a worker, after dumping its Python stack, when
+            \\                              it stops looping or spends this many seconds on one
+            \\                              HTTP request.
+            \\  --timeout-worker-startup INTEGER
+            \\                              Replace a worker that has not started serving this
+            \\                              many seconds after it was forked.
+            \\  --h2-max-connection-streams INTEGER
+            \\                              Recycle HTTP/2 connections after this many streams.
+            \\  --h2-max-connection-age INTEGER
+            \\                              Recycle HTTP/2 connections after this many seconds.
+            \\  --ws-max-size INTEGER       WebSocket max message size in bytes. [default: 16777216]
+            \\  --ws-max-buffered INTEGER   Bytes an app may have sent to a WebSocket and not yet
+            \\                              written before send() waits; 0 disables the limit.
+            \\                              [default: 4194304]
+            \\  --ws-stream-fragments       Deliver WebSocket fragments to the app as they arrive,
+            \\                              marking all but the last with more_body.
+            \\  --ws-per-message-deflate BOOLEAN
+            \\                              WebSocket per-message-deflate compression. [default: True]
+            \\  --ws-deflate-memory INTEGER Bytes a WebSocket connection may keep between messages
+            \\                              for compression history. [default: 1048576]
+            \\  --ws-deflate-max-contexts INTEGER
+            \\                              Connections that may keep compression history at once.
+            \\                              [default: 1024]
+            \\  --ws-broadcast-max-pending INTEGER
+            \\                              Broadcast frames a WebSocket may have queued before
+            \\                              the broadcast policy applies. [default: 256]
+            \\  --ws-broadcast-policy [drop|disconnect]
+            \\                              Drop the oldest queued broadcast or disconnect a slow
+            \\                              subscriber. [default: drop]
+            \\  --ws-ping-interval FLOAT     WebSocket ping interval in seconds; 0 disables pings.
+            \\                              [default: 20.0]
+            \\  --ws-ping-timeout FLOAT      WebSocket ping timeout in seconds; 0 waits forever.
+            \\                              [default: 20.0]
             \\  -h, --help                  Show this help message and exit.
             \\
         );
     }
 
+    /// Parse a boolean option value the way Click does
+    fn parseBool(value: []const u8) !bool {
+        const truthy = [_][]const u8{ "1", "true", "t", "yes", "y", "on" };
+        const falsy = [_][]const u8{ "0", "false", "f", "no", "n", "off" };
+
+        for (truthy) |word| {
+            if (std.ascii.eqlIgnoreCase(value, word)) return true;
+        }
+        for (falsy) |word| {
+            if (std.ascii.eqlIgnoreCase(value, word)) return false;
+        }
+        return error.InvalidBoolean;
+    }
+
     /// Parse the application string into module and attribute
     pub fn parseApp(self: *const Options, allocator: Allocator) !struct { module: []const u8, attr: []const u8 } {
         var parts = std.mem.splitScalar(u8, self.app, ':');
@@ -222,6 +441,9 @@ pub const Options = struct {
             allocator.free(excludes);
         }
 
+        self.cpu_affinity.deinit(allocator);
+        self.cpu_affinity = .none;
+
         allocator.free(self.app);
     }
 };
@@ -301,3 +523,159 @@ test "Options with reload directories" {
     options.deinit(allocator);
     allocator.free(options.app);
 }
+
+test "Options with graceful shutdown and HTTP/2 recycling" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    const args = [_][]const u8{ "program_name", "--timeout-graceful-shutdown=15", "--timeout-worker-hang", "30", "--timeout-worker-startup=120", "--h2-max-connection-streams", "1000", "--h2-max-connection-age=600", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(@as(?u32, 15), options.timeout_graceful_shutdown);
+    try std.testing.expectEqual(@as(?u32, 30), options.timeout_worker_hang);
+    try std.testing.expectEqual(@as(?u32, 120), options.timeout_worker_startup);
+    try std.testing.expectEqual(@as(?u32, 1000), options.h2_max_connection_streams);
+    try std.testing.expectEqual(@as(?u32, 600), options.h2_max_connection_age);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with WebSocket message limits" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    try std.testing.expectEqual(@as(u32, 4 * 1024 * 1024), options.ws_max_buffered);
+
+    const args = [_][]const u8{ "program_name", "--ws-max-size", "65536", "--ws-stream-fragments", "--ws-max-buffered=262144", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(@as(u32, 65536), options.ws_max_size);
+    try std.testing.expect(options.ws_stream_fragments);
+    try std.testing.expectEqual(@as(u32, 262144), options.ws_max_buffered);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with WebSocket compression" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    try std.testing.expect(options.ws_per_message_deflate);
+
+    const args = [_][]const u8{ "program_name", "--ws-per-message-deflate=False", "--ws-deflate-memory", "0", "--ws-deflate-max-contexts=64", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expect(!options.ws_per_message_deflate);
+    try std.testing.expectEqual(@as(u32, 0), options.ws_deflate_memory);
+    try std.testing.expectEqual(@as(u32, 64), options.ws_deflate_max_contexts);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with WebSocket broadcast backpressure" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    try std.testing.expectEqual(broadcast.Policy.drop_oldest, options.ws_broadcast_policy);
+
+    const args = [_][]const u8{ "program_name", "--ws-broadcast-max-pending=32", "--ws-broadcast-policy", "disconnect", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(@as(u32, 32), options.ws_broadcast_max_pending);
+    try std.testing.expectEqual(broadcast.Policy.disconnect, options.ws_broadcast_policy);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with WebSocket keepalive" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    const args = [_][]const u8{ "program_name", "--ws-ping-interval=5", "--ws-ping-timeout", "2.5", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(@as(f64, 5.0), options.ws_ping_interval);
+    try std.testing.expectEqual(@as(f64, 2.5), options.ws_ping_timeout);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with worker accept modes" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    try std.testing.expectEqual(http_server.AcceptMode.shared, options.accept_mode);
+
+    const args = [_][]const u8{ "program_name", "--workers=4", "--accept-mode", "reuseport", "--reuseport-steering=cpu", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(http_server.AcceptMode.reuseport, options.accept_mode);
+    try std.testing.expectEqual(http_server.Steering.cpu, options.reuseport_steering);
+
+    const bad_args = [_][]const u8{ "program_name", "--accept-mode=random", "module:app" };
+    try std.testing.expectError(error.InvalidAcceptMode, options.parseArgs(allocator, &bad_args));
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with CPU affinity" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    try std.testing.expectEqual(affinity.Policy.none, options.cpu_affinity);
+
+    const args = [_][]const u8{ "program_name", "--cpu-affinity=spread", "--cpu-affinity", "0,2,4-5", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqualSlices(usize, &[_]usize{ 0, 2, 4, 5 }, options.cpu_affinity.list);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with worker recycling limits" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    const args = [_][]const u8{ "program_name", "--limit-max-requests=10000", "--limit-max-requests-jitter", "500", "--limit-max-rss=512", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(@as(?u32, 10000), options.limit_max_requests);
+    try std.testing.expectEqual(@as(?u32, 500), options.limit_max_requests_jitter);
+    try std.testing.expectEqual(@as(?u32, 512), options.limit_max_rss);
+
+    // Clean up
+    options.deinit(allocator);
+}
+
+test "Options with worker autoscaling" {
+    var options = Options.init();
+    const allocator = std.testing.allocator;
+
+    const args = [_][]const u8{ "program_name", "--workers-min=2", "--workers-max", "8", "module:app" };
+
+    try options.parseArgs(allocator, &args);
+
+    try std.testing.expectEqual(@as(?u16, 2), options.workers_min);
+    try std.testing.expectEqual(@as(?u16, 8), options.workers_max);
+
+    const bad_args = [_][]const u8{ "program_name", "--workers-min=4", "--workers-max=2", "module:app" };
+    try std.testing.expectError(error.InvalidWorkerRange, options.parseArgs(allocator, &bad_args));
+
+    // Clean up
+    options.deinit(allocator);
+}
@@ -0,0 +1,124 @@
+const std = @import("std");
+
+const ns_per_s = std.time.ns_per_s;
+
+/// Token bucket refilled continuously at `rate` tokens per second up to
+/// `capacity`. Tokens are kept in nanosecond units so refills need no
+/// floating point.
+pub const TokenBucket = struct {
+    capacity: u32,
+    rate: u32,
+    /// Available tokens times ns_per_s
+    level: u64,
+    last_refill: u64,
+
+    pub fn init(capacity: u32, rate: u32, now_ns: u64) TokenBucket {
+        return TokenBucket{
+            .capacity = capacity,
+            .rate = rate,
+            .level = @as(u64, capacity) * ns_per_s,
+            .last_refill = now_ns,
+        };
+    }
+
+    /// Take one token. Returns false when the bucket is empty.
+    pub fn take(self: *TokenBucket, now_ns: u64) bool {
+        self.refill(now_ns);
+        if (self.level < ns_per_s) return false;
+        self.level -= ns_per_s;
+        return true;
+    }
+
+    /// Add `tokens` earned by something other than time, up to `capacity`
+    pub fn credit(self: *TokenBucket, tokens: u32) void {
+        const full = @as(u64, self.capacity) * ns_per_s;
+        self.level = @min(full, self.level + @as(u64, tokens) * ns_per_s);
+    }
+
+    fn refill(self: *TokenBucket, now_ns: u64) void {
+        if (now_ns <= self.last_refill) return;
+
+        const full = @as(u64, self.capacity) * ns_per_s;
+        // Anything past a minute of idle time refills the bucket anyway;
+        // clamping keeps the multiplication from overflowing
+        const elapsed = @min(now_ns - self.last_refill, 60 * ns_per_s);
+        self.level = @min(full, self.level + elapsed * self.rate);
+        self.last_refill = now_ns;
+    }
+};
+
+/// Frame kinds that cost the server work without producing a response and
+/// are therefore rate limited per connection
+pub const FrameKind = enum {
+    rst_stream,
+    ping,
+    settings,
+    empty_data,
+    window_update,
+    /// PRIORITY and frames of unknown type, which are read and dropped
+    ignored,
+};
+
+/// Burst size and sustained rate for one frame kind
+pub const Budget = struct {
+    burst: u32,
+    per_second: u32,
+};
+
+/// Per-connection budgets. The defaults are far above what a well-behaved
+/// client sends (browsers reset a handful of streams per page, ping and
+/// change settings a few times per connection) while cutting off
+/// rapid-reset and control-frame floods within a few hundred frames.
+/// WINDOW_UPDATE also earns tokens from the DATA we send (see
+/// `FloodGuard.creditDataSent`), since a client acknowledges downloads
+/// with it. Some browsers send a few PRIORITY frames per request, so the
+/// ignored-frame budget matches the reset one.
+pub const Limits = struct {
+    rst_stream: Budget = .{ .burst = 200, .per_second = 100 },
+    ping: Budget = .{ .burst = 50, .per_second = 10 },
+    settings: Budget = .{ .burst = 50, .per_second = 10 },
+    empty_data: Budget = .{ .burst = 100, .per_second = 50 },
+    window_update: Budget = .{ .burst = 2000, .per_second = 1000 },
+    ignored: Budget = .{ .burst = 200, .per_second = 100 },
+};
+
+/// Token buckets for each limited frame kind on one connection
+pub const FloodGuard = struct {
+    buckets: std.EnumArray(FrameKind, TokenBucket),
+    epoch: std.time.Instant,
+
+    pub fn init(limits: Limits) !FloodGuard {
+        var buckets = std.EnumArray(FrameKind, TokenBucket).initUndefined();
+        inline for (std.meta.fields(FrameKind)) |field| {
+            const budget: Budget = @field(limits, field.name);
+            buckets.set(@field(FrameKind, field.name), TokenBucket.init(budget.burst, budget.per_second, 0));
+        }
+
+        return FloodGuard{
+            .buckets = buckets,
+            .epoch = try std.time.Instant.now(),
+        };
+    }
+
+    /// WINDOW_UPDATE frames a peer may send for each DATA frame it
+    /// receives: one for the stream and one for the connection
+    pub const window_updates_per_data_frame = 2;
+
+    /// Record DATA frames sent to the peer, each of which it may answer
+    /// with WINDOW_UPDATEs, so a fast download cannot trip the budget
+    pub fn creditDataSent(self: *FloodGuard, frames: u32) void {
+        self.buckets.getPtr(.window_update).credit(frames * window_updates_per_data_frame);
+    }
+
+    /// Charge one frame of `kind` against its budget at the current time
+    pub fn charge(self: *FloodGuard, kind: FrameKind) !void {
+        const now = std.time.Instant.now() catch return;
+        return self.chargeAt(kind, now.since(self.epoch));
+    }
+
+    /// Charge one frame of `kind` at `now_ns` nanoseconds since the guard
+    /// was created. Returns error.EnhanceYourCalm when the budget is spent.
+    pub fn chargeAt(self: *FloodGuard, kind: FrameKind, now_ns: u64) !void {
+        if (!self.buckets.getPtr(kind).take(now_ns)) return error.EnhanceYourCalm;
+    }
+};
@@ -0,0 +1,60 @@
+const std = @import("std");
+const testing = std.testing;
+const h2_flood = @import("h2_flood.zig");
+
+const ns_per_s = std.time.ns_per_s;
+
+test "Token bucket allows a burst then refills at its rate" {
+    var bucket = h2_flood.TokenBucket.init(3, 2, 0);
+
+    try testing.expect(bucket.take(0));
+    try testing.expect(bucket.take(0));
+    try testing.expect(bucket.take(0));
+    try testing.expect(!bucket.take(0));
+
+    // Two tokens per second: one is back after half a second
+    try testing.expect(!bucket.take(ns_per_s / 4));
+    try testing.expect(bucket.take(ns_per_s / 2));
+    try testing.expect(!bucket.take(ns_per_s / 2));
+
+    // Refill never exceeds the burst size
+    var taken: usize = 0;
+    while (bucket.take(100 * ns_per_s)) taken += 1;
+    try testing.expectEqual(@as(usize, 3), taken);
+}
+
+test "Flood guard budgets are independent per frame kind" {
+    var guard = try h2_flood.FloodGuard.init(.{
+        .ping = .{ .burst = 2, .per_second = 1 },
+    });
+
+    try guard.chargeAt(.ping, 0);
+    try guard.chargeAt(.ping, 0);
+    try testing.expectError(error.EnhanceYourCalm, guard.chargeAt(.ping, 0));
+
+    // Other kinds keep their own budget
+    try guard.chargeAt(.settings, 0);
+    try guard.chargeAt(.rst_stream, 0);
+
+    try guard.chargeAt(.ping, ns_per_s);
+}
+
+test "DATA we send earns WINDOW_UPDATE budget" {
+    var guard = try h2_flood.FloodGuard.init(.{
+        .window_update = .{ .burst = 4, .per_second = 1 },
+    });
+
+    for (0..4) |_| try guard.chargeAt(.window_update, 0);
+    try testing.expectError(error.EnhanceYourCalm, guard.chargeAt(.window_update, 0));
+
+    // Each DATA frame may be acknowledged on the stream and the connection
+    guard.creditDataSent(1);
+    try guard.chargeAt(.window_update, 0);
+    try guard.chargeAt(.window_update, 0);
+    try testing.expectError(error.EnhanceYourCalm, guard.chargeAt(.window_update, 0));
+
+    // Credit never exceeds the burst size
+    guard.creditDataSent(100);
+    for (0..4) |_| try guard.chargeAt(.window_update, 0);
+    try testing.expectError(error.EnhanceYourCalm, guard.chargeAt(.window_update, 0));
+}
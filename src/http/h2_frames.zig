@@ -13,6 +13,8 @@ pub const FrameType = enum(u8) {
     GOAWAY = 0x7,
     WINDOW_UPDATE = 0x8,
     CONTINUATION = 0x9,
+    // Unknown frame types must be ignored (RFC 9113 section 4.1)
+    _,
 };
 
 pub const FrameFlags = struct {
@@ -38,6 +40,7 @@ pub const ErrorCode = enum(u32) {
     ENHANCE_YOUR_CALM = 0xb,
     INADEQUATE_SECURITY = 0xc,
     HTTP_1_1_REQUIRED = 0xd,
+    _,
 };
 
 pub const SettingsId = enum(u16) {
@@ -47,6 +50,10 @@ pub const SettingsId = enum(u16) {
     INITIAL_WINDOW_SIZE = 0x4,
     MAX_FRAME_SIZE = 0x5,
     MAX_HEADER_LIST_SIZE = 0x6,
+    /// Extended CONNECT, for WebSockets over HTTP/2 (RFC 8441 section 3)
+    ENABLE_CONNECT_PROTOCOL = 0x8,
+    // Unknown settings must be ignored (RFC 9113 section 6.5.2)
+    _,
 };
 
 pub const FrameHeader = struct {
@@ -91,33 +98,36 @@ pub const FrameHeader = struct {
     }
 };
 
+/// An HTTP/2 frame. The payload is a borrowed view: for parsed frames it
+/// points into the caller's read buffer and is only valid until that buffer
+/// is refilled.
 pub const Frame = struct {
     header: FrameHeader,
     payload: []const u8,
 
-    pub fn parse(allocator: mem.Allocator, data: []const u8) !Frame {
+    /// Parse a frame as a view into `data` without copying the payload
+    pub fn parse(data: []const u8) !Frame {
         const header = try FrameHeader.parse(data);
 
         if (data.len < FrameHeader.SIZE + header.length) {
             return error.InsufficientData;
         }
 
-        const payload = data[FrameHeader.SIZE..][0..header.length];
-        const owned_payload = try allocator.dupe(u8, payload);
-
         return Frame{
             .header = header,
-            .payload = owned_payload,
+            .payload = data[FrameHeader.SIZE..][0..header.length],
         };
     }
 
-    pub fn deinit(self: Frame, allocator: mem.Allocator) void {
-        allocator.free(self.payload);
+    /// Size of the frame on the wire, including the 9-byte header
+    pub fn wireSize(self: Frame) usize {
+        return FrameHeader.SIZE + self.payload.len;
     }
 
+    /// Serialize into a freshly allocated buffer. The connection write path
+    /// uses `FrameWriter` instead; this is kept for tests and tooling.
     pub fn serialize(self: Frame, allocator: mem.Allocator) ![]u8 {
-        const total_size = FrameHeader.SIZE + self.payload.len;
-        var buffer = try allocator.alloc(u8, total_size);
+        const buffer = try allocator.alloc(u8, self.wireSize());
 
         try self.header.serialize(buffer[0..FrameHeader.SIZE]);
         @memcpy(buffer[FrameHeader.SIZE..], self.payload);
@@ -169,9 +179,16 @@ pub const SettingsFrame = struct {
     }
 
     pub fn serialize(self: SettingsFrame, allocator: mem.Allocator) ![]u8 {
-        const payload_size = self.settings.items.len * 6;
-        var payload = try allocator.alloc(u8, payload_size);
+        const payload = try allocator.alloc(u8, self.payloadSize());
+        self.encodeInto(payload);
+        return payload;
+    }
 
+    fn payloadSize(self: SettingsFrame) usize {
+        return self.settings.items.len * 6;
+    }
+
+    fn encodeInto(self: SettingsFrame, payload: []u8) void {
         for (self.settings.items, 0..) |setting, i| {
             const offset = i * 6;
             const id_val = @intFromEnum(setting.id);
@@ -183,22 +200,17 @@ pub const SettingsFrame = struct {
             payload[offset + 4] = @intCast((setting.value >> 8) & 0xFF);
             payload[offset + 5] = @intCast(setting.value & 0xFF);
         }
-
-        return payload;
     }
 
-    pub fn toFrame(self: SettingsFrame, allocator: mem.Allocator, flags: u8) !Frame {
-        const payload = try self.serialize(allocator);
-
-        return Frame{
-            .header = FrameHeader{
-                .length = @intCast(payload.len),
-                .frame_type = FrameType.SETTINGS,
-                .flags = flags,
-                .stream_id = 0,
-            },
-            .payload = payload,
-        };
+    /// Queue this SETTINGS frame, encoding the payload into the writer's scratch area
+    pub fn write(self: SettingsFrame, writer: *FrameWriter, flags: u8) !void {
+        const payload = try writer.reserveFrame(FrameHeader{
+            .length = @intCast(self.payloadSize()),
+            .frame_type = FrameType.SETTINGS,
+            .flags = flags,
+            .stream_id = 0,
+        }, self.payloadSize());
+        self.encodeInto(payload);
     }
 };
 
@@ -206,7 +218,8 @@ pub const DataFrame = struct {
     data: []const u8,
     pad_length: ?u8 = null,
 
-    pub fn parse(allocator: mem.Allocator, frame: Frame) !DataFrame {
+    /// Strip padding from a DATA frame. `data` borrows from the frame payload.
+    pub fn parse(frame: Frame) !DataFrame {
         if (frame.header.frame_type != FrameType.DATA) {
             return error.InvalidFrameType;
         }
@@ -223,49 +236,28 @@ pub const DataFrame = struct {
             payload = payload[0 .. payload.len - pad_length.?];
         }
 
-        const owned_data = try allocator.dupe(u8, payload);
-
         return DataFrame{
-            .data = owned_data,
+            .data = payload,
             .pad_length = pad_length,
         };
     }
 
-    pub fn deinit(self: DataFrame, allocator: mem.Allocator) void {
-        allocator.free(self.data);
-    }
-
-    pub fn toFrame(self: DataFrame, allocator: mem.Allocator, stream_id: u31, flags: u8) !Frame {
-        var payload_size = self.data.len;
-        var frame_flags = flags;
-
-        if (self.pad_length) |pad_len| {
-            payload_size += 1 + pad_len;
-            frame_flags |= FrameFlags.PADDED;
-        }
-
-        var payload = try allocator.alloc(u8, payload_size);
-        var offset: usize = 0;
-
-        if (self.pad_length) |pad_len| {
-            payload[0] = pad_len;
-            offset = 1;
-            @memcpy(payload[offset .. offset + self.data.len], self.data);
-            offset += self.data.len;
-            @memset(payload[offset..], 0);
-        } else {
-            @memcpy(payload, self.data);
-        }
-
-        return Frame{
-            .header = FrameHeader{
-                .length = @intCast(payload.len),
-                .frame_type = FrameType.DATA,
-                .flags = frame_flags,
-                .stream_id = stream_id,
-            },
-            .payload = payload,
-        };
+    /// Queue this DATA frame without copying `data`; it must stay alive
+    /// until the writer is flushed. Padding bytes come from a static buffer.
+    pub fn write(self: DataFrame, writer: *FrameWriter, stream_id: u31, flags: u8) !void {
+        const pad_len: usize = self.pad_length orelse 0;
+        const prefix_len: usize = if (self.pad_length != null) 1 else 0;
+
+        const prefix = try writer.reserveFrame(FrameHeader{
+            .length = @intCast(prefix_len + self.data.len + pad_len),
+            .frame_type = FrameType.DATA,
+            .flags = if (self.pad_length != null) flags | FrameFlags.PADDED else flags,
+            .stream_id = stream_id,
+        }, prefix_len);
+
+        if (self.pad_length) |pad| prefix[0] = pad;
+        try writer.appendPayload(self.data);
+        try writer.appendPayload(zero_padding[0..pad_len]);
     }
 };
 
@@ -292,23 +284,14 @@ pub const WindowUpdateFrame = struct {
         };
     }
 
-    pub fn toFrame(self: WindowUpdateFrame, allocator: mem.Allocator, stream_id: u31) !Frame {
-        var payload = try allocator.alloc(u8, 4);
-
-        payload[0] = @intCast((self.window_size_increment >> 24) & 0xFF);
-        payload[1] = @intCast((self.window_size_increment >> 16) & 0xFF);
-        payload[2] = @intCast((self.window_size_increment >> 8) & 0xFF);
-        payload[3] = @intCast(self.window_size_increment & 0xFF);
-
-        return Frame{
-            .header = FrameHeader{
-                .length = 4,
-                .frame_type = FrameType.WINDOW_UPDATE,
-                .flags = 0,
-                .stream_id = stream_id,
-            },
-            .payload = payload,
-        };
+    pub fn write(self: WindowUpdateFrame, writer: *FrameWriter, stream_id: u31) !void {
+        const payload = try writer.reserveFrame(FrameHeader{
+            .length = 4,
+            .frame_type = FrameType.WINDOW_UPDATE,
+            .flags = 0,
+            .stream_id = stream_id,
+        }, 4);
+        mem.writeInt(u32, payload[0..4], self.window_size_increment, .big);
     }
 };
 
@@ -332,24 +315,14 @@ pub const RstStreamFrame = struct {
         };
     }
 
-    pub fn toFrame(self: RstStreamFrame, allocator: mem.Allocator, stream_id: u31) !Frame {
-        var payload = try allocator.alloc(u8, 4);
-        const error_code_val = @intFromEnum(self.error_code);
-
-        payload[0] = @intCast((error_code_val >> 24) & 0xFF);
-        payload[1] = @intCast((error_code_val >> 16) & 0xFF);
-        payload[2] = @intCast((error_code_val >> 8) & 0xFF);
-        payload[3] = @intCast(error_code_val & 0xFF);
-
-        return Frame{
-            .header = FrameHeader{
-                .length = 4,
-                .frame_type = FrameType.RST_STREAM,
-                .flags = 0,
-                .stream_id = stream_id,
-            },
-            .payload = payload,
-        };
+    pub fn write(self: RstStreamFrame, writer: *FrameWriter, stream_id: u31) !void {
+        const payload = try writer.reserveFrame(FrameHeader{
+            .length = 4,
+            .frame_type = FrameType.RST_STREAM,
+            .flags = 0,
+            .stream_id = stream_id,
+        }, 4);
+        mem.writeInt(u32, payload[0..4], @intFromEnum(self.error_code), .big);
     }
 };
 
@@ -358,7 +331,8 @@ pub const GoAwayFrame = struct {
     error_code: ErrorCode,
     debug_data: []const u8,
 
-    pub fn parse(allocator: mem.Allocator, frame: Frame) !GoAwayFrame {
+    /// Parse a GOAWAY frame. `debug_data` borrows from the frame payload.
+    pub fn parse(frame: Frame) !GoAwayFrame {
         if (frame.header.frame_type != FrameType.GOAWAY) {
             return error.InvalidFrameType;
         }
@@ -376,49 +350,318 @@ pub const GoAwayFrame = struct {
             @as(u32, frame.payload[7]);
 
         const last_stream_id = last_stream_id_raw & 0x7FFFFFFF;
-        const debug_data = if (frame.payload.len > 8)
-            try allocator.dupe(u8, frame.payload[8..])
-        else
-            try allocator.alloc(u8, 0);
 
         return GoAwayFrame{
             .last_stream_id = @intCast(last_stream_id),
             .error_code = @enumFromInt(error_code_raw),
-            .debug_data = debug_data,
+            .debug_data = frame.payload[8..],
+        };
+    }
+
+    /// Queue this GOAWAY frame; the (small) debug data is copied into the scratch area
+    pub fn write(self: GoAwayFrame, writer: *FrameWriter) !void {
+        const payload = try writer.reserveFrame(FrameHeader{
+            .length = @intCast(8 + self.debug_data.len),
+            .frame_type = FrameType.GOAWAY,
+            .flags = 0,
+            .stream_id = 0,
+        }, 8 + self.debug_data.len);
+
+        mem.writeInt(u32, payload[0..4], self.last_stream_id, .big);
+        mem.writeInt(u32, payload[4..8], @intFromEnum(self.error_code), .big);
+        @memcpy(payload[8..], self.debug_data);
+    }
+};
+
+pub const PingFrame = struct {
+    opaque_data: [8]u8,
+
+    pub fn parse(frame: Frame) !PingFrame {
+        if (frame.header.frame_type != FrameType.PING) {
+            return error.InvalidFrameType;
+        }
+
+        if (frame.payload.len != 8) return error.InvalidPingFrame;
+
+        return PingFrame{
+            .opaque_data = frame.payload[0..8].*,
+        };
+    }
+
+    pub fn write(self: PingFrame, writer: *FrameWriter, flags: u8) !void {
+        const payload = try writer.reserveFrame(FrameHeader{
+            .length = 8,
+            .frame_type = FrameType.PING,
+            .flags = flags,
+            .stream_id = 0,
+        }, 8);
+        @memcpy(payload, &self.opaque_data);
+    }
+};
+
+/// Client connection preface that precedes the first SETTINGS frame
+pub const CONNECTION_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+/// Maximum iovecs handed to a single writev call (IOV_MAX on Linux)
+const max_iovecs = 1024;
+
+/// Zero bytes referenced as padding so padded frames need no allocation
+const zero_padding = [_]u8{0} ** 256;
+
+/// Per-connection read buffer that yields frames as views into itself.
+/// A frame returned by `next` stays valid until the following `fill`.
+pub const FrameReader = struct {
+    const Self = @This();
+
+    allocator: mem.Allocator,
+    buffer: []u8,
+    start: usize = 0,
+    end: usize = 0,
+    max_frame_size: u32,
+
+    pub fn init(allocator: mem.Allocator, max_frame_size: u32) !Self {
+        // Room for two maximum-size frames so a single read can complete one
+        // frame and still pick up the start of the next
+        const capacity = 2 * (FrameHeader.SIZE + @as(usize, max_frame_size));
+        return Self{
+            .allocator = allocator,
+            .buffer = try allocator.alloc(u8, capacity),
+            .max_frame_size = max_frame_size,
         };
     }
 
-    pub fn deinit(self: GoAwayFrame, allocator: mem.Allocator) void {
-        allocator.free(self.debug_data);
+    pub fn deinit(self: *Self) void {
+        self.allocator.free(self.buffer);
+    }
+
+    /// Bytes received but not yet consumed as frames
+    pub fn buffered(self: *const Self) []const u8 {
+        return self.buffer[self.start..self.end];
+    }
+
+    /// Read once from `fd` into the free tail of the buffer. Frames handed
+    /// out earlier are invalidated. Returns 0 on EOF.
+    pub fn fill(self: *Self, fd: std.posix.fd_t) !usize {
+        self.compact();
+        if (self.end == self.buffer.len) return error.ReadBufferFull;
+
+        const bytes_read = try std.posix.read(fd, self.buffer[self.end..]);
+        self.end += bytes_read;
+        return bytes_read;
     }
 
-    pub fn toFrame(self: GoAwayFrame, allocator: mem.Allocator) !Frame {
-        const payload_size = 8 + self.debug_data.len;
-        var payload = try allocator.alloc(u8, payload_size);
+    /// Append bytes that were read elsewhere (e.g. sniffed while detecting h2c)
+    pub fn feed(self: *Self, data: []const u8) !void {
+        self.compact();
+        if (self.buffer.len - self.end < data.len) return error.ReadBufferFull;
 
-        payload[0] = @intCast((self.last_stream_id >> 24) & 0xFF);
-        payload[1] = @intCast((self.last_stream_id >> 16) & 0xFF);
-        payload[2] = @intCast((self.last_stream_id >> 8) & 0xFF);
-        payload[3] = @intCast(self.last_stream_id & 0xFF);
+        @memcpy(self.buffer[self.end..][0..data.len], data);
+        self.end += data.len;
+    }
 
-        const error_code_val = @intFromEnum(self.error_code);
-        payload[4] = @intCast((error_code_val >> 24) & 0xFF);
-        payload[5] = @intCast((error_code_val >> 16) & 0xFF);
-        payload[6] = @intCast((error_code_val >> 8) & 0xFF);
-        payload[7] = @intCast(error_code_val & 0xFF);
+    /// Consume the client connection preface. Returns false if it has not
+    /// fully arrived yet.
+    pub fn consumePreface(self: *Self) !bool {
+        const available = self.buffered();
+        if (available.len < CONNECTION_PREFACE.len) {
+            if (!mem.startsWith(u8, CONNECTION_PREFACE, available)) return error.InvalidPreface;
+            return false;
+        }
 
-        if (self.debug_data.len > 0) {
-            @memcpy(payload[8..], self.debug_data);
+        if (!mem.eql(u8, available[0..CONNECTION_PREFACE.len], CONNECTION_PREFACE)) {
+            return error.InvalidPreface;
         }
 
+        self.start += CONNECTION_PREFACE.len;
+        return true;
+    }
+
+    /// Next complete frame in the buffer, or null if more bytes are needed
+    pub fn next(self: *Self) !?Frame {
+        const available = self.buffered();
+        if (available.len < FrameHeader.SIZE) return null;
+
+        const header = try FrameHeader.parse(available);
+        if (header.length > self.max_frame_size) return error.FrameSizeError;
+
+        const total = FrameHeader.SIZE + @as(usize, header.length);
+        if (available.len < total) return null;
+
+        self.start += total;
         return Frame{
-            .header = FrameHeader{
-                .length = @intCast(payload.len),
-                .frame_type = FrameType.GOAWAY,
-                .flags = 0,
-                .stream_id = 0,
-            },
-            .payload = payload,
+            .header = header,
+            .payload = available[FrameHeader.SIZE..total],
+        };
+    }
+
+    fn compact(self: *Self) void {
+        if (self.start == 0) return;
+
+        if (self.start == self.end) {
+            self.start = 0;
+            self.end = 0;
+            return;
+        }
+
+        mem.copyForwards(u8, self.buffer, self.buffer[self.start..self.end]);
+        self.end -= self.start;
+        self.start = 0;
+    }
+};
+
+/// Coalescing frame writer. Each frame is queued as iovec segments: the
+/// 9-byte header and small control payloads live in a scratch area, while
+/// bulk payloads are borrowed from the caller. Everything queued during one
+/// reactor turn goes out with a single writev.
+pub const FrameWriter = struct {
+    const Self = @This();
+
+    const Segment = union(enum) {
+        /// Byte range inside `scratch` (offsets stay valid while it grows)
+        scratch: struct { start: usize, len: usize },
+        /// Caller-owned bytes that must outlive the next flush
+        borrowed: []const u8,
+    };
+
+    allocator: mem.Allocator,
+    scratch: std.ArrayList(u8),
+    segments: std.ArrayList(Segment),
+    /// Heap payloads handed over with `queueOwnedFrame`, freed once flushed
+    owned: std.ArrayList([]u8),
+    iovecs: std.ArrayList(std.posix.iovec_const),
+    /// First segment that has not been fully written yet
+    head: usize = 0,
+    pending_bytes: usize = 0,
+
+    pub fn init(allocator: mem.Allocator) Self {
+        return Self{
+            .allocator = allocator,
+            .scratch = std.ArrayList(u8).init(allocator),
+            .segments = std.ArrayList(Segment).init(allocator),
+            .owned = std.ArrayList([]u8).init(allocator),
+            .iovecs = std.ArrayList(std.posix.iovec_const).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.reset();
+        self.scratch.deinit();
+        self.segments.deinit();
+        self.owned.deinit();
+        self.iovecs.deinit();
+    }
+
+    pub fn hasPending(self: *const Self) bool {
+        return self.pending_bytes > 0;
+    }
+
+    /// Queue a frame header followed by `inline_len` payload bytes in the
+    /// scratch area. Returns the inline bytes for the caller to fill in;
+    /// the slice is valid until the next call on the writer.
+    pub fn reserveFrame(self: *Self, header: FrameHeader, inline_len: usize) ![]u8 {
+        const len = FrameHeader.SIZE + inline_len;
+        try self.scratch.ensureUnusedCapacity(len);
+        // Header segment plus room for a payload and padding segment
+        try self.segments.ensureUnusedCapacity(3);
+
+        const start = self.scratch.items.len;
+        const bytes = self.scratch.addManyAsSliceAssumeCapacity(len);
+        header.serialize(bytes[0..FrameHeader.SIZE]) catch unreachable;
+
+        self.segments.appendAssumeCapacity(.{ .scratch = .{ .start = start, .len = len } });
+        self.pending_bytes += len;
+        return bytes[FrameHeader.SIZE..];
+    }
+
+    /// Continue the most recently reserved frame with borrowed payload bytes
+    pub fn appendPayload(self: *Self, bytes: []const u8) !void {
+        // Empty segments would make writev report no progress
+        if (bytes.len == 0) return;
+
+        try self.segments.append(.{ .borrowed = bytes });
+        self.pending_bytes += bytes.len;
+    }
+
+    /// Queue a frame whose payload is borrowed until the next flush
+    pub fn queueFrame(self: *Self, header: FrameHeader, payload: []const u8) !void {
+        std.debug.assert(header.length == payload.len);
+        _ = try self.reserveFrame(header, 0);
+        try self.appendPayload(payload);
+    }
+
+    /// Queue a frame and take ownership of its heap-allocated payload. On
+    /// error the caller keeps ownership.
+    pub fn queueOwnedFrame(self: *Self, header: FrameHeader, payload: []u8) !void {
+        try self.owned.ensureUnusedCapacity(1);
+        try self.queueFrame(header, payload);
+        self.owned.appendAssumeCapacity(payload);
+    }
+
+    /// Take ownership of a heap buffer that frames queued afterwards borrow
+    /// from (e.g. a header block split into HEADERS and CONTINUATION). It
+    /// is freed with the rest of the queue. On error the caller keeps
+    /// ownership.
+    pub fn adopt(self: *Self, bytes: []u8) !void {
+        try self.owned.append(bytes);
+    }
+
+    /// Write everything queued. A single writev is issued unless the queue
+    /// exceeds IOV_MAX segments or the kernel accepts a short write. On
+    /// error.WouldBlock the unwritten tail stays queued for the next flush.
+    pub fn flush(self: *Self, fd: std.posix.fd_t) !void {
+        while (self.head < self.segments.items.len) {
+            const end = @min(self.segments.items.len, self.head + max_iovecs);
+
+            self.iovecs.clearRetainingCapacity();
+            try self.iovecs.ensureTotalCapacity(end - self.head);
+            for (self.segments.items[self.head..end]) |segment| {
+                const bytes = self.segmentBytes(segment);
+                self.iovecs.appendAssumeCapacity(.{ .base = bytes.ptr, .len = bytes.len });
+            }
+
+            var written = try std.posix.writev(fd, self.iovecs.items);
+            if (written == 0) return error.ConnectionClosed;
+            self.pending_bytes -= written;
+
+            // Retire fully written segments and trim a partially written one
+            while (written > 0) {
+                const segment = &self.segments.items[self.head];
+                const len = self.segmentBytes(segment.*).len;
+                if (written >= len) {
+                    written -= len;
+                    self.head += 1;
+                } else {
+                    switch (segment.*) {
+                        .scratch => |*range| {
+                            range.start += written;
+                            range.len -= written;
+                        },
+                        .borrowed => |*bytes| bytes.* = bytes.*[written..],
+                    }
+                    written = 0;
+                }
+            }
+        }
+
+        self.reset();
+    }
+
+    /// Drop everything queued, releasing owned payloads
+    pub fn reset(self: *Self) void {
+        for (self.owned.items) |payload| {
+            self.allocator.free(payload);
+        }
+        self.owned.clearRetainingCapacity();
+        self.scratch.clearRetainingCapacity();
+        self.segments.clearRetainingCapacity();
+        self.head = 0;
+        self.pending_bytes = 0;
+    }
+
+    fn segmentBytes(self: *const Self, segment: Segment) []const u8 {
+        return switch (segment) {
+            .scratch => |range| self.scratch.items[range.start..][0..range.len],
+            .borrowed => |bytes| bytes,
         };
     }
 };
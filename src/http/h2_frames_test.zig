@@ -35,8 +35,6 @@ test "SettingsFrame parse and serialize" {
 }
 
 test "DataFrame with padding" {
-    const allocator = testing.allocator;
-
     const payload = [_]u8{ 0x05, 'H', 'e', 'l', 'l', 'o', 0x00, 0x00, 0x00, 0x00, 0x00 };
     const frame = h2_frames.Frame{
         .header = h2_frames.FrameHeader{
@@ -48,9 +46,98 @@ test "DataFrame with padding" {
         .payload = &payload,
     };
 
-    var data_frame = try h2_frames.DataFrame.parse(allocator, frame);
-    defer data_frame.deinit(allocator);
+    const data_frame = try h2_frames.DataFrame.parse(frame);
 
     try testing.expectEqualSlices(u8, "Hello", data_frame.data);
     try testing.expect(data_frame.pad_length.? == 5);
 }
+
+test "Frame.parse returns a view into the input" {
+    const wire = [_]u8{ 0x00, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 'a', 'b', 'c' };
+    const frame = try h2_frames.Frame.parse(&wire);
+
+    try testing.expectEqualSlices(u8, "abc", frame.payload);
+    try testing.expect(frame.payload.ptr == wire[9..].ptr);
+    try testing.expectEqual(@as(usize, 12), frame.wireSize());
+}
+
+test "FrameReader yields several frames from one buffer and waits on partial frames" {
+    const allocator = testing.allocator;
+
+    var reader = try h2_frames.FrameReader.init(allocator, 16384);
+    defer reader.deinit();
+
+    const ping = [_]u8{ 0x00, 0x00, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00 } ++ [_]u8{7} ** 8;
+    const settings_ack = [_]u8{ 0x00, 0x00, 0x00, 0x04, 0x01, 0x00, 0x00, 0x00, 0x00 };
+
+    try reader.feed(h2_frames.CONNECTION_PREFACE);
+    try reader.feed(&ping);
+    try reader.feed(&settings_ack);
+    try reader.feed(ping[0..5]);
+
+    try testing.expect(try reader.consumePreface());
+
+    const first = (try reader.next()).?;
+    try testing.expect(first.header.frame_type == .PING);
+    try testing.expectEqualSlices(u8, ping[9..], first.payload);
+
+    const second = (try reader.next()).?;
+    try testing.expect(second.header.frame_type == .SETTINGS);
+    try testing.expect(second.header.flags == h2_frames.FrameFlags.ACK);
+
+    // Only half of the next header has arrived
+    try testing.expect((try reader.next()) == null);
+
+    try reader.feed(ping[5..]);
+    const third = (try reader.next()).?;
+    try testing.expect(third.header.frame_type == .PING);
+    try testing.expect((try reader.next()) == null);
+}
+
+test "FrameReader rejects frames above max_frame_size" {
+    const allocator = testing.allocator;
+
+    var reader = try h2_frames.FrameReader.init(allocator, 16384);
+    defer reader.deinit();
+
+    // Length 0x010000 is one byte above the default maximum
+    try reader.feed(&[_]u8{ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 });
+    try testing.expectError(error.FrameSizeError, reader.next());
+}
+
+test "FrameWriter coalesces queued frames into one write" {
+    const allocator = testing.allocator;
+
+    var writer = h2_frames.FrameWriter.init(allocator);
+    defer writer.deinit();
+
+    const body = "hello world";
+    try (h2_frames.DataFrame{ .data = body }).write(&writer, 1, h2_frames.FrameFlags.END_STREAM);
+    try (h2_frames.PingFrame{ .opaque_data = [_]u8{1} ** 8 }).write(&writer, h2_frames.FrameFlags.ACK);
+    try (h2_frames.WindowUpdateFrame{ .window_size_increment = 1024 }).write(&writer, 0);
+
+    const expected_len = (9 + body.len) + (9 + 8) + (9 + 4);
+    try testing.expectEqual(expected_len, writer.pending_bytes);
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    try writer.flush(fds[1]);
+    try testing.expect(!writer.hasPending());
+
+    var out: [128]u8 = undefined;
+    const n = try std.posix.read(fds[0], &out);
+    try testing.expectEqual(expected_len, n);
+
+    const data = try h2_frames.Frame.parse(out[0..n]);
+    try testing.expect(data.header.frame_type == .DATA);
+    try testing.expectEqualSlices(u8, body, data.payload);
+
+    const ping = try h2_frames.Frame.parse(out[data.wireSize()..n]);
+    try testing.expect(ping.header.frame_type == .PING);
+    try testing.expect(ping.header.flags == h2_frames.FrameFlags.ACK);
+
+    const window = try h2_frames.WindowUpdateFrame.parse(try h2_frames.Frame.parse(out[data.wireSize() + ping.wireSize() .. n]));
+    try testing.expectEqual(@as(u31, 1024), window.window_size_increment);
+}
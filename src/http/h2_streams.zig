@@ -67,12 +67,14 @@ pub const Stream = struct {
         };
     }
 
+    /// Grow (or, for a SETTINGS change, shrink) the send window. Summed in
+    /// 64 bits, so a peer-supplied increment cannot overflow the i32.
     pub fn updateWindow(self: *Stream, increment: i32) !void {
-        const new_size = self.window_size + increment;
+        const new_size = @as(i64, self.window_size) + increment;
         if (new_size > std.math.maxInt(i31)) {
             return error.FlowControlError;
         }
-        self.window_size = new_size;
+        self.window_size = @intCast(new_size);
     }
 
     pub fn transitionState(self: *Stream, event: StateEvent) !void {
@@ -208,11 +210,11 @@ pub const StreamManager = struct {
     }
 
     pub fn updateConnectionWindow(self: *StreamManager, increment: i32) !void {
-        const new_size = self.connection_window_size + increment;
+        const new_size = @as(i64, self.connection_window_size) + increment;
         if (new_size > std.math.maxInt(i31)) {
             return error.FlowControlError;
         }
-        self.connection_window_size = new_size;
+        self.connection_window_size = @intCast(new_size);
     }
 
     pub fn updateAllStreamWindows(self: *StreamManager, increment: i32) !void {
@@ -285,6 +287,8 @@ pub const ConnectionSettings = struct {
     initial_window_size: u32 = 65535,
     max_frame_size: u32 = 16384,
     max_header_list_size: ?u32 = null,
+    /// Extended CONNECT (RFC 8441) is accepted
+    enable_connect_protocol: bool = false,
 
     pub fn updateSetting(self: *ConnectionSettings, id: u16, value: u32) !void {
         switch (id) {
@@ -300,6 +304,10 @@ pub const ConnectionSettings = struct {
                 self.max_frame_size = value;
             },
             6 => self.max_header_list_size = value,
+            8 => {
+                if (value > 1) return error.ProtocolError;
+                self.enable_connect_protocol = value == 1;
+            },
             else => {}, // Unknown settings are ignored
         }
     }
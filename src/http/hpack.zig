@@ -157,11 +157,19 @@ pub const DynamicTable = struct {
 pub const HpackDecoder = struct {
     dynamic_table: DynamicTable,
     allocator: mem.Allocator,
+    /// Upper bound for dynamic table size updates sent by the encoder
+    /// (our SETTINGS_HEADER_TABLE_SIZE)
+    max_table_size_limit: usize,
+    /// Upper bound for the decoded header list of one block, counted as in
+    /// SETTINGS_MAX_HEADER_LIST_SIZE (name + value + 32 per field). Guards
+    /// against blocks that reference large table entries over and over.
+    max_header_list_size: usize = std.math.maxInt(usize),
 
     pub fn init(allocator: mem.Allocator, max_table_size: usize) HpackDecoder {
         return HpackDecoder{
             .dynamic_table = DynamicTable.init(allocator, max_table_size),
             .allocator = allocator,
+            .max_table_size_limit = max_table_size,
         };
     }
 
@@ -171,34 +179,50 @@ pub const HpackDecoder = struct {
 
     pub fn decode(self: *HpackDecoder, data: []const u8) !std.ArrayList(HeaderField) {
         var headers = std.ArrayList(HeaderField).init(self.allocator);
+        errdefer {
+            for (headers.items) |header| {
+                self.allocator.free(header.name);
+                self.allocator.free(header.value);
+            }
+            headers.deinit();
+        }
+
         var pos: usize = 0;
+        var list_size: usize = 0;
 
         while (pos < data.len) {
-            if (data[pos] & 0x80 != 0) {
+            const header = if (data[pos] & 0x80 != 0) blk: {
                 // Indexed Header Field
                 const index = try self.decodeInteger(data, &pos, 7);
-                const header = try self.getHeaderField(index);
-                try headers.append(header);
-            } else if (data[pos] & 0x40 != 0) {
+                break :blk try self.getHeaderField(index);
+            } else if (data[pos] & 0x40 != 0) blk: {
                 // Literal Header Field with Incremental Indexing
                 const index = try self.decodeInteger(data, &pos, 6);
-                const header = try self.decodeLiteralHeader(data, &pos, index, true);
-                try headers.append(header);
+                break :blk try self.decodeLiteralHeader(data, &pos, index, true);
             } else if (data[pos] & 0x20 != 0) {
                 // Dynamic Table Size Update
                 const new_size = try self.decodeInteger(data, &pos, 5);
+                if (new_size > self.max_table_size_limit) return error.CompressionError;
                 self.dynamic_table.setMaxSize(new_size);
-            } else if (data[pos] & 0x10 != 0) {
+                continue;
+            } else if (data[pos] & 0x10 != 0) blk: {
                 // Literal Header Field Never Indexed
                 const index = try self.decodeInteger(data, &pos, 4);
-                const header = try self.decodeLiteralHeader(data, &pos, index, false);
-                try headers.append(header);
-            } else {
+                break :blk try self.decodeLiteralHeader(data, &pos, index, false);
+            } else blk: {
                 // Literal Header Field without Indexing
                 const index = try self.decodeInteger(data, &pos, 4);
-                const header = try self.decodeLiteralHeader(data, &pos, index, false);
-                try headers.append(header);
-            }
+                break :blk try self.decodeLiteralHeader(data, &pos, index, false);
+            };
+
+            list_size += header.size();
+            headers.append(header) catch |err| {
+                self.allocator.free(header.name);
+                self.allocator.free(header.value);
+                return err;
+            };
+
+            if (list_size > self.max_header_list_size) return error.HeaderListTooLarge;
         }
 
         return headers;
@@ -219,13 +243,18 @@ pub const HpackDecoder = struct {
             const b = data[pos.*];
             pos.* += 1;
 
+            // Nothing we accept needs more than 32 bits; longer encodings
+            // would overflow the shift
+            if (m > 28) return error.IntegerOverflow;
+
             value += (@as(usize, b & 0x7F) << m);
             m += 7;
 
-            if (b & 0x80 == 0) break;
+            if (b & 0x80 == 0) return value;
         }
 
-        return value;
+        // Continuation bit set on the last byte of the block
+        return error.InvalidInteger;
     }
 
     fn decodeString(self: *HpackDecoder, data: []const u8, pos: *usize) ![]u8 {
@@ -280,8 +309,10 @@ pub const HpackDecoder = struct {
             defer self.allocator.free(header.name);
             break :blk try self.allocator.dupe(u8, header.name);
         };
+        errdefer self.allocator.free(name);
 
         const value = try self.decodeString(data, pos);
+        errdefer self.allocator.free(value);
 
         if (add_to_table) {
             try self.dynamic_table.add(name, value);
@@ -84,3 +84,59 @@ test "Basic header encoding/decoding" {
     try testing.expectEqualStrings(":method", decoded_headers.items[0].name);
     try testing.expectEqualStrings("GET", decoded_headers.items[0].value);
 }
+
+test "Decoded header list is bounded" {
+    const allocator = testing.allocator;
+
+    var encoder = hpack.HpackEncoder.init(allocator, 4096);
+    defer encoder.deinit();
+
+    var decoder = hpack.HpackDecoder.init(allocator, 4096);
+    defer decoder.deinit();
+    decoder.max_header_list_size = 256;
+
+    // A block that keeps referencing one indexed entry decodes to far more
+    // than it costs on the wire
+    const big_value = "x" ** 100;
+    const headers = [_]hpack.HeaderField{
+        .{ .name = "x-big", .value = big_value },
+        .{ .name = "x-big", .value = big_value },
+        .{ .name = "x-big", .value = big_value },
+    };
+
+    const encoded = try encoder.encode(&headers);
+    defer allocator.free(encoded);
+
+    try testing.expectError(error.HeaderListTooLarge, decoder.decode(encoded));
+}
+
+test "Table size update above the advertised limit is rejected" {
+    const allocator = testing.allocator;
+
+    var decoder = hpack.HpackDecoder.init(allocator, 4096);
+    defer decoder.deinit();
+
+    var encoded = std.ArrayList(u8).init(allocator);
+    defer encoded.deinit();
+
+    var encoder = hpack.HpackEncoder.init(allocator, 4096);
+    defer encoder.deinit();
+    try encoder.encodeInteger(&encoded, 1 << 20, 5, 0x20);
+
+    try testing.expectError(error.CompressionError, decoder.decode(encoded.items));
+}
+
+test "Malformed integers are rejected" {
+    const allocator = testing.allocator;
+
+    var decoder = hpack.HpackDecoder.init(allocator, 4096);
+    defer decoder.deinit();
+
+    // Continuation bit set on the final byte
+    var pos: usize = 0;
+    try testing.expectError(error.InvalidInteger, decoder.decodeInteger(&[_]u8{ 0x1F, 0x80 }, &pos, 5));
+
+    // More continuation bytes than any 32-bit value needs
+    pos = 0;
+    try testing.expectError(error.IntegerOverflow, decoder.decodeInteger(&[_]u8{ 0x1F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 }, &pos, 5));
+}
@@ -1,6 +1,43 @@
 const std = @import("std");
 const Allocator = std.mem.Allocator;
 const net = std.net;
+const builtin = @import("builtin");
+
+/// How worker processes sharing a port divide up incoming connections
+pub const AcceptMode = enum {
+    /// Every worker polls the one listener the master bound. Simple, but
+    /// each connection wakes every idle worker and the least busy one does
+    /// not necessarily win.
+    shared,
+    /// The one listener is waited on with EPOLLEXCLUSIVE, so a connection
+    /// wakes a single idle worker (Linux; elsewhere this acts as `shared`)
+    exclusive,
+    /// Each worker accepts from its own SO_REUSEPORT socket and the kernel
+    /// assigns connections to sockets, as chosen by `Steering`
+    reuseport,
+
+    pub fn parse(name: []const u8) ?AcceptMode {
+        if (std.mem.eql(u8, name, "shared")) return .shared;
+        if (std.mem.eql(u8, name, "exclusive")) return .exclusive;
+        if (std.mem.eql(u8, name, "reuseport")) return .reuseport;
+        return null;
+    }
+};
+
+/// Which SO_REUSEPORT socket a new connection goes to
+pub const Steering = enum {
+    /// The kernel's hash of the connection's addresses and ports
+    hash,
+    /// The CPU that handled the incoming SYN, modulo the group size, via a
+    /// classic BPF program. Pairs with workers pinned to matching CPUs.
+    cpu,
+
+    pub fn parse(name: []const u8) ?Steering {
+        if (std.mem.eql(u8, name, "hash")) return .hash;
+        if (std.mem.eql(u8, name, "cpu")) return .cpu;
+        return null;
+    }
+};
 
 // UVICORN PARITY: Add TLS/SSL configuration options (cert_file, key_file, ca_certs)
 // UVICORN PARITY: Add HTTP/2 configuration options and protocol selection
@@ -10,14 +47,94 @@ pub const Config = struct {
     host: []const u8 = "127.0.0.1",
     port: u16 = 8000,
     backlog: u32 = 128,
+    accept_mode: AcceptMode = .shared,
 };
 
+/// Bind a non-blocking listening socket. With `reuse_port` other sockets
+/// may bind the same address and share its connections.
+pub fn bindListener(host: []const u8, port: u16, backlog: u32, reuse_port: bool) !net.Server {
+    const address = try std.net.Address.parseIp(host, port);
+    return address.listen(.{
+        .kernel_backlog = @intCast(@min(backlog, std.math.maxInt(u31))),
+        .reuse_address = true,
+        .reuse_port = reuse_port,
+        // Set non-blocking mode
+        .force_nonblocking = true,
+    });
+}
+
+/// Bind `count` SO_REUSEPORT sockets on one address, in order, and steer
+/// connections between them. With `.cpu` steering, socket i takes the
+/// connections whose SYN was handled on CPU i modulo `count`. The kernel
+/// indexes a group by the order its sockets were bound, so the sockets
+/// must all stay open for the indices to hold. The caller owns the
+/// returned sockets.
+pub fn bindReusePortGroup(allocator: Allocator, host: []const u8, port: u16, backlog: u32, count: usize, steering: Steering) ![]net.Server {
+    const listeners = try allocator.alloc(net.Server, count);
+    var bound: usize = 0;
+    errdefer {
+        for (listeners[0..bound]) |*listener| listener.deinit();
+        allocator.free(listeners);
+    }
+
+    var bound_port = port;
+    for (listeners) |*listener| {
+        listener.* = try bindListener(host, bound_port, backlog, true);
+        bound += 1;
+        // Port 0 asks for any port; the rest of the group must join it
+        bound_port = listener.listen_address.getPort();
+    }
+
+    if (steering == .cpu) try attachCpuSteering(listeners[0], @intCast(count));
+    return listeners;
+}
+
+/// TCP_INFO from linux/tcp.h
+const TCP_INFO = 11;
+
+/// Connections waiting in a listening socket's accept queue. For a
+/// listener, the kernel reports the queue length in tcpi_unacked, which
+/// follows eight one-byte fields and four u32 fields in struct tcp_info.
+pub fn acceptQueueDepth(listener: net.Server) !u32 {
+    if (builtin.os.tag != .linux) return error.UnsupportedPlatform;
+
+    var info: [32]u8 align(4) = undefined;
+    try std.posix.getsockopt(listener.stream.handle, std.posix.IPPROTO.TCP, TCP_INFO, &info);
+    return std.mem.readInt(u32, info[24..28], builtin.cpu.arch.endian());
+}
+
+/// SO_ATTACH_REUSEPORT_CBPF from the asm-generic socket options
+const SO_ATTACH_REUSEPORT_CBPF = 51;
+
+/// Classic BPF instruction and program, as in linux/filter.h
+const SockFilter = extern struct { code: u16, jt: u8, jf: u8, k: u32 };
+const SockFprog = extern struct { len: u16, filter: [*]const SockFilter };
+
+/// Attach a classic BPF program to a reuseport group that returns the
+/// current CPU modulo `group_size` as the index of the socket to use
+fn attachCpuSteering(listener: net.Server, group_size: u32) !void {
+    if (builtin.os.tag != .linux) return error.UnsupportedPlatform;
+
+    // Ancillary load of the CPU id: SKF_AD_OFF (-0x1000) + SKF_AD_CPU (36)
+    const skf_ad_cpu: u32 = @bitCast(@as(i32, -0x1000 + 36));
+    const program = [_]SockFilter{
+        .{ .code = 0x20, .jt = 0, .jf = 0, .k = skf_ad_cpu }, // BPF_LD | BPF_W | BPF_ABS
+        .{ .code = 0x94, .jt = 0, .jf = 0, .k = group_size }, // BPF_ALU | BPF_MOD | BPF_K
+        .{ .code = 0x16, .jt = 0, .jf = 0, .k = 0 }, // BPF_RET | BPF_A
+    };
+    const fprog = SockFprog{ .len = program.len, .filter = &program };
+    try std.posix.setsockopt(listener.stream.handle, std.posix.SOL.SOCKET, SO_ATTACH_REUSEPORT_CBPF, std.mem.asBytes(&fprog));
+}
+
 /// HTTP server that can be started and stopped
 pub const Server = struct {
     allocator: Allocator,
     config: Config,
     listener: ?net.Server = null,
     running: bool = false,
+    /// epoll instance holding the listener with EPOLLEXCLUSIVE, created on
+    /// the first wait in `.exclusive` mode
+    epoll_fd: ?std.posix.fd_t = null,
 
     /// Create a new HTTP server with the given configuration
     pub fn init(allocator: Allocator, config: Config) Server {
@@ -27,29 +144,88 @@ pub const Server = struct {
         };
     }
 
-    // OPTIMIZATION 5: Network I/O - Add TCP_NODELAY, SO_REUSEPORT, and socket buffer tuning
+    // OPTIMIZATION 5: Network I/O - Add TCP_NODELAY and socket buffer tuning
     // OPTIMIZATION 9: System-Level - Optimize socket buffer sizes (SO_RCVBUF, SO_SNDBUF)
     // UVICORN PARITY: Add TLS/SSL socket setup and certificate loading
     // UVICORN PARITY: Add HTTP/2 ALPN negotiation support
-    /// Start the server and begin accepting connections
+    /// Start the server and begin accepting connections. In `.reuseport`
+    /// mode the socket joins any group already bound to the port.
     pub fn start(self: *Server) !void {
         if (self.running) return;
 
-        const address = try std.net.Address.parseIp(self.config.host, self.config.port);
-        self.listener = try address.listen(.{
-            .reuse_address = true,
-            // Set non-blocking mode
-            .force_nonblocking = true,
-        });
+        self.listener = try bindListener(self.config.host, self.config.port, self.config.backlog, self.config.accept_mode == .reuseport);
         self.running = true;
 
         std.debug.print("HTTP server listening on http://{s}:{d}\n", .{ self.config.host, self.config.port });
     }
 
+    /// Serve on a listener bound elsewhere, such as the one a worker
+    /// inherits from the master process
+    pub fn adopt(self: *Server, listener: net.Server) void {
+        self.listener = listener;
+        self.running = true;
+    }
+
+    /// Block until a connection may be waiting, `control` becomes readable
+    /// or `timeout_ms` passes. Returns true when `control` is readable,
+    /// which includes its other end being closed.
+    pub fn waitForConnection(self: *Server, control: ?std.posix.fd_t, timeout_ms: i32) !bool {
+        const listener = self.listener orelse return error.ServerNotRunning;
+
+        if (builtin.os.tag == .linux and self.config.accept_mode == .exclusive) {
+            return self.waitExclusive(listener, control, timeout_ms);
+        }
+
+        var fds = [2]std.posix.pollfd{
+            .{ .fd = listener.stream.handle, .events = std.posix.POLL.IN, .revents = 0 },
+            .{ .fd = control orelse -1, .events = std.posix.POLL.IN, .revents = 0 },
+        };
+        _ = try std.posix.poll(&fds, timeout_ms);
+
+        return fds[1].revents != 0;
+    }
+
+    /// `waitForConnection` through epoll, so that of all the processes
+    /// waiting on the shared listener only one is woken per connection
+    fn waitExclusive(self: *Server, listener: net.Server, control: ?std.posix.fd_t, timeout_ms: i32) !bool {
+        const linux = std.os.linux;
+
+        const epoll_fd = self.epoll_fd orelse blk: {
+            const fd = try std.posix.epoll_create1(linux.EPOLL.CLOEXEC);
+            errdefer std.posix.close(fd);
+
+            var listen_event = linux.epoll_event{
+                .events = linux.EPOLL.IN | linux.EPOLL.EXCLUSIVE,
+                .data = .{ .fd = listener.stream.handle },
+            };
+            try std.posix.epoll_ctl(fd, linux.EPOLL.CTL_ADD, listener.stream.handle, &listen_event);
+
+            if (control) |control_fd| {
+                var control_event = linux.epoll_event{ .events = linux.EPOLL.IN, .data = .{ .fd = control_fd } };
+                try std.posix.epoll_ctl(fd, linux.EPOLL.CTL_ADD, control_fd, &control_event);
+            }
+
+            self.epoll_fd = fd;
+            break :blk fd;
+        };
+
+        var events: [2]linux.epoll_event = undefined;
+        const ready = std.posix.epoll_wait(epoll_fd, &events, timeout_ms);
+        for (events[0..ready]) |event| {
+            if (control != null and event.data.fd == control.?) return true;
+        }
+        return false;
+    }
+
     /// Stop the server and close all connections
     pub fn stop(self: *Server) void {
         if (!self.running) return;
 
+        if (self.epoll_fd) |fd| {
+            std.posix.close(fd);
+            self.epoll_fd = null;
+        }
+
         if (self.listener) |*listener| {
             listener.deinit();
             self.listener = null;
@@ -269,32 +445,52 @@ pub const Response = struct {
         var buffer = std.ArrayList(u8).init(self.allocator);
         defer buffer.deinit();
 
+        try self.writeHead(buffer.writer(), false);
+
+        // Add body if present
+        if (self.body) |body| {
+            try buffer.writer().writeAll(body);
+        }
+
+        // Write to stream
+        _ = try stream.write(buffer.items);
+    }
+
+    /// Send the status line and headers of a chunked response. The body
+    /// follows with `sendChunk` and is ended by `sendLastChunk`, which can
+    /// carry trailer fields (the ASGI http.response.trailers extension).
+    pub fn sendChunkedHead(self: *const Response, stream: *net.Stream) !void {
+        var buffer = std.ArrayList(u8).init(self.allocator);
+        defer buffer.deinit();
+
+        try self.writeHead(buffer.writer(), true);
+        try stream.writeAll(buffer.items);
+    }
+
+    fn writeHead(self: *const Response, writer: anytype, chunked: bool) !void {
         // Add the status line
-        try buffer.writer().print("HTTP/1.1 {d} {s}\r\n", .{
+        try writer.print("HTTP/1.1 {d} {s}\r\n", .{
             self.status, statusText(self.status),
         });
 
-        // Add content length if body exists
-        if (self.body) |body| {
-            try buffer.writer().print("Content-Length: {d}\r\n", .{body.len});
+        // Framing: chunked responses carry no length up front
+        if (chunked) {
+            try writer.writeAll("Transfer-Encoding: chunked\r\n");
+        } else if (self.body) |body| {
+            try writer.print("Content-Length: {d}\r\n", .{body.len});
         }
 
         // Add headers
         var iterator = self.headers.iterator();
         while (iterator.next()) |entry| {
-            try buffer.writer().print("{s}: {s}\r\n", .{ entry.key_ptr.*, entry.value_ptr.* });
+            // The chunked framing above replaces any the application set
+            if (chunked and (std.ascii.eqlIgnoreCase(entry.key_ptr.*, "Content-Length") or
+                std.ascii.eqlIgnoreCase(entry.key_ptr.*, "Transfer-Encoding"))) continue;
+            try writer.print("{s}: {s}\r\n", .{ entry.key_ptr.*, entry.value_ptr.* });
         }
 
         // End headers
-        try buffer.writer().writeAll("\r\n");
-
-        // Add body if present
-        if (self.body) |body| {
-            try buffer.writer().writeAll(body);
-        }
-
-        // Write to stream
-        _ = try stream.write(buffer.items);
+        try writer.writeAll("\r\n");
     }
 
     /// Free all memory allocated for the response
@@ -316,6 +512,37 @@ pub const Response = struct {
     }
 };
 
+/// Send one chunk of a chunked response body. Empty chunks are skipped
+/// because a zero-size chunk ends the body.
+pub fn sendChunk(stream: *net.Stream, data: []const u8) !void {
+    if (data.len == 0) return;
+
+    var size_buf: [18]u8 = undefined;
+    const size_line = try std.fmt.bufPrint(&size_buf, "{x}\r\n", .{data.len});
+
+    var iovecs = [_]std.posix.iovec_const{
+        .{ .base = size_line.ptr, .len = size_line.len },
+        .{ .base = data.ptr, .len = data.len },
+        .{ .base = "\r\n", .len = 2 },
+    };
+    try stream.writevAll(&iovecs);
+}
+
+/// End a chunked response body with the last chunk and optional trailer
+/// fields (RFC 9112 section 7.1.2)
+pub fn sendLastChunk(allocator: Allocator, stream: *net.Stream, trailers: []const [2][]const u8) !void {
+    var buffer = std.ArrayList(u8).init(allocator);
+    defer buffer.deinit();
+
+    try buffer.writer().writeAll("0\r\n");
+    for (trailers) |trailer| {
+        try buffer.writer().print("{s}: {s}\r\n", .{ trailer[0], trailer[1] });
+    }
+    try buffer.writer().writeAll("\r\n");
+
+    try stream.writeAll(buffer.items);
+}
+
 // TODO: move this to asgi/protocol.zig when figure out how to handle dependencies
 // ASGI Scope representation
 pub const AsgiScope = struct {
@@ -405,6 +632,12 @@ pub const AsgiScope = struct {
             try json_object.put(entry.key_ptr.*, .{ .string = entry.value_ptr.* });
         }
 
+        // Advertise the ASGI extensions this server implements
+        var extensions = std.json.ObjectMap.init(self.allocator);
+        errdefer extensions.deinit();
+        try extensions.put("http.response.trailers", .{ .object = std.json.ObjectMap.init(self.allocator) });
+        try json_object.put("extensions", .{ .object = extensions });
+
         // Convert the object map to a JSON value
         return std.json.Value{ .object = json_object };
     }
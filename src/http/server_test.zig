@@ -32,6 +32,16 @@ test "Server init with custom config" {
     try testing.expectEqual(@as(u32, 256), httpServer.config.backlog);
 }
 
+test "Accept mode and steering names" {
+    try testing.expectEqual(server.AcceptMode.shared, server.AcceptMode.parse("shared").?);
+    try testing.expectEqual(server.AcceptMode.exclusive, server.AcceptMode.parse("exclusive").?);
+    try testing.expectEqual(server.AcceptMode.reuseport, server.AcceptMode.parse("reuseport").?);
+    try testing.expect(server.AcceptMode.parse("random") == null);
+
+    try testing.expectEqual(server.Steering.cpu, server.Steering.parse("cpu").?);
+    try testing.expect(server.Steering.parse("rr") == null);
+}
+
 test "Request parsing" {
     const allocator = testing.allocator;
     const raw_request =
@@ -381,3 +391,47 @@ test "HTTP/2 Request parsing" {
     try testing.expect(authority.len > 0);
     try testing.expect(path.len > 0);
 }
+
+test "Chunked body with trailers" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    var stream = net.Stream{ .handle = fds[1] };
+
+    try server.sendChunk(&stream, "hello");
+    // Empty chunks must not end the body early
+    try server.sendChunk(&stream, "");
+    try server.sendLastChunk(testing.allocator, &stream, &.{.{ "grpc-status", "0" }});
+
+    var buf: [128]u8 = undefined;
+    const n = try std.posix.read(fds[0], &buf);
+    try testing.expectEqualStrings("5\r\nhello\r\n0\r\ngrpc-status: 0\r\n\r\n", buf[0..n]);
+}
+
+test "Chunked head drops the application's framing headers" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    var stream = net.Stream{ .handle = fds[1] };
+
+    var response = server.Response.init(testing.allocator);
+    defer response.deinit();
+    try response.setHeader("content-length", "5");
+    try response.setHeader("Transfer-Encoding", "gzip");
+    try response.setHeader("Content-Type", "text/plain");
+
+    try response.sendChunkedHead(&stream);
+
+    var buf: [256]u8 = undefined;
+    const n = try std.posix.read(fds[0], &buf);
+    const head = buf[0..n];
+    try testing.expect(std.mem.startsWith(u8, head, "HTTP/1.1 200 OK\r\n"));
+    try testing.expect(std.mem.endsWith(u8, head, "\r\n\r\n"));
+    try testing.expect(std.mem.indexOf(u8, head, "Content-Type: text/plain\r\n") != null);
+    try testing.expect(std.ascii.indexOfIgnoreCase(head, "content-length") == null);
+    try testing.expect(std.mem.indexOf(u8, head, "gzip") == null);
+    try testing.expect(std.mem.indexOf(u8, head, "Transfer-Encoding: chunked\r\n") != null);
+    try testing.expectEqual(@as(usize, 1), std.mem.count(u8, head, "Transfer-Encoding"));
+}
@@ -7,6 +7,7 @@ const lib = @import("ladybug_lib");
 const http = lib.http;
 const asgi = lib.asgi.protocol;
 const h2_asgi = lib.asgi.h2_integration; // HTTP/2 ASGI integration
+const ws_asgi = lib.asgi.ws_integration; // WebSocket ASGI integration
 const python = lib.python;
 const cli = lib.cli;
 const utils = lib.utils;
@@ -42,75 +43,104 @@ pub fn main() !void {
 
     logger.info("Starting ladybug ASGI server...", .{});
     // Handle multi-worker mode
-    if (options.workers > 1) {
-        // TODO: Implement master process
-        try runMaster(allocator, &options, &logger);
+    if (options.workers > 1 or options.workers_max != null) {
+        try runMaster(allocator, &options, &logger, app_info.module, app_info.attr);
     } else {
-        try runWorker(allocator, &options, &logger, app_info.module, app_info.attr);
+        try runWorker(allocator, &options, &logger, app_info.module, app_info.attr, null);
     }
 }
 
-const SignalHandler = struct {
-    flag: *bool,
+/// Set by SIGTERM/SIGINT in the master process
+var master_shutdown_flag: bool = false;
+/// Set by SIGHUP in the master process
+var master_reload_flag: bool = false;
 
-    fn handle(sig: c_int, handler_ptr: ?*anyopaque) callconv(.C) void {
-        std.debug.print("DEBUG: Singal handler\n", .{});
-        _ = sig;
-        if (handler_ptr) |ptr| {
-            const self = @as(*@This(), @ptrCast(ptr));
-            self.flag.* = true; // Set the flag to true when the signal is received
-        }
+fn handleMasterSignal(sig: c_int) callconv(.C) void {
+    if (sig == std.posix.SIG.HUP) {
+        master_reload_flag = true;
+    } else {
+        master_shutdown_flag = true;
+    }
+}
+
+/// Arguments a forked worker needs to run the application
+const WorkerArgs = struct {
+    allocator: std.mem.Allocator,
+    options: *cli.Options,
+    logger: *const utils.Logger,
+    module_name: []const u8,
+    app_name: []const u8,
+
+    fn run(context: ?*anyopaque, worker: utils.WorkerContext) u8 {
+        const self: *WorkerArgs = @ptrCast(@alignCast(context.?));
+        runWorker(self.allocator, self.options, self.logger, self.module_name, self.app_name, worker) catch |err| {
+            self.logger.err("Worker {d} failed: {!}", .{ worker.index, err });
+            return 1;
+        };
+        return 0;
     }
 };
 
 // OPTIMIZATION 10: Monitoring - Add performance metrics and health monitoring for master process
-// UVICORN PARITY: Add graceful worker restarts, better signal handling for SIGTERM/SIGINT/SIGHUP
-// UVICORN PARITY: Add worker health monitoring and automatic restart on failures
-/// Run as master process, managing worker processes
-fn runMaster(allocator: std.mem.Allocator, options: *cli.Options, logger: *const utils.Logger) !void {
+/// Run as master process, managing worker processes. The master binds the
+/// port once and never loads Python; each worker is forked with the
+/// listening socket and initializes its own interpreter. SIGHUP replaces
+/// every worker with one running the application's current code.
+fn runMaster(allocator: std.mem.Allocator, options: *cli.Options, logger: *const utils.Logger, module_name: []const u8, app_name: []const u8) !void {
     logger.info("Running in master mode with {d} workers", .{options.workers});
 
     // Create worker pool
     var pool = utils.WorkerPool.init(allocator, options.workers, options.app, options.host, options.port);
     defer pool.deinit();
+    pool.accept_mode = options.accept_mode;
+    pool.steering = options.reuseport_steering;
+    pool.cpu_affinity = options.cpu_affinity;
+    if (options.timeout_worker_hang) |seconds| pool.hang_timeout_ms = @as(u64, seconds) * std.time.ms_per_s;
+    if (options.timeout_worker_startup) |seconds| pool.startup_timeout_ms = @as(u64, seconds) * std.time.ms_per_s;
+    if (options.timeout_graceful_shutdown) |seconds| pool.shutdown_timeout_ms = @as(u64, seconds) * std.time.ms_per_s;
+    if (options.workers_max) |max| {
+        const min = options.workers_min orelse 1;
+        pool.autoscaler = utils.autoscale.Scaler.init(.{ .min_workers = min, .max_workers = max });
+        pool.target_count = std.math.clamp(options.workers, min, max);
+        logger.info("Autoscaling between {d} and {d} workers", .{ min, max });
+    }
+
+    try pool.listen();
+    logger.info("Listening on http://{s}:{d} ({s} accept)", .{ options.host, options.port, @tagName(options.accept_mode) });
+
+    const act = std.posix.Sigaction{
+        .handler = .{ .handler = handleMasterSignal },
+        .mask = std.posix.empty_sigset,
+        .flags = 0,
+    };
+    std.posix.sigaction(std.posix.SIG.TERM, &act, null);
+    std.posix.sigaction(std.posix.SIG.INT, &act, null);
+    std.posix.sigaction(std.posix.SIG.HUP, &act, null);
 
     // Start worker processes
-    try pool.start();
-
-    // Set up signal handling
-    var sigterm_flag = false;
-    var sigint_flag = false;
-
-    // TODO: These handlers don't appear directly used in the code but are referenced indirectly by the signal system.
-    // The handlers are stored in variables to maintain their lifetime for the duration of signal handling.
-    var _term_handler = SignalHandler{ .flag = &sigterm_flag };
-    var _int_handler = SignalHandler{ .flag = &sigint_flag };
-
-    // Tell the compiler these variables are intentionally here, even if not directly referenced
-    _ = &_term_handler;
-    _ = &_int_handler;
-
-    if (builtin.os.tag != .macos and builtin.os.tag != .darwin) {
-        // On Linux and other Unix systems, use sigaction
-        _ = std.os.sigaction(std.os.SIG.TERM, &.{
-            .handler = .{ .handler = SignalHandler.handle },
-            .mask = std.os.empty_sigset,
-            .flags = 0,
-        }, null);
-
-        _ = std.os.sigaction(std.os.SIG.INT, &.{
-            .handler = .{ .handler = SignalHandler.handle },
-            .mask = std.os.empty_sigset,
-            .flags = 0,
-        }, null);
-    } else {
-        // On macOS, just print a message
-        logger.info("Signal handling limited on macOS. Use Ctrl+C to exit.", .{});
-        // We'll handle cleanup in the main loop with manual checks
+    var worker_args = WorkerArgs{
+        .allocator = allocator,
+        .options = options,
+        .logger = logger,
+        .module_name = module_name,
+        .app_name = app_name,
+    };
+    try pool.start(.{ .context = &worker_args, .run = WorkerArgs.run });
+    if (pool.topology) |topology| {
+        logger.info("CPU affinity {s}: {d} CPUs on {d} NUMA nodes", .{ @tagName(options.cpu_affinity), topology.cpus.len, topology.node_count });
+        for (pool.workers.items) |worker| {
+            const cpu = worker.cpu orelse continue;
+            logger.info("Worker {d} (pid {d}) on CPU {d}, node {d}", .{ worker.index, worker.pid, cpu.id, cpu.node });
+        }
     }
 
     // Main loop
-    while (!sigterm_flag and !sigint_flag) {
+    while (!master_shutdown_flag) {
+        if (master_reload_flag) {
+            master_reload_flag = false;
+            logger.info("Reloading: starting a new generation of workers", .{});
+            pool.reload();
+        }
         try pool.check();
         std.time.sleep(500 * std.time.ns_per_ms); // 500ms
     }
@@ -122,18 +152,9 @@ fn runMaster(allocator: std.mem.Allocator, options: *cli.Options, logger: *const
 // Global variable for signal handling
 var global_shutdown_flag: bool = false;
 
-const AnotherSignalHandler = struct {
-    flag: *bool,
-
-    fn handle(sig: c_int, handler_ptr: ?*anyopaque) callconv(.C) void {
-        std.debug.print("DEBUG: Singal handler\n", .{});
-        _ = sig;
-        if (handler_ptr) |ptr| {
-            const self = @as(*@This(), @ptrCast(ptr));
-            self.flag.* = true; // Set the flag to true when the signal is received
-        }
-    }
-};
+/// This worker's slot in the master's heartbeat board, through which it
+/// reports liveness and asks to be recycled
+var worker_heartbeat: ?*utils.heartbeat.Slot = null;
 
 // OPTIMIZATION 4: Python Integration - Optimize Python interpreter initialization and reuse
 // OPTIMIZATION 5: Network I/O - Implement non-blocking I/O and connection pooling
@@ -141,13 +162,36 @@ const AnotherSignalHandler = struct {
 // OPTIMIZATION 10: Monitoring - Remove debug prints from hot paths for production
 // UVICORN PARITY: Add auto-reload functionality with file watching for development mode
 // UVICORN PARITY: Add access logging with configurable formats and structured output
-fn runWorker(allocator: std.mem.Allocator, options: *cli.Options, logger: *const utils.Logger, module_name: []const u8, app_name: []const u8) !void {
+/// Serve the application in this process. A forked `worker` serves on the
+/// listener it inherited and stops when its control pipe becomes readable;
+/// without one the server binds the port itself.
+fn runWorker(allocator: std.mem.Allocator, options: *cli.Options, logger: *const utils.Logger, module_name: []const u8, app_name: []const u8, worker: ?utils.WorkerContext) !void {
     std.debug.print("DEBUG: Running worker\n", .{});
 
+    // Forked workers are placed by the pool; a lone server places itself
+    // before the interpreter allocates anything
+    if (worker == null and options.cpu_affinity != .none) {
+        var topology = try utils.affinity.Topology.detect(allocator);
+        defer topology.deinit();
+        if (topology.place(options.cpu_affinity, 0)) |cpu| {
+            try utils.affinity.pin(cpu, topology.node_count > 1);
+            logger.info("Running on CPU {d}, node {d}", .{ cpu.id, cpu.node });
+        }
+    }
+
     // Set up Python interpreter
     try python.base.initialize();
     defer python.base.finalize();
 
+    if (worker) |w| {
+        if (w.heartbeat) |slot| {
+            worker_heartbeat = slot;
+            python.base.registerStackDump(utils.heartbeat.stack_dump_signal) catch |err| {
+                logger.warning("Python stacks will not be dumped if this worker hangs: {!}", .{err});
+            };
+        }
+    }
+
     // Create and set up the event loop
     const event_loop_ctx = try python.event_loop.createAndSetEventLoop();
     defer {
@@ -167,6 +211,7 @@ fn runWorker(allocator: std.mem.Allocator, options: *cli.Options, logger: *const
     const server_config = http.Config{
         .host = options.host,
         .port = options.port,
+        .accept_mode = options.accept_mode,
     };
 
     var server = http.Server.init(allocator, server_config);
@@ -190,10 +235,17 @@ fn runWorker(allocator: std.mem.Allocator, options: *cli.Options, logger: *const
     };
 
     std.posix.sigaction(std.posix.SIG.INT, &act, null);
+    std.posix.sigaction(std.posix.SIG.TERM, &act, null);
 
     // Start the server
-    try server.start();
-    logger.info("Listening on http://{s}:{d}", .{ server_config.host, server_config.port });
+    const control: ?std.posix.fd_t = if (worker) |w| w.control else null;
+    if (worker) |w| {
+        server.adopt(w.listener);
+        logger.info("Worker {d} (pid {d}) serving on http://{s}:{d}", .{ w.index, std.c.getpid(), server_config.host, server_config.port });
+    } else {
+        try server.start();
+        logger.info("Listening on http://{s}:{d}", .{ server_config.host, server_config.port });
+    }
 
     std.debug.print("DEBUG: Should run lifespan protocol: {s}\n", .{options.lifespan});
     // Run the lifespan protocol if enabled
@@ -204,15 +256,68 @@ fn runWorker(allocator: std.mem.Allocator, options: *cli.Options, logger: *const
     }
     logger.info("Finished lifespan protocol\n", .{});
 
+    var broadcast_hub = lib.websocket.broadcast.Hub.init(allocator);
+    defer broadcast_hub.deinit();
+
+    // Read buffers shared by WebSocket connections while they have input;
+    // idle ones hold none
+    var ws_buffers = lib.websocket.buffer_pool.BufferPool.init(allocator, lib.websocket.frame.FrameReader.min_read_size, 256);
+    defer ws_buffers.deinit();
+
+    // One thread turns the keepalive wheel for every WebSocket connection
+    var timers = try utils.timer_wheel.TimerService.init(100 * std.time.ns_per_ms);
+    try timers.start();
+    defer timers.stop();
+
+    const ws_config = ws_asgi.Config{
+        .max_message_size = options.ws_max_size,
+        .max_buffered_bytes = options.ws_max_buffered,
+        .stream_fragments = options.ws_stream_fragments,
+        .per_message_deflate = options.ws_per_message_deflate,
+        .deflate_memory_budget = options.ws_deflate_memory,
+        .deflate_max_contexts = options.ws_deflate_max_contexts,
+        .hub = &broadcast_hub,
+        .broadcast_max_pending = options.ws_broadcast_max_pending,
+        .broadcast_policy = options.ws_broadcast_policy,
+        .buffer_pool = &ws_buffers,
+        .payloads = python.websocket_payloads,
+        .timers = &timers,
+        .ping_interval_ns = secondsToNs(options.ws_ping_interval),
+        .ping_timeout_ns = secondsToNs(options.ws_ping_timeout),
+    };
+
+    var h2_config = Http2Config{
+        .lifetime = .{
+            .max_streams = options.h2_max_connection_streams,
+            .max_age_ns = if (options.h2_max_connection_age) |seconds| @as(u64, seconds) * std.time.ns_per_s else null,
+        },
+        .control = control,
+    };
+    if (options.timeout_graceful_shutdown) |seconds| h2_config.lifetime.drain_timeout_ns = @as(u64, seconds) * std.time.ns_per_s;
+
+    var recycler = utils.recycle.Recycler.init(.{
+        .max_requests = options.limit_max_requests,
+        .max_requests_jitter = options.limit_max_requests_jitter orelse (options.limit_max_requests orelse 0) / 10,
+        .max_rss_bytes = if (options.limit_max_rss) |mib| @as(u64, mib) * 1024 * 1024 else null,
+    });
+    defer recycler.deinit();
+    var retirement = Retirement{ .recycler = &recycler, .logger = logger };
+    h2_config.retirement = &retirement;
+
+    if (worker_heartbeat) |slot| slot.markReady();
+
     // OPTIMIZATION 5: Network I/O - Replace blocking accept() with epoll/kqueue event loop
     // OPTIMIZATION 3: Concurrency - This main loop should dispatch to worker threads
     // Main server loop
     while (!global_shutdown_flag) {
+        if (worker_heartbeat) |slot| slot.beat();
+
         const conn = server.accept() catch |err| {
             switch (err) {
                 error.WouldBlock => {
-                    // No connection available, sleep briefly and check shutdown flag
-                    std.time.sleep(10 * std.time.ns_per_ms); // 10ms sleep
+                    // Wait for a connection; a readable control pipe means
+                    // the master wants this worker gone
+                    if (try server.waitForConnection(control, 100)) global_shutdown_flag = true;
                     continue;
                 },
                 else => {
@@ -232,22 +337,62 @@ fn runWorker(allocator: std.mem.Allocator, options: *cli.Options, logger: *const
         conn_copy.* = conn;
 
         // TODO: Handle event loop?
-        try handleConnection(allocator, conn_copy, app, logger, event_loop_ctx.loop);
+        // The request clock starts once the request has been read
+        if (worker_heartbeat) |slot| slot.begin(.reading);
+        defer if (worker_heartbeat) |slot| slot.finish();
+        const served = recycler.served;
+        try handleConnection(allocator, conn_copy, app, logger, event_loop_ctx.loop, &ws_config, &h2_config);
+        // An HTTP/2 connection has counted each of its streams already
+        if (recycler.served == served) retirement.record();
     }
 
     logger.info("Shutting down server...", .{});
+
+    const deflate_stats = lib.websocket.deflate.metrics.snapshot();
+    if (deflate_stats.messages_compressed + deflate_stats.messages_inflated > 0) {
+        logger.info("permessage-deflate: {d} sent at ratio {d:.2} ({d:.1} ns/byte), {d} inflated ({d:.1} ns/byte)", .{
+            deflate_stats.messages_compressed,
+            deflate_stats.compressionRatio(),
+            deflate_stats.compressNsPerByte(),
+            deflate_stats.messages_inflated,
+            deflate_stats.inflateNsPerByte(),
+        });
+    }
+}
+
+/// Counts served requests toward the worker's recycling limits and retires
+/// the worker once one is reached
+const Retirement = struct {
+    recycler: *utils.recycle.Recycler,
+    logger: *const utils.Logger,
+    retiring: bool = false,
+
+    fn record(self: *Retirement) void {
+        if (self.retiring) return;
+        const reason = self.recycler.record() orelse return;
+        self.retiring = true;
+        self.logger.info("Recycling worker after {d} requests ({s})", .{ self.recycler.served, @tagName(reason) });
+        // Under a master, keep serving until the replacement is up and the
+        // master closes our control pipe
+        if (worker_heartbeat) |slot| slot.retire() else global_shutdown_flag = true;
+    }
+};
+
+/// Convert a duration option in seconds; negative values count as 0
+fn secondsToNs(seconds: f64) u64 {
+    if (!(seconds > 0)) return 0;
+    return @intFromFloat(seconds * std.time.ns_per_s);
 }
 
 // OPTIMIZATION 1: Memory Management - Use memory pools for connection objects
 // OPTIMIZATION 2: HTTP Parsing - Implement zero-copy parsing and streaming
 // OPTIMIZATION 4: Python Integration - Cache Python objects and reduce transitions
 // OPTIMIZATION 8: Protocol-Specific - Optimize ASGI message handling
-// UVICORN PARITY: Add WebSocket connection upgrade handling and protocol support
 // UVICORN PARITY: Add HTTP/2 protocol support and connection multiplexing
 // UVICORN PARITY: Add middleware chain execution for ASGI applications
 // UVICORN PARITY: Add request/response logging and metrics collection
 /// Handle an HTTP connection
-fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Connection, app: *python.PyObject, logger: *const utils.Logger, loop: *python.PyObject) !void {
+fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Connection, app: *python.PyObject, logger: *const utils.Logger, loop: *python.PyObject, ws_config: *const ws_asgi.Config, h2_config: *const Http2Config) !void {
     // Make sure we clean up the connection and memory
     defer {
         connection.stream.close();
@@ -255,6 +400,15 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
     }
 
     logger.info("Handling HTTP connection in app: {}", .{app});
+
+    // HTTP/2 with prior knowledge (h2c) opens with the connection preface
+    if (isHttp2Preface(connection.stream.handle)) {
+        handleHttp2(allocator, connection, app, logger, loop, h2_config) catch |err| {
+            logger.err("HTTP/2 connection failed: {!}", .{err});
+        };
+        return;
+    }
+
     // Parse the HTTP request
     var request = http.parseRequest(allocator, &connection.stream) catch |err| {
         std.debug.print("Error parsing HTTP request: {!}", .{err});
@@ -262,6 +416,12 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
     };
     defer request.deinit();
     std.debug.print("\nParsed request\n", .{});
+    if (worker_heartbeat) |slot| slot.begin(.request);
+
+    if (lib.websocket.isUpgradeRequest(&request.headers)) {
+        if (worker_heartbeat) |slot| slot.begin(.websocket);
+        return handleWebSocket(allocator, connection, &request, app, logger, loop, ws_config);
+    }
 
     // Create message queues for communication
     var to_app = asgi.MessageQueue.init(allocator);
@@ -327,6 +487,10 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
     // Send response
     // Process response events from the application
     var response_started = false;
+    // Set when the app asked for the http.response.trailers extension; the
+    // response then goes out chunked so trailers can follow the body
+    var trailers_expected = false;
+    var chunked_started = false;
     var status: u16 = 200;
     var response_headers = std.StringHashMap([]const u8).init(allocator);
     defer {
@@ -338,6 +502,15 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
         response_headers.deinit();
     }
 
+    var response_trailers = std.ArrayList([2][]const u8).init(allocator);
+    defer {
+        for (response_trailers.items) |trailer| {
+            allocator.free(trailer[0]);
+            allocator.free(trailer[1]);
+        }
+        response_trailers.deinit();
+    }
+
     // OPTIMIZATION 8: Protocol-Specific - Batch ASGI messages for better performance
     while (true) {
         const event = try from_app.receive();
@@ -349,6 +522,10 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
         if (std.mem.eql(u8, type_value.string, "http.response.start")) {
             response_started = true;
 
+            if (event.object.get("trailers")) |trailers_value| {
+                trailers_expected = trailers_value == .bool and trailers_value.bool;
+            }
+
             // Get status code
             const status_value = event.object.get("status") orelse continue;
             if (status_value == .integer) {
@@ -382,6 +559,17 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
             const body_value = event.object.get("body") orelse continue;
             if (body_value != .string) continue;
 
+            if (trailers_expected) {
+                if (!chunked_started) {
+                    try sendChunkedHead(allocator, &connection.stream, status, &response_headers);
+                    chunked_started = true;
+                }
+                try http.sendChunk(&connection.stream, body_value.string);
+
+                // The response ends with http.response.trailers
+                continue;
+            }
+
             // Send response
             var response = http.Response.init(allocator);
             defer response.deinit();
@@ -405,10 +593,551 @@ fn handleConnection(allocator: std.mem.Allocator, connection: *std.net.Server.Co
             if (more_body != .bool or !more_body.bool) {
                 break;
             }
+        } else if (std.mem.eql(u8, type_value.string, "http.response.trailers")) {
+            if (!trailers_expected) {
+                logger.err("Received http.response.trailers without trailers in http.response.start", .{});
+                continue;
+            }
+
+            if (event.object.get("headers")) |headers_value| {
+                if (headers_value == .array) {
+                    for (headers_value.array.items) |header| {
+                        if (header != .array or header.array.items.len != 2) continue;
+
+                        const name = header.array.items[0];
+                        const value = header.array.items[1];
+
+                        if (name != .string or value != .string) continue;
+
+                        const name_str = try allocator.dupe(u8, name.string);
+                        errdefer allocator.free(name_str);
+                        const value_str = try allocator.dupe(u8, value.string);
+                        errdefer allocator.free(value_str);
+
+                        try response_trailers.append(.{ name_str, value_str });
+                    }
+                }
+            }
+
+            const more_trailers = event.object.get("more_trailers") orelse std.json.Value{ .bool = false };
+            if (more_trailers == .bool and more_trailers.bool) continue;
+
+            // A response without body events still needs its head
+            if (!chunked_started) {
+                try sendChunkedHead(allocator, &connection.stream, status, &response_headers);
+                chunked_started = true;
+            }
+            try http.sendLastChunk(allocator, &connection.stream, response_trailers.items);
+            break;
+        }
+    }
+}
+
+/// Run a websocket ASGI application on an upgraded HTTP/1.1 connection.
+/// The caller owns and closes the connection.
+fn handleWebSocket(allocator: std.mem.Allocator, connection: *std.net.Server.Connection, request: *http.Request, app: *python.PyObject, logger: *const utils.Logger, loop: *python.PyObject, ws_config: *const ws_asgi.Config) !void {
+    var session = ws_asgi.WebSocketSession.init(allocator, ws_config.*, connection.stream, &request.headers) catch |err| {
+        logger.err("Rejecting WebSocket upgrade: {!}", .{err});
+        var response = http.Response.init(allocator);
+        defer response.deinit();
+        response.status = if (err == error.UnsupportedVersion) 426 else 400;
+        if (err == error.UnsupportedVersion) try response.setHeader("Sec-WebSocket-Version", "13");
+        try response.send(&connection.stream);
+        return;
+    };
+    defer session.deinit();
+
+    // TODO: Get actual addresses
+    const client_addr = "127.0.0.1";
+    const server_addr = "127.0.0.1";
+
+    var headers_list = std.ArrayList([2][]const u8).init(allocator);
+    defer {
+        for (headers_list.items) |header| {
+            allocator.free(header[0]);
+        }
+        headers_list.deinit();
+    }
+
+    var headers_iter = request.headers.iterator();
+    while (headers_iter.next()) |header| {
+        const key_buf = try allocator.alloc(u8, header.key_ptr.len);
+        errdefer allocator.free(key_buf);
+        _ = std.ascii.lowerString(key_buf, header.key_ptr.*);
+        try headers_list.append(.{ key_buf, header.value_ptr.* });
+    }
+
+    const scope = try asgi.createWebSocketScope(allocator, server_addr, 8000, client_addr, 0, request.path, request.query, headers_list.items);
+    defer asgi.jsonValueDeinit(scope, allocator);
+
+    const py_scope = try python.base.jsonToPyObject(allocator, scope);
+    defer python.base.decref(py_scope);
+
+    const receive = try python.create_receive_vectorcall_callable(&session.to_app, loop);
+    defer python.base.decref(receive);
+
+    const send = try python.create_send_vectorcall_callable(&session.from_app, loop);
+    defer python.base.decref(send);
+
+    try session.start();
+    defer session.finish();
+
+    // Detached before `finish` so the app cannot reach a finished session
+    const channel = try python.attachBroadcastChannel(py_scope, &session);
+    defer python.detachBroadcastChannel(channel);
+
+    python.callAsgiApplication(app, py_scope, receive, send, loop) catch |err| {
+        logger.err("WebSocket application failed: {!}", .{err});
+    };
+}
+
+/// What HTTP/2 connections take from the worker's options
+const Http2Config = struct {
+    lifetime: h2_asgi.ConnectionLifetime,
+    /// The worker's control pipe. Once it turns readable the master wants
+    /// the worker gone, and open connections drain.
+    control: ?std.posix.fd_t,
+    /// Counts each finished stream as a request, so a long-lived
+    /// connection cannot keep the worker from recycling
+    retirement: ?*Retirement = null,
+};
+
+/// How long an HTTP/2 connection waits in poll while applications are
+/// running. They report back on the event loop thread, which cannot wake
+/// poll, so their events are collected this often.
+const h2_busy_poll_ms = 1;
+/// How long it waits with nothing running
+const h2_idle_poll_ms = 250;
+
+/// Whether the client opened with the HTTP/2 connection preface. Only
+/// peeks, leaving an HTTP/1 request for the parser; its method is never
+/// "PRI".
+fn isHttp2Preface(fd: std.posix.fd_t) bool {
+    const preface = http.h2_frames.CONNECTION_PREFACE;
+    var start: [3]u8 = undefined;
+    const n = std.posix.recv(fd, &start, std.posix.MSG.PEEK | std.posix.MSG.WAITALL) catch return false;
+    return n == start.len and std.mem.eql(u8, &start, preface[0..start.len]);
+}
+
+/// Where a socket address points, as ASGI scopes report it. The host is
+/// formatted into `buf`.
+fn endpointOf(buf: []u8, address: std.net.Address) h2_asgi.Endpoint {
+    const text = std.fmt.bufPrint(buf, "{}", .{address}) catch return .{};
+    const colon = std.mem.lastIndexOfScalar(u8, text, ':') orelse return .{ .host = text };
+    var host = text[0..colon];
+    if (host.len >= 2 and host[0] == '[') host = host[1 .. host.len - 1];
+    return .{ .host = host, .port = address.getPort() };
+}
+
+/// Serve an HTTP/2 connection opened with prior knowledge. Each stream's
+/// application runs as its own task on the event loop while this thread
+/// reads frames, passes request bodies and WebSocket messages to the tasks
+/// and writes what they send. A response goes out once its application
+/// returns, as on HTTP/1.1.
+fn handleHttp2(allocator: std.mem.Allocator, connection: *std.net.Server.Connection, app: *python.PyObject, logger: *const utils.Logger, loop: *python.PyObject, config: *const Http2Config) !void {
+    const fd = connection.stream.handle;
+
+    var handler = try h2_asgi.Http2AsgiHandler.init(allocator, 65535);
+    defer handler.deinit();
+    handler.lifetime = config.lifetime;
+
+    var client_buf: [64]u8 = undefined;
+    handler.client = endpointOf(&client_buf, connection.address);
+    var server_buf: [64]u8 = undefined;
+    var local: std.net.Address = undefined;
+    var local_len: std.posix.socklen_t = @sizeOf(std.net.Address);
+    if (std.posix.getsockname(fd, &local.any, &local_len)) |_| {
+        handler.server = endpointOf(&server_buf, local);
+    } else |_| {}
+
+    // The preface was only peeked at
+    while (!try handler.reader.consumePreface()) {
+        if (try handler.reader.fill(fd) == 0) return;
+    }
+    try handler.sendServerPreface();
+    try handler.flush(fd);
+
+    var calls = std.ArrayList(*Http2Call).init(allocator);
+    defer {
+        for (calls.items) |call| call.abandon();
+        calls.deinit();
+    }
+    // Calls whose responses are queued; their bodies are borrowed until
+    // the next flush
+    var finished = std.ArrayList(*Http2Call).init(allocator);
+    defer {
+        for (finished.items) |call| call.destroy();
+        finished.deinit();
+    }
+
+    while (true) {
+        reportHttp2Progress(calls.items);
+
+        // The control pipe stays readable once closed, so it is only
+        // watched until the drain starts
+        const control = if (handler.drain_started == null) config.control orelse -1 else -1;
+        var fds = [_]std.posix.pollfd{
+            .{ .fd = fd, .events = std.posix.POLL.IN, .revents = 0 },
+            .{ .fd = control, .events = std.posix.POLL.IN, .revents = 0 },
+        };
+        const timeout: i32 = if (calls.items.len > 0) h2_busy_poll_ms else h2_idle_poll_ms;
+        // Let the event loop thread run the applications meanwhile
+        const thread_state = python.saveThread();
+        const polled = std.posix.poll(&fds, timeout);
+        python.restoreThread(thread_state);
+        _ = try polled;
+
+        if (fds[0].revents != 0) {
+            if (!try handler.onReadable(fd)) break;
+        }
+
+        // Shutting down or reloading: finish the streams in flight, bounded
+        // by the drain timeout, then let the worker exit
+        if (fds[1].revents != 0 or global_shutdown_flag) {
+            global_shutdown_flag = true;
+            try handler.beginDrain();
+        }
+
+        while (handler.takeReady()) |stream| {
+            try calls.ensureUnusedCapacity(1);
+            const stream_id = stream.stream_id;
+            const websocket = stream.websocket;
+
+            // Reset before its application started
+            if (handler.message_queue.isCancelled(stream_id)) {
+                handler.message_queue.removeStreamQueue(stream_id);
+                stream.destroy(allocator);
+                continue;
+            }
+
+            const call = Http2Call.start(allocator, &handler, stream, app, loop) catch |err| {
+                logger.err("Could not start the application for HTTP/2 stream {d}: {!}", .{ stream_id, err });
+                stream.destroy(allocator);
+                if (websocket) {
+                    try handler.finishWebSocket(stream_id);
+                } else {
+                    defer handler.message_queue.removeStreamQueue(stream_id);
+                    try handler.sendResponse(stream_id, 500, &.{}, null, null);
+                }
+                continue;
+            };
+            calls.appendAssumeCapacity(call);
+        }
+
+        var i: usize = 0;
+        while (i < calls.items.len) {
+            const call = calls.items[i];
+            call.pump(&handler) catch |err| {
+                if (err == error.OutOfMemory) return err;
+                logger.err("HTTP/2 stream {d} failed: {!}", .{ call.stream.stream_id, err });
+                call.cancel();
+            };
+
+            if (!python.isAsgiApplicationDone(call.task)) {
+                i += 1;
+                continue;
+            }
+
+            try finished.ensureUnusedCapacity(1);
+            _ = calls.swapRemove(i);
+            finished.appendAssumeCapacity(call);
+            call.finish(&handler, logger) catch |err| {
+                if (err == error.OutOfMemory) return err;
+                logger.err("Could not answer HTTP/2 stream {d}: {!}", .{ call.stream.stream_id, err });
+            };
+            if (config.retirement) |retirement| retirement.record();
         }
+
+        // Also runs on poll timeouts, so an idle connection is recycled and
+        // a drain ends even when the peer sends nothing
+        const open = try handler.tick();
+
+        try handler.flush(fd);
+        for (finished.items) |call| call.destroy();
+        finished.clearRetainingCapacity();
+
+        if (!open) break;
+    }
+    try handler.flush(fd);
+}
+
+/// Report an HTTP/2 connection's progress to the hang detector: it is
+/// judged by its oldest request in flight, and not at all while only
+/// WebSockets are open
+fn reportHttp2Progress(calls: []const *Http2Call) void {
+    const slot = worker_heartbeat orelse return;
+
+    var oldest: ?i64 = null;
+    for (calls) |call| {
+        if (call.stream.websocket) continue;
+        oldest = if (oldest) |started| @min(started, call.started_ms) else call.started_ms;
+    }
+
+    if (oldest) |started| {
+        slot.beginAt(.request, started);
+    } else if (calls.len > 0) {
+        slot.beginAt(.websocket, utils.heartbeat.now());
+    } else {
+        slot.finish();
     }
 }
 
+/// The application serving one HTTP/2 stream, running as a task on the
+/// event loop. Its receive and send use this call's queues, so the call
+/// lives until the task has ended, even after a reset.
+const Http2Call = struct {
+    allocator: std.mem.Allocator,
+    stream: *h2_asgi.StreamScope,
+    to_app: asgi.MessageQueue,
+    from_app: asgi.MessageQueue,
+    py_scope: *python.PyObject,
+    receive: *python.PyObject,
+    send: *python.PyObject,
+    task: python.AsgiTask,
+    /// Monotonic milliseconds when the application started
+    started_ms: i64,
+    /// Response body gathered from http.response.body events; the DATA
+    /// frames borrow it until the connection is flushed
+    body: std.ArrayList(u8),
+    /// The stream was reset or failed; nothing more is sent on it
+    cancelled: bool = false,
+    /// The disconnect event has been queued for the application
+    disconnected: bool = false,
+    /// The task has ended and been released
+    done: bool = false,
+
+    fn start(allocator: std.mem.Allocator, handler: *h2_asgi.Http2AsgiHandler, stream: *h2_asgi.StreamScope, app: *python.PyObject, loop: *python.PyObject) !*Http2Call {
+        const call = try allocator.create(Http2Call);
+        errdefer allocator.destroy(call);
+        call.* = Http2Call{
+            .allocator = allocator,
+            .stream = stream,
+            .to_app = asgi.MessageQueue.init(allocator),
+            .from_app = asgi.MessageQueue.init(allocator),
+            .py_scope = undefined,
+            .receive = undefined,
+            .send = undefined,
+            .task = undefined,
+            .started_ms = utils.heartbeat.now(),
+            .body = std.ArrayList(u8).init(allocator),
+        };
+        errdefer {
+            call.to_app.deinit();
+            call.from_app.deinit();
+        }
+
+        call.py_scope = try python.base.jsonToPyObject(allocator, stream.scope);
+        errdefer python.base.decref(call.py_scope);
+        call.receive = try python.create_receive_vectorcall_callable(&call.to_app, loop);
+        errdefer python.base.decref(call.receive);
+        call.send = try python.create_send_vectorcall_callable(&call.from_app, loop);
+        errdefer python.base.decref(call.send);
+
+        call.task = try python.startAsgiApplication(app, call.py_scope, call.receive, call.send, loop);
+        // From here on the stream is destroyed with the call
+        handler.message_queue.setCanceller(stream.stream_id, .{ .context = call, .cancel = cancelTask }) catch {};
+        return call;
+    }
+
+    /// Canceller for the stream's queue: the peer reset the stream
+    fn cancelTask(context: ?*anyopaque, stream_id: u31) void {
+        _ = stream_id;
+        const call: *Http2Call = @ptrCast(@alignCast(context.?));
+        call.cancel();
+    }
+
+    /// Give up on the stream: tell the application it is gone and cancel
+    /// its task
+    fn cancel(self: *Http2Call) void {
+        if (self.done) return;
+        self.cancelled = true;
+        self.disconnect();
+        python.cancelAsgiApplication(self.task);
+    }
+
+    fn disconnect(self: *Http2Call) void {
+        if (self.disconnected) return;
+        self.disconnected = true;
+
+        const event = blk: {
+            if (self.stream.websocket) break :blk asgi.createWebSocketDisconnectMessage(self.allocator, 1006) catch return;
+            break :blk asgi.createHttpDisconnectMessage(self.allocator) catch return;
+        };
+        self.to_app.push(event) catch asgi.jsonValueDeinit(event, self.allocator);
+    }
+
+    /// Pass what arrived on the stream to the application and, on a
+    /// WebSocket, what the application sent to the peer
+    fn pump(self: *Http2Call, handler: *h2_asgi.Http2AsgiHandler) !void {
+        const stream_id = self.stream.stream_id;
+        while (handler.message_queue.takeFromStream(stream_id)) |message| {
+            self.to_app.push(message) catch |err| {
+                asgi.jsonValueDeinit(message, self.allocator);
+                return err;
+            };
+        }
+
+        if (!self.stream.websocket or self.cancelled) return;
+        while (self.from_app.tryReceive()) |event| {
+            defer asgi.jsonValueDeinit(event, self.allocator);
+            try handler.sendWebSocketEvent(stream_id, event);
+        }
+    }
+
+    /// Release the ended task and answer the stream with what the
+    /// application sent. The response goes out with the next flush.
+    fn finish(self: *Http2Call, handler: *h2_asgi.Http2AsgiHandler, logger: *const utils.Logger) !void {
+        const stream_id = self.stream.stream_id;
+        self.done = true;
+        python.waitAsgiApplication(self.task) catch |err| {
+            if (!self.cancelled) logger.err("Application failed on HTTP/2 stream {d}: {!}", .{ stream_id, err });
+        };
+
+        if (self.stream.websocket) {
+            if (!self.cancelled) try self.pump(handler);
+            return handler.finishWebSocket(stream_id);
+        }
+
+        defer handler.message_queue.removeStreamQueue(stream_id);
+        if (!self.cancelled) try self.respond(handler, logger);
+    }
+
+    /// Queue the response made of the application's http.response.*
+    /// events, or a 500 if it never started one
+    fn respond(self: *Http2Call, handler: *h2_asgi.Http2AsgiHandler, logger: *const utils.Logger) !void {
+        const stream_id = self.stream.stream_id;
+
+        // Header strings are borrowed from the events until the response
+        // is queued; the body is copied into `body`
+        var events = std.ArrayList(std.json.Value).init(self.allocator);
+        defer {
+            for (events.items) |event| asgi.jsonValueDeinit(event, self.allocator);
+            events.deinit();
+        }
+        var headers = std.ArrayList([2][]const u8).init(self.allocator);
+        defer headers.deinit();
+        var trailers = std.ArrayList([2][]const u8).init(self.allocator);
+        defer trailers.deinit();
+
+        var status: ?u16 = null;
+        var trailers_expected = false;
+
+        while (self.from_app.tryReceive()) |event| {
+            events.append(event) catch |err| {
+                asgi.jsonValueDeinit(event, self.allocator);
+                return err;
+            };
+
+            const type_value = event.object.get("type") orelse continue;
+            if (type_value != .string) continue;
+
+            if (std.mem.eql(u8, type_value.string, "http.response.start")) {
+                status = 200;
+                if (event.object.get("status")) |value| {
+                    if (value == .integer) status = std.math.cast(u16, value.integer) orelse 500;
+                }
+                if (event.object.get("trailers")) |value| {
+                    trailers_expected = value == .bool and value.bool;
+                }
+                try appendHttp2Fields(&headers, event.object.get("headers"));
+            } else if (std.mem.eql(u8, type_value.string, "http.response.body")) {
+                if (status == null) {
+                    logger.err("Received http.response.body before http.response.start", .{});
+                    continue;
+                }
+                const body_value = event.object.get("body") orelse continue;
+                if (body_value == .string) try self.body.appendSlice(body_value.string);
+            } else if (std.mem.eql(u8, type_value.string, "http.response.trailers")) {
+                if (!trailers_expected) {
+                    logger.err("Received http.response.trailers without trailers in http.response.start", .{});
+                    continue;
+                }
+                try appendHttp2Fields(&trailers, event.object.get("headers"));
+            }
+        }
+
+        const final_status = status orelse {
+            logger.err("Application returned without a response on HTTP/2 stream {d}", .{stream_id});
+            return handler.sendResponse(stream_id, 500, &.{}, null, null);
+        };
+        try handler.sendResponse(
+            stream_id,
+            final_status,
+            headers.items,
+            if (self.body.items.len > 0) self.body.items else null,
+            if (trailers_expected) trailers.items else null,
+        );
+    }
+
+    /// Stop the application of a connection that is going away. Its task
+    /// still uses this call's queues, so wait for it to end.
+    fn abandon(self: *Http2Call) void {
+        if (!python.isAsgiApplicationDone(self.task)) {
+            self.cancel();
+            while (!python.isAsgiApplicationDone(self.task)) {
+                const thread_state = python.saveThread();
+                std.time.sleep(std.time.ns_per_ms);
+                python.restoreThread(thread_state);
+            }
+        }
+        self.done = true;
+        python.waitAsgiApplication(self.task) catch {};
+        self.destroy();
+    }
+
+    /// Free the call once its task has been released
+    fn destroy(self: *Http2Call) void {
+        python.base.decref(self.send);
+        python.base.decref(self.receive);
+        python.base.decref(self.py_scope);
+
+        for ([_]*asgi.MessageQueue{ &self.to_app, &self.from_app }) |queue| {
+            while (queue.tryReceive()) |event| asgi.jsonValueDeinit(event, self.allocator);
+            queue.deinit();
+        }
+        self.body.deinit();
+        self.stream.destroy(self.allocator);
+        self.allocator.destroy(self);
+    }
+};
+
+/// Append the name/value pairs of an ASGI headers list. Connection-specific
+/// fields have no meaning in HTTP/2 and make the response malformed (RFC
+/// 9113 section 8.2.2), so they are left out.
+fn appendHttp2Fields(fields: *std.ArrayList([2][]const u8), headers_value: ?std.json.Value) !void {
+    const value = headers_value orelse return;
+    if (value != .array) return;
+
+    for (value.array.items) |header| {
+        if (header != .array or header.array.items.len != 2) continue;
+        const name = header.array.items[0];
+        const field_value = header.array.items[1];
+        if (name != .string or field_value != .string) continue;
+
+        const connection_specific = [_][]const u8{ "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade" };
+        var skip = false;
+        for (connection_specific) |field| {
+            if (std.ascii.eqlIgnoreCase(name.string, field)) skip = true;
+        }
+        if (!skip) try fields.append(.{ name.string, field_value.string });
+    }
+}
+
+/// Send the head of a chunked HTTP/1.1 response
+fn sendChunkedHead(allocator: std.mem.Allocator, stream: *std.net.Stream, status: u16, headers: *const std.StringHashMap([]const u8)) !void {
+    var response = http.Response.init(allocator);
+    defer response.deinit();
+
+    response.status = status;
+
+    var headers_it = headers.iterator();
+    while (headers_it.next()) |header| {
+        try response.setHeader(header.key_ptr.*, header.value_ptr.*);
+    }
+
+    try response.sendChunkedHead(stream);
+}
+
 // OPTIMIZATION 8: Protocol-Specific - Optimize lifespan protocol for faster startup
 // UVICORN PARITY: Add proper error handling for lifespan startup/shutdown failures
 // UVICORN PARITY: Add timeout handling for lifespan events
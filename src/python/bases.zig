@@ -73,6 +73,15 @@ pub fn initialize() !void {
     }
 }
 
+/// Make `signal` dump every thread's Python stack to stderr. faulthandler
+/// writes the dump from the signal handler itself, so it works even while
+/// the interpreter is deadlocked or spinning in C code.
+pub fn registerStackDump(signal: c_int) !void {
+    var buf: [96]u8 = undefined;
+    const code = std.fmt.bufPrintZ(&buf, "import faulthandler\nfaulthandler.register({d}, all_threads=True)\n", .{signal}) catch unreachable;
+    if (python.og.PyRun_SimpleStringFlags(code.ptr, null) != 0) return PythonError.RuntimeError;
+}
+
 /// Finalize the Python interpreter
 pub fn finalize() void {
     std.debug.print("DEBUG: Finalizing Python interpreter\n", .{});
@@ -7,6 +7,9 @@ pub const event_loop = @import("event_loop.zig");
 
 // Import ASGI protocol module using relative import
 const protocol = @import("../asgi/protocol.zig");
+const ws_asgi = @import("../asgi/ws_integration.zig");
+const broadcast = @import("../websocket/broadcast.zig");
+const websocket = @import("../websocket/server.zig");
 
 // Export the PyObject type for external use
 pub const PyObject = python.og.PyObject;
@@ -88,7 +91,9 @@ pub fn asgi_receive_vectorcall(callable: [*c]?*python.PyObject, args: [*c]?*pyth
 
     // Convert to Python dict
     const gpa = std.heap.c_allocator;
-    const py_message = base.jsonToPyObject(gpa, message) catch {
+    // The dict holds its own copy, so the event goes back either way
+    defer queue.dispose(message);
+    const py_message = eventToPyObject(gpa, message) catch {
         _ = python.og.PyErr_SetString(python.PyExc_RuntimeError, "Failed to convert message to Python object");
         return python.og.PyDict_New();
     };
@@ -106,6 +111,60 @@ pub fn asgi_receive_vectorcall(callable: [*c]?*python.PyObject, args: [*c]?*pyth
     }
 }
 
+/// Convert an event taken from a queue, leaving the event untouched. A
+/// payload object made on the reader thread (see `websocket_payloads`) goes
+/// in under its ASGI key in place of its handle and size; the event's
+/// reference to it passes to the dict.
+fn eventToPyObject(allocator: Allocator, message: std.json.Value) !*PyObject {
+    const payload = protocol.payloadObject(message) orelse return base.jsonToPyObject(allocator, message);
+    const object: *PyObject = @ptrFromInt(payload.handle);
+    defer decref(object);
+
+    const dict = try base.jsonToPyObject(allocator, message);
+    errdefer decref(dict);
+    for ([_][:0]const u8{ payload.handle_key, protocol.payload_size_key }) |key| {
+        if (python.og.PyDict_DelItemString(dict, key.ptr) < 0) python.PyErr_Clear();
+    }
+    if (python.og.PyDict_SetItemString(dict, payload.key.ptr, object) < 0) return PythonError.RuntimeError;
+    return dict;
+}
+
+/// Makes websocket.receive payloads into `bytes` and `str` objects on the
+/// WebSocket reader thread, directly from the connection's read buffer.
+/// Text has been validated by then, and text known to be ASCII is copied
+/// into the `str` without being decoded again.
+pub const websocket_payloads = ws_asgi.PayloadFactory{
+    .create = createPayload,
+    .destroy = destroyPayload,
+};
+
+fn createPayload(context: ?*anyopaque, message_type: websocket.MessageType, data: []const u8, ascii: bool) ?usize {
+    _ = context;
+    const gil_state = python.og.PyGILState_Ensure();
+    defer python.og.PyGILState_Release(gil_state);
+
+    const size: c_long = @intCast(data.len);
+    const object = if (message_type == .binary)
+        python.PyBytes_FromStringAndSize(data.ptr, size)
+    else if (ascii)
+        python.zig_py_unicode_from_ascii(data.ptr, size)
+    else
+        python.PyUnicode_DecodeUTF8(data.ptr, size, "strict");
+
+    return @intFromPtr(object orelse {
+        python.PyErr_Clear();
+        return null;
+    });
+}
+
+fn destroyPayload(context: ?*anyopaque, handle: usize) void {
+    _ = context;
+    const gil_state = python.og.PyGILState_Ensure();
+    defer python.og.PyGILState_Release(gil_state);
+
+    decref(@ptrFromInt(handle));
+}
+
 // The await function: This gets called when `await receive()` is used
 fn receive_await(self: [*c]python.PyObject) callconv(.C) [*c]python.PyObject {
     return self; // Return self to indicate it's an awaitable
@@ -169,8 +228,17 @@ pub fn asgi_send_vectorcall(callable: [*c]?*python.PyObject, args: [*c]?*python.
                 _ = python.PyErr_SetString(python.PyExc_RuntimeError, "Failed to convert message to JSON");
                 return python.getPyNone();
             };
-            // Push the message to the queue
-            queue.push(json_message) catch {
+            // Push the message to the queue. A bounded queue applies
+            // backpressure: the send waits, without the GIL, until the
+            // consumer has written enough of what is already queued.
+            const pushed = if (queue.max_pending_bytes == 0)
+                queue.push(json_message)
+            else blk: {
+                const thread_state = python.PyEval_SaveThread();
+                defer python.PyEval_RestoreThread(thread_state);
+                break :blk queue.pushBounded(json_message);
+            };
+            pushed catch {
                 _ = python.PyErr_SetString(python.PyExc_RuntimeError, "Failed to push message to queue");
             };
         }
@@ -216,7 +284,178 @@ pub fn create_send_vectorcall_callable(queue: *protocol.MessageQueue, loop: *PyO
     return @as(*python.PyObject, @ptrCast(send_obj));
 }
 
+/// Python handle on a WebSocket connection's broadcast groups. The
+/// application finds it at scope["extensions"]["ladybug.broadcast"]["channel"]
+/// and calls join(group), leave(group) and publish(group, data) on it.
+pub const BroadcastChannelObject = extern struct {
+    ob_base: PyObject,
+    /// Cleared when the connection ends; calls after that raise
+    session: ?*ws_asgi.WebSocketSession,
+};
+
+/// The channel's session, or null with RuntimeError set
+fn channelSession(self: ?*PyObject) ?*ws_asgi.WebSocketSession {
+    const channel = @as(*BroadcastChannelObject, @ptrCast(@alignCast(self.?)));
+    return channel.session orelse {
+        _ = python.PyErr_SetString(python.PyExc_RuntimeError, "WebSocket connection has ended");
+        return null;
+    };
+}
+
+/// Positional string argument as UTF-8, or null with TypeError set
+fn stringArg(args: ?*PyObject, index: c_long) ?[]const u8 {
+    const item = python.PyTuple_GetItem(args orelse return null, index) orelse {
+        python.PyErr_Clear();
+        _ = python.PyErr_SetString(python.PyExc_TypeError, "Missing argument");
+        return null;
+    };
+    if (python.zig_py_unicode_check(item) == 0) {
+        _ = python.PyErr_SetString(python.PyExc_TypeError, "Expected a str");
+        return null;
+    }
+
+    var size: python.og.Py_ssize_t = 0;
+    const utf8 = python.og.PyUnicode_AsUTF8AndSize(item, &size) orelse return null;
+    return utf8[0..@intCast(size)];
+}
+
+fn channelJoin(self: ?*PyObject, args: ?*PyObject) callconv(.C) ?*PyObject {
+    const session = channelSession(self) orelse return null;
+    const group = stringArg(args, 0) orelse return null;
+
+    session.join(group) catch |err| {
+        const message = if (err == error.SubscriberEvicted) "Connection was evicted for falling behind" else "Failed to join group";
+        _ = python.PyErr_SetString(python.PyExc_RuntimeError, message);
+        return null;
+    };
+    return python.getPyNone();
+}
+
+fn channelLeave(self: ?*PyObject, args: ?*PyObject) callconv(.C) ?*PyObject {
+    const session = channelSession(self) orelse return null;
+    const group = stringArg(args, 0) orelse return null;
+
+    session.leave(group);
+    return python.getPyNone();
+}
+
+/// publish(group, data) -> int. str goes out as a text frame and bytes as
+/// a binary frame. The frame is encoded once, here, and queued for every
+/// member; the return value is how many it was queued for.
+fn channelPublish(self: ?*PyObject, args: ?*PyObject) callconv(.C) ?*PyObject {
+    const session = channelSession(self) orelse return null;
+    const hub = session.config.hub.?;
+    const group = stringArg(args, 0) orelse return null;
+
+    const data = python.PyTuple_GetItem(args.?, 1) orelse {
+        python.PyErr_Clear();
+        _ = python.PyErr_SetString(python.PyExc_TypeError, "publish() takes a group and data");
+        return null;
+    };
+
+    var opcode: broadcast.Opcode = .text;
+    var payload: []const u8 = undefined;
+    if (python.zig_py_unicode_check(data) != 0) {
+        payload = stringArg(args, 1) orelse return null;
+    } else if (python.zig_py_bytes_check(data) != 0) {
+        var bytes_ptr: [*c]u8 = undefined;
+        var size: c_long = 0;
+        if (python.PyBytes_AsStringAndSize(data, &bytes_ptr, &size) < 0) return null;
+        opcode = .binary;
+        payload = bytes_ptr[0..@intCast(size)];
+    } else {
+        _ = python.PyErr_SetString(python.PyExc_TypeError, "Expected str or bytes");
+        return null;
+    }
+
+    // The payload is borrowed from Python, so encode before letting go of the GIL
+    const shared = broadcast.SharedFrame.create(hub.allocator, opcode, payload) catch {
+        _ = python.PyErr_SetString(python.PyExc_RuntimeError, "Failed to encode broadcast frame");
+        return null;
+    };
+    defer shared.release();
+
+    const thread_state = python.PyEval_SaveThread();
+    const delivery = hub.publishFrame(group, shared);
+    python.PyEval_RestoreThread(thread_state);
+
+    return python.PyLong_FromLongLong(@intCast(delivery.queued));
+}
+
+var channel_methods = [_]python.og.PyMethodDef{
+    .{
+        .ml_name = "join",
+        .ml_meth = @ptrCast(&channelJoin),
+        .ml_flags = python.METH_VARARGS,
+        .ml_doc = "Add this connection to a broadcast group",
+    },
+    .{
+        .ml_name = "leave",
+        .ml_meth = @ptrCast(&channelLeave),
+        .ml_flags = python.METH_VARARGS,
+        .ml_doc = "Remove this connection from a broadcast group",
+    },
+    .{
+        .ml_name = "publish",
+        .ml_meth = @ptrCast(&channelPublish),
+        .ml_flags = python.METH_VARARGS,
+        .ml_doc = "Send str or bytes to every member of a group",
+    },
+    std.mem.zeroes(python.og.PyMethodDef),
+};
+
+var BroadcastChannelType = PyTypeObject{
+    .ob_base = undefined,
+    .tp_name = "ladybug.BroadcastChannel",
+    .tp_basicsize = @sizeOf(BroadcastChannelObject),
+    .tp_itemsize = 0,
+    .tp_flags = python.og.Py_TPFLAGS_DEFAULT,
+    .tp_methods = &channel_methods,
+    .tp_doc = python.og.PyDoc_STR("Broadcast groups for a WebSocket connection"),
+};
+
+/// Create the broadcast channel for `session` and publish it in the scope
+/// as the ladybug.broadcast extension. Pass the result to
+/// `detachBroadcastChannel` before the session ends.
+pub fn attachBroadcastChannel(py_scope: *PyObject, session: *ws_asgi.WebSocketSession) !*PyObject {
+    if (python.og.PyType_Ready(&BroadcastChannelType) < 0) return error.PythonTypeInitFailed;
+
+    const instance = python.og.PyType_GenericAlloc(@ptrCast(&BroadcastChannelType), 0) orelse return error.PythonAllocationFailed;
+    errdefer decref(instance);
+    const channel = @as(*BroadcastChannelObject, @ptrCast(instance));
+    channel.session = session;
+
+    const extension = python.PyDict_New() orelse return error.PythonAllocationFailed;
+    defer decref(extension);
+    if (python.og.PyDict_SetItemString(extension, "channel", instance) < 0) return error.PythonAllocationFailed;
+
+    const extensions = python.PyDict_New() orelse return error.PythonAllocationFailed;
+    defer decref(extensions);
+    if (python.og.PyDict_SetItemString(extensions, "ladybug.broadcast", extension) < 0) return error.PythonAllocationFailed;
+
+    if (python.og.PyDict_SetItemString(py_scope, "extensions", extensions) < 0) return error.PythonAllocationFailed;
+
+    return instance;
+}
+
+/// Cut the channel off from its session so an application that kept it
+/// gets an exception instead of touching a finished connection
+pub fn detachBroadcastChannel(instance: *PyObject) void {
+    const gil_state = base.PyGILState_Ensure();
+    defer base.PyGILState_Release(gil_state);
+
+    const channel = @as(*BroadcastChannelObject, @ptrCast(instance));
+    channel.session = null;
+    decref(instance);
+}
+
 pub fn create_app_coroutine_for_event_loop(function: *PyObject, args: *PyObject, loop: *PyObject) !*PyObject {
+    return scheduleAppCoroutine(function, args, loop, null);
+}
+
+/// Call `function` to make a coroutine and schedule it on `loop`. With
+/// `coroutine_out` the caller also gets a reference to the coroutine.
+fn scheduleAppCoroutine(function: *PyObject, args: *PyObject, loop: *PyObject, coroutine_out: ?**PyObject) !*PyObject {
 
     // Debug the send object type
     if (python.og.PyCallable_Check(function) == 0) {
@@ -303,18 +542,21 @@ pub fn create_app_coroutine_for_event_loop(function: *PyObject, args: *PyObject,
     python.decref(run_args.?); // Decref the tuple, which decrefs items it holds (coroutine, loop)
     python.decref(run_coro_fn);
     python.decref(asyncio);
-    python.decref(coroutine.?); // Decref our original reference to coroutine
 
     // We don't decref the loop, as it was passed in and is owned elsewhere.
 
     if (future == null) {
         std.debug.print("DEBUG: run_coroutine_threadsafe failed\n", .{});
+        python.decref(coroutine.?);
         handlePythonError(); // Check/print Python error state
         python.og.PyGILState_Release(gil_state); // Release GIL
         return PythonError.CallFailed;
     }
     // future is a new reference
 
+    // Hand over our original reference to coroutine, or drop it
+    if (coroutine_out) |out| out.* = coroutine.? else python.decref(coroutine.?);
+
     // Release the GIL before returning the future
     python.og.PyGILState_Release(gil_state); // Release GIL
 
@@ -362,6 +604,24 @@ pub fn create_asgi_future_for_event_loop(value: *PyObject, loop: *PyObject) !*Py
 // UVICORN PARITY: Add application timeout handling and cancellation
 /// Call an ASGI application with scope, receive, and send
 pub fn callAsgiApplication(app: *PyObject, scope: *PyObject, receive: *PyObject, send: *PyObject, loop: *PyObject) !void {
+    const task = try startAsgiApplication(app, scope, receive, send, loop);
+    return waitAsgiApplication(task);
+}
+
+/// An ASGI application call running on the event loop thread
+pub const AsgiTask = struct {
+    /// concurrent.futures.Future from run_coroutine_threadsafe
+    future: *PyObject,
+    /// The application's coroutine. A cancelled future reports done at
+    /// once, while the coroutine may still be unwinding and using its
+    /// receive and send callables; it has finished only once its frame is
+    /// gone.
+    coroutine: *PyObject,
+};
+
+/// Schedule an ASGI application call on the event loop without waiting for
+/// it. Pass the task to `waitAsgiApplication`, which releases it.
+pub fn startAsgiApplication(app: *PyObject, scope: *PyObject, receive: *PyObject, send: *PyObject, loop: *PyObject) !AsgiTask {
     std.debug.print("\nDEBUG: Calling ASGI application\n", .{});
 
     // Debug the app object type
@@ -412,7 +672,7 @@ pub fn callAsgiApplication(app: *PyObject, scope: *PyObject, receive: *PyObject,
     std.debug.print("DEBUG: Args tuple created successfully: {*}\n", .{args.?});
 
     // --- GIL NEEDED FOR TUPLE SETUP ---
-    var gil_state = python.og.PyGILState_Ensure(); // Acquire GIL
+    const gil_state = python.og.PyGILState_Ensure(); // Acquire GIL
 
     // Set the tuple items - PyTuple_SetItem does NOT steal refs. Incref needed.
     python.incref(scope);
@@ -440,7 +700,8 @@ pub fn callAsgiApplication(app: *PyObject, scope: *PyObject, receive: *PyObject,
     // --- GIL RELEASED ---
 
     // This function handles its own GIL management for the run_coroutine_threadsafe call
-    const future = create_app_coroutine_for_event_loop(app, args.?, loop) catch |err| {
+    var coroutine: *PyObject = undefined;
+    const future = scheduleAppCoroutine(app, args.?, loop, &coroutine) catch |err| {
         // If creation failed, args tuple might still exist, but its items were
         // likely already handled (decref'd) inside the failing function or weren't set.
         // The original scope, receive, send were incref'd above but not put in the tuple
@@ -451,10 +712,17 @@ pub fn callAsgiApplication(app: *PyObject, scope: *PyObject, receive: *PyObject,
         return err; // Propagate the error
     };
     // If create_app succeeded, it consumed the `args` tuple, no need to decref args here.
-    // `future` is a new reference.
+    // `future` and `coroutine` are new references.
+    return AsgiTask{ .future = future, .coroutine = coroutine };
+}
 
+/// Wait for a call started by `startAsgiApplication` to finish and release
+/// it. An application that raised, or was cancelled, fails with CallFailed.
+pub fn waitAsgiApplication(task: AsgiTask) !void {
+    const future = task.future;
     // --- GIL NEEDED FOR result() ---
-    gil_state = python.og.PyGILState_Ensure(); // Acquire GIL
+    const gil_state = python.og.PyGILState_Ensure(); // Acquire GIL
+    defer python.decref(task.coroutine);
 
     // Get the result() method from the future
     const result_method = base.getAttribute(future, "result") catch |err| {
@@ -490,6 +758,67 @@ pub fn callAsgiApplication(app: *PyObject, scope: *PyObject, receive: *PyObject,
     return;
 }
 
+/// Whether the application's coroutine has finished, so that
+/// `waitAsgiApplication` will not block and nothing uses the call's receive
+/// and send any more. Coroutine-like objects without a frame are judged by
+/// their future.
+pub fn isAsgiApplicationDone(task: AsgiTask) bool {
+    const gil_state = python.og.PyGILState_Ensure();
+    defer python.og.PyGILState_Release(gil_state);
+
+    if (python.og.PyObject_HasAttrString(task.coroutine, "cr_frame") == 1) {
+        const frame = base.getAttribute(task.coroutine, "cr_frame") catch {
+            handlePythonError();
+            return true;
+        };
+        defer decref(frame);
+        if (frame != python.getPyNone()) return false;
+    }
+
+    const done = callMethod(task.future, "done") orelse return true;
+    defer decref(done);
+    return python.og.PyObject_IsTrue(done) == 1;
+}
+
+/// Cancel a call started by `startAsgiApplication`. The task is cancelled
+/// on the event loop thread, where the application sees CancelledError at
+/// its next await; wait for `isAsgiApplicationDone` before releasing what
+/// its receive and send use, then call `waitAsgiApplication`.
+pub fn cancelAsgiApplication(task: AsgiTask) void {
+    const gil_state = python.og.PyGILState_Ensure();
+    defer python.og.PyGILState_Release(gil_state);
+
+    const cancelled = callMethod(task.future, "cancel") orelse return;
+    decref(cancelled);
+}
+
+/// Release the GIL so the event loop thread can run while this thread
+/// blocks outside Python, e.g. in poll. Hand the result to `restoreThread`.
+pub fn saveThread() ?*anyopaque {
+    return python.PyEval_SaveThread();
+}
+
+pub fn restoreThread(thread_state: ?*anyopaque) void {
+    python.PyEval_RestoreThread(thread_state);
+}
+
+/// Call a method without arguments. Returns a new reference, or null with
+/// the Python error printed. The caller holds the GIL.
+fn callMethod(object: *PyObject, name: []const u8) ?*PyObject {
+    const method = base.getAttribute(object, name) catch {
+        handlePythonError();
+        return null;
+    };
+    defer decref(method);
+
+    const result = python.og.PyObject_CallObject(method, null);
+    if (result == null) {
+        handlePythonError();
+        return null;
+    }
+    return result.?;
+}
+
 // NOTE: We are only keeping below here for reference
 // TODO: Remove when the above vectorcall functions are working
 
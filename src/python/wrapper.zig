@@ -92,6 +92,8 @@ pub extern "c" fn PyFloat_AsDouble(obj: *PyObject) f64;
 // String operations
 pub extern "c" fn PyUnicode_FromStringAndSize(str: [*c]const u8, size: c_long) ?*PyObject;
 pub extern "c" fn PyUnicode_AsUTF8(unicode: *PyObject) [*c]const u8;
+pub extern "c" fn PyUnicode_DecodeUTF8(str: [*c]const u8, size: c_long, errors: [*c]const u8) ?*PyObject;
+pub extern "c" fn zig_py_unicode_from_ascii(str: [*c]const u8, size: c_long) ?*PyObject;
 
 // Type checking functions via our wrappers
 pub extern "c" fn zig_py_bool_check(obj: *PyObject) c_int;
@@ -115,6 +117,7 @@ pub extern "c" fn PyObject_Del(obj: *PyObject) void;
 pub extern "c" fn zig_py_object_new(type: *PyTypeObject) ?*PyObject;
 
 // Bytes operations
+pub extern "c" fn PyBytes_FromStringAndSize(str: [*c]const u8, size: c_long) ?*PyObject;
 pub extern "c" fn PyBytes_AsStringAndSize(obj: *PyObject, buffer: *[*c]u8, length: *c_long) c_int;
 
 // Capsule operations
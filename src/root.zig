@@ -21,12 +21,16 @@ pub const http = struct {
     pub const Response = server.Response;
     pub const AsgiScope = server.AsgiScope;
     pub const parseRequest = server.parseRequest;
+    pub const sendChunk = server.sendChunk;
+    pub const sendLastChunk = server.sendLastChunk;
 };
 
 // ASGI protocol implementation
 pub const asgi = struct {
     pub const protocol = @import("asgi/protocol.zig");
     pub const h2_integration = @import("asgi/h2_integration.zig");
+    pub const h2_websocket = @import("asgi/h2_websocket.zig");
+    pub const ws_integration = @import("asgi/ws_integration.zig");
 };
 
 // WebSocket support
@@ -0,0 +1,233 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const builtin = @import("builtin");
+const linux = std.os.linux;
+
+/// Highest CPU id a placement may name, from the size of `CpuSet`
+pub const max_cpus = 1024;
+
+/// Kernel cpu_set_t with room for `max_cpus` CPUs
+const CpuSet = [max_cpus / @bitSizeOf(usize)]usize;
+
+/// SO_INCOMING_CPU from the asm-generic socket options
+const SO_INCOMING_CPU = 49;
+
+/// MPOL_PREFERRED from linux/mempolicy.h
+const MPOL_PREFERRED = 1;
+
+/// How workers are placed on CPUs
+pub const Policy = union(enum) {
+    /// Leave placement to the scheduler
+    none,
+    /// Fill one NUMA node's CPUs before moving to the next, so a small pool
+    /// shares one node's caches and memory
+    compact,
+    /// Deal workers out across NUMA nodes in turn, spreading them over
+    /// every node's memory bandwidth
+    spread,
+    /// Worker N runs on the Nth listed CPU, wrapping around
+    list: []const usize,
+
+    /// Parse "none", "compact", "spread" or a CPU list such as "0,2,4-7".
+    /// A list is allocated and freed with `deinit`.
+    pub fn parse(allocator: Allocator, text: []const u8) !Policy {
+        if (std.mem.eql(u8, text, "none")) return .none;
+        if (std.mem.eql(u8, text, "compact")) return .compact;
+        if (std.mem.eql(u8, text, "spread")) return .spread;
+        return Policy{ .list = try parseCpuList(allocator, text) };
+    }
+
+    pub fn deinit(self: Policy, allocator: Allocator) void {
+        switch (self) {
+            .list => |cpus| allocator.free(cpus),
+            else => {},
+        }
+    }
+};
+
+/// Parse a kernel-style CPU list ("0,2,4-7"), as in the sysfs cpulist
+/// files and taskset. The caller owns the returned ids.
+pub fn parseCpuList(allocator: Allocator, text: []const u8) ![]usize {
+    var cpus = std.ArrayList(usize).init(allocator);
+    errdefer cpus.deinit();
+
+    var entries = std.mem.splitScalar(u8, std.mem.trim(u8, text, " \n"), ',');
+    while (entries.next()) |entry| {
+        var bounds = std.mem.splitScalar(u8, entry, '-');
+        const first = std.fmt.parseInt(usize, bounds.first(), 10) catch return error.InvalidCpuList;
+        const last = if (bounds.next()) |end|
+            std.fmt.parseInt(usize, end, 10) catch return error.InvalidCpuList
+        else
+            first;
+        if (bounds.next() != null or last < first or last >= max_cpus) return error.InvalidCpuList;
+
+        var cpu = first;
+        while (cpu <= last) : (cpu += 1) try cpus.append(cpu);
+    }
+    return cpus.toOwnedSlice();
+}
+
+/// A CPU and the NUMA node it belongs to
+pub const Cpu = struct {
+    id: usize,
+    node: usize,
+
+    fn lessThan(_: void, a: Cpu, b: Cpu) bool {
+        if (a.node != b.node) return a.node < b.node;
+        return a.id < b.id;
+    }
+};
+
+/// The CPUs this process may run on, ordered by NUMA node and then by id
+pub const Topology = struct {
+    const Self = @This();
+
+    allocator: Allocator,
+    cpus: []Cpu,
+    /// NUMA nodes holding at least one of `cpus`
+    node_count: usize,
+
+    /// Build a topology from a list of CPUs in any order
+    pub fn init(allocator: Allocator, cpus: []const Cpu) !Self {
+        if (cpus.len == 0) return error.NoCpus;
+
+        const sorted = try allocator.dupe(Cpu, cpus);
+        std.mem.sort(Cpu, sorted, {}, Cpu.lessThan);
+
+        var node_count: usize = 1;
+        for (sorted[1..], sorted[0 .. sorted.len - 1]) |cpu, previous| {
+            if (cpu.node != previous.node) node_count += 1;
+        }
+        return Self{ .allocator = allocator, .cpus = sorted, .node_count = node_count };
+    }
+
+    /// Read the CPUs in this process's affinity mask and their nodes from
+    /// sysfs. Every CPU is on node 0 when the kernel exposes no NUMA
+    /// information.
+    pub fn detect(allocator: Allocator) !Self {
+        if (builtin.os.tag != .linux) return error.UnsupportedPlatform;
+
+        var allowed: CpuSet = std.mem.zeroes(CpuSet);
+        const rc = linux.syscall3(.sched_getaffinity, 0, @sizeOf(CpuSet), @intFromPtr(&allowed));
+        if (linux.E.init(rc) != .SUCCESS) return error.AffinityUnavailable;
+
+        var nodes = [_]usize{0} ** max_cpus;
+        readNodes(allocator, &nodes) catch {};
+
+        var cpus = std.ArrayList(Cpu).init(allocator);
+        defer cpus.deinit();
+        for (0..max_cpus) |id| {
+            if (isSet(&allowed, id)) try cpus.append(.{ .id = id, .node = nodes[id] });
+        }
+        return init(allocator, cpus.items);
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.allocator.free(self.cpus);
+    }
+
+    /// CPU for the worker in `slot`, or null when the policy leaves
+    /// placement to the scheduler
+    pub fn place(self: *const Self, policy: Policy, slot: usize) ?Cpu {
+        return switch (policy) {
+            .none => null,
+            .compact => self.cpus[slot % self.cpus.len],
+            .spread => self.spreadSlot(slot),
+            .list => |ids| blk: {
+                if (ids.len == 0) break :blk null;
+                const id = ids[slot % ids.len];
+                break :blk Cpu{ .id = id, .node = self.nodeOf(id) };
+            },
+        };
+    }
+
+    /// Slot N goes to node N mod node_count, on that node's next CPU
+    fn spreadSlot(self: *const Self, slot: usize) Cpu {
+        const node_rank = slot % self.node_count;
+        const round = slot / self.node_count;
+
+        // `cpus` is grouped by node, so find the group at `node_rank`
+        var start: usize = 0;
+        var rank: usize = 0;
+        while (rank < node_rank) : (rank += 1) {
+            const node = self.cpus[start].node;
+            while (self.cpus[start].node == node) start += 1;
+        }
+        var end = start;
+        while (end < self.cpus.len and self.cpus[end].node == self.cpus[start].node) end += 1;
+
+        return self.cpus[start + round % (end - start)];
+    }
+
+    /// Node of a CPU named in an explicit list; 0 for one outside the
+    /// affinity mask, which pinning will then reject
+    fn nodeOf(self: *const Self, id: usize) usize {
+        for (self.cpus) |cpu| {
+            if (cpu.id == id) return cpu.node;
+        }
+        return 0;
+    }
+};
+
+/// Fill `nodes[cpu]` from /sys/devices/system/node/node*/cpulist
+fn readNodes(allocator: Allocator, nodes: *[max_cpus]usize) !void {
+    var dir = try std.fs.openDirAbsolute("/sys/devices/system/node", .{ .iterate = true });
+    defer dir.close();
+
+    var entries = dir.iterate();
+    while (try entries.next()) |entry| {
+        if (!std.mem.startsWith(u8, entry.name, "node")) continue;
+        const node = std.fmt.parseInt(usize, entry.name[4..], 10) catch continue;
+
+        var path_buf: [64]u8 = undefined;
+        const path = try std.fmt.bufPrint(&path_buf, "{s}/cpulist", .{entry.name});
+        const text = dir.readFileAlloc(allocator, path, 4096) catch continue;
+        defer allocator.free(text);
+
+        // A node without CPUs has an empty list
+        if (std.mem.trim(u8, text, " \n").len == 0) continue;
+        const ids = parseCpuList(allocator, text) catch continue;
+        defer allocator.free(ids);
+        for (ids) |id| nodes[id] = node;
+    }
+}
+
+fn isSet(set: *const CpuSet, id: usize) bool {
+    const bit: std.math.Log2Int(usize) = @intCast(id % @bitSizeOf(usize));
+    return set[id / @bitSizeOf(usize)] & (@as(usize, 1) << bit) != 0;
+}
+
+/// Run the calling process on `cpu` only, and when the machine has more
+/// than one NUMA node, allocate its memory from that CPU's node first.
+/// The memory policy is a preference rather than a bind, so a full node
+/// falls back to a remote one instead of invoking the OOM killer.
+pub fn pin(cpu: Cpu, numa: bool) !void {
+    if (builtin.os.tag != .linux) return error.UnsupportedPlatform;
+    if (cpu.id >= max_cpus) return error.InvalidCpu;
+
+    var set: CpuSet = std.mem.zeroes(CpuSet);
+    const bit: std.math.Log2Int(usize) = @intCast(cpu.id % @bitSizeOf(usize));
+    set[cpu.id / @bitSizeOf(usize)] |= @as(usize, 1) << bit;
+    const rc = linux.syscall3(.sched_setaffinity, 0, @sizeOf(CpuSet), @intFromPtr(&set));
+    if (linux.E.init(rc) != .SUCCESS) return error.InvalidCpu;
+
+    if (!numa) return;
+    var nodemask = [_]usize{0} ** 4;
+    if (cpu.node >= nodemask.len * @bitSizeOf(usize)) return error.InvalidNode;
+    const node_bit: std.math.Log2Int(usize) = @intCast(cpu.node % @bitSizeOf(usize));
+    nodemask[cpu.node / @bitSizeOf(usize)] |= @as(usize, 1) << node_bit;
+    // maxnode counts one past the last bit the kernel reads
+    const mpol_rc = linux.syscall3(.set_mempolicy, MPOL_PREFERRED, @intFromPtr(&nodemask), nodemask.len * @bitSizeOf(usize) + 1);
+    if (linux.E.init(mpol_rc) != .SUCCESS) return error.MemoryPolicyUnavailable;
+}
+
+/// Mark a socket in a reuseport group as belonging to `cpu`. Without a
+/// steering program, the kernel prefers that socket for connections
+/// received on that CPU, so a worker pinned next to a NIC queue's
+/// interrupts accepts the connections that queue delivers.
+pub fn setIncomingCpu(fd: std.posix.fd_t, cpu: usize) !void {
+    if (builtin.os.tag != .linux) return error.UnsupportedPlatform;
+
+    const value: c_int = @intCast(cpu);
+    try std.posix.setsockopt(fd, std.posix.SOL.SOCKET, SO_INCOMING_CPU, std.mem.asBytes(&value));
+}
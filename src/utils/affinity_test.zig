@@ -0,0 +1,77 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const testing = std.testing;
+const affinity = @import("affinity.zig");
+
+test "parseCpuList expands ranges" {
+    const cpus = try affinity.parseCpuList(testing.allocator, "0,2,4-7\n");
+    defer testing.allocator.free(cpus);
+    try testing.expectEqualSlices(usize, &[_]usize{ 0, 2, 4, 5, 6, 7 }, cpus);
+
+    try testing.expectError(error.InvalidCpuList, affinity.parseCpuList(testing.allocator, ""));
+    try testing.expectError(error.InvalidCpuList, affinity.parseCpuList(testing.allocator, "3-1"));
+    try testing.expectError(error.InvalidCpuList, affinity.parseCpuList(testing.allocator, "1-2-3"));
+    try testing.expectError(error.InvalidCpuList, affinity.parseCpuList(testing.allocator, "0,,1"));
+    try testing.expectError(error.InvalidCpuList, affinity.parseCpuList(testing.allocator, "4096"));
+}
+
+test "Policy names and lists" {
+    try testing.expectEqual(affinity.Policy.compact, try affinity.Policy.parse(testing.allocator, "compact"));
+    try testing.expectEqual(affinity.Policy.spread, try affinity.Policy.parse(testing.allocator, "spread"));
+
+    const policy = try affinity.Policy.parse(testing.allocator, "3,1");
+    defer policy.deinit(testing.allocator);
+    try testing.expectEqualSlices(usize, &[_]usize{ 3, 1 }, policy.list);
+}
+
+// Two nodes with CPUs interleaved between them, as on many dual-socket
+// machines
+const two_nodes = [_]affinity.Cpu{
+    .{ .id = 0, .node = 0 }, .{ .id = 1, .node = 1 },
+    .{ .id = 2, .node = 0 }, .{ .id = 3, .node = 1 },
+    .{ .id = 4, .node = 0 }, .{ .id = 5, .node = 1 },
+};
+
+test "Topology compact fills a node before the next" {
+    var topology = try affinity.Topology.init(testing.allocator, &two_nodes);
+    defer topology.deinit();
+    try testing.expectEqual(@as(usize, 2), topology.node_count);
+
+    const expected = [_]usize{ 0, 2, 4, 1, 3, 5, 0 };
+    for (expected, 0..) |id, slot| {
+        try testing.expectEqual(id, topology.place(.compact, slot).?.id);
+    }
+    try testing.expectEqual(@as(usize, 1), topology.place(.compact, 3).?.node);
+}
+
+test "Topology spread alternates between nodes" {
+    var topology = try affinity.Topology.init(testing.allocator, &two_nodes);
+    defer topology.deinit();
+
+    const expected = [_]usize{ 0, 1, 2, 3, 4, 5, 0 };
+    for (expected, 0..) |id, slot| {
+        const cpu = topology.place(.spread, slot).?;
+        try testing.expectEqual(id, cpu.id);
+        try testing.expectEqual(slot % 2, cpu.node);
+    }
+}
+
+test "Topology list wraps and looks up nodes" {
+    var topology = try affinity.Topology.init(testing.allocator, &two_nodes);
+    defer topology.deinit();
+
+    const ids = [_]usize{ 5, 2 };
+    const policy = affinity.Policy{ .list = &ids };
+    try testing.expectEqual(affinity.Cpu{ .id = 5, .node = 1 }, topology.place(policy, 0).?);
+    try testing.expectEqual(affinity.Cpu{ .id = 2, .node = 0 }, topology.place(policy, 3).?);
+    try testing.expect(topology.place(.none, 0) == null);
+}
+
+test "Topology.detect finds the CPUs we may run on" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var topology = try affinity.Topology.detect(testing.allocator);
+    defer topology.deinit();
+    try testing.expect(topology.cpus.len > 0);
+    try testing.expect(topology.node_count >= 1);
+}
@@ -0,0 +1,137 @@
+const std = @import("std");
+
+/// Clock ticks per second in /proc/<pid>/stat, fixed by the kernel ABI
+const user_hz = 100;
+
+/// When to add or remove a worker. The gap between the up and down
+/// thresholds, the run of samples each needs and the cooldowns keep the
+/// pool from flapping around a steady load.
+pub const Config = struct {
+    min_workers: usize,
+    max_workers: usize,
+    /// Scale up when this share of workers is busy with a request
+    up_busy: f64 = 0.75,
+    /// Scale down only when at most this share is busy
+    down_busy: f64 = 0.25,
+    /// Scale up when workers use this share of a CPU on average
+    up_cpu: f64 = 0.75,
+    down_cpu: f64 = 0.25,
+    /// Consecutive hot samples before adding a worker
+    up_samples: u32 = 2,
+    /// Consecutive cold samples before removing one
+    down_samples: u32 = 20,
+    /// Minimum time since the last change before adding a worker
+    up_cooldown_ms: i64 = 5 * std.time.ms_per_s,
+    /// Minimum time since the last change before removing one
+    down_cooldown_ms: i64 = 60 * std.time.ms_per_s,
+};
+
+/// Load on the pool at one moment
+pub const Sample = struct {
+    /// Workers counting towards the target
+    workers: usize,
+    /// Workers in the middle of a request or WebSocket session
+    busy: usize = 0,
+    /// Connections waiting in the listeners' accept queues
+    queued: usize = 0,
+    /// Mean CPU use of the workers since the previous sample, where 1.0
+    /// is one full CPU
+    cpu: f64 = 0,
+
+    fn busyShare(self: Sample, workers: usize) f64 {
+        if (workers == 0) return 1;
+        return @as(f64, @floatFromInt(self.busy)) / @as(f64, @floatFromInt(workers));
+    }
+};
+
+pub const Decision = enum { none, up, down };
+
+/// Turns samples into scaling decisions
+pub const Scaler = struct {
+    const Self = @This();
+
+    config: Config,
+    hot_samples: u32 = 0,
+    cold_samples: u32 = 0,
+    /// When the pool last grew or shrank
+    last_change_ms: ?i64 = null,
+
+    pub fn init(config: Config) Self {
+        return Self{ .config = config };
+    }
+
+    /// Decide whether a pool of `current` workers should change size
+    pub fn decide(self: *Self, sample: Sample, current: usize, at_ms: i64) Decision {
+        self.hot_samples = if (self.isHot(sample)) self.hot_samples + 1 else 0;
+        self.cold_samples = if (self.isCold(sample)) self.cold_samples + 1 else 0;
+
+        if (self.hot_samples >= self.config.up_samples and current < self.config.max_workers and self.cooledDown(at_ms, self.config.up_cooldown_ms)) {
+            self.changed(at_ms);
+            return .up;
+        }
+        if (self.cold_samples >= self.config.down_samples and current > self.config.min_workers and self.cooledDown(at_ms, self.config.down_cooldown_ms)) {
+            self.changed(at_ms);
+            return .down;
+        }
+        return .none;
+    }
+
+    /// Connections waiting for a worker mean every worker is occupied
+    fn isHot(self: *const Self, sample: Sample) bool {
+        return sample.queued > 0 or
+            sample.busyShare(sample.workers) >= self.config.up_busy or
+            sample.cpu >= self.config.up_cpu;
+    }
+
+    /// Idle enough that the pool would not be hot with one worker fewer
+    fn isCold(self: *const Self, sample: Sample) bool {
+        if (sample.workers <= 1) return false;
+        return sample.queued == 0 and
+            sample.busyShare(sample.workers) <= self.config.down_busy and
+            sample.busyShare(sample.workers - 1) < self.config.up_busy and
+            sample.cpu <= self.config.down_cpu;
+    }
+
+    fn cooledDown(self: *const Self, at_ms: i64, cooldown_ms: i64) bool {
+        const last = self.last_change_ms orelse return true;
+        return at_ms - last >= cooldown_ms;
+    }
+
+    fn changed(self: *Self, at_ms: i64) void {
+        self.last_change_ms = at_ms;
+        self.hot_samples = 0;
+        self.cold_samples = 0;
+    }
+};
+
+/// CPU time a process has used, user and system, in clock ticks
+pub fn processCpuTicks(pid: std.posix.pid_t) !u64 {
+    var path_buf: [32]u8 = undefined;
+    const path = try std.fmt.bufPrint(&path_buf, "/proc/{d}/stat", .{pid});
+    const file = try std.fs.openFileAbsolute(path, .{});
+    defer file.close();
+
+    var buf: [1024]u8 = undefined;
+    const len = try file.readAll(&buf);
+    return parseStatCpuTicks(buf[0..len]);
+}
+
+/// utime plus stime from the text of /proc/<pid>/stat. The command name
+/// may hold spaces and parentheses, so fields are counted from the last
+/// closing parenthesis: utime and stime are the 12th and 13th after it.
+pub fn parseStatCpuTicks(text: []const u8) !u64 {
+    const end = std.mem.lastIndexOfScalar(u8, text, ')') orelse return error.InvalidStat;
+    var fields = std.mem.tokenizeScalar(u8, text[end + 1 ..], ' ');
+    for (0..11) |_| _ = fields.next() orelse return error.InvalidStat;
+
+    const utime = std.fmt.parseInt(u64, fields.next() orelse return error.InvalidStat, 10) catch return error.InvalidStat;
+    const stime = std.fmt.parseInt(u64, fields.next() orelse return error.InvalidStat, 10) catch return error.InvalidStat;
+    return utime + stime;
+}
+
+/// Share of one CPU used by `ticks` of CPU time over `elapsed_ms`
+pub fn cpuShare(ticks: u64, elapsed_ms: i64) f64 {
+    if (elapsed_ms <= 0) return 0;
+    const cpu_ms = @as(f64, @floatFromInt(ticks)) * (std.time.ms_per_s / user_hz);
+    return cpu_ms / @as(f64, @floatFromInt(elapsed_ms));
+}
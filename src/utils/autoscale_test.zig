@@ -0,0 +1,78 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const testing = std.testing;
+const autoscale = @import("autoscale.zig");
+
+const config = autoscale.Config{
+    .min_workers = 2,
+    .max_workers = 4,
+    .up_samples = 2,
+    .down_samples = 3,
+    .up_cooldown_ms = 1000,
+    .down_cooldown_ms = 5000,
+};
+
+test "Scaler scales up after consecutive hot samples" {
+    var scaler = autoscale.Scaler.init(config);
+    const busy = autoscale.Sample{ .workers = 2, .busy = 2 };
+
+    try testing.expectEqual(autoscale.Decision.none, scaler.decide(busy, 2, 0));
+    try testing.expectEqual(autoscale.Decision.up, scaler.decide(busy, 2, 500));
+
+    // Cooldown holds the next step back
+    try testing.expectEqual(autoscale.Decision.none, scaler.decide(busy, 3, 1000));
+    try testing.expectEqual(autoscale.Decision.none, scaler.decide(busy, 3, 1200));
+    try testing.expectEqual(autoscale.Decision.up, scaler.decide(busy, 3, 1600));
+
+    // Never past the maximum
+    for (0..5) |i| {
+        try testing.expectEqual(autoscale.Decision.none, scaler.decide(busy, 4, 10_000 + @as(i64, @intCast(i)) * 1000));
+    }
+}
+
+test "Scaler treats queued connections and CPU as load" {
+    var queued = autoscale.Scaler.init(config);
+    const waiting = autoscale.Sample{ .workers = 4, .busy = 0, .queued = 3 };
+    _ = queued.decide(waiting, 3, 0);
+    try testing.expectEqual(autoscale.Decision.up, queued.decide(waiting, 3, 500));
+
+    var cpu = autoscale.Scaler.init(config);
+    const spinning = autoscale.Sample{ .workers = 3, .cpu = 0.9 };
+    _ = cpu.decide(spinning, 3, 0);
+    try testing.expectEqual(autoscale.Decision.up, cpu.decide(spinning, 3, 500));
+}
+
+test "Scaler scales down slowly and not into a hot pool" {
+    var scaler = autoscale.Scaler.init(config);
+    const idle = autoscale.Sample{ .workers = 4, .busy = 1, .cpu = 0.1 };
+
+    try testing.expectEqual(autoscale.Decision.none, scaler.decide(idle, 4, 0));
+    try testing.expectEqual(autoscale.Decision.none, scaler.decide(idle, 4, 500));
+    try testing.expectEqual(autoscale.Decision.down, scaler.decide(idle, 4, 1000));
+
+    // One busy worker among two is neither hot nor cold: stay put
+    const half = autoscale.Sample{ .workers = 2, .busy = 1 };
+    for (0..10) |i| {
+        try testing.expectEqual(autoscale.Decision.none, scaler.decide(half, 2, 10_000 + @as(i64, @intCast(i)) * 1000));
+    }
+
+    // A mixed sample resets the run of cold samples
+    var mixed = autoscale.Scaler.init(config);
+    _ = mixed.decide(idle, 3, 0);
+    _ = mixed.decide(idle, 3, 500);
+    _ = mixed.decide(.{ .workers = 3, .busy = 2 }, 3, 1000);
+    try testing.expectEqual(autoscale.Decision.none, mixed.decide(idle, 3, 1500));
+}
+
+test "parseStatCpuTicks reads utime and stime" {
+    const stat = "4242 (python (worker) 1) S 1 4242 4242 0 -1 4194560 1000 0 0 0 250 50 0 0 20 0 1 0 100 0 0";
+    try testing.expectEqual(@as(u64, 300), try autoscale.parseStatCpuTicks(stat));
+    try testing.expectError(error.InvalidStat, autoscale.parseStatCpuTicks("4242 (short) S 1"));
+
+    try testing.expectEqual(@as(f64, 0.5), autoscale.cpuShare(50, 1000));
+}
+
+test "processCpuTicks reads this process" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    _ = try autoscale.processCpuTicks(std.os.linux.getpid());
+}
@@ -1,5 +1,12 @@
 const std = @import("std");
 const Allocator = std.mem.Allocator;
+const builtin = @import("builtin");
+const http_server = @import("../http/server.zig");
+pub const affinity = @import("affinity.zig");
+pub const autoscale = @import("autoscale.zig");
+pub const heartbeat = @import("heartbeat.zig");
+pub const recycle = @import("recycle.zig");
+pub const timer_wheel = @import("timer_wheel.zig");
 
 // UVICORN PARITY: Add structured logging support (JSON format)
 // UVICORN PARITY: Add access log formatting with customizable fields
@@ -160,8 +167,30 @@ fn getTimestamp() []const u8 {
 
 /// Worker process information
 pub const Worker = struct {
-    pid: i32,
+    pid: std.posix.pid_t,
     status: WorkerStatus,
+    /// Slot the worker fills, 0 to target_count - 1; a replacement takes
+    /// the slot of the worker it replaces
+    index: usize = 0,
+    /// Write end of the worker's control pipe. Closing it tells the worker
+    /// to stop.
+    control: std.posix.fd_t = -1,
+    /// CPU the worker was pinned to, if the pool places workers
+    cpu: ?affinity.Cpu = null,
+    /// When a worker judged hung gets SIGKILL, its stack dump having been
+    /// requested
+    kill_at_ms: ?i64 = null,
+    /// Heartbeat board slot, held until the worker is reaped
+    heartbeat_slot: ?usize = null,
+    /// Replacement started for a worker that asked to retire. The worker
+    /// is stopped once its successor is running.
+    successor: ?std.posix.pid_t = null,
+    /// Successors that died before becoming ready, and when the next one
+    /// may be started
+    successor_failures: u32 = 0,
+    successor_retry_at_ms: ?i64 = null,
+    /// CPU ticks at the last autoscaling sample
+    cpu_ticks: ?u64 = null,
 
     /// Worker status
     pub const WorkerStatus = enum {
@@ -170,14 +199,51 @@ pub const Worker = struct {
         stopping,
         stopped,
     };
+
+    /// Whether the worker fills its slot towards the target count; a worker
+    /// being stopped or replaced does not
+    pub fn isActive(self: Worker) bool {
+        return self.status != .stopping and self.successor == null;
+    }
+
+    /// Close the master's end of the control pipe, asking the worker to
+    /// stop
+    pub fn closeControl(self: *Worker) void {
+        if (self.control < 0) return;
+        std.posix.close(self.control);
+        self.control = -1;
+    }
+};
+
+/// What a forked worker inherits from the master
+pub const WorkerContext = struct {
+    /// Listening socket bound by the master: the one shared by every
+    /// worker, or in `.reuseport` mode the socket for this worker's slot
+    listener: std.net.Server,
+    /// Read end of the control pipe. It becomes readable when the master
+    /// asks the worker to stop, and also if the master dies, so workers
+    /// are never orphaned.
+    control: std.posix.fd_t,
+    index: usize,
+    /// The worker's heartbeat slot. The worker beats it, marks it ready
+    /// once it accepts connections, and retires through it.
+    heartbeat: ?*heartbeat.Slot = null,
+};
+
+/// Code run in a forked worker. The return value is the worker's exit
+/// status.
+pub const WorkerEntry = struct {
+    context: ?*anyopaque,
+    run: *const fn (context: ?*anyopaque, worker: WorkerContext) u8,
 };
 
-// OPTIMIZATION 9: System-Level - Implement CPU affinity and NUMA awareness for workers
 // OPTIMIZATION 3: Concurrency - Improve worker load balancing and process management
 // UVICORN PARITY: Add worker preloading support for faster startup
 // UVICORN PARITY: Add worker memory monitoring and automatic restart on memory leaks
-// UVICORN PARITY: Add graceful worker shutdown with connection draining
-/// Worker pool for managing multiple worker processes
+/// Worker pool for managing multiple worker processes. The master binds the
+/// listening socket once and forks workers that inherit it, so workers do
+/// not depend on finding a `ladybug` binary or re-binding the port, and
+/// start without an exec.
 pub const WorkerPool = struct {
     const Self = @This();
 
@@ -187,6 +253,36 @@ pub const WorkerPool = struct {
     app: []const u8,
     host: []const u8,
     port: u16,
+    backlog: u32 = 128,
+    accept_mode: http_server.AcceptMode = .shared,
+    steering: http_server.Steering = .hash,
+    /// One shared socket, or one per slot in `.reuseport` mode. The master
+    /// keeps them all open so a replacement worker gets the same socket
+    /// and the reuseport group keeps its order.
+    listeners: []std.net.Server = &.{},
+    /// Where workers run. A slot keeps its CPU across restarts, so a
+    /// replacement lands where the worker it replaces ran.
+    cpu_affinity: affinity.Policy = .none,
+    /// CPUs available for placement, read by `start` unless set
+    topology: ?affinity.Topology = null,
+    /// A worker whose heartbeat or current request is older than this is
+    /// killed and replaced; 0 disables hang detection
+    hang_timeout_ms: u64 = 0,
+    /// A worker that has not become ready this long after its fork is
+    /// killed and replaced; 0 lets start-up take as long as it needs
+    startup_timeout_ms: u64 = 0,
+    /// How long `stop` lets workers finish their connections before it
+    /// sends SIGTERM, and SIGKILL `terminate_grace_ms` after that
+    shutdown_timeout_ms: u64 = 30 * std.time.ms_per_s,
+    /// Liveness and retirement records shared with the workers, with room
+    /// for each slot to have a worker draining, one serving and a
+    /// successor starting at once
+    heartbeats: ?heartbeat.Board = null,
+    /// Moves `target_count` between the configured bounds with the load;
+    /// null keeps it fixed
+    autoscaler: ?autoscale.Scaler = null,
+    last_sample_ms: i64 = 0,
+    entry: ?WorkerEntry = null,
 
     /// Initialize a new worker pool
     pub fn init(allocator: Allocator, target_count: usize, app: []const u8, host: []const u8, port: u16) Self {
@@ -200,162 +296,420 @@ pub const WorkerPool = struct {
         };
     }
 
-    /// Start the worker pool
-    pub fn start(self: *Self) !void {
-        while (self.workers.items.len < self.target_count) {
-            try self.startWorker();
+    /// Bind the listening sockets the workers will inherit
+    pub fn listen(self: *Self) !void {
+        if (self.listeners.len > 0) return;
+
+        if (self.accept_mode == .reuseport) {
+            self.listeners = try http_server.bindReusePortGroup(self.allocator, self.host, self.port, self.backlog, self.target_count, self.steering);
+        } else {
+            const listeners = try self.allocator.alloc(std.net.Server, 1);
+            errdefer self.allocator.free(listeners);
+            listeners[0] = try http_server.bindListener(self.host, self.port, self.backlog, false);
+            self.listeners = listeners;
+        }
+    }
+
+    /// Fork workers up to the target count, each running `entry`. Binds
+    /// the listener first if `listen` was not called.
+    pub fn start(self: *Self, entry: WorkerEntry) !void {
+        if (builtin.os.tag == .windows) return error.UnsupportedPlatform;
+
+        // Every reuseport socket needs a worker, or the connections the
+        // kernel hashes to it wait forever
+        if (self.autoscaler != null and self.accept_mode == .reuseport) return error.ReusePortCannotScale;
+
+        try self.listen();
+        if (self.cpu_affinity != .none and self.topology == null) {
+            self.topology = try affinity.Topology.detect(self.allocator);
+        }
+        if (self.heartbeats == null) {
+            self.heartbeats = try heartbeat.Board.init(3 * self.capacity());
+        }
+        self.entry = entry;
+        while (self.activeCount() < self.target_count) {
+            try self.startWorker(self.freeIndex());
         }
     }
 
-    // OPTIMIZATION 9: System-Level - Pin workers to specific CPU cores for better cache locality
-    /// Start a single worker
-    fn startWorker(self: *Self) !void {
-        // Create argv for the worker process
-        var argv = std.ArrayList([]const u8).init(self.allocator);
-        defer argv.deinit();
-
-        try argv.append("ladybug");
-        try argv.append("--worker");
-        try argv.append("--host");
-        try argv.append(self.host);
-        try argv.append("--port");
-
-        const port_str = try std.fmt.allocPrint(self.allocator, "{d}", .{self.port});
-        defer self.allocator.free(port_str);
-        try argv.append(port_str);
-
-        try argv.append(self.app);
-
-        // Platform-specific process spawning
-        const builtin = @import("builtin");
-        if (builtin.os.tag == .linux or builtin.os.tag == .freebsd or
-            builtin.os.tag == .netbsd or builtin.os.tag == .openbsd)
-        {
-            // On Unix-like systems that support fork/exec
-            const pid = try std.os.fork();
-            if (pid == 0) {
-                // Child process - exec ladybug
-                const environ = std.c.environ;
-                const result = std.os.execveZ("/usr/bin/env", argv.items, environ);
-                std.debug.print("Failed to start worker: {!}\n", .{result});
-                std.os.exit(1);
+    /// Fork a single worker into slot `index`
+    fn startWorker(self: *Self, index: usize) !void {
+        const entry = self.entry orelse return error.NotStarted;
+        if (self.listeners.len == 0) return error.NotListening;
+
+        const listener = self.listeners[if (self.accept_mode == .reuseport) index else 0];
+        const cpu = if (self.topology) |*topology| topology.place(self.cpu_affinity, index) else null;
+        const heartbeat_slot = self.freeHeartbeatSlot();
+        const slot = if (heartbeat_slot) |i| &self.heartbeats.?.slots[i] else null;
+        if (slot) |s| s.reset();
+        const control = try std.posix.pipe();
+        errdefer {
+            std.posix.close(control[0]);
+            std.posix.close(control[1]);
+        }
+
+        try self.workers.ensureUnusedCapacity(1);
+        const pid = try std.posix.fork();
+        if (pid == 0) {
+            // Only the master may hold write ends, or a worker would never
+            // see EOF when the master goes away
+            std.posix.close(control[1]);
+            for (self.workers.items) |worker| {
+                if (worker.control >= 0) std.posix.close(worker.control);
             }
 
-            // Parent process - track the worker
-            try self.workers.append(Worker{
-                .pid = pid,
-                .status = .starting,
-            });
-        } else if (builtin.os.tag == .macos or builtin.os.tag == .darwin) {
-            // On macOS, use child_process
-            const child_process = std.process;
-            var args = std.ArrayList([]const u8).init(self.allocator);
-            defer args.deinit();
-
-            try args.append("/usr/bin/env");
-            try args.append("ladybug");
-            try args.append("--worker");
-            try args.append("--host");
-            try args.append(self.host);
-            try args.append("--port");
-            try args.append(port_str);
-            try args.append(self.app);
-
-            _ = try child_process.Child.run(.{
-                .allocator = self.allocator,
-                .argv = args.items,
-            });
+            // A socket left open in a worker that never accepts from it
+            // would strand its share of reuseport connections
+            for (self.listeners) |other| {
+                if (other.stream.handle != listener.stream.handle) std.posix.close(other.stream.handle);
+            }
+
+            if (cpu) |placed| self.placeWorker(index, placed, listener);
 
-            // Child process ID will be invalid on macOS, but we still need a placeholder
-            const mock_pid: std.c.pid_t = 0;
-            try self.workers.append(Worker{
-                .pid = mock_pid,
-                .status = .starting,
+            const status = entry.run(entry.context, .{
+                .listener = listener,
+                .control = control[0],
+                .index = index,
+                .heartbeat = slot,
             });
-        } else {
-            // Unsupported platform
-            return error.UnsupportedPlatform;
+            std.posix.exit(status);
         }
+
+        std.posix.close(control[0]);
+        self.workers.appendAssumeCapacity(Worker{
+            .pid = pid,
+            .status = .starting,
+            .index = index,
+            .control = control[1],
+            .cpu = cpu,
+            .heartbeat_slot = heartbeat_slot,
+        });
     }
 
-    // UVICORN PARITY: Add graceful shutdown with configurable timeout
-    // UVICORN PARITY: Add connection draining before worker termination
-    /// Stop all worker processes gracefully
-    pub fn stop(self: *Self) void {
-        const builtin = @import("builtin");
-        // First send TERM signal to all workers
+    /// Pin a freshly forked worker. Placement is best effort: a worker
+    /// that cannot be pinned still serves, unpinned.
+    fn placeWorker(self: *const Self, index: usize, cpu: affinity.Cpu, listener: std.net.Server) void {
+        const numa = self.topology.?.node_count > 1;
+        affinity.pin(cpu, numa) catch |err| {
+            std.debug.print("Worker {d} could not be placed on CPU {d}, node {d}: {}\n", .{ index, cpu.id, cpu.node, err });
+        };
+
+        // Each reuseport socket stays with its slot, so the mark survives
+        // worker restarts
+        if (self.accept_mode == .reuseport) {
+            affinity.setIncomingCpu(listener.stream.handle, cpu.id) catch {};
+        }
+    }
+
+    fn heartbeatSlot(self: *const Self, worker: Worker) ?*heartbeat.Slot {
+        const board = self.heartbeats orelse return null;
+        return &board.slots[worker.heartbeat_slot orelse return null];
+    }
+
+    /// Lowest heartbeat slot no unreaped worker holds, or null when the
+    /// board is full; such a worker runs unwatched
+    fn freeHeartbeatSlot(self: *const Self) ?usize {
+        const board = self.heartbeats orelse return null;
+        for (0..board.slots.len) |i| {
+            for (self.workers.items) |worker| {
+                if (worker.heartbeat_slot != null and worker.heartbeat_slot.? == i) break;
+            } else return i;
+        }
+        return null;
+    }
+
+    /// Most workers the pool may aim for
+    fn capacity(self: *const Self) usize {
+        const scaler = self.autoscaler orelse return self.target_count;
+        return @max(self.target_count, scaler.config.max_workers);
+    }
+
+    /// Workers that count towards the target
+    fn activeCount(self: *const Self) usize {
+        var count: usize = 0;
         for (self.workers.items) |worker| {
-            if (builtin.os.tag != .macos and builtin.os.tag != .darwin) {
-                _ = std.os.kill(worker.pid, std.os.SIG.TERM) catch continue;
-            } else {
-                // On macOS, use SIGTERM (15)
-                _ = std.c.kill(worker.pid, 15);
-            }
+            if (worker.isActive()) count += 1;
+        }
+        return count;
+    }
+
+    /// Lowest slot no active worker holds. A worker being stopped gives up
+    /// its slot, so its replacement inherits the slot's socket and CPU.
+    fn freeIndex(self: *const Self) usize {
+        var index: usize = 0;
+        while (true) : (index += 1) {
+            for (self.workers.items) |worker| {
+                if (worker.isActive() and worker.index == index) break;
+            } else return index;
+        }
+    }
+
+    /// Replace every worker with a fresh one, as though each had asked to
+    /// retire. The master never loads the application, so the new workers
+    /// import its code as it is now. Each old worker keeps serving until
+    /// its successor is ready and the listening sockets stay open
+    /// throughout, so no connection is refused. If the new code fails to
+    /// start, the old workers keep serving while successors are retried
+    /// with backoff.
+    pub fn reload(self: *Self) void {
+        for (self.workers.items) |*worker| {
+            if (!worker.isActive()) continue;
+            // New code deserves a fresh set of attempts
+            worker.successor_failures = 0;
+            worker.successor_retry_at_ms = null;
+            if (self.heartbeatSlot(worker.*)) |slot| slot.retire();
+        }
+    }
+
+    /// Successors that die during start-up are retried after a delay that
+    /// doubles from `successor_retry_base_ms` up to
+    /// `successor_retry_max_ms`, at most `successor_max_attempts` times.
+    /// After that the retiring worker keeps serving.
+    pub const successor_retry_base_ms = 1000;
+    pub const successor_retry_max_ms = 60 * std.time.ms_per_s;
+    pub const successor_max_attempts = 8;
+
+    /// Delay before starting another successor after `failures` of them
+    /// died during start-up
+    pub fn successorBackoffMs(failures: u32) i64 {
+        if (failures == 0) return 0;
+        const shift: u6 = @intCast(@min(failures - 1, 32));
+        return @min(@as(i64, successor_retry_base_ms) << shift, successor_retry_max_ms);
+    }
+
+    /// How long a worker gets to exit after SIGTERM before SIGKILL
+    pub const terminate_grace_ms = 5 * std.time.ms_per_s;
+
+    /// Stop all worker processes gracefully. Closing a control pipe makes
+    /// the worker finish its current connection and exit. Workers still
+    /// running after `shutdown_timeout_ms` get SIGTERM, then SIGKILL.
+    pub fn stop(self: *Self) void {
+        for (self.workers.items) |*worker| {
+            worker.closeControl();
+            worker.status = .stopping;
         }
 
-        // Wait for all workers to exit
+        const terminate_at = heartbeat.now() + @as(i64, @intCast(self.shutdown_timeout_ms));
+        const kill_at = terminate_at + terminate_grace_ms;
+        // Last signal sent, 0 before the deadline
+        var sent: u8 = 0;
         while (self.workers.items.len > 0) {
-            if (builtin.os.tag != .macos and builtin.os.tag != .darwin) {
-                const pid = std.os.waitpid(-1, 0);
-                if (pid.pid <= 0) break;
-
-                // Remove the worker from the list
-                for (self.workers.items, 0..) |worker, i| {
-                    if (worker.pid == pid.pid) {
-                        _ = self.workers.swapRemove(i);
-                        break;
-                    }
-                }
-            } else {
-                // On macOS, just remove one worker from the list
-                // since we don't have proper worker tracking
-                if (self.workers.items.len > 0) {
-                    _ = self.workers.swapRemove(0);
-                }
-                std.time.sleep(100 * std.time.ns_per_ms); // Wait a bit
+            const result = std.posix.waitpid(-1, std.posix.W.NOHANG);
+            if (result.pid > 0) {
+                self.forget(result.pid);
+                continue;
+            }
+
+            const at_ms = heartbeat.now();
+            const signal: u8 = if (at_ms >= kill_at) std.posix.SIG.KILL else if (at_ms >= terminate_at) std.posix.SIG.TERM else 0;
+            if (signal != sent) {
+                sent = signal;
+                std.debug.print("{d} workers still running at shutdown; sending {s}\n", .{
+                    self.workers.items.len, if (signal == std.posix.SIG.KILL) "SIGKILL" else "SIGTERM",
+                });
+                for (self.workers.items) |worker| std.posix.kill(worker.pid, signal) catch {};
             }
+            std.time.sleep(10 * std.time.ns_per_ms);
         }
     }
 
     // OPTIMIZATION 10: Monitoring - Add performance metrics and health checks for workers
-    /// Check if any workers need to be restarted
+    /// Reap workers that exited and fork replacements
     pub fn check(self: *Self) !void {
-        const builtin = @import("builtin");
-
-        if (builtin.os.tag != .macos and builtin.os.tag != .darwin) {
-            // On Linux and other Unix-like systems, use waitpid
-            var status: struct {
-                pid: std.c.pid_t,
-                status: u32,
-            } = undefined;
-
-            while (true) {
-                const rc = std.c.waitpid(-1, &status.status, std.c.WNOHANG);
-                status.pid = rc;
-
-                if (status.pid <= 0) break;
-
-                // Remove the worker from the list
-                for (self.workers.items, 0..) |worker, i| {
-                    if (worker.pid == status.pid) {
-                        _ = self.workers.swapRemove(i);
-                        break;
-                    }
+        while (self.workers.items.len > 0) {
+            const result = std.posix.waitpid(-1, std.posix.W.NOHANG);
+            if (result.pid <= 0) break;
+
+            std.debug.print("Worker pid {d} exited with status {d}\n", .{ result.pid, result.status });
+            self.forget(result.pid);
+        }
+
+        if (self.hang_timeout_ms > 0 or self.startup_timeout_ms > 0) self.killHung();
+        try self.recycle();
+        if (self.autoscaler != null) self.scale();
+
+        // Start new workers if needed
+        while (self.activeCount() < self.target_count) {
+            try self.startWorker(self.freeIndex());
+        }
+    }
+
+    /// Mark workers running once they accept connections, and replace
+    /// workers that asked to retire: the successor is started in the same
+    /// slot, and the old worker is stopped only when the successor is
+    /// running, so the pool never runs short while a worker restarts
+    fn recycle(self: *Self) !void {
+        const at_ms = heartbeat.now();
+        var i: usize = 0;
+        while (i < self.workers.items.len) : (i += 1) {
+            const worker = &self.workers.items[i];
+            const slot = self.heartbeatSlot(worker.*) orelse {
+                // Without a slot it cannot report readiness
+                if (worker.status == .starting) worker.status = .running;
+                continue;
+            };
+            if (worker.status == .starting and slot.isReady()) worker.status = .running;
+            if (worker.status != .running or worker.successor != null or !slot.isRetiring()) continue;
+            if (worker.successor_failures >= successor_max_attempts) continue;
+            if (worker.successor_retry_at_ms) |retry_at| {
+                if (at_ms < retry_at) continue;
+            }
+
+            // Starting a worker may move the list
+            const pid = worker.pid;
+            try self.startWorker(worker.index);
+            const successor = self.workers.items[self.workers.items.len - 1].pid;
+            self.workers.items[i].successor = successor;
+            std.debug.print("Worker pid {d} is retiring; started pid {d} to replace it\n", .{ pid, successor });
+        }
+
+        for (self.workers.items) |*worker| {
+            const successor = worker.successor orelse continue;
+            if (worker.status == .stopping) continue;
+
+            const next = self.find(successor) orelse {
+                // The successor died while starting; try again later
+                worker.successor = null;
+                worker.successor_failures += 1;
+                if (worker.successor_failures >= successor_max_attempts) {
+                    std.debug.print("Worker pid {d}: {d} successors failed to start; it keeps serving\n", .{ worker.pid, worker.successor_failures });
+                    continue;
                 }
+                const delay = successorBackoffMs(worker.successor_failures);
+                worker.successor_retry_at_ms = at_ms + delay;
+                std.debug.print("Worker pid {d}: successor pid {d} exited during start-up (attempt {d} of {d}); retrying in {d} ms\n", .{
+                    worker.pid, successor, worker.successor_failures, successor_max_attempts, delay,
+                });
+                continue;
+            };
+            if (next.status == .running) {
+                worker.closeControl();
+                worker.status = .stopping;
             }
-        } else {
-            // On macOS, we'll use a simpler approach since we don't have proper worker tracking
-            // Just maintain the worker count
         }
+    }
 
-        // Start new workers if needed
-        while (self.workers.items.len < self.target_count) {
-            try self.startWorker();
+    /// Sample the load and grow or shrink the target by one worker. A
+    /// worker is only ever removed by closing its control pipe, so it
+    /// finishes its current connection first.
+    fn scale(self: *Self) void {
+        const at_ms = heartbeat.now();
+        const sample = self.sample(at_ms);
+        switch (self.autoscaler.?.decide(sample, self.target_count, at_ms)) {
+            .none => {},
+            .up => {
+                self.target_count += 1;
+                std.debug.print("Scaling up to {d} workers ({d} busy, {d} queued, {d:.0}% CPU)\n", .{ self.target_count, sample.busy, sample.queued, sample.cpu * 100 });
+            },
+            .down => if (self.drainOne()) {
+                self.target_count -= 1;
+                std.debug.print("Scaling down to {d} workers ({d} busy, {d:.0}% CPU)\n", .{ self.target_count, sample.busy, sample.cpu * 100 });
+            },
+        }
+    }
+
+    /// Current load: busy workers from the heartbeat board, waiting
+    /// connections from the listeners and CPU use from /proc
+    fn sample(self: *Self, at_ms: i64) autoscale.Sample {
+        const elapsed_ms = at_ms - self.last_sample_ms;
+        self.last_sample_ms = at_ms;
+
+        var result = autoscale.Sample{ .workers = 0 };
+        var cpu_total: f64 = 0;
+        var cpu_measured: usize = 0;
+        for (self.workers.items) |*worker| {
+            if (!worker.isActive()) continue;
+            result.workers += 1;
+            if (self.heartbeatSlot(worker.*)) |slot| {
+                if (slot.currentState() != .idle) result.busy += 1;
+            }
+
+            const ticks = autoscale.processCpuTicks(worker.pid) catch continue;
+            if (worker.cpu_ticks) |previous| {
+                cpu_total += autoscale.cpuShare(ticks -| previous, elapsed_ms);
+                cpu_measured += 1;
+            }
+            worker.cpu_ticks = ticks;
+        }
+        if (cpu_measured > 0) result.cpu = cpu_total / @as(f64, @floatFromInt(cpu_measured));
+
+        for (self.listeners) |listener| {
+            result.queued += http_server.acceptQueueDepth(listener) catch 0;
+        }
+        return result;
+    }
+
+    /// Stop the running worker in the highest slot, keeping the slots in
+    /// use contiguous
+    fn drainOne(self: *Self) bool {
+        var chosen: ?*Worker = null;
+        for (self.workers.items) |*worker| {
+            if (!worker.isActive() or worker.status != .running) continue;
+            if (chosen == null or worker.index > chosen.?.index) chosen = worker;
+        }
+        const worker = chosen orelse return false;
+        worker.closeControl();
+        worker.status = .stopping;
+        return true;
+    }
+
+    fn find(self: *const Self, pid: std.posix.pid_t) ?*Worker {
+        for (self.workers.items) |*worker| {
+            if (worker.pid == pid) return worker;
+        }
+        return null;
+    }
+
+    /// Ask workers that stopped making progress for a stack dump, then
+    /// kill them once it has had time to be written. They are replaced
+    /// when reaped.
+    fn killHung(self: *Self) void {
+        const at_ms = heartbeat.now();
+        for (self.workers.items) |*worker| {
+            if (worker.kill_at_ms) |deadline| {
+                if (at_ms >= deadline) {
+                    std.posix.kill(worker.pid, std.posix.SIG.KILL) catch {};
+                    worker.kill_at_ms = std.math.maxInt(i64);
+                }
+                continue;
+            }
+
+            const slot = self.heartbeatSlot(worker.*) orelse continue;
+            if (slot.startingFor(at_ms)) |starting| {
+                if (self.startup_timeout_ms == 0 or starting <= @as(i64, @intCast(self.startup_timeout_ms))) continue;
+                std.debug.print("Worker pid {d} still starting after {d} ms; dumping its stack and killing it\n", .{ worker.pid, starting });
+            } else {
+                if (self.hang_timeout_ms == 0) continue;
+                const stalled = slot.stalledFor(at_ms) orelse continue;
+                if (stalled <= @as(i64, @intCast(self.hang_timeout_ms))) continue;
+                std.debug.print("Worker pid {d} unresponsive for {d} ms ({s}); dumping its stack and killing it\n", .{
+                    worker.pid, stalled, @tagName(slot.currentState()),
+                });
+            }
+            std.posix.kill(worker.pid, heartbeat.stack_dump_signal) catch {};
+            worker.status = .stopping;
+            worker.kill_at_ms = at_ms + heartbeat.stack_dump_grace_ms;
+        }
+    }
+
+    /// Drop a reaped worker from the list
+    fn forget(self: *Self, pid: std.posix.pid_t) void {
+        for (self.workers.items, 0..) |*worker, i| {
+            if (worker.pid == pid) {
+                worker.closeControl();
+                _ = self.workers.swapRemove(i);
+                return;
+            }
         }
     }
 
     /// Free resources
     pub fn deinit(self: *Self) void {
+        for (self.workers.items) |*worker| worker.closeControl();
         self.workers.deinit();
+        for (self.listeners) |*listener| listener.deinit();
+        self.allocator.free(self.listeners);
+        if (self.topology) |*topology| topology.deinit();
+        if (self.heartbeats) |*board| board.deinit();
     }
 };
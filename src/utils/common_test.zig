@@ -109,6 +109,47 @@ test "WorkerPool initialization" {
     try testing.expectEqualStrings("127.0.0.1", pool.host);
     try testing.expectEqual(@as(u16, 8000), pool.port);
     try testing.expectEqual(@as(usize, 0), pool.workers.items.len);
+    try testing.expectEqual(@as(usize, 0), pool.listeners.len);
+}
+
+test "WorkerPool binds the shared listener once" {
+    var pool = common.WorkerPool.init(testing.allocator, 2, "app:app", "127.0.0.1", 0);
+    defer pool.deinit();
+
+    try pool.listen();
+    try testing.expectEqual(@as(usize, 1), pool.listeners.len);
+    const handle = pool.listeners[0].stream.handle;
+
+    // Workers inherit this socket rather than binding their own
+    try pool.listen();
+    try testing.expectEqual(handle, pool.listeners[0].stream.handle);
+}
+
+test "WorkerPool binds one reuseport socket per worker" {
+    if (@import("builtin").os.tag != .linux) return error.SkipZigTest;
+
+    var pool = common.WorkerPool.init(testing.allocator, 3, "app:app", "127.0.0.1", 0);
+    defer pool.deinit();
+    pool.accept_mode = .reuseport;
+    pool.steering = .cpu;
+
+    try pool.listen();
+    try testing.expectEqual(@as(usize, 3), pool.listeners.len);
+
+    // Every socket in the group is on the same port
+    const port = pool.listeners[0].listen_address.getPort();
+    for (pool.listeners[1..]) |listener| {
+        try testing.expectEqual(port, listener.listen_address.getPort());
+    }
+}
+
+test "WorkerPool backs off failing successors" {
+    const Pool = common.WorkerPool;
+    try testing.expectEqual(@as(i64, 0), Pool.successorBackoffMs(0));
+    try testing.expectEqual(@as(i64, Pool.successor_retry_base_ms), Pool.successorBackoffMs(1));
+    try testing.expectEqual(@as(i64, 2 * Pool.successor_retry_base_ms), Pool.successorBackoffMs(2));
+    try testing.expectEqual(@as(i64, 4 * Pool.successor_retry_base_ms), Pool.successorBackoffMs(3));
+    try testing.expectEqual(@as(i64, Pool.successor_retry_max_ms), Pool.successorBackoffMs(40));
 }
 
 // Note: We're not testing the actual process management functions like start(), startWorker()
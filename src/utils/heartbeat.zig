@@ -0,0 +1,152 @@
+const std = @import("std");
+const posix = std.posix;
+
+/// Signal the master sends a hung worker before killing it. Workers
+/// register it to dump their Python stacks.
+pub const stack_dump_signal = posix.SIG.USR1;
+
+/// How long a hung worker gets to write its stack dump before SIGKILL
+pub const stack_dump_grace_ms = 1000;
+
+/// What a worker is doing, as far as hang detection is concerned
+pub const State = enum(u32) {
+    /// Starting up or waiting for a connection; the heartbeat must stay
+    /// fresh
+    idle,
+    /// Waiting for a client to send its request. The client sets the
+    /// pace, so the worker is not judged.
+    reading,
+    /// Handling an HTTP request, which must finish in time
+    request,
+    /// Serving a WebSocket session. Sessions are long-lived by design and
+    /// have their own ping timeouts, so they are never judged hung.
+    websocket,
+};
+
+/// One worker's liveness record. Workers write it and the master reads it,
+/// each side with atomic word accesses, so it needs no lock.
+pub const Slot = extern struct {
+    /// Monotonic milliseconds when the worker last went around its loop
+    heartbeat_ms: i64 = 0,
+    /// Monotonic milliseconds when the current request started
+    request_start_ms: i64 = 0,
+    state: u32 = @intFromEnum(State.idle),
+    /// Nonzero once the worker has started and is accepting connections
+    ready: u32 = 0,
+    /// Nonzero once the worker wants to be replaced. It keeps serving
+    /// until the master stops it.
+    retiring: u32 = 0,
+
+    /// Prepare the slot for a newly forked worker, so start-up is timed
+    /// from the fork by `startingFor`
+    pub fn reset(self: *Slot) void {
+        @atomicStore(u32, &self.state, @intFromEnum(State.idle), .release);
+        @atomicStore(u32, &self.ready, 0, .release);
+        @atomicStore(u32, &self.retiring, 0, .release);
+        @atomicStore(i64, &self.heartbeat_ms, now(), .release);
+    }
+
+    /// Record that the worker has finished starting up
+    pub fn markReady(self: *Slot) void {
+        self.beat();
+        @atomicStore(u32, &self.ready, 1, .release);
+    }
+
+    /// Ask the master for a replacement
+    pub fn retire(self: *Slot) void {
+        @atomicStore(u32, &self.retiring, 1, .release);
+    }
+
+    pub fn isReady(self: *const Slot) bool {
+        return @atomicLoad(u32, &self.ready, .acquire) != 0;
+    }
+
+    pub fn isRetiring(self: *const Slot) bool {
+        return @atomicLoad(u32, &self.retiring, .acquire) != 0;
+    }
+
+    /// Record that the worker is alive and between connections
+    pub fn beat(self: *Slot) void {
+        @atomicStore(i64, &self.heartbeat_ms, now(), .release);
+    }
+
+    /// Record the start of a request or WebSocket session
+    pub fn begin(self: *Slot, state: State) void {
+        self.beginAt(state, now());
+    }
+
+    /// Record work that started at `started_ms`. A worker multiplexing
+    /// several requests reports the oldest one still in flight.
+    pub fn beginAt(self: *Slot, state: State, started_ms: i64) void {
+        @atomicStore(i64, &self.request_start_ms, started_ms, .release);
+        self.beat();
+        @atomicStore(u32, &self.state, @intFromEnum(state), .release);
+    }
+
+    /// Record that the worker is back in its accept loop
+    pub fn finish(self: *Slot) void {
+        @atomicStore(u32, &self.state, @intFromEnum(State.idle), .release);
+        self.beat();
+    }
+
+    pub fn currentState(self: *const Slot) State {
+        return @enumFromInt(@atomicLoad(u32, &self.state, .acquire));
+    }
+
+    /// How long the worker has failed to make progress at `at_ms`: the
+    /// age of its heartbeat when idle, of its request when busy, and null
+    /// while it starts up, reads a request or serves a WebSocket session
+    pub fn stalledFor(self: *const Slot, at_ms: i64) ?i64 {
+        if (!self.isReady()) return null;
+        const since = switch (self.currentState()) {
+            .idle => @atomicLoad(i64, &self.heartbeat_ms, .acquire),
+            .request => @atomicLoad(i64, &self.request_start_ms, .acquire),
+            .reading, .websocket => return null,
+        };
+        return @max(at_ms - since, 0);
+    }
+
+    /// How long the worker has been starting up at `at_ms`, or null once
+    /// it is ready. Start-up (imports, lifespan) is judged by its own
+    /// timeout, as it may legitimately take longer than a request.
+    pub fn startingFor(self: *const Slot, at_ms: i64) ?i64 {
+        if (self.isReady()) return null;
+        return @max(at_ms - @atomicLoad(i64, &self.heartbeat_ms, .acquire), 0);
+    }
+};
+
+/// Heartbeat slots in an anonymous shared mapping, created by the master
+/// before it forks so every worker inherits the same pages. A worker holds
+/// its slot until it is reaped, so a replacement started while the old
+/// worker drains gets a slot of its own.
+pub const Board = struct {
+    const Self = @This();
+
+    memory: []align(std.heap.page_size_min) u8,
+    slots: []Slot,
+
+    pub fn init(count: usize) !Self {
+        const size = @max(count, 1) * @sizeOf(Slot);
+        const memory = try posix.mmap(
+            null,
+            size,
+            posix.PROT.READ | posix.PROT.WRITE,
+            .{ .TYPE = .SHARED, .ANONYMOUS = true },
+            -1,
+            0,
+        );
+        const slots: [*]Slot = @ptrCast(memory.ptr);
+        for (slots[0..count]) |*slot| slot.* = .{};
+        return Self{ .memory = memory, .slots = slots[0..count] };
+    }
+
+    pub fn deinit(self: *Self) void {
+        posix.munmap(self.memory);
+    }
+};
+
+/// Monotonic clock in milliseconds, comparable across processes
+pub fn now() i64 {
+    const ts = posix.clock_gettime(.MONOTONIC) catch return 0;
+    return @as(i64, ts.sec) * std.time.ms_per_s + @divTrunc(@as(i64, ts.nsec), std.time.ns_per_ms);
+}
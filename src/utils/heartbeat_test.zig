@@ -0,0 +1,92 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const testing = std.testing;
+const heartbeat = @import("heartbeat.zig");
+
+test "Slot measures stalls by state" {
+    var slot = heartbeat.Slot{};
+    slot.reset();
+    slot.markReady();
+    const start = heartbeat.now();
+
+    // Idle workers are judged by their heartbeat
+    try testing.expect(slot.stalledFor(start + 5000).? >= 4000);
+
+    // Busy workers by their request, however often they beat
+    slot.begin(.request);
+    slot.beat();
+    try testing.expectEqual(heartbeat.State.request, slot.currentState());
+    try testing.expect(slot.stalledFor(start + 5000).? >= 4000);
+
+    // WebSocket sessions are exempt
+    slot.begin(.websocket);
+    try testing.expect(slot.stalledFor(start + 60_000) == null);
+
+    // So is waiting for a slow client to send its request
+    slot.begin(.reading);
+    try testing.expect(slot.stalledFor(start + 60_000) == null);
+
+    slot.finish();
+    try testing.expectEqual(heartbeat.State.idle, slot.currentState());
+    try testing.expectEqual(@as(?i64, 0), slot.stalledFor(0));
+}
+
+test "Slot times multiplexed requests from the oldest one" {
+    var slot = heartbeat.Slot{};
+    slot.reset();
+    slot.markReady();
+    const start = heartbeat.now();
+
+    slot.beginAt(.request, start - 3000);
+    try testing.expectEqual(heartbeat.State.request, slot.currentState());
+    try testing.expect(slot.stalledFor(start).? >= 3000);
+
+    // A newer request finishing does not reset the clock
+    slot.beginAt(.request, start - 3000);
+    try testing.expect(slot.stalledFor(start + 1000).? >= 4000);
+}
+
+test "Slot times start-up separately from stalls" {
+    var slot = heartbeat.Slot{};
+    slot.reset();
+    const start = heartbeat.now();
+
+    // A slow start-up is not a hang
+    try testing.expect(slot.stalledFor(start + 60_000) == null);
+    try testing.expect(slot.startingFor(start + 60_000).? >= 59_000);
+
+    slot.markReady();
+    try testing.expect(slot.startingFor(start + 60_000) == null);
+    try testing.expect(slot.stalledFor(start + 60_000) != null);
+}
+
+test "Board is shared with forked children" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    var board = try heartbeat.Board.init(2);
+    defer board.deinit();
+    try testing.expectEqual(@as(usize, 2), board.slots.len);
+
+    const pid = try std.posix.fork();
+    if (pid == 0) {
+        board.slots[1].begin(.request);
+        std.posix.exit(0);
+    }
+    _ = std.posix.waitpid(pid, 0);
+
+    try testing.expectEqual(heartbeat.State.request, board.slots[1].currentState());
+    try testing.expectEqual(heartbeat.State.idle, board.slots[0].currentState());
+}
+
+test "Slot reset clears readiness and retirement" {
+    var slot = heartbeat.Slot{};
+    slot.reset();
+    try testing.expect(!slot.isReady() and !slot.isRetiring());
+
+    slot.markReady();
+    slot.retire();
+    try testing.expect(slot.isReady() and slot.isRetiring());
+
+    slot.reset();
+    try testing.expect(!slot.isReady() and !slot.isRetiring());
+}
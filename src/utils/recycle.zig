@@ -0,0 +1,82 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+/// When a worker should be replaced
+pub const Limits = struct {
+    /// Requests to serve before retiring; null serves forever
+    max_requests: ?u32 = null,
+    /// Up to this many extra requests, drawn per worker, so workers
+    /// started together do not all retire together
+    max_requests_jitter: u32 = 0,
+    /// Resident set size in bytes above which the worker retires
+    max_rss_bytes: ?u64 = null,
+};
+
+pub const Reason = enum {
+    max_requests,
+    max_rss,
+};
+
+/// Counts what a worker has served and decides when it should retire
+pub const Recycler = struct {
+    const Self = @This();
+
+    /// This worker's request limit, jitter included
+    request_limit: ?u64,
+    max_rss_bytes: ?u64,
+    served: u64 = 0,
+    /// /proc/self/statm, kept open and re-read with pread
+    statm: ?std.posix.fd_t = null,
+
+    pub fn init(limits: Limits) Self {
+        const request_limit: ?u64 = if (limits.max_requests) |max|
+            @as(u64, max) + std.crypto.random.uintAtMost(u32, limits.max_requests_jitter)
+        else
+            null;
+
+        var statm: ?std.posix.fd_t = null;
+        if (limits.max_rss_bytes != null and builtin.os.tag == .linux) {
+            statm = std.posix.open("/proc/self/statm", .{ .ACCMODE = .RDONLY, .CLOEXEC = true }, 0) catch null;
+        }
+        return Self{
+            .request_limit = request_limit,
+            .max_rss_bytes = limits.max_rss_bytes,
+            .statm = statm,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        if (self.statm) |fd| std.posix.close(fd);
+        self.statm = null;
+    }
+
+    /// Count a finished request. Returns why the worker should retire, or
+    /// null while it is within its limits.
+    pub fn record(self: *Self) ?Reason {
+        self.served += 1;
+        if (self.request_limit) |limit| {
+            if (self.served >= limit) return .max_requests;
+        }
+        if (self.max_rss_bytes) |max| {
+            const fd = self.statm orelse return null;
+            const rss = residentBytes(fd) catch return null;
+            if (rss > max) return .max_rss;
+        }
+        return null;
+    }
+};
+
+/// Resident set size from a /proc/<pid>/statm file: its second field, in
+/// pages
+pub fn residentBytes(statm: std.posix.fd_t) !u64 {
+    var buf: [128]u8 = undefined;
+    const len = try std.posix.pread(statm, &buf, 0);
+    return parseStatm(buf[0..len]);
+}
+
+pub fn parseStatm(text: []const u8) !u64 {
+    var fields = std.mem.tokenizeScalar(u8, text, ' ');
+    _ = fields.next() orelse return error.InvalidStatm;
+    const pages = std.fmt.parseInt(u64, fields.next() orelse return error.InvalidStatm, 10) catch return error.InvalidStatm;
+    return pages * std.heap.pageSize();
+}
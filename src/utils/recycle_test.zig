@@ -0,0 +1,42 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const testing = std.testing;
+const recycle = @import("recycle.zig");
+
+test "Recycler retires after the request limit" {
+    var recycler = recycle.Recycler.init(.{ .max_requests = 3 });
+    defer recycler.deinit();
+
+    try testing.expect(recycler.record() == null);
+    try testing.expect(recycler.record() == null);
+    try testing.expectEqual(recycle.Reason.max_requests, recycler.record().?);
+}
+
+test "Recycler jitter stays within bounds" {
+    for (0..100) |_| {
+        const recycler = recycle.Recycler.init(.{ .max_requests = 1000, .max_requests_jitter = 50 });
+        const limit = recycler.request_limit.?;
+        try testing.expect(limit >= 1000 and limit <= 1050);
+    }
+}
+
+test "Recycler without limits never retires" {
+    var recycler = recycle.Recycler.init(.{});
+    defer recycler.deinit();
+
+    for (0..1000) |_| try testing.expect(recycler.record() == null);
+}
+
+test "Recycler retires above the RSS cap" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+
+    // Any running process is resident for more than one byte
+    var recycler = recycle.Recycler.init(.{ .max_rss_bytes = 1 });
+    defer recycler.deinit();
+    try testing.expectEqual(recycle.Reason.max_rss, recycler.record().?);
+}
+
+test "parseStatm reads resident pages" {
+    try testing.expectEqual(@as(u64, 2 * std.heap.pageSize()), try recycle.parseStatm("100 2 1 0 0 50 0\n"));
+    try testing.expectError(error.InvalidStatm, recycle.parseStatm("100"));
+}
@@ -0,0 +1,237 @@
+const std = @import("std");
+
+/// An intrusive timer. Embed it in the object it belongs to and recover
+/// that object in the callback with @fieldParentPtr; scheduling never
+/// allocates.
+pub const Timer = struct {
+    callback: *const fn (*Timer) void,
+    /// Tick at which the timer fires
+    expires: u64 = 0,
+    next: ?*Timer = null,
+    prev: ?*Timer = null,
+    /// List the timer is on; null when it is not scheduled
+    list: ?*List = null,
+
+    pub fn init(callback: *const fn (*Timer) void) Timer {
+        return Timer{ .callback = callback };
+    }
+
+    pub fn isScheduled(self: *const Timer) bool {
+        return self.list != null;
+    }
+};
+
+/// Doubly linked list of timers
+pub const List = struct {
+    head: ?*Timer = null,
+
+    pub fn isEmpty(self: *const List) bool {
+        return self.head == null;
+    }
+
+    pub fn push(self: *List, timer: *Timer) void {
+        timer.prev = null;
+        timer.next = self.head;
+        if (self.head) |head| head.prev = timer;
+        self.head = timer;
+        timer.list = self;
+    }
+
+    pub fn remove(self: *List, timer: *Timer) void {
+        if (timer.prev) |prev| prev.next = timer.next else self.head = timer.next;
+        if (timer.next) |next| next.prev = timer.prev;
+        timer.next = null;
+        timer.prev = null;
+        timer.list = null;
+    }
+
+    pub fn popFirst(self: *List) ?*Timer {
+        const timer = self.head orelse return null;
+        self.remove(timer);
+        return timer;
+    }
+
+    /// Detach every timer at once and return the first; the rest follow
+    /// through `next`
+    fn takeAll(self: *List) ?*Timer {
+        const head = self.head;
+        self.head = null;
+        return head;
+    }
+};
+
+/// Hierarchical timing wheel (Varghese and Lauck). Level 0 has one slot
+/// per tick; each higher level has slots 64 times as wide, and its timers
+/// cascade down a level when the wheel reaches their slot. Scheduling and
+/// cancelling are O(1) whatever the number of timers, and a tick only
+/// touches the timers that are due or cascading.
+///
+/// Not thread safe; `TimerService` adds the locking and the clock.
+pub const Wheel = struct {
+    const Self = @This();
+
+    pub const slot_bits = 6;
+    pub const slot_count = 1 << slot_bits;
+    pub const levels = 4;
+    /// Delays past this many ticks are parked in the top level and
+    /// re-placed as the wheel turns
+    pub const max_delay: u64 = (1 << (slot_bits * levels)) - 1;
+
+    const slot_mask: u64 = slot_count - 1;
+
+    slots: [levels][slot_count]List = [_][slot_count]List{[_]List{.{}} ** slot_count} ** levels,
+    /// Ticks elapsed so far
+    now: u64 = 0,
+
+    /// Fire `timer` after `delay` ticks (at least one). A scheduled timer
+    /// is moved.
+    pub fn schedule(self: *Self, timer: *Timer, delay: u64) void {
+        self.cancel(timer);
+        timer.expires = self.now + @max(delay, 1);
+        self.place(timer);
+    }
+
+    pub fn cancel(self: *Self, timer: *Timer) void {
+        _ = self;
+        if (timer.list) |list| list.remove(timer);
+    }
+
+    /// Turn the wheel `ticks` ticks, moving every timer that comes due
+    /// onto `due`
+    pub fn advance(self: *Self, ticks: u64, due: *List) void {
+        var remaining = ticks;
+        while (remaining > 0) : (remaining -= 1) {
+            self.now += 1;
+
+            // Cascade from the widest level that rolled over down to level
+            // 1, so timers re-placed from above are cascaded again below
+            var top: usize = 0;
+            while (top + 1 < levels and (self.now & ((@as(u64, 1) << @intCast(slot_bits * (top + 1))) - 1)) == 0) {
+                top += 1;
+            }
+            var level = top;
+            while (level > 0) : (level -= 1) {
+                const index = (self.now >> @intCast(slot_bits * level)) & slot_mask;
+                var timer = self.slots[level][index].takeAll();
+                while (timer) |current| {
+                    timer = current.next;
+                    current.list = null;
+                    self.place(current);
+                }
+            }
+
+            const slot = &self.slots[0][self.now & slot_mask];
+            while (slot.popFirst()) |timer| due.push(timer);
+        }
+    }
+
+    fn place(self: *Self, timer: *Timer) void {
+        const delta = @min(timer.expires -| self.now, max_delay);
+        const target = self.now + delta;
+
+        var level: usize = 0;
+        while (level + 1 < levels and delta >= (@as(u64, 1) << @intCast(slot_bits * (level + 1)))) {
+            level += 1;
+        }
+
+        const index = (target >> @intCast(slot_bits * level)) & slot_mask;
+        self.slots[level][index].push(timer);
+    }
+};
+
+/// A wheel turned by one background thread. Callbacks run on that thread,
+/// one at a time and without the lock held, so they may reschedule
+/// themselves; they must not block.
+pub const TimerService = struct {
+    const Self = @This();
+
+    mutex: std.Thread.Mutex = .{},
+    /// Signalled to stop the thread early
+    wake: std.Thread.Condition = .{},
+    /// Signalled after each callback, for `cancel`
+    idle: std.Thread.Condition = .{},
+    wheel: Wheel = .{},
+    due: List = .{},
+    /// Timer whose callback is running
+    running: ?*Timer = null,
+    tick_ns: u64,
+    started: std.time.Instant,
+    stopping: bool = false,
+    thread: ?std.Thread = null,
+    /// Id of `thread`, so a callback can cancel its own timer
+    thread_id: std.atomic.Value(std.Thread.Id) = std.atomic.Value(std.Thread.Id).init(0),
+
+    pub fn init(tick_ns: u64) !Self {
+        return Self{
+            .tick_ns = @max(tick_ns, 1),
+            .started = try std.time.Instant.now(),
+        };
+    }
+
+    pub fn start(self: *Self) !void {
+        self.thread = try std.Thread.spawn(.{}, run, .{self});
+    }
+
+    /// Stop the thread. Timers still scheduled never fire.
+    pub fn stop(self: *Self) void {
+        self.mutex.lock();
+        self.stopping = true;
+        self.wake.signal();
+        self.mutex.unlock();
+
+        if (self.thread) |thread| {
+            thread.join();
+            self.thread = null;
+        }
+    }
+
+    /// Fire `timer` after at least `delay_ns`, rounded up to whole ticks
+    pub fn schedule(self: *Self, timer: *Timer, delay_ns: u64) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.wheel.schedule(timer, std.math.divCeil(u64, delay_ns, self.tick_ns) catch unreachable);
+    }
+
+    /// Unschedule `timer`, waiting for its callback if it is running. The
+    /// timer's owner may be freed once this returns, unless the callback
+    /// is the caller.
+    pub fn cancel(self: *Self, timer: *Timer) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (self.running == timer and std.Thread.getCurrentId() != self.thread_id.load(.acquire)) {
+            self.idle.wait(&self.mutex);
+        }
+        // Only now, as the callback may have rescheduled itself
+        if (timer.list) |list| list.remove(timer);
+    }
+
+    fn elapsedTicks(self: *Self) u64 {
+        const now = std.time.Instant.now() catch return self.wheel.now;
+        return now.since(self.started) / self.tick_ns;
+    }
+
+    fn run(self: *Self) void {
+        self.thread_id.store(std.Thread.getCurrentId(), .release);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (!self.stopping) {
+            const target = self.elapsedTicks();
+            if (target > self.wheel.now) self.wheel.advance(target - self.wheel.now, &self.due);
+
+            while (self.due.popFirst()) |timer| {
+                self.running = timer;
+                self.mutex.unlock();
+                timer.callback(timer);
+                self.mutex.lock();
+                self.running = null;
+                self.idle.broadcast();
+            }
+
+            self.wake.timedWait(&self.mutex, self.tick_ns) catch {};
+        }
+    }
+};
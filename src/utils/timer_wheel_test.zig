@@ -0,0 +1,133 @@
+const std = @import("std");
+const testing = std.testing;
+const timer_wheel = @import("timer_wheel.zig");
+
+const Wheel = timer_wheel.Wheel;
+const Timer = timer_wheel.Timer;
+
+fn noop(_: *Timer) void {}
+
+/// Turn the wheel one tick at a time until `timer` comes due and return
+/// the tick it fired on
+fn fireTick(wheel: *Wheel, timer: *Timer, limit: u64) !u64 {
+    var due = timer_wheel.List{};
+    while (wheel.now < limit) {
+        wheel.advance(1, &due);
+        while (due.popFirst()) |fired| {
+            if (fired == timer) return wheel.now;
+        }
+    }
+    return error.TimerDidNotFire;
+}
+
+test "timers fire on their tick at every level" {
+    const delays = [_]u64{ 1, 63, 64, 65, 4095, 4096, 4097, 300_000, Wheel.max_delay };
+
+    for (delays) |delay| {
+        // Start off a slot boundary so cascades happen mid-delay
+        var wheel = Wheel{};
+        var due = timer_wheel.List{};
+        wheel.advance(37, &due);
+
+        var timer = Timer.init(noop);
+        wheel.schedule(&timer, delay);
+        try testing.expectEqual(wheel.now + delay, try fireTick(&wheel, &timer, wheel.now + delay + 1));
+    }
+}
+
+test "delays past the wheel are re-placed until due" {
+    var wheel = Wheel{};
+    var timer = Timer.init(noop);
+    wheel.schedule(&timer, Wheel.max_delay + 1000);
+
+    var due = timer_wheel.List{};
+    wheel.advance(Wheel.max_delay, &due);
+    try testing.expect(due.isEmpty());
+    try testing.expectEqual(Wheel.max_delay + 1000, try fireTick(&wheel, &timer, Wheel.max_delay + 1001));
+}
+
+test "cancelled and rescheduled timers" {
+    var wheel = Wheel{};
+    var cancelled = Timer.init(noop);
+    var moved = Timer.init(noop);
+
+    wheel.schedule(&cancelled, 10);
+    wheel.schedule(&moved, 10);
+    wheel.cancel(&cancelled);
+    try testing.expect(!cancelled.isScheduled());
+    wheel.schedule(&moved, 200);
+
+    var due = timer_wheel.List{};
+    wheel.advance(100, &due);
+    try testing.expect(due.isEmpty());
+    try testing.expectEqual(@as(u64, 200), try fireTick(&wheel, &moved, 300));
+}
+
+const Counter = struct {
+    timer: Timer = Timer.init(fire),
+    fired: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+    service: *timer_wheel.TimerService,
+
+    fn fire(timer: *Timer) void {
+        const self: *Counter = @fieldParentPtr("timer", timer);
+        // Periodic: reschedule from inside the callback
+        if (self.fired.fetchAdd(1, .monotonic) < 2) self.service.schedule(&self.timer, 0);
+    }
+};
+
+test "TimerService runs callbacks on its thread" {
+    var service = try timer_wheel.TimerService.init(std.time.ns_per_ms);
+    try service.start();
+    defer service.stop();
+
+    var counter = Counter{ .service = &service };
+    service.schedule(&counter.timer, 5 * std.time.ns_per_ms);
+
+    var waited: usize = 0;
+    while (counter.fired.load(.monotonic) < 3 and waited < 1000) : (waited += 1) {
+        std.time.sleep(std.time.ns_per_ms);
+    }
+    try testing.expectEqual(@as(u32, 3), counter.fired.load(.monotonic));
+
+    service.cancel(&counter.timer);
+    try testing.expect(!counter.timer.isScheduled());
+}
+
+test "timer wheel with 100k connections" {
+    const count = 100_000;
+    const timers = try testing.allocator.alloc(Timer, count);
+    defer testing.allocator.free(timers);
+
+    var wheel = Wheel{};
+    var prng = std.Random.DefaultPrng.init(0x5EED);
+    const random = prng.random();
+
+    var timer = try std.time.Timer.start();
+    for (timers) |*t| {
+        t.* = Timer.init(noop);
+        // Pings spread over 20 s at 100 ms per tick
+        wheel.schedule(t, random.intRangeAtMost(u64, 1, 200));
+    }
+    const schedule_ns = timer.lap();
+
+    var due = timer_wheel.List{};
+    var fired: usize = 0;
+    var ticks: usize = 0;
+    while (ticks < 200) : (ticks += 1) {
+        wheel.advance(1, &due);
+        while (due.popFirst()) |t| {
+            fired += 1;
+            // Re-arm, as a keepalive does after each ping
+            wheel.schedule(t, 200);
+        }
+    }
+    const turn_ns = timer.read();
+
+    try testing.expectEqual(@as(usize, count), fired);
+    std.debug.print("\ntimer wheel: {d} timers scheduled in {d:.2} ms, 200 ticks firing all in {d:.2} ms ({d:.0} ns/timer)\n", .{
+        count,
+        @as(f64, @floatFromInt(schedule_ns)) / std.time.ns_per_ms,
+        @as(f64, @floatFromInt(turn_ns)) / std.time.ns_per_ms,
+        @as(f64, @floatFromInt(turn_ns)) / count,
+    });
+}
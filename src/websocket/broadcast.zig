@@ -0,0 +1,305 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const frame = @import("frame.zig");
+
+pub const Opcode = frame.Opcode;
+
+/// A server frame encoded once and queued for any number of subscribers.
+/// Each queue holds a reference; the last `release` frees it.
+pub const SharedFrame = struct {
+    allocator: Allocator,
+    refs: std.atomic.Value(u32),
+    /// Header and payload, ready for the wire
+    bytes: []u8,
+
+    /// Encode a final, unmasked frame carrying `payload`. The caller owns
+    /// the one reference it starts with.
+    pub fn create(allocator: Allocator, opcode: frame.Opcode, payload: []const u8) !*SharedFrame {
+        var header_buf: [frame.max_header_size]u8 = undefined;
+        const header = frame.writeHeader(&header_buf, true, opcode, payload.len, null);
+
+        const bytes = try allocator.alloc(u8, header.len + payload.len);
+        errdefer allocator.free(bytes);
+        @memcpy(bytes[0..header.len], header);
+        @memcpy(bytes[header.len..], payload);
+
+        const self = try allocator.create(SharedFrame);
+        self.* = SharedFrame{
+            .allocator = allocator,
+            .refs = std.atomic.Value(u32).init(1),
+            .bytes = bytes,
+        };
+        return self;
+    }
+
+    pub fn retain(self: *SharedFrame) void {
+        _ = self.refs.fetchAdd(1, .monotonic);
+    }
+
+    pub fn release(self: *SharedFrame) void {
+        if (self.refs.fetchSub(1, .release) != 1) return;
+
+        // Pairs with the release above so every holder's reads happen first
+        _ = self.refs.load(.acquire);
+        self.allocator.free(self.bytes);
+        self.allocator.destroy(self);
+    }
+};
+
+/// What to do with a subscriber whose queue is full
+pub const Policy = enum {
+    /// Discard its oldest queued frame to make room; for feeds where only
+    /// the latest state matters
+    drop_oldest,
+    /// Evict it from every group and close the connection
+    disconnect,
+
+    pub fn parse(name: []const u8) ?Policy {
+        if (std.mem.eql(u8, name, "drop")) return .drop_oldest;
+        if (std.mem.eql(u8, name, "disconnect")) return .disconnect;
+        return null;
+    }
+};
+
+/// Outcome of queueing one frame for one subscriber
+pub const Offer = enum { queued, dropped_oldest, evicted };
+
+/// Broadcast frames waiting to be written to one connection.
+///
+/// The mutex and condition belong to whoever drains the queue, so a single
+/// wait covers both its own work and broadcasts.
+pub const Subscriber = struct {
+    const Self = @This();
+
+    mutex: *std.Thread.Mutex,
+    condition: *std.Thread.Condition,
+    pending: std.fifo.LinearFifo(*SharedFrame, .Dynamic),
+    max_pending: usize,
+    policy: Policy,
+    /// Fell behind under `.disconnect`; the drainer should close the
+    /// connection once it sees this
+    evicted: bool = false,
+    /// Frames discarded under `.drop_oldest`
+    dropped: u64 = 0,
+
+    pub fn init(allocator: Allocator, mutex: *std.Thread.Mutex, condition: *std.Thread.Condition, max_pending: usize, policy: Policy) Self {
+        return Self{
+            .mutex = mutex,
+            .condition = condition,
+            .pending = std.fifo.LinearFifo(*SharedFrame, .Dynamic).init(allocator),
+            .max_pending = @max(max_pending, 1),
+            .policy = policy,
+        };
+    }
+
+    /// Release every queued frame. The subscriber must have left all groups.
+    pub fn deinit(self: *Self) void {
+        self.mutex.lock();
+        self.releasePending();
+        self.mutex.unlock();
+
+        self.pending.deinit();
+    }
+
+    /// Queue a reference to `shared` and wake the drainer
+    pub fn offer(self: *Self, shared: *SharedFrame) Offer {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        if (self.evicted) return .evicted;
+
+        var result = Offer.queued;
+        if (self.pending.count >= self.max_pending) {
+            switch (self.policy) {
+                .drop_oldest => {
+                    self.pending.readItem().?.release();
+                    self.dropped += 1;
+                    result = .dropped_oldest;
+                },
+                .disconnect => {
+                    self.evicted = true;
+                    self.releasePending();
+                    self.condition.signal();
+                    return .evicted;
+                },
+            }
+        }
+
+        self.pending.writeItem(shared) catch {
+            // Out of memory counts as falling behind
+            self.dropped += 1;
+            return .dropped_oldest;
+        };
+        shared.retain();
+        self.condition.signal();
+        return result;
+    }
+
+    /// Next frame to write, handing its reference to the caller. Caller
+    /// holds `mutex`.
+    pub fn takeLocked(self: *Self) ?*SharedFrame {
+        return self.pending.readItem();
+    }
+
+    fn releasePending(self: *Self) void {
+        while (self.pending.readItem()) |shared| shared.release();
+    }
+};
+
+/// Result of one publish
+pub const Delivery = struct {
+    /// Subscribers the frame was queued for
+    queued: usize = 0,
+    /// Of those, subscribers that lost an older frame to make room
+    dropped: usize = 0,
+    /// Subscribers evicted for falling behind
+    evicted: usize = 0,
+};
+
+/// Named groups of subscribers. Publishing encodes a frame once and queues
+/// a reference to it for every member; nothing is written to a socket
+/// while the groups are locked.
+pub const Hub = struct {
+    const Self = @This();
+
+    const Members = std.ArrayListUnmanaged(*Subscriber);
+
+    allocator: Allocator,
+    /// Taken before any subscriber's mutex
+    mutex: std.Thread.Mutex = .{},
+    groups: std.StringHashMapUnmanaged(Members) = .{},
+
+    pub fn init(allocator: Allocator) Self {
+        return Self{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Self) void {
+        var it = self.groups.iterator();
+        while (it.next()) |entry| {
+            self.allocator.free(entry.key_ptr.*);
+            entry.value_ptr.deinit(self.allocator);
+        }
+        self.groups.deinit(self.allocator);
+    }
+
+    /// Add `subscriber` to `group`, creating the group if needed. Joining
+    /// twice has no effect; an evicted subscriber cannot rejoin.
+    pub fn join(self: *Self, group: []const u8, subscriber: *Subscriber) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        subscriber.mutex.lock();
+        const evicted = subscriber.evicted;
+        subscriber.mutex.unlock();
+        if (evicted) return error.SubscriberEvicted;
+
+        const entry = try self.groups.getOrPut(self.allocator, group);
+        if (!entry.found_existing) {
+            entry.key_ptr.* = self.allocator.dupe(u8, group) catch |err| {
+                self.groups.removeByPtr(entry.key_ptr);
+                return err;
+            };
+            entry.value_ptr.* = .{};
+        }
+
+        for (entry.value_ptr.items) |member| {
+            if (member == subscriber) return;
+        }
+        try entry.value_ptr.append(self.allocator, subscriber);
+    }
+
+    /// Remove `subscriber` from `group`; empty groups are dropped
+    pub fn leave(self: *Self, group: []const u8, subscriber: *Subscriber) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const members = self.groups.getPtr(group) orelse return;
+        removeMember(members, subscriber);
+        if (members.items.len == 0) self.removeGroup(group);
+    }
+
+    /// Remove `subscriber` from every group, e.g. when its connection ends
+    pub fn leaveAll(self: *Self, subscriber: *Subscriber) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.removeEverywhere(subscriber);
+    }
+
+    /// Members of `group`
+    pub fn memberCount(self: *Self, group: []const u8) usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const members = self.groups.get(group) orelse return 0;
+        return members.items.len;
+    }
+
+    /// Encode `payload` once and queue it for every member of `group`
+    pub fn publish(self: *Self, group: []const u8, opcode: frame.Opcode, payload: []const u8) !Delivery {
+        const shared = try SharedFrame.create(self.allocator, opcode, payload);
+        defer shared.release();
+
+        return self.publishFrame(group, shared);
+    }
+
+    /// Queue an already encoded frame for every member of `group`.
+    /// Subscribers evicted on the way are removed from all groups.
+    pub fn publishFrame(self: *Self, group: []const u8, shared: *SharedFrame) Delivery {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        var delivery = Delivery{};
+        const members = self.groups.getPtr(group) orelse return delivery;
+
+        var evicted = std.ArrayList(*Subscriber).init(self.allocator);
+        defer evicted.deinit();
+
+        for (members.items) |subscriber| {
+            switch (subscriber.offer(shared)) {
+                .queued => delivery.queued += 1,
+                .dropped_oldest => {
+                    delivery.queued += 1;
+                    delivery.dropped += 1;
+                },
+                .evicted => {
+                    delivery.evicted += 1;
+                    evicted.append(subscriber) catch {};
+                },
+            }
+        }
+
+        // An evicted subscriber may belong to other groups too
+        for (evicted.items) |subscriber| self.removeEverywhere(subscriber);
+
+        return delivery;
+    }
+
+    fn removeEverywhere(self: *Self, subscriber: *Subscriber) void {
+        var empty = std.ArrayList([]const u8).init(self.allocator);
+        defer empty.deinit();
+
+        var it = self.groups.iterator();
+        while (it.next()) |entry| {
+            removeMember(entry.value_ptr, subscriber);
+            if (entry.value_ptr.items.len == 0) empty.append(entry.key_ptr.*) catch {};
+        }
+        for (empty.items) |group| self.removeGroup(group);
+    }
+
+    fn removeGroup(self: *Self, group: []const u8) void {
+        const entry = self.groups.fetchRemove(group) orelse return;
+        var members = entry.value;
+        members.deinit(self.allocator);
+        self.allocator.free(entry.key);
+    }
+
+    fn removeMember(members: *Members, subscriber: *Subscriber) void {
+        for (members.items, 0..) |member, i| {
+            if (member == subscriber) {
+                _ = members.swapRemove(i);
+                return;
+            }
+        }
+    }
+};
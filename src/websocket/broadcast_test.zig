@@ -0,0 +1,125 @@
+const std = @import("std");
+const testing = std.testing;
+const broadcast = @import("broadcast.zig");
+const frame = @import("frame.zig");
+
+/// A subscriber with its own lock, standing in for a connection's writer
+const TestSubscriber = struct {
+    mutex: std.Thread.Mutex = .{},
+    condition: std.Thread.Condition = .{},
+    subscriber: broadcast.Subscriber = undefined,
+
+    fn init(self: *TestSubscriber, max_pending: usize, policy: broadcast.Policy) void {
+        self.subscriber = broadcast.Subscriber.init(testing.allocator, &self.mutex, &self.condition, max_pending, policy);
+    }
+
+    /// Payloads of the queued frames, oldest first
+    fn expectPending(self: *TestSubscriber, expected: []const []const u8) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        try testing.expectEqual(expected.len, self.subscriber.pending.count);
+        for (expected, 0..) |payload, i| {
+            const shared = self.subscriber.pending.peekItem(i);
+            const header = (try frame.FrameHeader.parse(shared.bytes)).?;
+            try testing.expectEqualStrings(payload, shared.bytes[header.size..]);
+        }
+    }
+};
+
+test "SharedFrame encodes a final unmasked frame" {
+    const shared = try broadcast.SharedFrame.create(testing.allocator, .binary, "abc");
+    defer shared.release();
+
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x82, 0x03, 'a', 'b', 'c' }, shared.bytes);
+
+    // Extra references keep it alive until the last release
+    shared.retain();
+    shared.release();
+    try testing.expectEqual(@as(u32, 1), shared.refs.load(.monotonic));
+}
+
+test "publish encodes once and queues for every member" {
+    var hub = broadcast.Hub.init(testing.allocator);
+    defer hub.deinit();
+
+    var a = TestSubscriber{};
+    a.init(8, .drop_oldest);
+    defer a.subscriber.deinit();
+    var b = TestSubscriber{};
+    b.init(8, .drop_oldest);
+    defer b.subscriber.deinit();
+
+    try hub.join("room", &a.subscriber);
+    try hub.join("room", &b.subscriber);
+    try hub.join("room", &b.subscriber);
+    try testing.expectEqual(@as(usize, 2), hub.memberCount("room"));
+
+    const shared = try broadcast.SharedFrame.create(testing.allocator, .text, "hi");
+    defer shared.release();
+
+    const delivery = hub.publishFrame("room", shared);
+    try testing.expectEqual(@as(usize, 2), delivery.queued);
+    // One reference here and one per queue, all on the same buffer
+    try testing.expectEqual(@as(u32, 3), shared.refs.load(.monotonic));
+    try a.expectPending(&.{"hi"});
+    try b.expectPending(&.{"hi"});
+
+    try testing.expectEqual(@as(usize, 0), (try hub.publish("empty", .text, "nobody")).queued);
+
+    hub.leave("room", &a.subscriber);
+    hub.leaveAll(&b.subscriber);
+    try testing.expectEqual(@as(usize, 0), hub.memberCount("room"));
+}
+
+test "drop_oldest keeps the newest frames" {
+    var hub = broadcast.Hub.init(testing.allocator);
+    defer hub.deinit();
+
+    var slow = TestSubscriber{};
+    slow.init(2, .drop_oldest);
+    defer slow.subscriber.deinit();
+    try hub.join("ticks", &slow.subscriber);
+
+    _ = try hub.publish("ticks", .text, "1");
+    _ = try hub.publish("ticks", .text, "2");
+    const delivery = try hub.publish("ticks", .text, "3");
+
+    try testing.expectEqual(@as(usize, 1), delivery.queued);
+    try testing.expectEqual(@as(usize, 1), delivery.dropped);
+    try testing.expectEqual(@as(u64, 1), slow.subscriber.dropped);
+    try slow.expectPending(&.{ "2", "3" });
+
+    hub.leaveAll(&slow.subscriber);
+}
+
+test "disconnect evicts a slow subscriber from every group" {
+    var hub = broadcast.Hub.init(testing.allocator);
+    defer hub.deinit();
+
+    var slow = TestSubscriber{};
+    slow.init(1, .disconnect);
+    defer slow.subscriber.deinit();
+    var fast = TestSubscriber{};
+    fast.init(8, .disconnect);
+    defer fast.subscriber.deinit();
+
+    try hub.join("a", &slow.subscriber);
+    try hub.join("b", &slow.subscriber);
+    try hub.join("a", &fast.subscriber);
+
+    _ = try hub.publish("a", .text, "1");
+    const delivery = try hub.publish("a", .text, "2");
+
+    try testing.expectEqual(@as(usize, 1), delivery.queued);
+    try testing.expectEqual(@as(usize, 1), delivery.evicted);
+    try testing.expect(slow.subscriber.evicted);
+    try slow.expectPending(&.{});
+    try fast.expectPending(&.{ "1", "2" });
+
+    try testing.expectEqual(@as(usize, 1), hub.memberCount("a"));
+    try testing.expectEqual(@as(usize, 0), hub.memberCount("b"));
+    try testing.expectError(error.SubscriberEvicted, hub.join("a", &slow.subscriber));
+
+    hub.leaveAll(&fast.subscriber);
+}
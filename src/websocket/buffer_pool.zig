@@ -0,0 +1,71 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+
+/// Fixed-size buffers shared by many connections. A connection borrows one
+/// only while it has bytes to handle and gives it back when it goes idle,
+/// so memory follows the number of busy connections rather than open ones.
+/// Thread safe.
+pub const BufferPool = struct {
+    const Self = @This();
+
+    allocator: Allocator,
+    /// Size of every buffer the pool hands out
+    buffer_size: usize,
+    /// Returned buffers kept for reuse; any beyond this are freed
+    max_idle: usize,
+    mutex: std.Thread.Mutex = .{},
+    idle: std.ArrayListUnmanaged([]u8) = .{},
+    /// Buffers handed out and not yet returned
+    in_use: usize = 0,
+
+    pub const Stats = struct {
+        in_use: usize,
+        idle: usize,
+    };
+
+    pub fn init(allocator: Allocator, buffer_size: usize, max_idle: usize) Self {
+        return Self{
+            .allocator = allocator,
+            .buffer_size = buffer_size,
+            .max_idle = max_idle,
+        };
+    }
+
+    /// Free the idle buffers. Every borrowed buffer must have been returned.
+    pub fn deinit(self: *Self) void {
+        for (self.idle.items) |buffer| self.allocator.free(buffer);
+        self.idle.deinit(self.allocator);
+    }
+
+    /// Borrow a buffer of `buffer_size` bytes. Its contents are undefined.
+    pub fn acquire(self: *Self) ![]u8 {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const buffer = self.idle.pop() orelse try self.allocator.alloc(u8, self.buffer_size);
+        self.in_use += 1;
+        return buffer;
+    }
+
+    /// Give back a buffer from `acquire`
+    pub fn release(self: *Self, buffer: []u8) void {
+        std.debug.assert(buffer.len == self.buffer_size);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        self.in_use -= 1;
+        if (self.idle.items.len >= self.max_idle) {
+            self.allocator.free(buffer);
+            return;
+        }
+        self.idle.append(self.allocator, buffer) catch self.allocator.free(buffer);
+    }
+
+    pub fn stats(self: *Self) Stats {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        return Stats{ .in_use = self.in_use, .idle = self.idle.items.len };
+    }
+};
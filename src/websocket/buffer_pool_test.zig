@@ -0,0 +1,30 @@
+const std = @import("std");
+const testing = std.testing;
+const BufferPool = @import("buffer_pool.zig").BufferPool;
+
+test "BufferPool reuses returned buffers" {
+    var pool = BufferPool.init(testing.allocator, 64, 2);
+    defer pool.deinit();
+
+    const first = try pool.acquire();
+    try testing.expectEqual(@as(usize, 64), first.len);
+    try testing.expectEqual(BufferPool.Stats{ .in_use = 1, .idle = 0 }, pool.stats());
+
+    pool.release(first);
+    try testing.expectEqual(BufferPool.Stats{ .in_use = 0, .idle = 1 }, pool.stats());
+
+    const again = try pool.acquire();
+    try testing.expectEqual(first.ptr, again.ptr);
+    pool.release(again);
+}
+
+test "BufferPool frees buffers beyond max_idle" {
+    var pool = BufferPool.init(testing.allocator, 64, 2);
+    defer pool.deinit();
+
+    var buffers: [4][]u8 = undefined;
+    for (&buffers) |*buffer| buffer.* = try pool.acquire();
+    for (buffers) |buffer| pool.release(buffer);
+
+    try testing.expectEqual(BufferPool.Stats{ .in_use = 0, .idle = 2 }, pool.stats());
+}
@@ -0,0 +1,303 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const flate = std.compress.flate;
+
+/// Extension token in Sec-WebSocket-Extensions (RFC 7692)
+pub const extension_name = "permessage-deflate";
+
+/// Tail of a sync flush. Stripped from every compressed message and put
+/// back before inflating (RFC 7692 section 7.2.1).
+const sync_marker = [_]u8{ 0x00, 0x00, 0xFF, 0xFF };
+
+/// Sync marker followed by an empty final stored block, so each message
+/// inflates as a complete deflate stream
+const inflate_tail = sync_marker ++ [_]u8{ 0x01, 0x00, 0x00, 0xFF, 0xFF };
+
+/// Messages shorter than this go out uncompressed; the deflate framing
+/// would cost more than it saves
+pub const min_compress_size = 64;
+
+/// Compressor writing into a growable buffer. Holds the 32 KiB history
+/// window plus match tables, which is what context takeover keeps alive.
+const Deflater = flate.Compressor(std.ArrayList(u8).Writer);
+
+/// Memory a connection keeps between messages when it uses context
+/// takeover for the messages it sends
+pub const retained_context_size = @sizeOf(Deflater);
+
+/// Parameters of the first acceptable offer in a Sec-WebSocket-Extensions
+/// request header
+pub const Offer = struct {
+    /// The client asked us not to carry history between messages
+    server_no_context_takeover: bool = false,
+    /// The client sent server_max_window_bits (of 15), which the response
+    /// must then repeat
+    server_max_window_bits: bool = false,
+
+    /// Pick the first permessage-deflate offer we can honour. Offers that
+    /// limit our window below 15 bits are skipped: std.compress.flate
+    /// always compresses with a 32 KiB window.
+    pub fn negotiate(header: []const u8) ?Offer {
+        var offers = std.mem.splitScalar(u8, header, ',');
+        offers: while (offers.next()) |offer| {
+            var params = std.mem.splitScalar(u8, offer, ';');
+            const name = std.mem.trim(u8, params.next() orelse continue, " \t");
+            if (!std.ascii.eqlIgnoreCase(name, extension_name)) continue;
+
+            var result = Offer{};
+            while (params.next()) |param| {
+                var parts = std.mem.splitScalar(u8, std.mem.trim(u8, param, " \t"), '=');
+                const key = std.mem.trim(u8, parts.next().?, " \t");
+                if (key.len == 0) continue;
+                const value: ?[]const u8 = if (parts.next()) |v| std.mem.trim(u8, std.mem.trim(u8, v, " \t"), "\"") else null;
+
+                if (std.ascii.eqlIgnoreCase(key, "server_no_context_takeover")) {
+                    if (value != null or result.server_no_context_takeover) continue :offers;
+                    result.server_no_context_takeover = true;
+                } else if (std.ascii.eqlIgnoreCase(key, "client_no_context_takeover")) {
+                    if (value != null) continue :offers;
+                } else if (std.ascii.eqlIgnoreCase(key, "server_max_window_bits")) {
+                    const bits = parseWindowBits(value orelse continue :offers) orelse continue :offers;
+                    if (bits < 15) continue :offers;
+                    result.server_max_window_bits = true;
+                } else if (std.ascii.eqlIgnoreCase(key, "client_max_window_bits")) {
+                    // Any client window inflates with our 32 KiB window
+                    if (value) |v| _ = parseWindowBits(v) orelse continue :offers;
+                } else {
+                    continue :offers;
+                }
+            }
+            return result;
+        }
+        return null;
+    }
+
+    /// Format the response header value. We always ask the client for
+    /// client_no_context_takeover (section 7.1.1.2) so each incoming
+    /// message inflates on its own and no inflate state outlives it.
+    pub fn response(self: Offer, context_takeover: bool, buf: []u8) ![]const u8 {
+        var stream = std.io.fixedBufferStream(buf);
+        const writer = stream.writer();
+
+        try writer.writeAll(extension_name ++ "; client_no_context_takeover");
+        if (!context_takeover) try writer.writeAll("; server_no_context_takeover");
+        if (self.server_max_window_bits) try writer.writeAll("; server_max_window_bits=15");
+
+        return stream.getWritten();
+    }
+};
+
+fn parseWindowBits(value: []const u8) ?u4 {
+    const bits = std.fmt.parseInt(u8, value, 10) catch return null;
+    if (bits < 8 or bits > 15) return null;
+    return @intCast(bits);
+}
+
+/// Process-wide compression counters
+pub const Metrics = struct {
+    /// Connections currently keeping a compression context between messages
+    active_contexts: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+    messages_compressed: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    compress_bytes_in: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    compress_bytes_out: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    compress_ns: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    messages_inflated: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    inflate_bytes_in: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    inflate_bytes_out: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+    inflate_ns: std.atomic.Value(u64) = std.atomic.Value(u64).init(0),
+
+    pub fn snapshot(self: *const Metrics) Snapshot {
+        return Snapshot{
+            .active_contexts = self.active_contexts.load(.monotonic),
+            .messages_compressed = self.messages_compressed.load(.monotonic),
+            .compress_bytes_in = self.compress_bytes_in.load(.monotonic),
+            .compress_bytes_out = self.compress_bytes_out.load(.monotonic),
+            .compress_ns = self.compress_ns.load(.monotonic),
+            .messages_inflated = self.messages_inflated.load(.monotonic),
+            .inflate_bytes_in = self.inflate_bytes_in.load(.monotonic),
+            .inflate_bytes_out = self.inflate_bytes_out.load(.monotonic),
+            .inflate_ns = self.inflate_ns.load(.monotonic),
+        };
+    }
+};
+
+/// Point-in-time copy of `Metrics`
+pub const Snapshot = struct {
+    active_contexts: u32,
+    messages_compressed: u64,
+    compress_bytes_in: u64,
+    compress_bytes_out: u64,
+    compress_ns: u64,
+    messages_inflated: u64,
+    inflate_bytes_in: u64,
+    inflate_bytes_out: u64,
+    inflate_ns: u64,
+
+    /// Uncompressed over compressed size of everything sent; 1 when
+    /// nothing has been compressed yet
+    pub fn compressionRatio(self: Snapshot) f64 {
+        if (self.compress_bytes_out == 0) return 1;
+        return @as(f64, @floatFromInt(self.compress_bytes_in)) / @as(f64, @floatFromInt(self.compress_bytes_out));
+    }
+
+    /// CPU time spent compressing per uncompressed byte
+    pub fn compressNsPerByte(self: Snapshot) f64 {
+        if (self.compress_bytes_in == 0) return 0;
+        return @as(f64, @floatFromInt(self.compress_ns)) / @as(f64, @floatFromInt(self.compress_bytes_in));
+    }
+
+    /// CPU time spent inflating per inflated byte
+    pub fn inflateNsPerByte(self: Snapshot) f64 {
+        if (self.inflate_bytes_out == 0) return 0;
+        return @as(f64, @floatFromInt(self.inflate_ns)) / @as(f64, @floatFromInt(self.inflate_bytes_out));
+    }
+};
+
+pub var metrics: Metrics = .{};
+
+/// Claim one of `max_contexts` process-wide slots for a retained context
+fn acquireContextSlot(max_contexts: u32) bool {
+    var current = metrics.active_contexts.load(.monotonic);
+    while (current < max_contexts) {
+        current = metrics.active_contexts.cmpxchgWeak(current, current + 1, .monotonic, .monotonic) orelse return true;
+    }
+    return false;
+}
+
+fn elapsedSince(start: ?std.time.Instant) u64 {
+    const begin = start orelse return 0;
+    const now = std.time.Instant.now() catch return 0;
+    return now.since(begin);
+}
+
+/// Reads a compressed message followed by `inflate_tail` without copying
+/// the two together
+const MessageSource = struct {
+    parts: [2][]const u8,
+    index: usize = 0,
+
+    const Reader = std.io.GenericReader(*MessageSource, error{}, read);
+
+    fn reader(self: *MessageSource) Reader {
+        return .{ .context = self };
+    }
+
+    fn read(self: *MessageSource, buffer: []u8) error{}!usize {
+        while (self.index < self.parts.len) {
+            const part = self.parts[self.index];
+            if (part.len == 0) {
+                self.index += 1;
+                continue;
+            }
+
+            const n = @min(part.len, buffer.len);
+            @memcpy(buffer[0..n], part[0..n]);
+            self.parts[self.index] = part[n..];
+            return n;
+        }
+        return 0;
+    }
+};
+
+const Inflater = flate.Decompressor(MessageSource.Reader);
+
+/// permessage-deflate state for one connection. Compression runs on the
+/// sending side only and inflation on the receiving side only, so the two
+/// halves may be used from different threads.
+pub const Codec = struct {
+    const Self = @This();
+
+    allocator: Allocator,
+    /// Compressed output of the last `compress`
+    output: std.ArrayList(u8),
+    /// Compressor kept between messages under context takeover; created
+    /// on the first compressed message
+    deflater: ?*Deflater = null,
+    context_takeover: bool,
+
+    /// Create the codec for a negotiated offer. Context takeover is used
+    /// only when the client allows it, `memory_budget` covers the retained
+    /// compressor and a process-wide slot is free; otherwise every message
+    /// is compressed from scratch and nothing is kept between messages.
+    pub fn create(allocator: Allocator, offer: Offer, memory_budget: usize, max_contexts: u32) !*Self {
+        const self = try allocator.create(Self);
+        errdefer allocator.destroy(self);
+
+        const context_takeover = !offer.server_no_context_takeover and
+            retained_context_size <= memory_budget and
+            acquireContextSlot(max_contexts);
+
+        self.* = Self{
+            .allocator = allocator,
+            .output = std.ArrayList(u8).init(allocator),
+            .context_takeover = context_takeover,
+        };
+        return self;
+    }
+
+    pub fn destroy(self: *Self) void {
+        if (self.deflater) |deflater| self.allocator.destroy(deflater);
+        if (self.context_takeover) _ = metrics.active_contexts.fetchSub(1, .monotonic);
+        self.output.deinit();
+        self.allocator.destroy(self);
+    }
+
+    /// Compress one message. The result is borrowed until the next call.
+    pub fn compress(self: *Self, data: []const u8) ![]const u8 {
+        const started = std.time.Instant.now() catch null;
+
+        self.output.clearRetainingCapacity();
+
+        const deflater = self.deflater orelse blk: {
+            const created = try self.allocator.create(Deflater);
+            errdefer self.allocator.destroy(created);
+            created.* = try flate.compressor(self.output.writer(), .{});
+
+            if (self.context_takeover) self.deflater = created;
+            break :blk created;
+        };
+        defer if (!self.context_takeover) self.allocator.destroy(deflater);
+
+        try deflater.writer().writeAll(data);
+        try deflater.flush();
+
+        var compressed = self.output.items;
+        if (std.mem.endsWith(u8, compressed, &sync_marker)) {
+            compressed = compressed[0 .. compressed.len - sync_marker.len];
+        }
+
+        _ = metrics.messages_compressed.fetchAdd(1, .monotonic);
+        _ = metrics.compress_bytes_in.fetchAdd(data.len, .monotonic);
+        _ = metrics.compress_bytes_out.fetchAdd(compressed.len, .monotonic);
+        _ = metrics.compress_ns.fetchAdd(elapsedSince(started), .monotonic);
+
+        return compressed;
+    }
+
+    /// Inflate one message into `out`, replacing its contents. Fails with
+    /// error.MessageTooBig as soon as the output passes `max_size`, so a
+    /// small message cannot expand without bound.
+    pub fn inflate(self: *Self, input: []const u8, out: *std.ArrayList(u8), max_size: usize) !void {
+        const started = std.time.Instant.now() catch null;
+
+        var source = MessageSource{ .parts = .{ input, &inflate_tail } };
+        const inflater = try self.allocator.create(Inflater);
+        defer self.allocator.destroy(inflater);
+        inflater.* = flate.decompressor(source.reader());
+
+        out.clearRetainingCapacity();
+        while (true) {
+            try out.ensureUnusedCapacity(16 * 1024);
+            const n = inflater.read(out.unusedCapacitySlice()) catch return error.InvalidCompressedData;
+            if (n == 0) break;
+
+            out.items.len += n;
+            if (out.items.len > max_size) return error.MessageTooBig;
+        }
+
+        _ = metrics.messages_inflated.fetchAdd(1, .monotonic);
+        _ = metrics.inflate_bytes_in.fetchAdd(input.len, .monotonic);
+        _ = metrics.inflate_bytes_out.fetchAdd(out.items.len, .monotonic);
+        _ = metrics.inflate_ns.fetchAdd(elapsedSince(started), .monotonic);
+    }
+};
@@ -0,0 +1,121 @@
+const std = @import("std");
+const testing = std.testing;
+const deflate = @import("deflate.zig");
+
+const sample = "{\"event\":\"tick\",\"symbol\":\"LDBG\",\"price\":101.25,\"volume\":1200}" ** 8;
+
+test "negotiate accepts a plain offer" {
+    const offer = deflate.Offer.negotiate("permessage-deflate; client_max_window_bits").?;
+    try testing.expect(!offer.server_no_context_takeover);
+    try testing.expect(!offer.server_max_window_bits);
+
+    var buf: [128]u8 = undefined;
+    try testing.expectEqualStrings(
+        "permessage-deflate; client_no_context_takeover",
+        try offer.response(true, &buf),
+    );
+}
+
+test "negotiate skips offers it cannot honour" {
+    try testing.expect(deflate.Offer.negotiate("x-webkit-deflate-frame") == null);
+    try testing.expect(deflate.Offer.negotiate("permessage-deflate; server_max_window_bits=10") == null);
+    try testing.expect(deflate.Offer.negotiate("permessage-deflate; unknown_param") == null);
+
+    // The second offer is acceptable once the first is ruled out
+    const offer = deflate.Offer.negotiate(
+        "permessage-deflate; server_max_window_bits=9, permessage-deflate; server_no_context_takeover; server_max_window_bits=15",
+    ).?;
+    try testing.expect(offer.server_no_context_takeover);
+    try testing.expect(offer.server_max_window_bits);
+
+    var buf: [128]u8 = undefined;
+    try testing.expectEqualStrings(
+        "permessage-deflate; client_no_context_takeover; server_no_context_takeover; server_max_window_bits=15",
+        try offer.response(false, &buf),
+    );
+}
+
+test "compress and inflate round trip" {
+    const codec = try deflate.Codec.create(testing.allocator, .{}, 0, 0);
+    defer codec.destroy();
+    try testing.expect(!codec.context_takeover);
+
+    const compressed = try codec.compress(sample);
+    try testing.expect(compressed.len < sample.len);
+    try testing.expect(!std.mem.endsWith(u8, compressed, &[_]u8{ 0x00, 0x00, 0xFF, 0xFF }));
+
+    // Copy out, as the next compress reuses the buffer
+    const wire = try testing.allocator.dupe(u8, compressed);
+    defer testing.allocator.free(wire);
+
+    var out = std.ArrayList(u8).init(testing.allocator);
+    defer out.deinit();
+    try codec.inflate(wire, &out, sample.len);
+    try testing.expectEqualStrings(sample, out.items);
+}
+
+test "inflate stops at the size limit" {
+    const codec = try deflate.Codec.create(testing.allocator, .{}, 0, 0);
+    defer codec.destroy();
+
+    const zeros = [_]u8{0} ** (64 * 1024);
+    const wire = try testing.allocator.dupe(u8, try codec.compress(&zeros));
+    defer testing.allocator.free(wire);
+
+    var out = std.ArrayList(u8).init(testing.allocator);
+    defer out.deinit();
+    try testing.expectError(error.MessageTooBig, codec.inflate(wire, &out, 1024));
+}
+
+test "inflate rejects garbage" {
+    const codec = try deflate.Codec.create(testing.allocator, .{}, 0, 0);
+    defer codec.destroy();
+
+    var out = std.ArrayList(u8).init(testing.allocator);
+    defer out.deinit();
+    try testing.expectError(error.InvalidCompressedData, codec.inflate(&[_]u8{ 0xFF, 0xFF, 0xFF }, &out, 1024));
+}
+
+test "context takeover shrinks repeated messages within the limits" {
+    const before = deflate.metrics.active_contexts.load(.monotonic);
+
+    const codec = try deflate.Codec.create(testing.allocator, .{}, deflate.retained_context_size, before + 1);
+    try testing.expect(codec.context_takeover);
+    try testing.expectEqual(before + 1, deflate.metrics.active_contexts.load(.monotonic));
+
+    // The global cap is reached, so the next connection compresses statelessly
+    const capped = try deflate.Codec.create(testing.allocator, .{}, deflate.retained_context_size, before + 1);
+    try testing.expect(!capped.context_takeover);
+    capped.destroy();
+
+    const first_len = (try codec.compress(sample)).len;
+    const second_len = (try codec.compress(sample)).len;
+    try testing.expect(second_len < first_len);
+
+    codec.destroy();
+    try testing.expectEqual(before, deflate.metrics.active_contexts.load(.monotonic));
+}
+
+test "server_no_context_takeover and a small budget disable takeover" {
+    const refused = try deflate.Codec.create(testing.allocator, .{ .server_no_context_takeover = true }, std.math.maxInt(usize), 1024);
+    defer refused.destroy();
+    try testing.expect(!refused.context_takeover);
+
+    const small = try deflate.Codec.create(testing.allocator, .{}, deflate.retained_context_size - 1, 1024);
+    defer small.destroy();
+    try testing.expect(!small.context_takeover);
+}
+
+test "metrics report the compression ratio" {
+    const before = deflate.metrics.snapshot();
+
+    const codec = try deflate.Codec.create(testing.allocator, .{}, 0, 0);
+    defer codec.destroy();
+    const compressed_len = (try codec.compress(sample)).len;
+
+    const after = deflate.metrics.snapshot();
+    try testing.expectEqual(before.messages_compressed + 1, after.messages_compressed);
+    try testing.expectEqual(before.compress_bytes_in + sample.len, after.compress_bytes_in);
+    try testing.expectEqual(before.compress_bytes_out + compressed_len, after.compress_bytes_out);
+    try testing.expect(after.compressionRatio() > 1);
+}
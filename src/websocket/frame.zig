@@ -0,0 +1,342 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const mask = @import("mask.zig");
+const utf8 = @import("utf8.zig");
+const BufferPool = @import("buffer_pool.zig").BufferPool;
+
+/// WebSocket frame opcodes
+pub const Opcode = enum(u4) {
+    continuation = 0x0,
+    text = 0x1,
+    binary = 0x2,
+    close = 0x8,
+    ping = 0x9,
+    pong = 0xA,
+    _,
+
+    /// Close, ping and pong frames (opcodes 0x8-0xF)
+    pub fn isControl(self: Opcode) bool {
+        return @intFromEnum(self) & 0x8 != 0;
+    }
+
+    fn isKnown(self: Opcode) bool {
+        return switch (self) {
+            .continuation, .text, .binary, .close, .ping, .pong => true,
+            _ => false,
+        };
+    }
+};
+
+/// Longest possible frame header: 2 fixed bytes, an 8-byte extended
+/// length and a 4-byte masking key
+pub const max_header_size = 14;
+
+/// Largest payload accepted in a single frame unless configured otherwise
+pub const default_max_frame_size: usize = 16 * 1024 * 1024;
+
+/// Decoded fixed part of a frame (RFC 6455 section 5.2)
+pub const FrameHeader = struct {
+    fin: bool,
+    /// RSV1-3 as the low three bits (RSV1 = 0b100)
+    rsv: u3,
+    opcode: Opcode,
+    mask_key: ?[4]u8,
+    payload_len: u64,
+    /// Bytes taken by the header itself
+    size: usize,
+
+    /// Parse a header from the start of `bytes`. Returns null when the
+    /// header has not fully arrived yet.
+    pub fn parse(bytes: []const u8) !?FrameHeader {
+        if (bytes.len < 2) return null;
+
+        const fin = bytes[0] & 0x80 != 0;
+        const rsv: u3 = @intCast((bytes[0] >> 4) & 0x07);
+        const opcode: Opcode = @enumFromInt(bytes[0] & 0x0F);
+        const masked = bytes[1] & 0x80 != 0;
+        const short_len: u7 = @intCast(bytes[1] & 0x7F);
+
+        var size: usize = 2;
+        var payload_len: u64 = short_len;
+        if (short_len == 126) {
+            if (bytes.len < size + 2) return null;
+            payload_len = std.mem.readInt(u16, bytes[2..4], .big);
+            // Lengths must use the shortest encoding
+            if (payload_len < 126) return error.ProtocolError;
+            size += 2;
+        } else if (short_len == 127) {
+            if (bytes.len < size + 8) return null;
+            payload_len = std.mem.readInt(u64, bytes[2..10], .big);
+            // The most significant bit must be zero
+            if (payload_len >> 63 != 0 or payload_len <= 0xFFFF) return error.ProtocolError;
+            size += 8;
+        }
+
+        var mask_key: ?[4]u8 = null;
+        if (masked) {
+            if (bytes.len < size + 4) return null;
+            mask_key = bytes[size..][0..4].*;
+            size += 4;
+        }
+
+        if (!opcode.isKnown()) return error.InvalidOpcode;
+        if (opcode.isControl() and (!fin or payload_len > 125)) return error.ProtocolError;
+
+        return FrameHeader{
+            .fin = fin,
+            .rsv = rsv,
+            .opcode = opcode,
+            .mask_key = mask_key,
+            .payload_len = payload_len,
+            .size = size,
+        };
+    }
+};
+
+/// A complete frame. `payload` is already unmasked and points into the
+/// reader's buffer; it stays valid until the next `fill` or `feed`.
+pub const Frame = struct {
+    fin: bool,
+    rsv: u3,
+    opcode: Opcode,
+    payload: []u8,
+    /// The text message this frame belongs to has been all ASCII up to
+    /// and including this frame. Only known for text checked on the way
+    /// in (see `FrameReader.validate_utf8`); false otherwise.
+    ascii: bool = false,
+};
+
+/// Per-connection read buffer. Each `fill` is a single read of whatever
+/// the socket has, and `next` then hands out every complete frame in the
+/// buffer, so several small frames cost one syscall and a frame split
+/// across reads simply waits for the rest.
+pub const FrameReader = struct {
+    const Self = @This();
+
+    /// Initial buffer size, and the least free space offered to a read
+    pub const min_read_size = 16 * 1024;
+
+    allocator: Allocator,
+    buffer: []u8 = &.{},
+    start: usize = 0,
+    end: usize = 0,
+    max_frame_size: usize,
+    /// Servers must reject unmasked frames from clients (section 5.1)
+    require_mask: bool,
+    /// RSV bits a negotiated extension gives meaning to
+    allowed_rsv: u3 = 0,
+    /// Size of the incomplete frame at `start`, once its header is known
+    pending_frame_size: usize = 0,
+    /// Source of the buffer, when it is borrowed rather than owned; see
+    /// `releaseBuffer`
+    pool: ?*BufferPool = null,
+    /// `buffer` came from `pool`
+    pooled: bool = false,
+    /// Check that text is UTF-8 while unmasking it (RFC 6455 section 8.1).
+    /// Compressed messages are left to whoever inflates them.
+    validate_utf8: bool = true,
+    /// UTF-8 state of the uncompressed text message being received, which
+    /// may be split across fragments
+    text: ?utf8.Validator = null,
+
+    /// The buffer is allocated on the first read
+    pub fn init(allocator: Allocator, max_frame_size: usize, require_mask: bool) Self {
+        return Self{
+            .allocator = allocator,
+            .max_frame_size = max_frame_size,
+            .require_mask = require_mask,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.dropBuffer();
+        self.* = undefined;
+    }
+
+    /// Bytes received but not yet consumed as frames
+    pub fn buffered(self: *const Self) []const u8 {
+        return self.buffer[self.start..self.end];
+    }
+
+    /// Every byte read has been handed out as a frame
+    pub fn isDrained(self: *const Self) bool {
+        return self.start == self.end;
+    }
+
+    /// Give the buffer back to the pool, or free it, while nothing is
+    /// buffered. The next read takes a fresh one. Frames handed out
+    /// earlier are invalidated.
+    pub fn releaseBuffer(self: *Self) void {
+        if (!self.isDrained()) return;
+
+        self.dropBuffer();
+        self.buffer = &.{};
+        self.start = 0;
+        self.end = 0;
+    }
+
+    /// Read once from `fd` into the free tail of the buffer. Frames handed
+    /// out earlier are invalidated. Returns 0 on EOF.
+    pub fn fill(self: *Self, fd: std.posix.fd_t) !usize {
+        try self.reserve(min_read_size);
+
+        const bytes_read = try std.posix.read(fd, self.buffer[self.end..]);
+        self.end += bytes_read;
+        return bytes_read;
+    }
+
+    /// Append bytes that were read elsewhere
+    pub fn feed(self: *Self, data: []const u8) !void {
+        try self.reserve(data.len);
+
+        @memcpy(self.buffer[self.end..][0..data.len], data);
+        self.end += data.len;
+    }
+
+    /// Next complete frame in the buffer, or null if more bytes are needed
+    pub fn next(self: *Self) !?Frame {
+        const available = self.buffer[self.start..self.end];
+        const header = try FrameHeader.parse(available) orelse return null;
+
+        if (header.rsv & ~self.allowed_rsv != 0) return error.ProtocolError;
+        if (self.require_mask and header.mask_key == null) return error.UnmaskedFrame;
+        if (header.payload_len > self.max_frame_size) return error.FrameTooLarge;
+
+        const total = header.size + @as(usize, @intCast(header.payload_len));
+        if (available.len < total) {
+            self.pending_frame_size = total;
+            return null;
+        }
+
+        self.pending_frame_size = 0;
+        self.start += total;
+
+        const payload = available[header.size..total];
+        const ascii = try self.unmask(header, payload);
+
+        return Frame{
+            .fin = header.fin,
+            .rsv = header.rsv,
+            .opcode = header.opcode,
+            .payload = payload,
+            .ascii = ascii,
+        };
+    }
+
+    /// Unmask a payload, validating text as it goes. A close frame's
+    /// reason is text too. Returns whether the text message has been
+    /// all ASCII so far.
+    fn unmask(self: *Self, header: FrameHeader, payload: []u8) !bool {
+        var validator: ?*utf8.Validator = null;
+        if (self.validate_utf8) {
+            switch (header.opcode) {
+                .text => self.text = if (header.rsv & 0b100 == 0) utf8.Validator{} else null,
+                .binary => self.text = null,
+                else => {},
+            }
+            if (header.opcode == .text or header.opcode == .continuation) {
+                if (self.text) |*text| validator = text;
+            }
+        }
+
+        if (validator) |text| {
+            if (header.mask_key) |key| utf8.unmaskAndValidate(key, payload, 0, text) else text.feed(payload);
+
+            if (!text.isValid() or (header.fin and !text.isComplete())) return error.InvalidUtf8;
+            const ascii = text.ascii;
+            if (header.fin) self.text = null;
+            return ascii;
+        }
+
+        if (header.mask_key) |key| mask.applyMask(key, payload, 0);
+
+        if (self.validate_utf8 and header.opcode == .close and payload.len > 2) {
+            if (!utf8.validate(payload[2..])) return error.InvalidUtf8;
+        }
+        return false;
+    }
+
+    /// Make room for at least `wanted` more bytes, and for the whole of a
+    /// partially received frame
+    fn reserve(self: *Self, wanted: usize) !void {
+        self.compact();
+
+        const needed = @max(self.end + wanted, self.pending_frame_size);
+        if (needed <= self.buffer.len) return;
+
+        const limit = self.max_frame_size + max_header_size + min_read_size;
+        if (self.end + wanted > limit) return error.ReadBufferFull;
+
+        if (self.pool) |pool| {
+            if (self.buffer.len == 0 and needed <= pool.buffer_size) {
+                self.buffer = try pool.acquire();
+                self.pooled = true;
+                return;
+            }
+        }
+
+        const new_len = @min(@max(needed, 2 * self.buffer.len, min_read_size), limit);
+        if (!self.pooled) {
+            self.buffer = try self.allocator.realloc(self.buffer, new_len);
+            return;
+        }
+
+        // Frames too large for a pooled buffer move to one of their own
+        const grown = try self.allocator.alloc(u8, new_len);
+        @memcpy(grown[0..self.end], self.buffer[0..self.end]);
+        self.pool.?.release(self.buffer);
+        self.buffer = grown;
+        self.pooled = false;
+    }
+
+    fn dropBuffer(self: *Self) void {
+        if (self.pooled) {
+            self.pool.?.release(self.buffer);
+            self.pooled = false;
+        } else {
+            self.allocator.free(self.buffer);
+        }
+    }
+
+    fn compact(self: *Self) void {
+        if (self.start == 0) return;
+
+        if (self.start == self.end) {
+            self.start = 0;
+            self.end = 0;
+            return;
+        }
+
+        std.mem.copyForwards(u8, self.buffer, self.buffer[self.start..self.end]);
+        self.end -= self.start;
+        self.start = 0;
+    }
+};
+
+/// Write a frame header for `payload_len` bytes into `out` and return the
+/// bytes used. `mask_key` is included when the frame is masked.
+pub fn writeHeader(out: *[max_header_size]u8, fin: bool, opcode: Opcode, payload_len: usize, mask_key: ?[4]u8) []const u8 {
+    const fin_bit: u8 = if (fin) 0x80 else 0;
+    out[0] = fin_bit | @as(u8, @intFromEnum(opcode));
+
+    const mask_bit: u8 = if (mask_key != null) 0x80 else 0;
+    var size: usize = 2;
+    if (payload_len < 126) {
+        out[1] = mask_bit | @as(u8, @intCast(payload_len));
+    } else if (payload_len <= 0xFFFF) {
+        out[1] = mask_bit | 126;
+        std.mem.writeInt(u16, out[2..4], @intCast(payload_len), .big);
+        size = 4;
+    } else {
+        out[1] = mask_bit | 127;
+        std.mem.writeInt(u64, out[2..10], payload_len, .big);
+        size = 10;
+    }
+
+    if (mask_key) |key| {
+        out[size..][0..4].* = key;
+        size += 4;
+    }
+
+    return out[0..size];
+}
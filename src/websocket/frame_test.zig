@@ -0,0 +1,241 @@
+const std = @import("std");
+const testing = std.testing;
+const frame = @import("frame.zig");
+const mask = @import("mask.zig");
+const BufferPool = @import("buffer_pool.zig").BufferPool;
+
+const test_key = [_]u8{ 0x37, 0xFA, 0x21, 0x3D };
+
+/// Append a client frame (masked with `test_key`) to `out`
+fn appendClientFrame(out: *std.ArrayList(u8), fin: bool, opcode: frame.Opcode, payload: []const u8) !void {
+    var header_buf: [frame.max_header_size]u8 = undefined;
+    try out.appendSlice(frame.writeHeader(&header_buf, fin, opcode, payload.len, test_key));
+
+    const start = out.items.len;
+    try out.appendSlice(payload);
+    mask.applyMask(test_key, out.items[start..], 0);
+}
+
+test "writeHeader picks the shortest length encoding" {
+    var buf: [frame.max_header_size]u8 = undefined;
+
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x81, 0x05 }, frame.writeHeader(&buf, true, .text, 5, null));
+    try testing.expectEqualSlices(u8, &[_]u8{ 0x02, 0x7E, 0x01, 0x00 }, frame.writeHeader(&buf, false, .binary, 256, null));
+    try testing.expectEqual(@as(usize, 10), frame.writeHeader(&buf, true, .binary, 70000, null).len);
+    try testing.expectEqual(@as(usize, 14), frame.writeHeader(&buf, true, .binary, 70000, test_key).len);
+}
+
+test "FrameReader returns several frames from one read" {
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+
+    try appendClientFrame(&wire, true, .text, "one");
+    try appendClientFrame(&wire, true, .ping, "");
+    try appendClientFrame(&wire, true, .binary, "three");
+
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+    try reader.feed(wire.items);
+
+    const first = (try reader.next()).?;
+    try testing.expectEqual(frame.Opcode.text, first.opcode);
+    try testing.expectEqualStrings("one", first.payload);
+
+    const second = (try reader.next()).?;
+    try testing.expectEqual(frame.Opcode.ping, second.opcode);
+    try testing.expectEqual(@as(usize, 0), second.payload.len);
+
+    const third = (try reader.next()).?;
+    try testing.expectEqualStrings("three", third.payload);
+
+    try testing.expect(try reader.next() == null);
+}
+
+test "FrameReader waits for frames split across reads" {
+    var payload: [300]u8 = undefined;
+    for (&payload, 0..) |*byte, i| byte.* = @truncate(i);
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, true, .binary, &payload);
+
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+
+    // Split inside the extended length, then inside the payload
+    try reader.feed(wire.items[0..3]);
+    try testing.expect(try reader.next() == null);
+    try reader.feed(wire.items[3..100]);
+    try testing.expect(try reader.next() == null);
+    try reader.feed(wire.items[100..]);
+
+    const complete = (try reader.next()).?;
+    try testing.expect(complete.fin);
+    try testing.expectEqualSlices(u8, &payload, complete.payload);
+}
+
+test "FrameReader grows for frames larger than its buffer" {
+    const payload = try testing.allocator.alloc(u8, 3 * frame.FrameReader.min_read_size + 5);
+    defer testing.allocator.free(payload);
+    @memset(payload, 'x');
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, true, .binary, payload);
+
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+
+    var offset: usize = 0;
+    while (offset < wire.items.len) {
+        const chunk = @min(4096, wire.items.len - offset);
+        try reader.feed(wire.items[offset..][0..chunk]);
+        offset += chunk;
+        if (offset < wire.items.len) try testing.expect(try reader.next() == null);
+    }
+
+    const complete = (try reader.next()).?;
+    try testing.expectEqualSlices(u8, payload, complete.payload);
+}
+
+test "FrameReader rejects protocol violations" {
+    var reader = frame.FrameReader.init(testing.allocator, 1024, true);
+    defer reader.deinit();
+
+    // Unmasked frame from a client
+    try reader.feed(&[_]u8{ 0x81, 0x00 });
+    try testing.expectError(error.UnmaskedFrame, reader.next());
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+
+    // Fragmented control frame
+    try appendClientFrame(&wire, false, .ping, "");
+    var fragmented = frame.FrameReader.init(testing.allocator, 1024, true);
+    defer fragmented.deinit();
+    try fragmented.feed(wire.items);
+    try testing.expectError(error.ProtocolError, fragmented.next());
+
+    // Reserved bit without a negotiated extension
+    var rsv = frame.FrameReader.init(testing.allocator, 1024, false);
+    defer rsv.deinit();
+    try rsv.feed(&[_]u8{ 0xC1, 0x00 });
+    try testing.expectError(error.ProtocolError, rsv.next());
+
+    // Reserved opcode
+    var opcode = frame.FrameReader.init(testing.allocator, 1024, false);
+    defer opcode.deinit();
+    try opcode.feed(&[_]u8{ 0x83, 0x00 });
+    try testing.expectError(error.InvalidOpcode, opcode.next());
+
+    // Frame over the size limit is refused from its header alone
+    var limited = frame.FrameReader.init(testing.allocator, 1024, false);
+    defer limited.deinit();
+    try limited.feed(&[_]u8{ 0x82, 0x7E, 0x08, 0x00 });
+    try testing.expectError(error.FrameTooLarge, limited.next());
+}
+
+test "FrameReader rejects text that is not UTF-8" {
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, true, .text, "\xED\xA0\x80");
+    try reader.feed(wire.items);
+
+    try testing.expectError(error.InvalidUtf8, reader.next());
+}
+
+test "FrameReader validates text across fragments" {
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+
+    // "é" split between two fragments is fine
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, false, .text, "caf\xC3");
+    try appendClientFrame(&wire, true, .continuation, "\xA9");
+    try reader.feed(wire.items);
+
+    try testing.expectEqualStrings("caf\xC3", (try reader.next()).?.payload);
+    try testing.expectEqualStrings("\xA9", (try reader.next()).?.payload);
+
+    // A message may not end partway through a code point
+    wire.clearRetainingCapacity();
+    try appendClientFrame(&wire, false, .text, "ok");
+    try appendClientFrame(&wire, true, .continuation, "\xE2\x82");
+    try reader.feed(wire.items);
+
+    _ = (try reader.next()).?;
+    try testing.expectError(error.InvalidUtf8, reader.next());
+}
+
+test "FrameReader marks text that has been all ASCII" {
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, true, .text, "plain");
+    try appendClientFrame(&wire, false, .text, "still plain");
+    try appendClientFrame(&wire, false, .continuation, "caf\xC3\xA9");
+    try appendClientFrame(&wire, true, .continuation, "plain again");
+    try appendClientFrame(&wire, true, .binary, "plain");
+    try reader.feed(wire.items);
+
+    try testing.expect((try reader.next()).?.ascii);
+    try testing.expect((try reader.next()).?.ascii);
+    // Once a message has seen non-ASCII text it stays marked for its
+    // remaining fragments
+    try testing.expect(!(try reader.next()).?.ascii);
+    try testing.expect(!(try reader.next()).?.ascii);
+    // Binary payloads are never inspected
+    try testing.expect(!(try reader.next()).?.ascii);
+}
+
+test "FrameReader leaves binary payloads alone" {
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, true, .binary, "\xFF\xFE");
+    try reader.feed(wire.items);
+
+    try testing.expectEqualSlices(u8, "\xFF\xFE", (try reader.next()).?.payload);
+}
+
+test "FrameReader returns a pooled buffer once drained" {
+    var pool = BufferPool.init(testing.allocator, frame.FrameReader.min_read_size, 4);
+    defer pool.deinit();
+
+    var reader = frame.FrameReader.init(testing.allocator, frame.default_max_frame_size, true);
+    defer reader.deinit();
+    reader.pool = &pool;
+
+    var wire = std.ArrayList(u8).init(testing.allocator);
+    defer wire.deinit();
+    try appendClientFrame(&wire, true, .text, "idle soon");
+    try reader.feed(wire.items[0..4]);
+    try testing.expectEqual(@as(usize, 1), pool.stats().in_use);
+
+    // Half a frame is still buffered, so the buffer stays
+    try testing.expect(try reader.next() == null);
+    reader.releaseBuffer();
+    try testing.expectEqual(@as(usize, 1), pool.stats().in_use);
+
+    try reader.feed(wire.items[4..]);
+    try testing.expectEqualStrings("idle soon", (try reader.next()).?.payload);
+    reader.releaseBuffer();
+    try testing.expectEqual(BufferPool.Stats{ .in_use = 0, .idle = 1 }, pool.stats());
+
+    // A frame too large for a pooled buffer moves to one of its own
+    const large = [_]u8{'x'} ** (frame.FrameReader.min_read_size * 2);
+    wire.clearRetainingCapacity();
+    try appendClientFrame(&wire, true, .binary, &large);
+    try reader.feed(wire.items[0..16]);
+    try reader.feed(wire.items[16..]);
+    try testing.expectEqual(@as(usize, 0), pool.stats().in_use);
+    try testing.expectEqualSlices(u8, &large, (try reader.next()).?.payload);
+}
@@ -0,0 +1,42 @@
+const std = @import("std");
+
+/// Bytes XORed per step. Follows the target's widest native vector (16 on
+/// SSE/NEON, 32 on AVX2, 64 on AVX-512) and never drops below 16, which
+/// keeps it a multiple of the 4-byte mask.
+pub const vector_len: usize = @max(std.simd.suggestVectorLength(u8) orelse 16, 16);
+
+const MaskVector = @Vector(vector_len, u8);
+
+/// The mask as seen by a byte `offset` bytes into the payload
+pub fn rotateMask(mask_key: [4]u8, offset: usize) [4]u8 {
+    const shift = offset % 4;
+    return .{
+        mask_key[shift],
+        mask_key[(shift + 1) % 4],
+        mask_key[(shift + 2) % 4],
+        mask_key[(shift + 3) % 4],
+    };
+}
+
+/// XOR `data` in place with `mask_key` (RFC 6455 section 5.3). `offset` is
+/// the position of `data[0]` within the payload, so a payload can be
+/// (un)masked in pieces as it arrives. Masking and unmasking are the same
+/// operation.
+pub fn applyMask(mask_key: [4]u8, data: []u8, offset: usize) void {
+    const mask = rotateMask(mask_key, offset);
+
+    var i: usize = 0;
+    if (data.len >= vector_len) {
+        const pattern: MaskVector = std.simd.repeat(vector_len, @as(@Vector(4, u8), mask));
+
+        while (i + vector_len <= data.len) : (i += vector_len) {
+            const chunk: MaskVector = data[i..][0..vector_len].*;
+            data[i..][0..vector_len].* = chunk ^ pattern;
+        }
+    }
+
+    // `i` is a multiple of 4 here, so the rotated mask still lines up
+    while (i < data.len) : (i += 1) {
+        data[i] ^= mask[i % 4];
+    }
+}
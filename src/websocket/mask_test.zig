@@ -0,0 +1,59 @@
+const std = @import("std");
+const testing = std.testing;
+const mask = @import("mask.zig");
+
+fn maskScalar(mask_key: [4]u8, data: []u8, offset: usize) void {
+    for (data, 0..) |*byte, i| {
+        byte.* ^= mask_key[(offset + i) % 4];
+    }
+}
+
+test "rotateMask starts the key at the payload offset" {
+    const key = [_]u8{ 1, 2, 3, 4 };
+    try testing.expectEqual([_]u8{ 1, 2, 3, 4 }, mask.rotateMask(key, 0));
+    try testing.expectEqual([_]u8{ 2, 3, 4, 1 }, mask.rotateMask(key, 1));
+    try testing.expectEqual([_]u8{ 4, 1, 2, 3 }, mask.rotateMask(key, 7));
+}
+
+test "applyMask matches the byte-by-byte reference" {
+    const key = [_]u8{ 0x37, 0xFA, 0x21, 0x3D };
+
+    var source: [3 * 64 + 7]u8 = undefined;
+    var prng = std.Random.DefaultPrng.init(0x5eed);
+    prng.random().bytes(&source);
+
+    // Lengths on both sides of the vector width, at every mask phase
+    for ([_]usize{ 0, 1, 3, 4, 15, 16, 17, 31, 32, 33, 63, 64, 65, source.len }) |len| {
+        for (0..4) |offset| {
+            var expected: [source.len]u8 = source;
+            var actual: [source.len]u8 = source;
+
+            maskScalar(key, expected[0..len], offset);
+            mask.applyMask(key, actual[0..len], offset);
+
+            try testing.expectEqualSlices(u8, expected[0..len], actual[0..len]);
+        }
+    }
+}
+
+test "applyMask in pieces equals one pass" {
+    const key = [_]u8{ 0xA1, 0xB2, 0xC3, 0xD4 };
+
+    var whole: [200]u8 = undefined;
+    for (&whole, 0..) |*byte, i| byte.* = @truncate(i);
+    var pieces = whole;
+
+    mask.applyMask(key, &whole, 0);
+
+    // Split at offsets that are not multiples of 4, as partial reads are
+    mask.applyMask(key, pieces[0..7], 0);
+    mask.applyMask(key, pieces[7..90], 7);
+    mask.applyMask(key, pieces[90..], 90);
+
+    try testing.expectEqualSlices(u8, &whole, &pieces);
+
+    // Masking twice restores the input
+    mask.applyMask(key, &pieces, 0);
+    mask.applyMask(key, &whole, 0);
+    try testing.expectEqualSlices(u8, &whole, &pieces);
+}
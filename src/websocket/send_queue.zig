@@ -0,0 +1,184 @@
+const std = @import("std");
+const Allocator = std.mem.Allocator;
+const broadcast = @import("broadcast.zig");
+const frame = @import("frame.zig");
+const mask = @import("mask.zig");
+
+/// Frames handed to one `writev` at most; each takes up to two iovecs
+pub const max_batch = 64;
+
+/// Payload of a queued frame
+const Payload = union(enum) {
+    /// Allocated by the queue and freed once written
+    owned: []u8,
+    /// Owned by the caller, who keeps it alive until the queue is flushed
+    borrowed: []const u8,
+    /// Complete broadcast frame, header included; the queue holds a
+    /// reference
+    shared: *broadcast.SharedFrame,
+
+    fn bytes(self: Payload) []const u8 {
+        return switch (self) {
+            .owned => |owned| owned,
+            .borrowed => |borrowed| borrowed,
+            .shared => |shared| shared.bytes,
+        };
+    }
+};
+
+/// One frame waiting for the socket
+const Pending = struct {
+    header: [frame.max_header_size]u8 = undefined,
+    header_len: u8 = 0,
+    payload: Payload,
+
+    fn len(self: *const Pending) usize {
+        return self.header_len + self.payload.bytes().len;
+    }
+};
+
+/// Frames encoded for one connection and not yet written. Frames are
+/// queued whole and flushed together, so several small frames leave in a
+/// single `writev` instead of one write each.
+///
+/// Not thread safe; the connection's write lock covers it.
+pub const SendQueue = struct {
+    const Self = @This();
+
+    allocator: Allocator,
+    /// Frames before `first` are written; the iovecs point into the
+    /// entries, so they are addressed in place rather than copied out
+    frames: std.ArrayListUnmanaged(Pending) = .{},
+    first: usize = 0,
+    /// Bytes queued and not yet written
+    pending_bytes: usize = 0,
+    /// Bytes of the first frame already written
+    head_written: usize = 0,
+
+    pub fn init(allocator: Allocator) Self {
+        return Self{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.reset();
+        self.frames.deinit(self.allocator);
+    }
+
+    pub fn hasPending(self: *const Self) bool {
+        return !self.isEmpty();
+    }
+
+    /// Queue a frame. With `mask_key` the payload is masked in a copy;
+    /// without one it is borrowed when `borrow` is set and copied
+    /// otherwise.
+    pub fn pushFrame(self: *Self, fin: bool, rsv: u3, opcode: frame.Opcode, payload: []const u8, mask_key: ?[4]u8, borrow: bool) !void {
+        var pending = Pending{ .payload = undefined };
+        const header = frame.writeHeader(&pending.header, fin, opcode, payload.len, mask_key);
+        pending.header_len = @intCast(header.len);
+        pending.header[0] |= @as(u8, rsv) << 4;
+
+        if (mask_key == null and borrow) {
+            pending.payload = .{ .borrowed = payload };
+        } else {
+            const copy = try self.allocator.dupe(u8, payload);
+            if (mask_key) |key| mask.applyMask(key, copy, 0);
+            pending.payload = .{ .owned = copy };
+        }
+        errdefer if (pending.payload == .owned) self.allocator.free(pending.payload.owned);
+
+        try self.push(pending);
+    }
+
+    /// Queue an encoded broadcast frame, taking a reference to it
+    pub fn pushShared(self: *Self, shared: *broadcast.SharedFrame) !void {
+        try self.push(.{ .payload = .{ .shared = shared } });
+        shared.retain();
+    }
+
+    /// Write every queued frame, up to `max_batch` per system call. On
+    /// error the rest are dropped, as the stream is no longer usable.
+    pub fn flush(self: *Self, fd: std.posix.fd_t) !void {
+        errdefer self.reset();
+        while (!self.isEmpty()) _ = try self.writeSome(fd);
+    }
+
+    /// One `writev` of as many queued frames as fit. Returns the bytes
+    /// written.
+    pub fn writeSome(self: *Self, fd: std.posix.fd_t) !usize {
+        var iovecs: [max_batch * 2]std.posix.iovec_const = undefined;
+        var count: usize = 0;
+
+        var skip = self.head_written;
+        const batch = self.frames.items[self.first..];
+        for (batch[0..@min(batch.len, max_batch)]) |*pending| {
+            const parts = [_][]const u8{ pending.header[0..pending.header_len], pending.payload.bytes() };
+            for (parts) |part| {
+                if (skip >= part.len) {
+                    skip -= part.len;
+                    continue;
+                }
+                iovecs[count] = .{ .base = part[skip..].ptr, .len = part.len - skip };
+                count += 1;
+                skip = 0;
+            }
+        }
+        if (count == 0) return 0;
+
+        const written = try std.posix.writev(fd, iovecs[0..count]);
+        if (written == 0) return error.ConnectionClosed;
+        self.consume(written);
+        return written;
+    }
+
+    /// Drop every queued frame without writing it
+    pub fn reset(self: *Self) void {
+        for (self.frames.items[self.first..]) |pending| self.releasePayload(pending.payload);
+        self.frames.clearRetainingCapacity();
+        self.first = 0;
+        self.pending_bytes = 0;
+        self.head_written = 0;
+    }
+
+    fn isEmpty(self: *const Self) bool {
+        return self.first == self.frames.items.len;
+    }
+
+    fn push(self: *Self, pending: Pending) !void {
+        try self.frames.append(self.allocator, pending);
+        self.pending_bytes += pending.len();
+    }
+
+    /// Retire `written` bytes from the front of the queue
+    fn consume(self: *Self, written: usize) void {
+        self.pending_bytes -= written;
+
+        var remaining = self.head_written + written;
+        while (!self.isEmpty()) {
+            const head = &self.frames.items[self.first];
+            if (remaining < head.len()) break;
+
+            remaining -= head.len();
+            self.releasePayload(head.payload);
+            self.first += 1;
+        }
+        self.head_written = remaining;
+
+        if (self.isEmpty()) {
+            // Keep room for a typical batch, but not what a burst grew to
+            if (self.frames.capacity > max_batch) {
+                self.frames.clearAndFree(self.allocator);
+            } else {
+                self.frames.clearRetainingCapacity();
+            }
+            self.first = 0;
+        }
+    }
+
+    fn releasePayload(self: *Self, payload: Payload) void {
+        switch (payload) {
+            .owned => |owned| self.allocator.free(owned),
+            .borrowed => {},
+            .shared => |shared| shared.release(),
+        }
+    }
+};
@@ -0,0 +1,119 @@
+const std = @import("std");
+const testing = std.testing;
+const broadcast = @import("broadcast.zig");
+const frame = @import("frame.zig");
+const send_queue = @import("send_queue.zig");
+
+/// Read `expected.len` bytes from `fd` and compare
+fn expectRead(fd: std.posix.fd_t, expected: []const u8) !void {
+    const actual = try testing.allocator.alloc(u8, expected.len);
+    defer testing.allocator.free(actual);
+
+    var filled: usize = 0;
+    while (filled < actual.len) {
+        const n = try std.posix.read(fd, actual[filled..]);
+        if (n == 0) return error.EndOfStream;
+        filled += n;
+    }
+    try testing.expectEqualSlices(u8, expected, actual);
+}
+
+test "SendQueue writes queued frames together" {
+    var queue = send_queue.SendQueue.init(testing.allocator);
+    defer queue.deinit();
+
+    const shared = try broadcast.SharedFrame.create(testing.allocator, .text, "everyone");
+    defer shared.release();
+
+    try queue.pushFrame(true, 0, .text, "one", null, true);
+    try queue.pushShared(shared);
+    try queue.pushFrame(true, 0b100, .binary, "two", null, false);
+    try queue.pushFrame(true, 0, .ping, "", null, true);
+    try testing.expect(queue.hasPending());
+    try testing.expectEqual(@as(usize, 5 + shared.bytes.len + 5 + 2), queue.pending_bytes);
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    // Everything fits in the pipe, so one writev takes it all
+    try testing.expectEqual(queue.pending_bytes, try queue.writeSome(fds[1]));
+    try testing.expect(!queue.hasPending());
+
+    try expectRead(fds[0], "\x81\x03one");
+    try expectRead(fds[0], shared.bytes);
+    try expectRead(fds[0], "\xC2\x03two");
+    try expectRead(fds[0], "\x89\x00");
+}
+
+test "SendQueue masks client frames in a copy" {
+    var queue = send_queue.SendQueue.init(testing.allocator);
+    defer queue.deinit();
+
+    var payload = "masked".*;
+    const key = [_]u8{ 1, 2, 3, 4 };
+    try queue.pushFrame(true, 0, .text, &payload, key, true);
+    try testing.expectEqualStrings("masked", &payload);
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+    try queue.flush(fds[1]);
+
+    var out: [12]u8 = undefined;
+    try testing.expectEqual(out.len, try std.posix.read(fds[0], &out));
+    const header = (try frame.FrameHeader.parse(&out)).?;
+    try testing.expectEqual(key, header.mask_key.?);
+
+    var unmasked = out[header.size..][0..6].*;
+    for (&unmasked, 0..) |*byte, i| byte.* ^= key[i % 4];
+    try testing.expectEqualStrings("masked", &unmasked);
+}
+
+fn drain(fd: std.posix.fd_t, total: usize) void {
+    var buf: [4096]u8 = undefined;
+    var remaining = total;
+    while (remaining > 0) {
+        const n = std.posix.read(fd, &buf) catch return;
+        if (n == 0) return;
+        remaining -= n;
+    }
+}
+
+test "SendQueue resumes after short writes" {
+    var queue = send_queue.SendQueue.init(testing.allocator);
+    defer queue.deinit();
+
+    // Several times a pipe's capacity, so the kernel takes it in pieces
+    const payload = try testing.allocator.alloc(u8, 256 * 1024);
+    defer testing.allocator.free(payload);
+    @memset(payload, 'x');
+
+    for (0..4) |_| try queue.pushFrame(true, 0, .binary, payload, null, true);
+    const total = queue.pending_bytes;
+
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    const reader = try std.Thread.spawn(.{}, drain, .{ fds[0], total });
+    try queue.flush(fds[1]);
+    reader.join();
+
+    try testing.expect(!queue.hasPending());
+    try testing.expectEqual(@as(usize, 0), queue.pending_bytes);
+}
+
+test "SendQueue.reset releases shared frames" {
+    var queue = send_queue.SendQueue.init(testing.allocator);
+    defer queue.deinit();
+
+    const shared = try broadcast.SharedFrame.create(testing.allocator, .binary, "payload");
+    try queue.pushShared(shared);
+    try testing.expectEqual(@as(u32, 2), shared.refs.load(.monotonic));
+
+    queue.reset();
+    try testing.expectEqual(@as(u32, 1), shared.refs.load(.monotonic));
+    try testing.expect(!queue.hasPending());
+    shared.release();
+}
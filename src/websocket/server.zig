@@ -2,6 +2,13 @@ const std = @import("std");
 const Allocator = std.mem.Allocator;
 const net = std.net;
 const crypto = std.crypto;
+pub const broadcast = @import("broadcast.zig");
+pub const buffer_pool = @import("buffer_pool.zig");
+pub const deflate = @import("deflate.zig");
+pub const frame = @import("frame.zig");
+pub const mask = @import("mask.zig");
+pub const send_queue = @import("send_queue.zig");
+pub const utf8 = @import("utf8.zig");
 
 /// WebSocket message types
 pub const MessageType = enum {
@@ -13,15 +20,7 @@ pub const MessageType = enum {
 };
 
 /// WebSocket frame opcodes
-pub const Opcode = enum(u4) {
-    continuation = 0x0,
-    text = 0x1,
-    binary = 0x2,
-    close = 0x8,
-    ping = 0x9,
-    pong = 0xA,
-    _,
-};
+pub const Opcode = frame.Opcode;
 
 /// WebSocket message
 pub const Message = struct {
@@ -35,12 +34,83 @@ pub const Message = struct {
     }
 };
 
+/// A piece of a message as it arrived on the wire. `data` is borrowed from
+/// the connection's read buffer until the next receive.
+pub const Chunk = struct {
+    type: MessageType,
+    data: []const u8,
+    /// Last piece of the message; control messages are always final
+    final: bool,
+    /// Text known to be all ASCII from validating it (see `Frame.ascii`)
+    ascii: bool = false,
+};
+
+/// RSV1, which marks a compressed message under permessage-deflate
+const rsv1: u3 = 0b100;
+
+/// Largest reassembled message accepted unless configured otherwise
+pub const default_max_message_size: usize = 16 * 1024 * 1024;
+
+/// Close code carried by a close frame payload; 1005 when none is present
+pub fn closeCode(payload: []const u8) u16 {
+    if (payload.len < 2) return 1005;
+    return std.mem.readInt(u16, payload[0..2], .big);
+}
+
+/// Whether a peer may send `code` in a close frame (RFC 6455 section
+/// 7.4): the defined codes other than 1004-1006 and 1015, which are
+/// reserved or only reported locally, and 3000-4999 for libraries and
+/// applications
+pub fn isValidCloseCode(code: u16) bool {
+    return switch (code) {
+        1000...1003, 1007...1014, 3000...4999 => true,
+        else => false,
+    };
+}
+
+/// Longest close reason: control frames are limited to 125 bytes, two of
+/// which hold the code
+pub const max_close_reason_len = 123;
+
+/// `reason` cut to fit a close frame. The cut never falls inside a UTF-8
+/// sequence, which would make the peer fail the connection with 1007.
+pub fn closeReason(reason: []const u8) []const u8 {
+    if (reason.len <= max_close_reason_len) return reason;
+
+    // Back up over the continuation bytes of a character that spans the
+    // limit, then drop its lead byte too
+    var end: usize = max_close_reason_len;
+    while (end > 0 and (reason[end] & 0xC0) == 0x80) end -= 1;
+    return reason[0..end];
+}
+
+/// Check a received close payload: empty, or a valid code followed by an
+/// optional reason. The reader has already validated the reason's UTF-8.
+pub fn validateClosePayload(payload: []const u8) !void {
+    if (payload.len == 0) return;
+    if (payload.len == 1 or !isValidCloseCode(closeCode(payload))) return error.ProtocolError;
+}
+
 /// WebSocket connection
 pub const Connection = struct {
     stream: net.Stream,
     allocator: Allocator,
     is_server: bool,
     mask_outgoing: bool,
+    reader: frame.FrameReader,
+    max_message_size: usize = default_max_message_size,
+    /// Reassembly buffer for fragmented messages
+    fragments: std.ArrayList(u8),
+    /// Type of the fragmented message in progress, if any
+    fragment_type: ?MessageType = null,
+    /// permessage-deflate state once negotiated
+    deflate_codec: ?*deflate.Codec = null,
+    /// The data message being received has RSV1 set
+    message_compressed: bool = false,
+    /// Output of the last inflated message
+    inflated: std.ArrayList(u8),
+    /// Frames queued by `queue` and not yet flushed
+    outbound: send_queue.SendQueue,
 
     /// Create a new WebSocket connection
     pub fn init(stream: net.Stream, allocator: Allocator, is_server: bool) Connection {
@@ -49,16 +119,70 @@ pub const Connection = struct {
             .allocator = allocator,
             .is_server = is_server,
             .mask_outgoing = !is_server, // Client masks outgoing, server doesn't
+            // Only servers insist on masked frames
+            .reader = frame.FrameReader.init(allocator, default_max_message_size, is_server),
+            .fragments = std.ArrayList(u8).init(allocator),
+            .inflated = std.ArrayList(u8).init(allocator),
+            .outbound = send_queue.SendQueue.init(allocator),
         };
     }
 
-    /// Close the connection
+    /// Free the read buffers without closing the stream
+    pub fn deinit(self: *Connection) void {
+        self.reader.deinit();
+        self.fragments.deinit();
+        self.inflated.deinit();
+        self.outbound.deinit();
+        if (self.deflate_codec) |codec| codec.destroy();
+    }
+
+    /// Use permessage-deflate from now on. The connection takes ownership
+    /// of `codec`.
+    pub fn enableDeflate(self: *Connection, codec: *deflate.Codec) void {
+        self.deflate_codec = codec;
+        self.reader.allowed_rsv = rsv1;
+    }
+
+    /// Borrow read buffers from `pool` and hand them back whenever the
+    /// connection goes idle, instead of keeping one for its lifetime
+    pub fn usePool(self: *Connection, pool: *buffer_pool.BufferPool) void {
+        self.reader.pool = pool;
+    }
+
+    /// Drop everything only needed while a message is arriving: the read
+    /// buffer, and the reassembly and inflate buffers unless a fragmented
+    /// message is in progress. Data handed out earlier is invalidated.
+    pub fn releaseIdleBuffers(self: *Connection) void {
+        self.reader.releaseBuffer();
+        if (self.fragment_type == null) self.fragments.clearAndFree();
+        self.inflated.clearAndFree();
+    }
+
+    /// Limit the size of a message, whether it arrives in one frame or is
+    /// reassembled from fragments
+    pub fn setMaxMessageSize(self: *Connection, max_message_size: usize) void {
+        self.max_message_size = max_message_size;
+        self.reader.max_frame_size = max_message_size;
+    }
+
+    /// Close the connection and free the read buffers
     pub fn close(self: *Connection) void {
         self.stream.close();
+        self.deinit();
     }
 
-    /// Send a WebSocket message
+    /// Send a WebSocket message, along with anything queued before it.
+    /// Data messages are compressed when permessage-deflate is in use and
+    /// they are long enough to benefit.
     pub fn send(self: *Connection, message_type: MessageType, data: []const u8) !void {
+        try self.queue(message_type, data);
+        try self.flush();
+    }
+
+    /// Encode a message without writing it, so several can leave in one
+    /// `flush`. Unless it is compressed or masked, the payload is borrowed
+    /// rather than copied, so `data` must stay valid until then.
+    pub fn queue(self: *Connection, message_type: MessageType, data: []const u8) !void {
         const opcode: Opcode = switch (message_type) {
             .text => .text,
             .binary => .binary,
@@ -67,204 +191,295 @@ pub const Connection = struct {
             .pong => .pong,
         };
 
-        try self.sendFrame(true, opcode, data);
+        if (self.deflate_codec) |codec| {
+            if (!opcode.isControl() and data.len >= deflate.min_compress_size) {
+                // The codec reuses its output buffer, so this is copied
+                return self.queueFrame(true, rsv1, opcode, try codec.compress(data), false);
+            }
+        }
+
+        try self.queueFrame(true, 0, opcode, data, true);
     }
 
-    /// Send a WebSocket frame
-    fn sendFrame(self: *Connection, fin: bool, opcode: Opcode, data: []const u8) !void {
-        // First byte: FIN bit + opcode
-        const fin_bit: u8 = if (fin) 0x80 else 0;
-        const first_byte: u8 = @as(u8, @intFromEnum(opcode)) | fin_bit;
+    /// Queue a broadcast frame that is already encoded
+    pub fn queueShared(self: *Connection, shared: *broadcast.SharedFrame) !void {
+        try self.outbound.pushShared(shared);
+    }
 
-        // Prepare the buffer
-        var buffer = std.ArrayList(u8).init(self.allocator);
-        defer buffer.deinit();
+    /// Write every queued frame, batching them into as few `writev` calls
+    /// as possible
+    pub fn flush(self: *Connection) !void {
+        try self.outbound.flush(self.stream.handle);
+    }
 
-        try buffer.append(first_byte);
+    /// Send one fragment of a data message. The first fragment carries the
+    /// message type and the rest are continuations; `final` ends the message.
+    pub fn sendFragment(self: *Connection, message_type: MessageType, data: []const u8, first: bool, final: bool) !void {
+        const opcode: Opcode = if (!first) .continuation else switch (message_type) {
+            .text => .text,
+            .binary => .binary,
+            else => return error.InvalidOpcode,
+        };
 
-        // Second byte: MASK bit + payload length
-        var second_byte: u8 = 0;
-        if (self.mask_outgoing) {
-            second_byte |= 0x80; // Set MASK bit
-        }
+        try self.sendFrame(final, opcode, data);
+    }
 
-        // Determine payload length format
-        if (data.len < 126) {
-            second_byte |= @intCast(data.len);
-            try buffer.append(second_byte);
-        } else if (data.len <= 65535) {
-            second_byte |= 126;
-            try buffer.append(second_byte);
-
-            // 2-byte extended payload length
-            try buffer.append(@intCast((data.len >> 8) & 0xFF));
-            try buffer.append(@intCast(data.len & 0xFF));
-        } else {
-            second_byte |= 127;
-            try buffer.append(second_byte);
-
-            // 8-byte extended payload length
-            var i: usize = 8;
-            while (i > 0) : (i -= 1) {
-                const shift_amount: u6 = @intCast((i - 1) * 8);
-                try buffer.append(@intCast((data.len >> shift_amount) & 0xFF));
-            }
-        }
+    /// Send a close frame carrying `code` and an optional reason
+    pub fn sendClose(self: *Connection, code: u16, reason: []const u8) !void {
+        var payload: [2 + max_close_reason_len]u8 = undefined;
+        std.mem.writeInt(u16, payload[0..2], code, .big);
 
-        // Add masking key if needed
-        var mask_key: [4]u8 = undefined;
-        if (self.mask_outgoing) {
-            crypto.random.bytes(&mask_key);
-            try buffer.appendSlice(&mask_key);
-        }
+        const kept = closeReason(reason);
+        @memcpy(payload[2..][0..kept.len], kept);
 
-        // Add payload data (possibly masked)
-        if (self.mask_outgoing) {
-            // Apply masking
-            var masked_data = try self.allocator.alloc(u8, data.len);
-            defer self.allocator.free(masked_data);
+        try self.sendFrame(true, .close, payload[0 .. 2 + kept.len]);
+    }
 
-            for (data, 0..) |byte, i| {
-                masked_data[i] = byte ^ mask_key[i % 4];
-            }
+    /// Send a WebSocket frame, along with anything queued before it
+    fn sendFrame(self: *Connection, fin: bool, opcode: Opcode, data: []const u8) !void {
+        try self.queueFrame(fin, 0, opcode, data, true);
+        try self.flush();
+    }
 
-            try buffer.appendSlice(masked_data);
-        } else {
-            try buffer.appendSlice(data);
+    /// Queue a WebSocket frame. Client frames are masked in a copy; server
+    /// frames borrow `data` until the next flush when `borrow` is set.
+    fn queueFrame(self: *Connection, fin: bool, rsv: u3, opcode: Opcode, data: []const u8, borrow: bool) !void {
+        var mask_key: ?[4]u8 = null;
+        if (self.mask_outgoing) {
+            var key: [4]u8 = undefined;
+            crypto.random.bytes(&key);
+            mask_key = key;
         }
 
-        // Send the frame
-        _ = try self.stream.writeAll(buffer.items);
+        try self.outbound.pushFrame(fin, rsv, opcode, data, mask_key, borrow);
     }
 
-    /// Receive a WebSocket message
-    pub fn receive(self: *Connection) !Message {
-        // Read the first two bytes
-        var header: [2]u8 = undefined;
-        const bytes_read = try self.stream.read(&header);
-        if (bytes_read < 2) {
-            return error.ConnectionClosed;
-        }
-
-        // Parse first byte: FIN bit + opcode
-        const fin = (header[0] & 0x80) != 0;
-        const opcode = @as(Opcode, @enumFromInt(header[0] & 0x0F));
+    /// Next complete frame, reading from the socket as needed. The payload
+    /// is unmasked and borrowed from the read buffer until the next call.
+    pub fn nextFrame(self: *Connection) !frame.Frame {
+        while (true) {
+            if (try self.reader.next()) |next_frame| return next_frame;
+
+            // With a pool, a connection with nothing to read gives its
+            // buffers back before it blocks
+            if (self.reader.pool != null and self.reader.isDrained() and !try self.waitReadable(0)) {
+                self.releaseIdleBuffers();
+                _ = try self.waitReadable(-1);
+            }
 
-        if (!fin) {
-            // We don't support fragmented messages yet
-            return error.FragmentedMessage;
+            if (try self.reader.fill(self.stream.handle) == 0) {
+                return error.ConnectionClosed;
+            }
         }
+    }
 
-        // Parse second byte: MASK bit + payload length
-        const mask = (header[1] & 0x80) != 0;
-        var payload_len: usize = header[1] & 0x7F;
+    /// Wait up to `timeout_ms` (-1 for ever) for the socket to become
+    /// readable, or to hang up
+    fn waitReadable(self: *Connection, timeout_ms: i32) !bool {
+        var fds = [_]std.posix.pollfd{.{ .fd = self.stream.handle, .events = std.posix.POLL.IN, .revents = 0 }};
+        return try std.posix.poll(&fds, timeout_ms) > 0;
+    }
 
-        // Extended payload length
-        if (payload_len == 126) {
-            var ext_len: [2]u8 = undefined;
-            const ext_bytes_read = try self.stream.read(&ext_len);
-            if (ext_bytes_read < 2) {
-                return error.ConnectionClosed;
-            }
+    /// Check a frame against the fragmentation state and return the type of
+    /// the message it belongs to. Control frames may arrive between the
+    /// fragments of a data message (RFC 6455 section 5.4). Only the first
+    /// frame of a data message may carry RSV1 (RFC 7692 section 6.1).
+    fn trackFragment(self: *Connection, next_frame: frame.Frame) !MessageType {
+        switch (next_frame.opcode) {
+            .text, .binary => {
+                // A new data message may not start inside another one
+                if (self.fragment_type != null) return error.ProtocolError;
+
+                const message_type: MessageType = if (next_frame.opcode == .text) .text else .binary;
+                if (!next_frame.fin) self.fragment_type = message_type;
+                self.message_compressed = next_frame.rsv & rsv1 != 0;
+                return message_type;
+            },
+            .continuation => {
+                if (next_frame.rsv != 0) return error.ProtocolError;
+
+                const message_type = self.fragment_type orelse return error.ProtocolError;
+                if (next_frame.fin) self.fragment_type = null;
+                return message_type;
+            },
+            .close, .ping, .pong => {
+                if (next_frame.rsv != 0) return error.ProtocolError;
+
+                return switch (next_frame.opcode) {
+                    .close => .close,
+                    .ping => .ping,
+                    else => .pong,
+                };
+            },
+            _ => return error.InvalidOpcode,
+        }
+    }
 
-            payload_len = (@as(usize, ext_len[0]) << 8) | ext_len[1];
-        } else if (payload_len == 127) {
-            var ext_len: [8]u8 = undefined;
-            const ext_bytes_read = try self.stream.read(&ext_len);
-            if (ext_bytes_read < 8) {
-                return error.ConnectionClosed;
+    /// Next message or piece of one. Whole messages (`whole`, or any
+    /// compressed message, which can only be inflated whole) are gathered
+    /// in the reassembly buffer; otherwise each data frame is returned as
+    /// it arrives. The data is borrowed until the next call.
+    fn nextPiece(self: *Connection, whole: bool) !Chunk {
+        while (true) {
+            const next_frame = try self.nextFrame();
+            const message_type = try self.trackFragment(next_frame);
+
+            if (next_frame.opcode.isControl()) {
+                if (message_type == .close) try validateClosePayload(next_frame.payload);
+                return Chunk{ .type = message_type, .data = next_frame.payload, .final = true };
             }
 
-            payload_len = 0;
-            for (ext_len, 0..) |byte, i| {
-                const shift_amount: u6 = @intCast((7 - i) * 8);
-                payload_len |= @as(usize, byte) << shift_amount;
+            const first = next_frame.opcode != .continuation;
+            if (!whole and !self.message_compressed) {
+                return Chunk{ .type = message_type, .data = next_frame.payload, .final = next_frame.fin, .ascii = next_frame.ascii };
             }
-        }
 
-        // Read masking key if present
-        var mask_key: [4]u8 = undefined;
-        if (mask) {
-            const mask_bytes_read = try self.stream.read(&mask_key);
-            if (mask_bytes_read < 4) {
-                return error.ConnectionClosed;
-            }
-        }
+            var payload: []const u8 = next_frame.payload;
+            // The reader's validator spans fragments, so the final frame
+            // speaks for the whole message
+            var ascii = next_frame.ascii;
+            if (!(first and next_frame.fin)) {
+                if (first) self.fragments.clearRetainingCapacity();
 
-        // Read payload data
-        var payload = try self.allocator.alloc(u8, payload_len);
-        errdefer self.allocator.free(payload);
+                if (self.fragments.items.len + payload.len > self.max_message_size) {
+                    return error.MessageTooBig;
+                }
+                try self.fragments.appendSlice(payload);
 
-        var total_read: usize = 0;
-        while (total_read < payload_len) {
-            const payload_bytes_read = try self.stream.read(payload[total_read..]);
-            if (payload_bytes_read == 0) {
-                return error.ConnectionClosed;
+                if (!next_frame.fin) continue;
+                payload = self.fragments.items;
             }
 
-            total_read += payload_bytes_read;
-        }
-
-        // Apply masking if needed
-        if (mask) {
-            for (payload, 0..) |*byte, i| {
-                byte.* ^= mask_key[i % 4];
+            if (self.message_compressed) {
+                try self.deflate_codec.?.inflate(payload, &self.inflated, self.max_message_size);
+                payload = self.inflated.items;
+
+                // Uncompressed text is validated by the reader as it is unmasked
+                if (message_type == .text and self.reader.validate_utf8) {
+                    var validator = utf8.Validator{};
+                    validator.feed(payload);
+                    if (!validator.isComplete()) return error.InvalidUtf8;
+                    ascii = validator.ascii;
+                }
             }
+
+            return Chunk{ .type = message_type, .data = payload, .final = true, .ascii = ascii };
         }
+    }
 
-        // Determine message type
-        const message_type = switch (opcode) {
-            .text => MessageType.text,
-            .binary => MessageType.binary,
-            .close => MessageType.close,
-            .ping => MessageType.ping,
-            .pong => MessageType.pong,
-            else => return error.InvalidOpcode,
-        };
+    /// Receive a WebSocket message, reassembling fragmented data messages
+    /// and inflating compressed ones. Control frames interleaved with
+    /// fragments are returned as they come.
+    pub fn receive(self: *Connection) !Message {
+        const chunk = try self.nextPiece(true);
 
         return Message{
-            .type = message_type,
-            .data = payload,
+            .type = chunk.type,
+            .data = try self.allocator.dupe(u8, chunk.data),
             .allocator = self.allocator,
         };
     }
+
+    /// Like `receive`, but the data is borrowed until the next call rather
+    /// than copied
+    pub fn receiveBorrowed(self: *Connection) !Chunk {
+        return self.nextPiece(true);
+    }
+
+    /// Receive the next piece of a message without reassembling it. Each
+    /// data frame is returned as it arrives, so a large fragmented message
+    /// never has to be held in memory at once. Compressed messages are the
+    /// exception and come back whole.
+    pub fn receiveChunk(self: *Connection) !Chunk {
+        return self.nextPiece(false);
+    }
 };
 
-/// Perform the WebSocket handshake
-pub fn handshake(allocator: Allocator, stream: net.Stream, request_headers: std.StringHashMap([]const u8)) !Connection {
-    // Verify it's a valid WebSocket upgrade request
-    const upgrade = request_headers.get("Upgrade") orelse return error.NotWebSocketRequest;
-    const connection = request_headers.get("Connection") orelse return error.NotWebSocketRequest;
-    const websocket_key = request_headers.get("Sec-WebSocket-Key") orelse return error.NotWebSocketRequest;
-
-    if (!std.ascii.eqlIgnoreCase(upgrade, "websocket") or
-        std.mem.indexOf(u8, connection, "upgrade") == null)
-    {
-        return error.NotWebSocketRequest;
+/// GUID appended to the client key when computing Sec-WebSocket-Accept
+const websocket_key_suffix = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/// Look up a request header without regard to the case of its name
+pub fn getHeader(headers: *const std.StringHashMap([]const u8), name: []const u8) ?[]const u8 {
+    if (headers.get(name)) |value| return value;
+
+    var it = headers.iterator();
+    while (it.next()) |entry| {
+        if (std.ascii.eqlIgnoreCase(entry.key_ptr.*, name)) return entry.value_ptr.*;
+    }
+    return null;
+}
+
+/// Check whether a comma separated header value contains `token`
+fn hasToken(value: []const u8, token: []const u8) bool {
+    var tokens = std.mem.splitScalar(u8, value, ',');
+    while (tokens.next()) |item| {
+        if (std.ascii.eqlIgnoreCase(std.mem.trim(u8, item, " \t"), token)) return true;
     }
+    return false;
+}
+
+/// Check whether request headers ask for a WebSocket upgrade
+pub fn isUpgradeRequest(headers: *const std.StringHashMap([]const u8)) bool {
+    const upgrade = getHeader(headers, "Upgrade") orelse return false;
+    const connection = getHeader(headers, "Connection") orelse return false;
+
+    return hasToken(upgrade, "websocket") and hasToken(connection, "upgrade");
+}
 
-    // Calculate the accept key
-    const websocket_key_suffix = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-    const full_key = try std.mem.concat(allocator, u8, &[_][]const u8{ websocket_key, websocket_key_suffix });
-    defer allocator.free(full_key);
+/// Compute the Sec-WebSocket-Accept value for a client key
+pub fn computeAcceptKey(websocket_key: []const u8, out: *[28]u8) []const u8 {
+    var sha1 = crypto.hash.Sha1.init(.{});
+    sha1.update(websocket_key);
+    sha1.update(websocket_key_suffix);
 
     var sha1_hash: [20]u8 = undefined;
-    crypto.hash.Sha1.hash(full_key, &sha1_hash, .{});
+    sha1.final(&sha1_hash);
 
-    var base64_buf: [28]u8 = undefined; // SHA-1 hash in base64 is 28 bytes
-    const accept_key = std.base64.standard.Encoder.encode(&base64_buf, &sha1_hash);
+    return std.base64.standard.Encoder.encode(out, &sha1_hash);
+}
+
+/// Validate an upgrade request and return the Sec-WebSocket-Accept value
+pub fn acceptKeyForRequest(request_headers: *const std.StringHashMap([]const u8), out: *[28]u8) ![]const u8 {
+    if (!isUpgradeRequest(request_headers)) return error.NotWebSocketRequest;
 
-    // Send the WebSocket handshake response
+    const websocket_key = getHeader(request_headers, "Sec-WebSocket-Key") orelse return error.NotWebSocketRequest;
+    if (getHeader(request_headers, "Sec-WebSocket-Version")) |version| {
+        if (!std.mem.eql(u8, std.mem.trim(u8, version, " \t"), "13")) return error.UnsupportedVersion;
+    }
+
+    return computeAcceptKey(std.mem.trim(u8, websocket_key, " \t"), out);
+}
+
+/// Send the 101 response that completes the opening handshake
+pub fn writeHandshakeResponse(allocator: Allocator, stream: net.Stream, accept_key: []const u8, subprotocol: ?[]const u8, extra_headers: []const [2][]const u8) !void {
     var response = std.ArrayList(u8).init(allocator);
     defer response.deinit();
 
-    try response.writer().print("HTTP/1.1 101 Switching Protocols\r\n" ++
+    const writer = response.writer();
+    try writer.print("HTTP/1.1 101 Switching Protocols\r\n" ++
         "Upgrade: websocket\r\n" ++
         "Connection: Upgrade\r\n" ++
-        "Sec-WebSocket-Accept: {s}\r\n" ++
-        "\r\n", .{accept_key});
+        "Sec-WebSocket-Accept: {s}\r\n", .{accept_key});
+
+    if (subprotocol) |protocol| {
+        try writer.print("Sec-WebSocket-Protocol: {s}\r\n", .{protocol});
+    }
+
+    for (extra_headers) |header| {
+        try writer.print("{s}: {s}\r\n", .{ header[0], header[1] });
+    }
+
+    try writer.writeAll("\r\n");
+
+    try stream.writeAll(response.items);
+}
+
+/// Perform the WebSocket handshake
+pub fn handshake(allocator: Allocator, stream: net.Stream, request_headers: std.StringHashMap([]const u8)) !Connection {
+    var accept_buf: [28]u8 = undefined;
+    const accept_key = try acceptKeyForRequest(&request_headers, &accept_buf);
 
-    _ = try stream.writeAll(response.items);
+    try writeHandshakeResponse(allocator, stream, accept_key, null, &.{});
 
     // Create and return the WebSocket connection
     return Connection.init(stream, allocator, true);
@@ -164,3 +164,133 @@ test "WebSocket handshake calculation" {
     // Verify the calculated accept key matches the expected value
     try testing.expectEqualStrings(expected_accept, accept_key);
 }
+
+test "computeAcceptKey matches the RFC 6455 example" {
+    var buf: [28]u8 = undefined;
+    const accept_key = server.computeAcceptKey("dGhlIHNhbXBsZSBub25jZQ==", &buf);
+    try testing.expectEqualStrings("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept_key);
+}
+
+test "isUpgradeRequest ignores header case and token order" {
+    var headers = std.StringHashMap([]const u8).init(testing.allocator);
+    defer headers.deinit();
+
+    try testing.expect(!server.isUpgradeRequest(&headers));
+
+    try headers.put("upgrade", "WebSocket");
+    try headers.put("connection", "keep-alive, Upgrade");
+    try headers.put("sec-websocket-key", "dGhlIHNhbXBsZSBub25jZQ==");
+    try testing.expect(server.isUpgradeRequest(&headers));
+
+    var buf: [28]u8 = undefined;
+    try testing.expectEqualStrings("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", try server.acceptKeyForRequest(&headers, &buf));
+
+    try headers.put("sec-websocket-version", "8");
+    try testing.expectError(error.UnsupportedVersion, server.acceptKeyForRequest(&headers, &buf));
+
+    try headers.put("connection", "keep-alive");
+    try testing.expect(!server.isUpgradeRequest(&headers));
+}
+
+test "closeCode reads the status code from a close payload" {
+    try testing.expectEqual(@as(u16, 1005), server.closeCode(""));
+    try testing.expectEqual(@as(u16, 1000), server.closeCode(&[_]u8{ 0x03, 0xE8 }));
+    try testing.expectEqual(@as(u16, 4001), server.closeCode(&[_]u8{ 0x0F, 0xA1, 'b', 'y', 'e' }));
+}
+
+test "Close payloads carry no code or a valid one" {
+    for ([_]u16{ 1000, 1001, 1002, 1003, 1007, 1011, 1012, 1014, 3000, 4999 }) |code| {
+        try testing.expect(server.isValidCloseCode(code));
+    }
+    for ([_]u16{ 0, 999, 1004, 1005, 1006, 1015, 1016, 1100, 2000, 2999, 5000, 65535 }) |code| {
+        try testing.expect(!server.isValidCloseCode(code));
+    }
+
+    try server.validateClosePayload("");
+    try server.validateClosePayload(&[_]u8{ 0x03, 0xE8, 'o', 'k' });
+    try testing.expectError(error.ProtocolError, server.validateClosePayload(&[_]u8{0x03}));
+    try testing.expectError(error.ProtocolError, server.validateClosePayload(&[_]u8{ 0x03, 0xEE }));
+}
+
+test "Close reasons are cut to fit on a character boundary" {
+    const short = "going away";
+    try testing.expectEqualStrings(short, server.closeReason(short));
+
+    const ascii = "x" ** 200;
+    try testing.expectEqual(@as(usize, server.max_close_reason_len), server.closeReason(ascii).len);
+
+    // A two-byte character across the limit is dropped whole
+    const straddling = "x" ** 122 ++ "\u{E9}" ++ "tail";
+    try testing.expectEqualStrings("x" ** 122, server.closeReason(straddling));
+
+    // A four-byte one ending exactly at the limit is kept
+    const ending = "x" ** 119 ++ "\u{1F600}" ++ "tail";
+    try testing.expectEqualStrings("x" ** 119 ++ "\u{1F600}", server.closeReason(ending));
+    try testing.expect(std.unicode.utf8ValidateSlice(server.closeReason("\u{E9}" ** 100)));
+}
+
+/// Resident set size from /proc, or null where it is not available
+fn residentBytes() ?usize {
+    var buf: [128]u8 = undefined;
+    const file = std.fs.openFileAbsolute("/proc/self/statm", .{}) catch return null;
+    defer file.close();
+    const len = file.readAll(&buf) catch return null;
+
+    var fields = std.mem.tokenizeScalar(u8, buf[0..len], ' ');
+    _ = fields.next();
+    const pages = std.fmt.parseInt(usize, fields.next() orelse return null, 10) catch return null;
+    return pages * std.heap.pageSize();
+}
+
+/// Open `count` server connections, deliver one message to each and let
+/// them go idle. Returns the resident bytes added per connection.
+fn idleFootprint(count: usize, pool: ?*server.buffer_pool.BufferPool) !?usize {
+    const allocator = std.heap.page_allocator;
+
+    var wire: [64]u8 = undefined;
+    var header_buf: [server.frame.max_header_size]u8 = undefined;
+    const key = [_]u8{ 9, 8, 7, 6 };
+    const header = server.frame.writeHeader(&header_buf, true, .text, "subscribed".len, key);
+    @memcpy(wire[0..header.len], header);
+    @memcpy(wire[header.len..][0.."subscribed".len], "subscribed");
+    const frame_len = header.len + "subscribed".len;
+    server.mask.applyMask(key, wire[header.len..frame_len], 0);
+
+    const before = residentBytes() orelse return null;
+
+    const connections = try allocator.alloc(server.Connection, count);
+    defer allocator.free(connections);
+
+    for (connections) |*conn| {
+        conn.* = server.Connection.init(.{ .handle = -1 }, allocator, true);
+        if (pool) |p| conn.usePool(p);
+
+        try conn.reader.feed(wire[0..frame_len]);
+        const chunk = try conn.receiveBorrowed();
+        try testing.expectEqualStrings("subscribed", chunk.data);
+
+        // What `nextFrame` does before blocking on an idle pooled connection
+        if (pool != null) conn.releaseIdleBuffers();
+    }
+
+    const after = residentBytes() orelse return null;
+    for (connections) |*conn| conn.deinit();
+
+    return (after -| before) / count;
+}
+
+test "idle connections hold no read buffer" {
+    var pool = server.buffer_pool.BufferPool.init(std.heap.page_allocator, server.frame.FrameReader.min_read_size, 16);
+    defer pool.deinit();
+
+    const pooled = try idleFootprint(100_000, &pool) orelse return error.SkipZigTest;
+    try testing.expectEqual(@as(usize, 0), pool.stats().in_use);
+
+    // Each of these keeps the buffer its message arrived in
+    const owned = try idleFootprint(10_000, null) orelse return error.SkipZigTest;
+
+    std.debug.print("\nidle WebSocket connection: {d} bytes of state, {d} bytes resident pooled, {d} bytes resident with own buffers\n", .{
+        @sizeOf(server.Connection), pooled, owned,
+    });
+    try testing.expect(pooled < owned);
+}
@@ -0,0 +1,177 @@
+const std = @import("std");
+const mask = @import("mask.zig");
+
+/// Bytes checked per step on the ASCII fast path; matches the unmask width
+const vector_len = mask.vector_len;
+const ByteVector = @Vector(vector_len, u8);
+
+/// Byte classes. Every byte value falls in exactly one, so the DFA below
+/// needs one table lookup per class instead of per byte.
+const Class = enum(u8) {
+    ascii, // 00..7F
+    cont_low, // 80..8F
+    cont_mid, // 90..9F
+    cont_high, // A0..BF
+    invalid, // C0..C1, F5..FF
+    lead2, // C2..DF
+    lead_e0, // E0
+    lead3, // E1..EC, EE..EF
+    lead_ed, // ED
+    lead_f0, // F0
+    lead4, // F1..F3
+    lead_f4, // F4
+};
+
+const class_count = @typeInfo(Class).@"enum".fields.len;
+
+/// DFA states (Unicode 15 table 3-7). The E0, ED, F0 and F4 states narrow
+/// the second byte to rule out overlong forms, surrogates and code points
+/// past U+10FFFF.
+const State = enum(u8) {
+    accept,
+    reject,
+    need1,
+    need2,
+    need3,
+    after_e0,
+    after_ed,
+    after_f0,
+    after_f4,
+};
+
+const state_count = @typeInfo(State).@"enum".fields.len;
+
+const classes: [256]Class = blk: {
+    var table: [256]Class = undefined;
+    for (&table, 0..) |*class, byte| {
+        class.* = switch (byte) {
+            0x00...0x7F => .ascii,
+            0x80...0x8F => .cont_low,
+            0x90...0x9F => .cont_mid,
+            0xA0...0xBF => .cont_high,
+            0xC2...0xDF => .lead2,
+            0xE0 => .lead_e0,
+            0xE1...0xEC, 0xEE...0xEF => .lead3,
+            0xED => .lead_ed,
+            0xF0 => .lead_f0,
+            0xF1...0xF3 => .lead4,
+            0xF4 => .lead_f4,
+            else => .invalid,
+        };
+    }
+    break :blk table;
+};
+
+/// Next state, indexed by state * class_count + class
+const transitions: [state_count * class_count]State = blk: {
+    var table = [_]State{.reject} ** (state_count * class_count);
+    for (0..state_count) |s| {
+        for (0..class_count) |c| {
+            const state: State = @enumFromInt(s);
+            const class: Class = @enumFromInt(c);
+            table[s * class_count + c] = switch (state) {
+                .accept => switch (class) {
+                    .ascii => .accept,
+                    .lead2 => .need1,
+                    .lead_e0 => .after_e0,
+                    .lead3 => .need2,
+                    .lead_ed => .after_ed,
+                    .lead_f0 => .after_f0,
+                    .lead4 => .need3,
+                    .lead_f4 => .after_f4,
+                    else => .reject,
+                },
+                .need1, .need2, .need3 => switch (class) {
+                    .cont_low, .cont_mid, .cont_high => switch (state) {
+                        .need1 => .accept,
+                        .need2 => .need1,
+                        else => .need2,
+                    },
+                    else => .reject,
+                },
+                .after_e0 => if (class == .cont_high) .need1 else .reject,
+                .after_ed => if (class == .cont_low or class == .cont_mid) .need1 else .reject,
+                .after_f0 => if (class == .cont_mid or class == .cont_high) .need2 else .reject,
+                .after_f4 => if (class == .cont_low) .need2 else .reject,
+                .reject => .reject,
+            };
+        }
+    }
+    break :blk table;
+};
+
+/// Incremental UTF-8 validator. Feed a text message in as many pieces as
+/// it arrives in; a code point may straddle two pieces.
+pub const Validator = struct {
+    state: State = .accept,
+    /// Every byte so far was ASCII, so the text can be copied into a
+    /// string object without decoding it
+    ascii: bool = true,
+
+    /// Check more bytes. Whole vectors of ASCII between code points are
+    /// skipped with one comparison; everything else goes through the DFA.
+    pub fn feed(self: *Validator, bytes: []const u8) void {
+        var i: usize = 0;
+        while (i + vector_len <= bytes.len) : (i += vector_len) {
+            const chunk: ByteVector = bytes[i..][0..vector_len].*;
+            if (self.state == .accept and @reduce(.Max, chunk) < 0x80) continue;
+
+            self.step(bytes[i..][0..vector_len]);
+            if (self.state == .reject) return;
+        }
+        self.step(bytes[i..]);
+    }
+
+    /// No invalid sequence seen so far
+    pub fn isValid(self: Validator) bool {
+        return self.state != .reject;
+    }
+
+    /// Valid and not stopped partway through a code point
+    pub fn isComplete(self: Validator) bool {
+        return self.state == .accept;
+    }
+
+    fn step(self: *Validator, bytes: []const u8) void {
+        var state = self.state;
+        var seen: u8 = 0;
+        for (bytes) |byte| {
+            state = transitions[@as(usize, @intFromEnum(state)) * class_count + @intFromEnum(classes[byte])];
+            seen |= byte;
+        }
+        self.state = state;
+        if (seen >= 0x80) self.ascii = false;
+    }
+};
+
+/// Check a complete text
+pub fn validate(bytes: []const u8) bool {
+    var validator = Validator{};
+    validator.feed(bytes);
+    return validator.isComplete();
+}
+
+/// Unmask `data` in place (see `mask.applyMask`) and feed the result to
+/// `validator` in the same pass, so each vector is checked while it is
+/// still in registers instead of walking the payload twice.
+pub fn unmaskAndValidate(mask_key: [4]u8, data: []u8, offset: usize, validator: *Validator) void {
+    const rotated = mask.rotateMask(mask_key, offset);
+
+    var i: usize = 0;
+    if (data.len >= vector_len) {
+        const pattern: ByteVector = std.simd.repeat(vector_len, @as(@Vector(4, u8), rotated));
+
+        while (i + vector_len <= data.len) : (i += vector_len) {
+            const chunk = @as(ByteVector, data[i..][0..vector_len].*) ^ pattern;
+            data[i..][0..vector_len].* = chunk;
+
+            if (validator.state == .accept and @reduce(.Max, chunk) < 0x80) continue;
+            if (validator.state != .reject) validator.step(data[i..][0..vector_len]);
+        }
+    }
+
+    // `i` is a multiple of 4 here, so the rotated mask still lines up
+    const tail = data[i..];
+    for (tail, 0..) |*byte, j| byte.* ^= rotated[j % 4];
+    validator.step(tail);
+}
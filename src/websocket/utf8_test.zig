@@ -0,0 +1,101 @@
+const std = @import("std");
+const testing = std.testing;
+const utf8 = @import("utf8.zig");
+const mask = @import("mask.zig");
+
+test "validate accepts well-formed text" {
+    try testing.expect(utf8.validate(""));
+    try testing.expect(utf8.validate("plain ascii"));
+    try testing.expect(utf8.validate("κόσμε"));
+    try testing.expect(utf8.validate("\u{7FF}\u{800}\u{FFFF}\u{10000}\u{10FFFF}"));
+    try testing.expect(utf8.validate("ascii long enough to fill several vectors, then é at the end"));
+}
+
+test "validate rejects ill-formed text" {
+    const cases = [_][]const u8{
+        "\x80", // stray continuation
+        "\xC0\xAF", // overlong '/'
+        "\xE0\x9F\xBF", // overlong
+        "\xED\xA0\x80", // surrogate U+D800
+        "\xF4\x90\x80\x80", // past U+10FFFF
+        "\xF5\x80\x80\x80",
+        "\xFF",
+        "\xCE\xBA\xE1", // truncated
+        "a\xC3(",
+    };
+    for (cases) |case| try testing.expect(!utf8.validate(case));
+}
+
+test "a code point may straddle pieces" {
+    const text = "ascii, then \u{1F600} and more ascii after it";
+    for (0..text.len + 1) |split| {
+        var validator = utf8.Validator{};
+        validator.feed(text[0..split]);
+        try testing.expect(validator.isValid());
+        validator.feed(text[split..]);
+        try testing.expect(validator.isComplete());
+    }
+}
+
+test "validator reports whether the text was all ASCII" {
+    const cases = [_]struct { text: []const u8, ascii: bool }{
+        .{ .text = "", .ascii = true },
+        .{ .text = "plain ascii long enough to take the vector path more than once", .ascii = true },
+        .{ .text = "plain ascii long enough to take the vector path, then é", .ascii = false },
+        .{ .text = "κόσμε", .ascii = false },
+    };
+    for (cases) |case| {
+        var validator = utf8.Validator{};
+        validator.feed(case.text);
+        try testing.expectEqual(case.ascii, validator.ascii);
+
+        var copy: [128]u8 = undefined;
+        const key = [_]u8{ 0xA5, 0x5A, 0x0F, 0xF0 };
+        const masked = copy[0..case.text.len];
+        @memcpy(masked, case.text);
+        mask.applyMask(key, masked, 0);
+
+        var fused = utf8.Validator{};
+        utf8.unmaskAndValidate(key, masked, 0, &fused);
+        try testing.expectEqual(case.ascii, fused.ascii);
+    }
+}
+
+test "validate agrees with std.unicode on random input" {
+    var prng = std.Random.DefaultPrng.init(0xC0FFEE);
+    const random = prng.random();
+
+    // Mostly ASCII with lead and continuation bytes mixed in, so both the
+    // fast path and the DFA are exercised
+    const alphabet = "abc \x7F\x80\x8F\x90\xA0\xBF\xC2\xDF\xE0\xED\xEF\xF0\xF4\xF5";
+    var buf: [96]u8 = undefined;
+    for (0..20_000) |_| {
+        const len = random.uintLessThan(usize, buf.len);
+        for (buf[0..len]) |*byte| {
+            byte.* = if (random.boolean()) 'x' else alphabet[random.uintLessThan(usize, alphabet.len)];
+        }
+        try testing.expectEqual(std.unicode.utf8ValidateSlice(buf[0..len]), utf8.validate(buf[0..len]));
+    }
+}
+
+test "unmaskAndValidate matches unmask then validate" {
+    const key = [_]u8{ 0x12, 0x34, 0x56, 0x78 };
+    const texts = [_][]const u8{
+        "short",
+        "a longer message that spans more than one vector of bytes, with ünïcödé in the middle of it",
+        "bad \xED\xA0\x80 surrogate in a message long enough to reach the vector loop",
+    };
+
+    for (texts) |text| {
+        for (0..4) |offset| {
+            const masked = try testing.allocator.dupe(u8, text);
+            defer testing.allocator.free(masked);
+            mask.applyMask(key, masked, offset);
+
+            var validator = utf8.Validator{};
+            utf8.unmaskAndValidate(key, masked, offset, &validator);
+            try testing.expectEqualStrings(text, masked);
+            try testing.expectEqual(utf8.validate(text), validator.isComplete());
+        }
+    }
+}